@@ -0,0 +1,11 @@
+CONFIG -= app_bundle
+QT += network
+
+CONFIG += debug
+
+TARGET = psimedia-bench
+
+include(../psimedia/psimedia.pri)
+INCLUDEPATH += ../psimedia
+
+SOURCES += main.cpp
@@ -0,0 +1,385 @@
+/*
+ * Copyright (C) 2008-2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+// psimedia-bench: non-interactive loopback latency benchmark.
+//
+// drives two RtpSessions in-process: everything the producer's rtp
+//   channels emit is written straight into the receiver's channels, with
+//   no sockets in between.  arrival is then observed at the edges an
+//   application can see: repaints of the output video widget and the
+//   audio output intensity signal.  after the run, p50/p95/p99 of the
+//   packet-to-playout estimates are printed along with packet counts,
+//   bitrates and process cpu time, so releases can be gated on pipeline
+//   latency regressions.
+//
+// usage: psimedia-bench [seconds] [file.ogg]
+//   with no file argument, the default capture devices are used.
+
+#include <stdio.h>
+#include <time.h>
+#include <QApplication>
+#include <QTimer>
+#include <QTime>
+#include <QStringList>
+#include <QDir>
+#include <QLibrary>
+#include "psimedia.h"
+
+#define DEFAULT_RUN_SECONDS 10
+
+// collects millisecond samples and reports percentiles
+class LatencyStats
+{
+public:
+	QString name;
+	QList<int> samples;
+
+	LatencyStats(const QString &_name) :
+		name(_name)
+	{
+	}
+
+	void add(int ms)
+	{
+		samples += ms;
+	}
+
+	int percentile(int pct) const
+	{
+		if(samples.isEmpty())
+			return -1;
+
+		QList<int> sorted = samples;
+		qSort(sorted);
+		int at = (sorted.count() - 1) * pct / 100;
+		return sorted[at];
+	}
+
+	void print() const
+	{
+		if(samples.isEmpty())
+		{
+			printf("%-24s (no samples)\n", qPrintable(name));
+			return;
+		}
+
+		printf("%-24s n=%-6d p50=%dms p95=%dms p99=%dms\n",
+			qPrintable(name),
+			samples.count(),
+			percentile(50),
+			percentile(95),
+			percentile(99));
+	}
+};
+
+// the only frame delivery an application sees is a widget repaint, so
+//   timestamp those to estimate packet-to-display latency
+class BenchVideoWidget : public PsiMedia::VideoWidget
+{
+	Q_OBJECT
+
+public:
+	QTime *clock;
+	int lastPacketTime; // -1 if no video packet written yet
+	LatencyStats *stats;
+
+	BenchVideoWidget(QWidget *parent = 0) :
+		PsiMedia::VideoWidget(parent),
+		clock(0),
+		lastPacketTime(-1),
+		stats(0)
+	{
+	}
+
+protected:
+	virtual void paintEvent(QPaintEvent *event)
+	{
+		PsiMedia::VideoWidget::paintEvent(event);
+
+		if(stats && lastPacketTime != -1)
+		{
+			stats->add(clock->elapsed() - lastPacketTime);
+			lastPacketTime = -1;
+		}
+	}
+};
+
+class BenchApp : public QObject
+{
+	Q_OBJECT
+
+public:
+	PsiMedia::RtpSession producer;
+	PsiMedia::RtpSession receiver;
+	QString file;
+	int seconds;
+	bool failed;
+
+	BenchVideoWidget *outputWidget;
+	PsiMedia::VideoWidget *previewWidget;
+
+	QTime clock;
+	LatencyStats videoLatency;
+	LatencyStats audioLatency;
+	int audioPackets, videoPackets;
+	qint64 audioBytes, videoBytes;
+	int lastAudioPacketTime;
+	clock_t cpuStart;
+	int runStartTime;
+
+	BenchApp() :
+		producer(this),
+		receiver(this),
+		seconds(DEFAULT_RUN_SECONDS),
+		failed(false),
+		videoLatency("video packet-to-paint"),
+		audioLatency("audio packet-to-level"),
+		audioPackets(0),
+		videoPackets(0),
+		audioBytes(0),
+		videoBytes(0),
+		lastAudioPacketTime(-1),
+		runStartTime(0)
+	{
+		connect(&producer, SIGNAL(started()), SLOT(producer_started()));
+		connect(&producer, SIGNAL(error()), SLOT(session_error()));
+		connect(&receiver, SIGNAL(started()), SLOT(receiver_started()));
+		connect(&receiver, SIGNAL(error()), SLOT(session_error()));
+		connect(&receiver, SIGNAL(audioOutputIntensityChanged(int)), SLOT(receiver_audioIntensity(int)));
+
+		// widgets must exist (and the output one must paint) for
+		//   frames to be observable at the application edge
+		previewWidget = new PsiMedia::VideoWidget;
+		outputWidget = new BenchVideoWidget;
+		outputWidget->clock = &clock;
+		outputWidget->stats = &videoLatency;
+		producer.setVideoPreviewWidget(previewWidget);
+		receiver.setVideoOutputWidget(outputWidget);
+	}
+
+	~BenchApp()
+	{
+		producer.reset();
+		receiver.reset();
+
+		delete previewWidget;
+		delete outputWidget;
+	}
+
+signals:
+	void quit();
+
+public slots:
+	void start()
+	{
+		clock.start();
+
+		PsiMedia::Features f;
+		f.lookup();
+		f.waitForFinished();
+
+		if(!file.isEmpty())
+		{
+			producer.setFileInput(file);
+			producer.setFileLoopEnabled(true);
+		}
+		else
+		{
+			if(f.audioInputDevices().isEmpty() && f.videoInputDevices().isEmpty())
+			{
+				fprintf(stderr, "no capture devices and no input file given\n");
+				failed = true;
+				emit quit();
+				return;
+			}
+
+			if(!f.audioInputDevices().isEmpty())
+				producer.setAudioInputDevice(f.audioInputDevices().first().id());
+			if(!f.videoInputDevices().isEmpty())
+				producer.setVideoInputDevice(f.videoInputDevices().first().id());
+		}
+
+		if(!f.audioOutputDevices().isEmpty())
+			receiver.setAudioOutputDevice(f.audioOutputDevices().first().id());
+
+		producer.setLocalAudioPreferences(QList<PsiMedia::AudioParams>() << f.supportedAudioModes().first());
+		producer.setLocalVideoPreferences(QList<PsiMedia::VideoParams>() << f.supportedVideoModes().first());
+		receiver.setLocalAudioPreferences(QList<PsiMedia::AudioParams>() << f.supportedAudioModes().first());
+		receiver.setLocalVideoPreferences(QList<PsiMedia::VideoParams>() << f.supportedVideoModes().first());
+
+		outputWidget->show();
+
+		printf("starting producer...\n");
+		producer.start();
+	}
+
+private slots:
+	void producer_started()
+	{
+		if(producer.canTransmitAudio())
+			receiver.setRemoteAudioPreferences(producer.localAudioPayloadInfo());
+		if(producer.canTransmitVideo())
+			receiver.setRemoteVideoPreferences(producer.localVideoPayloadInfo());
+
+		connect(producer.audioRtpChannel(), SIGNAL(readyRead()), SLOT(audio_ready()));
+		connect(producer.videoRtpChannel(), SIGNAL(readyRead()), SLOT(video_ready()));
+
+		printf("starting receiver...\n");
+		receiver.start();
+	}
+
+	void receiver_started()
+	{
+		printf("transmitting for %d seconds...\n", seconds);
+		cpuStart = ::clock();
+		runStartTime = clock.elapsed();
+
+		if(producer.canTransmitAudio())
+			producer.transmitAudio();
+		if(producer.canTransmitVideo())
+			producer.transmitVideo();
+
+		QTimer::singleShot(seconds * 1000, this, SLOT(finish()));
+	}
+
+	void audio_ready()
+	{
+		// loop the producer's packets straight into the receiver
+		while(producer.audioRtpChannel()->packetsAvailable() > 0)
+		{
+			PsiMedia::RtpPacket packet = producer.audioRtpChannel()->read();
+			++audioPackets;
+			audioBytes += packet.rawValue().size();
+			lastAudioPacketTime = clock.elapsed();
+			receiver.audioRtpChannel()->write(packet);
+		}
+	}
+
+	void video_ready()
+	{
+		while(producer.videoRtpChannel()->packetsAvailable() > 0)
+		{
+			PsiMedia::RtpPacket packet = producer.videoRtpChannel()->read();
+			++videoPackets;
+			videoBytes += packet.rawValue().size();
+			if(outputWidget->lastPacketTime == -1)
+				outputWidget->lastPacketTime = clock.elapsed();
+			receiver.videoRtpChannel()->write(packet);
+		}
+	}
+
+	void receiver_audioIntensity(int intensity)
+	{
+		Q_UNUSED(intensity);
+
+		// audio playout isn't directly observable, so use the level
+		//   meter signal as the closest application-visible proxy
+		if(lastAudioPacketTime != -1)
+		{
+			audioLatency.add(clock.elapsed() - lastAudioPacketTime);
+			lastAudioPacketTime = -1;
+		}
+	}
+
+	void session_error()
+	{
+		fprintf(stderr, "session error, aborting\n");
+		failed = true;
+		emit quit();
+	}
+
+	void finish()
+	{
+		int elapsed = clock.elapsed() - runStartTime;
+		clock_t cpuEnd = ::clock();
+
+		producer.stop();
+		receiver.stop();
+
+		printf("\n");
+		audioLatency.print();
+		videoLatency.print();
+		printf("audio: %d packets, %dkbps\n", audioPackets,
+			(int)(audioBytes * 8 / qMax(elapsed, 1)));
+		printf("video: %d packets, %dkbps\n", videoPackets,
+			(int)(videoBytes * 8 / qMax(elapsed, 1)));
+		printf("cpu: %dms over %dms wall (%d%%)\n",
+			(int)((cpuEnd - cpuStart) * 1000 / CLOCKS_PER_SEC),
+			elapsed,
+			(int)((cpuEnd - cpuStart) * 100000 / CLOCKS_PER_SEC / qMax(elapsed, 1)));
+
+		emit quit();
+	}
+};
+
+static QString findPlugin(const QString &relpath, const QString &basename)
+{
+	QDir dir(QCoreApplication::applicationDirPath());
+	if(!dir.cd(relpath))
+		return QString();
+	foreach(const QString &fileName, dir.entryList())
+	{
+		if(fileName.contains(basename))
+		{
+			QString filePath = dir.filePath(fileName);
+			if(QLibrary::isLibrary(filePath))
+				return filePath;
+		}
+	}
+	return QString();
+}
+
+int main(int argc, char **argv)
+{
+	QApplication qapp(argc, argv);
+
+	QString pluginFile = qgetenv("PSI_MEDIA_PLUGIN");
+	if(pluginFile.isEmpty())
+		pluginFile = findPlugin("../gstprovider", "gstprovider");
+
+	PsiMedia::loadPlugin(pluginFile, QString());
+
+	if(!PsiMedia::isSupported())
+	{
+		fprintf(stderr, "error: could not load PsiMedia subsystem\n");
+		return 1;
+	}
+
+	BenchApp bench;
+
+	QStringList args = qapp.arguments();
+	for(int n = 1; n < args.count(); ++n)
+	{
+		bool ok;
+		int x = args[n].toInt(&ok);
+		if(ok)
+			bench.seconds = x;
+		else
+			bench.file = args[n];
+	}
+
+	QObject::connect(&bench, SIGNAL(quit()), &qapp, SLOT(quit()), Qt::QueuedConnection);
+	QTimer::singleShot(0, &bench, SLOT(start()));
+
+	qapp.exec();
+	return bench.failed ? 1 : 0;
+}
+
+#include "main.moc"
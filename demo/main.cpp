@@ -18,11 +18,15 @@
  *
  */
 
+#include <stdio.h>
 #include <QApplication>
 #include <QMainWindow>
 #include <QMessageBox>
 #include <QTimer>
+#include <QTime>
+#include <QLabel>
 #include <QVariant>
+#include <QFile>
 #include <QFileDialog>
 #include <QDir>
 #include <QHostAddress>
@@ -685,6 +689,398 @@ private slots:
 	}
 };
 
+//----------------------------------------------------------------------------
+// load test mode
+//----------------------------------------------------------------------------
+// --loadtest N [seconds]: headless capacity probe.  N session pairs are
+//   created in-process, with the sender's rtp wired straight into the
+//   receiver (and the receiver's rtcp looped back), and synthetic test
+//   devices standing in for real capture/playback hardware.  at the end
+//   of the run, per-session counters and resource usage go to stdout.
+
+// current process resident set size in kilobytes, or -1 if unknown
+static int processRssKb()
+{
+#if defined(Q_OS_LINUX)
+	QFile f("/proc/self/status");
+	if(f.open(QIODevice::ReadOnly))
+	{
+		foreach(const QByteArray &line, f.readAll().split('\n'))
+		{
+			if(line.startsWith("VmRSS:"))
+				return line.mid(6).trimmed().split(' ').first().toInt();
+		}
+	}
+#endif
+	return -1;
+}
+
+class LoadTestPair : public QObject
+{
+	Q_OBJECT
+
+public:
+	PsiMedia::RtpSession sender;
+	PsiMedia::RtpSession receiver;
+
+	LoadTestPair(const PsiMedia::AudioParams &_audioParams, const PsiMedia::VideoParams &_videoParams, bool _useVideo, QObject *parent = 0) :
+		QObject(parent),
+		audioParams(_audioParams),
+		videoParams(_videoParams),
+		useVideo(_useVideo)
+	{
+		connect(&sender, SIGNAL(started()), SLOT(sender_started()));
+		connect(&sender, SIGNAL(error()), SLOT(session_error()));
+		connect(&receiver, SIGNAL(started()), SLOT(receiver_started()));
+		connect(&receiver, SIGNAL(error()), SLOT(session_error()));
+
+		connect(sender.audioRtpChannel(), SIGNAL(readyRead()), SLOT(senderAudio_ready()));
+		connect(sender.videoRtpChannel(), SIGNAL(readyRead()), SLOT(senderVideo_ready()));
+		connect(receiver.audioRtpChannel(), SIGNAL(readyRead()), SLOT(receiverAudio_ready()));
+		connect(receiver.videoRtpChannel(), SIGNAL(readyRead()), SLOT(receiverVideo_ready()));
+	}
+
+	void start()
+	{
+		sender.setAudioInputDevice("test,");
+
+		QList<PsiMedia::AudioParams> audioParamsList;
+		audioParamsList += audioParams;
+		sender.setLocalAudioPreferences(audioParamsList);
+
+		if(useVideo)
+		{
+			sender.setVideoInputDevice("test,");
+
+			QList<PsiMedia::VideoParams> videoParamsList;
+			videoParamsList += videoParams;
+			sender.setLocalVideoPreferences(videoParamsList);
+		}
+
+		sender.start();
+	}
+
+signals:
+	void started();
+	void failed();
+
+private slots:
+	void sender_started()
+	{
+		// local loop: hand the sender's offer straight to the receiver
+		receiver.setAudioOutputDevice("test,");
+
+		QList<PsiMedia::AudioParams> audioParamsList;
+		audioParamsList += audioParams;
+		receiver.setLocalAudioPreferences(audioParamsList);
+		receiver.setRemoteAudioPreferences(sender.localAudioPayloadInfo());
+
+		if(useVideo && sender.canTransmitVideo())
+		{
+			QList<PsiMedia::VideoParams> videoParamsList;
+			videoParamsList += videoParams;
+			receiver.setLocalVideoPreferences(videoParamsList);
+			receiver.setRemoteVideoPreferences(sender.localVideoPayloadInfo());
+		}
+
+		receiver.start();
+	}
+
+	void receiver_started()
+	{
+		sender.transmitAudio();
+		if(useVideo && sender.canTransmitVideo())
+			sender.transmitVideo();
+
+		emit started();
+	}
+
+	void session_error()
+	{
+		emit failed();
+	}
+
+	void senderAudio_ready()
+	{
+		pump(sender.audioRtpChannel(), receiver.audioRtpChannel());
+	}
+
+	void senderVideo_ready()
+	{
+		pump(sender.videoRtpChannel(), receiver.videoRtpChannel());
+	}
+
+	void receiverAudio_ready()
+	{
+		pump(receiver.audioRtpChannel(), sender.audioRtpChannel());
+	}
+
+	void receiverVideo_ready()
+	{
+		pump(receiver.videoRtpChannel(), sender.videoRtpChannel());
+	}
+
+private:
+	PsiMedia::AudioParams audioParams;
+	PsiMedia::VideoParams videoParams;
+	bool useVideo;
+
+	static void pump(PsiMedia::RtpChannel *from, PsiMedia::RtpChannel *to)
+	{
+		while(from->packetsAvailable() > 0)
+			to->write(from->read());
+	}
+};
+
+class LoadTestRunner : public QObject
+{
+	Q_OBJECT
+
+public:
+	LoadTestRunner(int _count, int _seconds, QObject *parent = 0) :
+		QObject(parent),
+		count(_count),
+		seconds(_seconds),
+		useVideo(true)
+	{
+	}
+
+public slots:
+	void run()
+	{
+		// modes come from the provider, same as the gui would use
+		PsiMediaFeaturesSnapshot snap(PsiMediaFeaturesSnapshot::All);
+		PsiMedia::AudioParams audioParams;
+		PsiMedia::VideoParams videoParams;
+		if(!snap.supportedAudioModes.isEmpty())
+			audioParams = snap.supportedAudioModes.first();
+		if(!snap.supportedVideoModes.isEmpty())
+			videoParams = snap.supportedVideoModes.first();
+		else
+			useVideo = false;
+
+		printf("loadtest: %d session pair(s) for %d second(s), %s\n",
+			count, seconds, useVideo ? "audio+video" : "audio only");
+
+		for(int n = 0; n < count; ++n)
+		{
+			LoadTestPair *pair = new LoadTestPair(audioParams, videoParams, useVideo, this);
+			connect(pair, SIGNAL(failed()), SLOT(pair_failed()));
+			pairs += pair;
+			pair->start();
+		}
+
+		QTimer::singleShot(seconds * 1000, this, SLOT(report()));
+	}
+
+private slots:
+	void pair_failed()
+	{
+		printf("loadtest: pair %d failed\n", pairs.indexOf((LoadTestPair *)QObject::sender()));
+	}
+
+	void report()
+	{
+		qint64 totalCpuMs = 0;
+
+		printf("\n%4s %8s %8s %6s %6s %8s %8s %6s %6s %8s %7s\n",
+			"pair", "a-sent", "a-recv", "a-lost", "a-drop",
+			"v-sent", "v-recv", "v-lost", "v-drop", "cpu-ms", "thread");
+
+		for(int n = 0; n < pairs.count(); ++n)
+		{
+			LoadTestPair *pair = pairs[n];
+			PsiMedia::RtpSessionStats ss = pair->sender.statistics();
+			PsiMedia::RtpSessionStats rs = pair->receiver.statistics();
+			PsiMedia::ResourceUsage su = pair->sender.resourceUsage();
+			PsiMedia::ResourceUsage ru = pair->receiver.resourceUsage();
+
+			qint64 cpuMs = (su.cpuNsecs() + ru.cpuNsecs()) / 1000000;
+			totalCpuMs += cpuMs;
+
+			printf("%4d %8d %8d %6d %6d %8d %8d %6d %6d %8d %7d\n",
+				n,
+				ss.audioPacketsSent(),
+				rs.audioPacketsReceived(),
+				rs.audioPacketsLost(),
+				rs.audioPacketsDropped(),
+				ss.videoPacketsSent(),
+				rs.videoPacketsReceived(),
+				rs.videoPacketsLost(),
+				rs.videoPacketsDropped(),
+				(int)cpuMs,
+				su.streamingThreads() + ru.streamingThreads());
+		}
+
+		// the packet pool is process-wide, so report it once
+		if(!pairs.isEmpty())
+		{
+			PsiMedia::ResourceUsage u = pairs.first()->sender.resourceUsage();
+			printf("\npacket pool: %d served, %d missed\n",
+				u.poolPacketsServed(), u.poolPacketsMissed());
+		}
+
+		int rss = processRssKb();
+		if(rss != -1)
+			printf("total pipeline cpu: %d ms, rss: %d kB\n", (int)totalCpuMs, rss);
+		else
+			printf("total pipeline cpu: %d ms\n", (int)totalCpuMs);
+
+		QCoreApplication::exit(0);
+	}
+
+private:
+	int count;
+	int seconds;
+	bool useVideo;
+	QList<LoadTestPair*> pairs;
+};
+
+// toggleable performance hud: a translucent panel over the remote video
+//   widget, refreshed once a second from the public stats surface.  the
+//   point is screen-share diagnosability: a support session can read
+//   packet rates, loss, drops, jitter and cpu off the screen instead of
+//   requesting log captures.  (per-stage latency histograms are a log
+//   facility: run with PSI_TRACE_LATENCY=1 and check stdout.)
+class PerformanceHud : public QLabel
+{
+	Q_OBJECT
+
+public:
+	PerformanceHud(PsiMedia::RtpSession *_producer, PsiMedia::RtpSession *_receiver, QWidget *parent) :
+		QLabel(parent),
+		producer(_producer),
+		receiver(_receiver),
+		havePrev(false),
+		prevSendCpu(0),
+		prevRecvCpu(0)
+	{
+		QFont f = font();
+		f.setStyleHint(QFont::TypeWriter);
+		f.setFamily("Monospace");
+		f.setPointSize(8);
+		setFont(f);
+		setTextFormat(Qt::PlainText);
+		setStyleSheet("background-color: rgba(0, 0, 0, 160); color: white;");
+		setMargin(6);
+		hide();
+
+		timer = new QTimer(this);
+		connect(timer, SIGNAL(timeout()), SLOT(refresh()));
+		timer->setInterval(1000);
+	}
+
+	void setActive(bool on)
+	{
+		if(on)
+		{
+			// rates need two snapshots, so the first refresh only
+			//   primes the baseline
+			havePrev = false;
+			refresh();
+			timer->start();
+			show();
+			raise();
+		}
+		else
+		{
+			timer->stop();
+			hide();
+		}
+	}
+
+private slots:
+	void refresh()
+	{
+		PsiMedia::RtpSessionStats ss = producer->statistics();
+		PsiMedia::RtpSessionStats rs = receiver->statistics();
+		qint64 sendCpu = producer->resourceUsage().cpuNsecs();
+		qint64 recvCpu = receiver->resourceUsage().cpuNsecs();
+
+		if(!havePrev)
+		{
+			havePrev = true;
+			prevSend = ss;
+			prevRecv = rs;
+			prevSendCpu = sendCpu;
+			prevRecvCpu = recvCpu;
+			elapsed.start();
+			setText(tr("gathering..."));
+			adjustSize();
+			move(8, 8);
+			return;
+		}
+
+		int ms = elapsed.restart();
+		if(ms < 1)
+			ms = 1;
+
+		QString str;
+		str += tr("send:  a %1 pkt/s  v %2 pkt/s  drop %3/%4\n")
+			.arg(rate(ss.audioPacketsSent(), prevSend.audioPacketsSent(), ms))
+			.arg(rate(ss.videoPacketsSent(), prevSend.videoPacketsSent(), ms))
+			.arg(ss.audioPacketsDropped())
+			.arg(ss.videoPacketsDropped());
+		str += tr("recv:  a %1 pkt/s  v %2 pkt/s  lost %3/%4\n")
+			.arg(rate(rs.audioPacketsReceived(), prevRecv.audioPacketsReceived(), ms))
+			.arg(rate(rs.videoPacketsReceived(), prevRecv.videoPacketsReceived(), ms))
+			.arg(rs.audioPacketsLost())
+			.arg(rs.videoPacketsLost());
+		str += tr("video: capture %1 fps  display %2 fps\n")
+			.arg(rate(ss.previewFrames(), prevSend.previewFrames(), ms))
+			.arg(rate(rs.outputFrames(), prevRecv.outputFrames(), ms));
+		str += tr("audio: jitter %1 ms  jbuf %2 ms  rtt %3 ms\n")
+			.arg(rs.audioJitterMs())
+			.arg(rs.audioJitterBufferMs())
+			.arg(ss.audioRttMs());
+		str += tr("peer loss: a %1  v %2\n")
+			.arg(ss.audioPacketsLostRemote())
+			.arg(ss.videoPacketsLostRemote());
+		str += tr("cpu:   send %1%  recv %2% (pipeline threads)")
+			.arg(cpuPercent(sendCpu, prevSendCpu, ms))
+			.arg(cpuPercent(recvCpu, prevRecvCpu, ms));
+
+		prevSend = ss;
+		prevRecv = rs;
+		prevSendCpu = sendCpu;
+		prevRecvCpu = recvCpu;
+
+		setText(str);
+		adjustSize();
+		move(8, 8);
+		raise();
+	}
+
+private:
+	PsiMedia::RtpSession *producer;
+	PsiMedia::RtpSession *receiver;
+	QTimer *timer;
+	QTime elapsed;
+	bool havePrev;
+	PsiMedia::RtpSessionStats prevSend;
+	PsiMedia::RtpSessionStats prevRecv;
+	qint64 prevSendCpu;
+	qint64 prevRecvCpu;
+
+	static QString rate(int cur, int prev, int ms)
+	{
+		// counters can reset when a session restarts; show 0 rather
+		//   than a huge negative rate
+		int delta = cur - prev;
+		if(delta < 0)
+			delta = 0;
+		return QString::number((double)delta * 1000.0 / (double)ms, 'f', 1);
+	}
+
+	static QString cpuPercent(qint64 cur, qint64 prev, int ms)
+	{
+		qint64 delta = cur - prev;
+		if(delta < 0)
+			delta = 0;
+		return QString::number((double)delta / 10000.0 / (double)ms, 'f', 1);
+	}
+};
+
 class MainWin : public QMainWindow
 {
 	Q_OBJECT
@@ -692,6 +1088,8 @@ class MainWin : public QMainWindow
 public:
 	Ui::MainWin ui;
 	QAction *action_AboutProvider;
+	QAction *action_Hud;
+	PerformanceHud *hud;
 	QString creditName;
 	PsiMedia::RtpSession producer;
 	PsiMedia::RtpSession receiver;
@@ -705,6 +1103,8 @@ public:
 
 	MainWin() :
 		action_AboutProvider(0),
+		action_Hud(0),
+		hud(0),
 		producer(this),
 		receiver(this),
 		sendAudioRtp(0),
@@ -726,6 +1126,15 @@ public:
 			connect(action_AboutProvider, SIGNAL(triggered()), SLOT(doAboutProvider()));
 		}
 
+		// hud overlays the remote video widget, where the action is
+		hud = new PerformanceHud(&producer, &receiver, ui.vw_remote);
+		action_Hud = new QAction(this);
+		action_Hud->setText(tr("Performance &HUD"));
+		action_Hud->setCheckable(true);
+		action_Hud->setShortcut(QKeySequence(tr("Ctrl+H")));
+		ui.menu_File->insertAction(ui.action_Quit, action_Hud);
+		connect(action_Hud, SIGNAL(toggled(bool)), SLOT(hud_toggled(bool)));
+
 		config = getDefaultConfiguration();
 
 		ui.pb_transmit->setEnabled(false);
@@ -1160,6 +1569,11 @@ private slots:
 		receiver.stop();
 	}
 
+	void hud_toggled(bool on)
+	{
+		hud->setActive(on);
+	}
+
 	void change_volume_mic(int value)
 	{
 		producer.setInputVolume(value);
@@ -1369,6 +1783,28 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	// headless load test mode: --loadtest N [seconds]
+	QStringList args = qapp.arguments();
+	int at = args.indexOf("--loadtest");
+	if(at != -1)
+	{
+		int count = 1;
+		int seconds = 60;
+		if(at + 1 < args.count())
+			count = args[at + 1].toInt();
+		if(at + 2 < args.count())
+			seconds = args[at + 2].toInt();
+		if(count < 1 || seconds < 1)
+		{
+			fprintf(stderr, "usage: --loadtest N [seconds]\n");
+			return 1;
+		}
+
+		LoadTestRunner runner(count, seconds);
+		QTimer::singleShot(0, &runner, SLOT(run()));
+		return qapp.exec();
+	}
+
 	MainWin mainWin;
 
 	// give mainWin a chance to fix its layout before showing
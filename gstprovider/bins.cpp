@@ -24,6 +24,8 @@
 #include <QString>
 #include <QSize>
 #include <gst/gst.h>
+#include "codecs.h"
+#include "elementcache.h"
 
 // default latency is 200ms
 #define DEFAULT_RTP_LATENCY 200
@@ -39,116 +41,131 @@ static int get_rtp_latency()
 		return DEFAULT_RTP_LATENCY;
 }
 
-static GstElement *audio_codec_to_enc_element(const QString &name)
+// resampler quality (0-10), -1 = element default.  note that the
+//   resampler itself is passthrough whenever in/out rates already
+//   match, so the cheapest configuration is avoiding the conversion
+//   entirely: a device capturing natively at the codec rate (e.g.
+//   PSI_FIXED_RATE=16000 with 16kHz headsets and speex) pays nothing
+//   here regardless of this setting
+static int get_resample_quality()
 {
-	QString ename;
-	if(name == "speex")
-		ename = "speexenc";
-	else if(name == "vorbis")
-		ename = "vorbisenc";
-	else if(name == "pcmu")
-		ename = "mulawenc";
-	else
-		return 0;
+	QString val = QString::fromLatin1(qgetenv("PSI_RESAMPLE_QUALITY"));
+	if(!val.isEmpty())
+	{
+		int x = val.toInt();
+		if(x >= 0 && x <= 10)
+			return x;
+	}
+	return -1;
+}
+
+void bins_audioresample_configure(GstElement *audioresample)
+{
+	int quality = get_resample_quality();
+	if(quality == -1)
+		return;
+
+	// probe for the property: the speex-based resampler has it, the
+	//   old legacy one doesn't
+	if(g_object_class_find_property(G_OBJECT_GET_CLASS(audioresample), "quality"))
+		g_object_set(G_OBJECT(audioresample), "quality", quality, NULL);
+}
 
-	return gst_element_factory_make(ename.toLatin1().data(), NULL);
+// element selection comes from the codec descriptor table (codecs.h),
+//   so these are just lookups: no string building or allocation per
+//   call, and new codecs need only a table row
+static GstElement *audio_codec_to_enc_element(const QString &name)
+{
+	const CodecDescriptor *c = codec_lookup(name, false);
+	return c ? gst_element_factory_make(c->enc, NULL) : 0;
 }
 
 static GstElement *audio_codec_to_dec_element(const QString &name)
 {
-	QString ename;
-	if(name == "speex")
-		ename = "speexdec";
-	else if(name == "vorbis")
-		ename = "vorbisdec";
-	else if(name == "pcmu")
-		ename = "mulawdec";
-	else
-		return 0;
-
-	return gst_element_factory_make(ename.toLatin1().data(), NULL);
+	const CodecDescriptor *c = codec_lookup(name, false);
+	return c ? gst_element_factory_make(c->dec, NULL) : 0;
 }
 
 static GstElement *audio_codec_to_rtppay_element(const QString &name)
 {
-	QString ename;
-	if(name == "speex")
-		ename = "rtpspeexpay";
-	else if(name == "vorbis")
-		ename = "rtpvorbispay";
-	else if(name == "pcmu")
-		ename = "rtppcmupay";
-	else
-		return 0;
-
-	return gst_element_factory_make(ename.toLatin1().data(), NULL);
+	const CodecDescriptor *c = codec_lookup(name, false);
+	return c ? gst_element_factory_make(c->pay, NULL) : 0;
 }
 
 static GstElement *audio_codec_to_rtpdepay_element(const QString &name)
 {
-	QString ename;
-	if(name == "speex")
-		ename = "rtpspeexdepay";
-	else if(name == "vorbis")
-		ename = "rtpvorbisdepay";
-	else if(name == "pcmu")
-		ename = "rtppcmudepay";
-	else
-		return 0;
+	const CodecDescriptor *c = codec_lookup(name, false);
+	return c ? gst_element_factory_make(c->depay, NULL) : 0;
+}
 
-	return gst_element_factory_make(ename.toLatin1().data(), NULL);
+// set PSI_NO_HWCODEC=1 to force the software codec elements
+static bool hwcodec_allowed()
+{
+	return (QString::fromLatin1(qgetenv("PSI_NO_HWCODEC")) != "1");
 }
 
-static GstElement *video_codec_to_enc_element(const QString &name)
+// try a list of element names, best first.  hardware elements only exist
+//   where the platform plugins (vaapi, osx videotoolbox) are installed,
+//   so probe failure is normal and we silently fall through.
+static GstElement *make_first_element(const char **names)
 {
-	QString ename;
-	if(name == "theora")
-		ename = "theoraenc";
-	else if(name == "h263p")
-		ename = "ffenc_h263p";
-	else
-		return 0;
+	for(int n = 0; names[n]; ++n)
+	{
+		GstElement *e = gst_element_factory_make(names[n], NULL);
+		if(e)
+		{
+			printf("bins: using hardware element '%s'\n", names[n]);
+			return e;
+		}
+	}
 
-	return gst_element_factory_make(ename.toLatin1().data(), NULL);
+	return 0;
 }
 
-static GstElement *video_codec_to_dec_element(const QString &name)
+static GstElement *video_codec_to_hw_enc_element(const QString &name)
 {
-	QString ename;
-	if(name == "theora")
-		ename = "theoradec";
-	else if(name == "h263p")
-		ename = "ffdec_h263";
+	// note: no hardware theora encoder exists anywhere, so only h263p
+	//   has candidates for now
+	static const char *h263p_enc[] = { "vaapiencode_h263", "vtenc_h263", 0 };
+
+	if(name == "h263p")
+		return make_first_element(h263p_enc);
 	else
 		return 0;
-
-	return gst_element_factory_make(ename.toLatin1().data(), NULL);
 }
 
-static GstElement *video_codec_to_rtppay_element(const QString &name)
+static GstElement *video_codec_to_hw_dec_element(const QString &name)
 {
-	QString ename;
-	if(name == "theora")
-		ename = "rtptheorapay";
-	else if(name == "h263p")
-		ename = "rtph263ppay";
+	static const char *h263p_dec[] = { "vaapidecode", "vtdec", 0 };
+
+	if(name == "h263p")
+		return make_first_element(h263p_dec);
 	else
 		return 0;
+}
 
-	return gst_element_factory_make(ename.toLatin1().data(), NULL);
+static GstElement *video_codec_to_enc_element(const QString &name)
+{
+	const CodecDescriptor *c = codec_lookup(name, true);
+	return c ? gst_element_factory_make(c->enc, NULL) : 0;
 }
 
-static GstElement *video_codec_to_rtpdepay_element(const QString &name)
+static GstElement *video_codec_to_dec_element(const QString &name)
 {
-	QString ename;
-	if(name == "theora")
-		ename = "rtptheoradepay";
-	else if(name == "h263p")
-		ename = "rtph263pdepay";
-	else
-		return 0;
+	const CodecDescriptor *c = codec_lookup(name, true);
+	return c ? gst_element_factory_make(c->dec, NULL) : 0;
+}
 
-	return gst_element_factory_make(ename.toLatin1().data(), NULL);
+static GstElement *video_codec_to_rtppay_element(const QString &name)
+{
+	const CodecDescriptor *c = codec_lookup(name, true);
+	return c ? gst_element_factory_make(c->pay, NULL) : 0;
+}
+
+static GstElement *video_codec_to_rtpdepay_element(const QString &name)
+{
+	const CodecDescriptor *c = codec_lookup(name, true);
+	return c ? gst_element_factory_make(c->depay, NULL) : 0;
 }
 
 static bool audio_codec_get_send_elements(const QString &name, GstElement **enc, GstElement **rtppay)
@@ -215,10 +232,13 @@ static bool video_codec_get_recv_elements(const QString &name, GstElement **dec,
 	return true;
 }
 
-GstElement *bins_videoprep_create(const QSize &size, int fps, bool is_live)
+GstElement *bins_videoprep_create(const QSize &size, int fps, bool is_live, GstElement **scaleFilter)
 {
 	GstElement *bin = gst_bin_new("videoprepbin");
 
+	if(scaleFilter)
+		*scaleFilter = 0;
+
 	GstElement *videorate = 0;
 	GstElement *ratefilter = 0;
 	if(fps != -1)
@@ -227,9 +247,9 @@ GstElement *bins_videoprep_create(const QSize &size, int fps, bool is_live)
 		if(is_live)
 			videorate = gst_element_factory_make("videomaxrate", NULL);
 		else
-			videorate = gst_element_factory_make("videorate", NULL);
+			videorate = elementcache_make("videorate");
 
-		ratefilter = gst_element_factory_make("capsfilter", NULL);
+		ratefilter = elementcache_make("capsfilter");
 
 		GstCaps *caps = gst_caps_new_empty();
 		GstStructure *cs = gst_structure_new("video/x-raw-yuv",
@@ -247,8 +267,8 @@ GstElement *bins_videoprep_create(const QSize &size, int fps, bool is_live)
 	GstElement *scalefilter = 0;
 	if(size.isValid())
 	{
-		videoscale = gst_element_factory_make("videoscale", NULL);
-		scalefilter = gst_element_factory_make("capsfilter", NULL);
+		videoscale = elementcache_make("videoscale");
+		scalefilter = elementcache_make("capsfilter");
 
 		GstCaps *caps = gst_caps_new_empty();
 		GstStructure *cs = gst_structure_new("video/x-raw-yuv",
@@ -262,6 +282,9 @@ GstElement *bins_videoprep_create(const QSize &size, int fps, bool is_live)
 
 		g_object_set(G_OBJECT(scalefilter), "caps", caps, NULL);
 		gst_caps_unref(caps);
+
+		if(scaleFilter)
+			*scaleFilter = scalefilter;
 	}
 
 	if(!videorate && !videoscale)
@@ -317,7 +340,23 @@ GstElement *bins_videoprep_create(const QSize &size, int fps, bool is_live)
 	return bin;
 }
 
-GstElement *bins_audioenc_create(const QString &codec, int id, int rate, int size, int channels)
+// request a pad on the tee and expose it on the bin as "recsrc"
+static void add_record_tap_pad(GstElement *bin, GstElement *rectee)
+{
+	GstPad *pad = gst_element_get_request_pad(rectee, "src%d");
+	gst_element_add_pad(bin, gst_ghost_pad_new("recsrc", pad));
+	gst_object_unref(GST_OBJECT(pad));
+}
+
+// set an element property only if the element has it.  some encoder
+//   knobs exist only in newer element versions
+static void set_prop_if_exists(GstElement *e, const char *name, int value)
+{
+	if(g_object_class_find_property(G_OBJECT_GET_CLASS(e), name))
+		g_object_set(G_OBJECT(e), name, value, NULL);
+}
+
+GstElement *bins_audioenc_create(const QString &codec, int id, int rate, int size, int channels, bool recordTap, int ptime, int mtu, bool dtx)
 {
 	GstElement *bin = gst_bin_new("audioencbin");
 
@@ -326,11 +365,66 @@ GstElement *bins_audioenc_create(const QString &codec, int id, int rate, int siz
 	if(!audio_codec_get_send_elements(codec, &audioenc, &audiortppay))
 		return 0;
 
+	gst_element_set_name(audioenc, "audioenc");
+
 	if(id != -1)
 		g_object_set(G_OBJECT(audiortppay), "pt", id, NULL);
 
-	GstElement *audioconvert = gst_element_factory_make("audioconvert", NULL);
-	GstElement *audioresample = gst_element_factory_make("audioresample", NULL);
+	// keep every emitted packet within the transport's budget instead
+	//   of relying on ip fragmentation
+	if(mtu > 0 && g_object_class_find_property(G_OBJECT_GET_CLASS(audiortppay), "mtu"))
+		g_object_set(G_OBJECT(audiortppay), "mtu", (guint)mtu, NULL);
+
+	if(ptime > 0)
+	{
+		if(codec == "speex")
+		{
+			// speex frames are fixed at 20ms; larger ptimes pack
+			//   multiple frames into each output buffer
+			int nframes = qBound(1, ptime / 20, 8);
+			g_object_set(G_OBJECT(audioenc), "nframes", nframes, NULL);
+		}
+		else if(codec == "opus")
+		{
+			// opusenc frames natively, but only at specific sizes;
+			//   use the largest one not exceeding the request
+			static const int sizes[] = { 60, 40, 20, 10, 5, 0 };
+			int use = 20;
+			for(int n = 0; sizes[n]; ++n)
+			{
+				if(ptime >= sizes[n])
+				{
+					use = sizes[n];
+					break;
+				}
+			}
+			g_object_set(G_OBJECT(audioenc), "frame-size", use, NULL);
+		}
+
+		// aggregating payloaders also honor a ptime bound
+		if(g_object_class_find_property(G_OBJECT_GET_CLASS(audiortppay), "max-ptime"))
+			g_object_set(G_OBJECT(audiortppay), "max-ptime", (guint64)ptime * GST_MSECOND, NULL);
+	}
+
+	if(dtx)
+	{
+		// vad makes the encoder classify each frame as speech or not,
+		//   and dtx makes it encode the non-speech ones as minimal
+		//   comfort-noise frames.  speexenc has both; opusenc has dtx
+		//   only.  the worker withholds most of the resulting silence
+		//   frames from the wire (see dtxProcessAudioPacket)
+		set_prop_if_exists(audioenc, "vad", TRUE);
+		set_prop_if_exists(audioenc, "dtx", TRUE);
+	}
+
+	// push buffer lists where supported, so packets reach the sink in
+	//   batches and go out to the app in one callback
+	if(g_object_class_find_property(G_OBJECT_GET_CLASS(audiortppay), "buffer-list"))
+		g_object_set(G_OBJECT(audiortppay), "buffer-list", TRUE, NULL);
+
+	GstElement *audioconvert = elementcache_make("audioconvert");
+	GstElement *audioresample = elementcache_make("audioresample");
+	bins_audioresample_configure(audioresample);
 
 	GstStructure *cs;
 	GstCaps *caps = gst_caps_new_empty();
@@ -351,7 +445,7 @@ GstElement *bins_audioenc_create(const QString &codec, int id, int rate, int siz
 		gst_caps_append_structure(caps, cs);
 		printf("rate=%d,width=%d,channels=%d\n", rate, size, channels);
 	}
-	GstElement *capsfilter = gst_element_factory_make("capsfilter", NULL);
+	GstElement *capsfilter = elementcache_make("capsfilter");
 	g_object_set(G_OBJECT(capsfilter), "caps", caps, NULL);
 	gst_caps_unref(caps);
 
@@ -361,7 +455,18 @@ GstElement *bins_audioenc_create(const QString &codec, int id, int rate, int siz
 	gst_bin_add(GST_BIN(bin), audioenc);
 	gst_bin_add(GST_BIN(bin), audiortppay);
 
-	gst_element_link_many(audioconvert, audioresample, capsfilter, audioenc, audiortppay, NULL);
+	gst_element_link_many(audioconvert, audioresample, capsfilter, audioenc, NULL);
+
+	if(recordTap)
+	{
+		GstElement *rectee = gst_element_factory_make("tee", NULL);
+		gst_bin_add(GST_BIN(bin), rectee);
+		gst_element_link(audioenc, rectee);
+		gst_element_link(rectee, audiortppay);
+		add_record_tap_pad(bin, rectee);
+	}
+	else
+		gst_element_link(audioenc, audiortppay);
 
 	GstPad *pad;
 
@@ -376,28 +481,157 @@ GstElement *bins_audioenc_create(const QString &codec, int id, int rate, int siz
 	return bin;
 }
 
-GstElement *bins_videoenc_create(const QString &codec, int id, int maxkbps)
+GstElement *bins_videoenc_create(const QString &codec, int id, int maxkbps, int preset, int threads, bool recordTap, int mtu)
 {
+	bool try_hw = hwcodec_allowed();
+
+restart:
 	GstElement *bin = gst_bin_new("videoencbin");
 
 	GstElement *videoenc = 0;
+	if(try_hw)
+		videoenc = video_codec_to_hw_enc_element(codec);
+	bool hw = (videoenc != 0);
+
 	GstElement *videortppay = 0;
-	if(!video_codec_get_send_elements(codec, &videoenc, &videortppay))
-		return 0;
+	if(videoenc)
+	{
+		videortppay = video_codec_to_rtppay_element(codec);
+		if(!videortppay)
+		{
+			g_object_unref(G_OBJECT(videoenc));
+			return 0;
+		}
+	}
+	else
+	{
+		if(!video_codec_get_send_elements(codec, &videoenc, &videortppay))
+			return 0;
+	}
 
 	if(id != -1)
 		g_object_set(G_OBJECT(videortppay), "pt", id, NULL);
 
+	// keep every emitted packet within the transport's budget instead
+	//   of relying on ip fragmentation.  matters most here: fragmented
+	//   video packets get dropped in pairs, doubling effective loss
+	if(mtu > 0 && g_object_class_find_property(G_OBJECT_GET_CLASS(videortppay), "mtu"))
+		g_object_set(G_OBJECT(videortppay), "mtu", (guint)mtu, NULL);
+
+	// named so the worker can find it and poke the bitrate while live
+	gst_element_set_name(videoenc, "videoenc");
+
 	if(codec == "theora")
 		g_object_set(G_OBJECT(videoenc), "bitrate", maxkbps, NULL);
 
-	GstElement *videoconvert = gst_element_factory_make("ffmpegcolorspace", NULL);
+	// apply the speed/latency preset.  hardware encoders are realtime
+	//   by design and have no comparable knobs, so they are left alone
+	if(!hw)
+	{
+		if(codec == "theora")
+		{
+			if(preset == VideoEncPreset_Balanced)
+			{
+				set_prop_if_exists(videoenc, "speed-level", 1);
+				set_prop_if_exists(videoenc, "keyframe-force", 64);
+			}
+			else if(preset == VideoEncPreset_Realtime)
+			{
+				set_prop_if_exists(videoenc, "speed-level", 2);
+				set_prop_if_exists(videoenc, "keyframe-force", 32);
+				set_prop_if_exists(videoenc, "drop-frames", TRUE);
+			}
+		}
+		else if(codec == "h263p")
+		{
+			if(preset == VideoEncPreset_Balanced)
+				set_prop_if_exists(videoenc, "gop-size", 64);
+			else if(preset == VideoEncPreset_Realtime)
+				set_prop_if_exists(videoenc, "gop-size", 32);
+		}
+	}
+
+	// multi-threaded encoding where the element supports it.  theora
+	//   has no threaded encoder, so for it only the stage decoupling
+	//   below applies
+	if(threads > 1 && !hw)
+	{
+		set_prop_if_exists(videoenc, "threads", threads);
+		set_prop_if_exists(videoenc, "max-threads", threads);
+	}
+
+	GstElement *videoconvert = elementcache_make("ffmpegcolorspace");
 
 	gst_bin_add(GST_BIN(bin), videoconvert);
 	gst_bin_add(GST_BIN(bin), videoenc);
 	gst_bin_add(GST_BIN(bin), videortppay);
 
-	gst_element_link_many(videoconvert, videoenc, videortppay, NULL);
+	GstElement *rectee = 0;
+	if(recordTap)
+	{
+		rectee = gst_element_factory_make("tee", NULL);
+		gst_bin_add(GST_BIN(bin), rectee);
+	}
+
+	// when multiple threads are requested, decouple the conversion,
+	//   encode and payload stages so each runs on its own streaming
+	//   thread.  bounds are small: the point is parallelism, not
+	//   buffering
+	GstElement *encqueue = 0;
+	GstElement *payqueue = 0;
+	if(threads > 1)
+	{
+		encqueue = elementcache_make("queue");
+		payqueue = elementcache_make("queue");
+		g_object_set(G_OBJECT(encqueue),
+			"max-size-buffers", (guint)3,
+			"max-size-bytes", (guint)0,
+			"max-size-time", (guint64)0, NULL);
+		g_object_set(G_OBJECT(payqueue),
+			"max-size-buffers", (guint)3,
+			"max-size-bytes", (guint)0,
+			"max-size-time", (guint64)0, NULL);
+		gst_bin_add(GST_BIN(bin), encqueue);
+		gst_bin_add(GST_BIN(bin), payqueue);
+	}
+
+	bool linked;
+	if(encqueue)
+	{
+		if(rectee)
+		{
+			linked = gst_element_link_many(videoconvert, encqueue,
+				videoenc, rectee, payqueue, videortppay, NULL);
+		}
+		else
+		{
+			linked = gst_element_link_many(videoconvert, encqueue,
+				videoenc, payqueue, videortppay, NULL);
+		}
+	}
+	else if(rectee)
+	{
+		linked = gst_element_link_many(videoconvert, videoenc, rectee,
+			videortppay, NULL);
+	}
+	else
+		linked = gst_element_link_many(videoconvert, videoenc, videortppay, NULL);
+
+	if(!linked)
+	{
+		// a hardware encoder may exist yet not accept our raw caps.
+		//   throw the chain away and redo with the software element.
+		g_object_unref(G_OBJECT(bin));
+
+		if(hw)
+		{
+			printf("bins: hardware encoder doesn't link, using software\n");
+			try_hw = false;
+			goto restart;
+		}
+
+		return 0;
+	}
 
 	GstPad *pad;
 
@@ -409,9 +643,56 @@ GstElement *bins_videoenc_create(const QString &codec, int id, int maxkbps)
 	gst_element_add_pad(bin, gst_ghost_pad_new("src", pad));
 	gst_object_unref(GST_OBJECT(pad));
 
+	if(rectee)
+		add_record_tap_pad(bin, rectee);
+
 	return bin;
 }
 
+// turns the jitterbuffer's loss events into empty buffers for the
+//   decoder.  speexdec treats a zero-size buffer as a lost frame and
+//   synthesizes a concealment frame from the previous excitation, which
+//   sounds far better than the underrun the sink produces otherwise.
+//   decoders without concealment just emit nothing for it, which is no
+//   worse than the gap they'd have seen anyway.
+//
+// the probe watches the depayloader's sink pad, because the base
+//   depayloader consumes GstRTPPacketLost itself (it only advances the
+//   segment).  the empty buffer is chained straight into the decoder,
+//   on the same streaming thread that delivered the event, so it lands
+//   exactly where the gap sits in the buffer order.  data is the
+//   decoder element (borrowed; the bin outlives its pads' dataflow)
+static gboolean cb_audiodepay_loss_event(GstPad *pad, GstEvent *event, gpointer data)
+{
+	(void)pad;
+
+	if(GST_EVENT_TYPE(event) == GST_EVENT_CUSTOM_DOWNSTREAM)
+	{
+		const GstStructure *s = gst_event_get_structure(event);
+		if(s && gst_structure_has_name(s, "GstRTPPacketLost"))
+		{
+			guint64 ts = 0;
+			guint64 dur = 0;
+			gst_structure_get_uint64(s, "timestamp", &ts);
+			gst_structure_get_uint64(s, "duration", &dur);
+
+			GstPad *decpad = gst_element_get_static_pad((GstElement *)data, "sink");
+			if(decpad)
+			{
+				GstBuffer *buf = gst_buffer_new();
+				GST_BUFFER_TIMESTAMP(buf) = ts;
+				GST_BUFFER_DURATION(buf) = dur;
+				gst_buffer_set_caps(buf, GST_PAD_CAPS(decpad));
+
+				gst_pad_chain(decpad, buf);
+				gst_object_unref(GST_OBJECT(decpad));
+			}
+		}
+	}
+
+	return TRUE;
+}
+
 GstElement *bins_audiodec_create(const QString &codec)
 {
 	GstElement *bin = gst_bin_new("audiodecbin");
@@ -421,7 +702,8 @@ GstElement *bins_audiodec_create(const QString &codec)
 	if(!audio_codec_get_recv_elements(codec, &audiodec, &audiortpdepay))
 		return 0;
 
-	GstElement *audiortpjitterbuffer = gst_element_factory_make("gstrtpjitterbuffer", NULL);
+	// named so the worker can find it and manage its latency
+	GstElement *audiortpjitterbuffer = gst_element_factory_make("gstrtpjitterbuffer", "audiojbuf");
 
 	gst_bin_add(GST_BIN(bin), audiortpjitterbuffer);
 	gst_bin_add(GST_BIN(bin), audiortpdepay);
@@ -431,6 +713,20 @@ GstElement *bins_audiodec_create(const QString &codec)
 
 	g_object_set(G_OBJECT(audiortpjitterbuffer), "latency", (unsigned int)get_rtp_latency(), NULL);
 
+	// have the jitterbuffer declare gaps instead of silently skipping
+	//   them.  it sees the post-ingress-filter sequence space and waits
+	//   out its latency for reordered packets, so a declared loss is a
+	//   real one.  the probe converts the declarations into concealment
+	//   input for the decoder
+	if(g_object_class_find_property(G_OBJECT_GET_CLASS(audiortpjitterbuffer), "do-lost"))
+	{
+		g_object_set(G_OBJECT(audiortpjitterbuffer), "do-lost", TRUE, NULL);
+
+		GstPad *depaypad = gst_element_get_static_pad(audiortpdepay, "sink");
+		gst_pad_add_event_probe(depaypad, G_CALLBACK(cb_audiodepay_loss_event), audiodec);
+		gst_object_unref(GST_OBJECT(depaypad));
+	}
+
 	GstPad *pad;
 
 	pad = gst_element_get_static_pad(audiortpjitterbuffer, "sink");
@@ -446,12 +742,31 @@ GstElement *bins_audiodec_create(const QString &codec)
 
 GstElement *bins_videodec_create(const QString &codec)
 {
+	bool try_hw = hwcodec_allowed();
+
+restart:
 	GstElement *bin = gst_bin_new("videodecbin");
 
 	GstElement *videodec = 0;
+	if(try_hw)
+		videodec = video_codec_to_hw_dec_element(codec);
+	bool hw = (videodec != 0);
+
 	GstElement *videortpdepay = 0;
-	if(!video_codec_get_recv_elements(codec, &videodec, &videortpdepay))
-		return 0;
+	if(videodec)
+	{
+		videortpdepay = video_codec_to_rtpdepay_element(codec);
+		if(!videortpdepay)
+		{
+			g_object_unref(G_OBJECT(videodec));
+			return 0;
+		}
+	}
+	else
+	{
+		if(!video_codec_get_recv_elements(codec, &videodec, &videortpdepay))
+			return 0;
+	}
 
 	GstElement *videortpjitterbuffer = gst_element_factory_make("gstrtpjitterbuffer", NULL);
 
@@ -459,7 +774,21 @@ GstElement *bins_videodec_create(const QString &codec)
 	gst_bin_add(GST_BIN(bin), videortpdepay);
 	gst_bin_add(GST_BIN(bin), videodec);
 
-	gst_element_link_many(videortpjitterbuffer, videortpdepay, videodec, NULL);
+	if(!gst_element_link_many(videortpjitterbuffer, videortpdepay, videodec, NULL))
+	{
+		// as with encoding, a hardware decoder may not take this
+		//   format.  redo with the software element.
+		g_object_unref(G_OBJECT(bin));
+
+		if(hw)
+		{
+			printf("bins: hardware decoder doesn't link, using software\n");
+			try_hw = false;
+			goto restart;
+		}
+
+		return 0;
+	}
 
 	g_object_set(G_OBJECT(videortpjitterbuffer), "latency", (unsigned int)get_rtp_latency(), NULL);
 
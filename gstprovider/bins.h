@@ -28,13 +28,46 @@ class QSize;
 
 namespace PsiMedia {
 
-GstElement *bins_videoprep_create(const QSize &size, int fps, bool is_live);
+// scaleFilter, when given, receives the size capsfilter inside the bin
+//   (borrowed, owned by the bin; 0 when no scaling was requested).  it
+//   lets the caller renegotiate the encode size later without tearing
+//   the prep stage down
+GstElement *bins_videoprep_create(const QSize &size, int fps, bool is_live, GstElement **scaleFilter = 0);
 
-GstElement *bins_audioenc_create(const QString &codec, int id, int rate, int size, int channels);
-GstElement *bins_videoenc_create(const QString &codec, int id, int maxkbps);
+// if recordTap is true, the encoded stream is teed off between the
+//   encoder and the payloader, exposed as a "recsrc" pad on the bin.
+//   this lets a recording branch reuse the live encode instead of
+//   encoding a second time
+// ptime is the packetization interval in ms (-1 = codec default).  it
+//   is applied to the encoder's framing where the codec supports it,
+//   and passed to the payloader as an aggregation bound
+// encoder speed/latency tradeoff.  quality keeps the codec defaults,
+//   the other presets progressively trade compression efficiency for
+//   cpu headroom and a shorter keyframe distance.  numbering matches
+//   PVideoParams::encodePreset
+enum VideoEncPreset
+{
+	VideoEncPreset_Quality,
+	VideoEncPreset_Balanced,
+	VideoEncPreset_Realtime
+};
+
+// dtx enables encoder-level voice activity detection and discontinuous
+//   transmission where the codec supports it: silence is encoded as
+//   minimal comfort-noise frames instead of full speech frames
+GstElement *bins_audioenc_create(const QString &codec, int id, int rate, int size, int channels, bool recordTap = false, int ptime = -1, int mtu = -1, bool dtx = false);
+// threads > 1 enables multi-threaded encoding where the element
+//   supports it, and decouples the convert/encode/payload stages with
+//   small queues so the chain spreads across streaming threads
+GstElement *bins_videoenc_create(const QString &codec, int id, int maxkbps, int preset = VideoEncPreset_Quality, int threads = 1, bool recordTap = false, int mtu = -1);
 GstElement *bins_audiodec_create(const QString &codec);
 GstElement *bins_videodec_create(const QString &codec);
 
+// apply the configured resampler tuning (PSI_RESAMPLE_QUALITY, 0-10) to
+//   an audioresample element.  used by every audio chain so send and
+//   receive stay consistent.  no-op when the knob isn't set
+void bins_audioresample_configure(GstElement *audioresample);
+
 }
 
 #endif
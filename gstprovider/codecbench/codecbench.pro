@@ -0,0 +1,23 @@
+CONFIG -= app_bundle
+CONFIG += console
+QT -= gui
+
+CONFIG += debug
+
+TARGET = psimedia-codecbench
+
+include(../gstconf.pri)
+INCLUDEPATH += ..
+
+HEADERS += \
+	../codecs.h \
+	../bins.h \
+	../monotime.h \
+	../elementcache.h
+
+SOURCES += \
+	../codecs.cpp \
+	../bins.cpp \
+	../monotime.cpp \
+	../elementcache.cpp \
+	main.cpp
@@ -0,0 +1,448 @@
+/*
+ * Copyright (C) 2008-2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+// psimedia-codecbench: offline codec a/b benchmark over the bins
+//   factories.
+//
+// pumps a fixed generated pcm/yuv corpus through every codec pair in
+//   the descriptor table (codecs.h), with no devices and no network,
+//   and reports per codec:
+//     - encode and decode cpu cost, in cpu-ms per second of media
+//       (1000 means one full core just to keep up in realtime)
+//     - payload bitrate on the wire
+//     - per-buffer media-in to media-out latency percentiles
+//   one csv row per codec on stdout, so the codec defaults in
+//   modes.cpp can be picked from measurements on the actual target
+//   hardware instead of assumptions.
+//
+// usage: psimedia-codecbench [media-seconds]
+//
+// encode cost comes from a src ! enc ! fakesink pass; a second
+//   src ! enc ! dec ! fakesink pass then gives the decode cost as the
+//   difference, and the latency samples.  process cpu time is used,
+//   so run on an otherwise idle machine.  the corpus is synthetic
+//   (test sources with fixed settings), which flatters codecs on
+//   absolute bitrate but keeps every run comparable.
+
+#include <stdio.h>
+#include <time.h>
+#include <QString>
+#include <QSize>
+#include <QList>
+#include <QPair>
+#include <QMutex>
+#include <QByteArray>
+#include <QtAlgorithms>
+#include <gst/gst.h>
+#include "codecs.h"
+#include "bins.h"
+#include "monotime.h"
+
+using namespace PsiMedia;
+
+#define DEFAULT_MEDIA_SECONDS 30
+#define AUDIO_BUFFERS_PER_SECOND 50 // 20ms framing, like the rtp path
+
+// ---------------------------------------------------------------------
+// measurement state, shared with pad probes on streaming threads
+
+class PassStats
+{
+public:
+	QMutex mutex;
+
+	// bytes/buffers leaving the encoder bin (the rtp payload side)
+	qint64 payloadBytes;
+	int payloadBuffers;
+
+	// (stream timestamp, wall time) of buffers entering the encoder,
+	//   matched against buffers leaving the decoder for per-buffer
+	//   latency.  bounded so a stalled output can't grow it forever
+	QList< QPair<quint64, quint64> > inTimes;
+	QList<int> latencies; // ms
+
+	PassStats() :
+		payloadBytes(0),
+		payloadBuffers(0)
+	{
+	}
+};
+
+static gboolean media_in_probe(GstPad *pad, GstBuffer *buf, gpointer user_data)
+{
+	Q_UNUSED(pad);
+	PassStats *stats = (PassStats *)user_data;
+
+	if(GST_BUFFER_TIMESTAMP(buf) == GST_CLOCK_TIME_NONE)
+		return TRUE;
+
+	QMutexLocker locker(&stats->mutex);
+	if(stats->inTimes.count() < 4096)
+		stats->inTimes += qMakePair((quint64)GST_BUFFER_TIMESTAMP(buf), (quint64)monotime_ns());
+	return TRUE;
+}
+
+// payloaders may push buffer lists (see bins_audioenc_create), so this
+//   edge uses a data probe and handles both object kinds
+static gboolean payload_probe(GstPad *pad, GstMiniObject *obj, gpointer user_data)
+{
+	Q_UNUSED(pad);
+	PassStats *stats = (PassStats *)user_data;
+
+	QMutexLocker locker(&stats->mutex);
+	if(GST_IS_BUFFER(obj))
+	{
+		stats->payloadBytes += GST_BUFFER_SIZE(GST_BUFFER(obj));
+		++stats->payloadBuffers;
+	}
+	else if(GST_IS_BUFFER_LIST(obj))
+	{
+		GstBufferListIterator *it = gst_buffer_list_iterate(GST_BUFFER_LIST(obj));
+		while(gst_buffer_list_iterator_next_group(it))
+		{
+			GstBuffer *buf;
+			while((buf = gst_buffer_list_iterator_next(it)))
+			{
+				stats->payloadBytes += GST_BUFFER_SIZE(buf);
+				++stats->payloadBuffers;
+			}
+		}
+		gst_buffer_list_iterator_free(it);
+	}
+	return TRUE;
+}
+
+static gboolean media_out_probe(GstPad *pad, GstBuffer *buf, gpointer user_data)
+{
+	Q_UNUSED(pad);
+	PassStats *stats = (PassStats *)user_data;
+
+	quint64 ts = GST_BUFFER_TIMESTAMP(buf);
+	if(ts == GST_CLOCK_TIME_NONE)
+		return TRUE;
+
+	QMutexLocker locker(&stats->mutex);
+
+	// match against the newest input at or before this output's
+	//   timestamp.  codecs with algorithmic delay emit later than they
+	//   consume, so anything older is already accounted for (or lost)
+	int at = -1;
+	for(int n = 0; n < stats->inTimes.count(); ++n)
+	{
+		if(stats->inTimes[n].first <= ts)
+			at = n;
+		else
+			break;
+	}
+	if(at == -1)
+		return TRUE;
+
+	stats->latencies += (int)(((quint64)monotime_ns() - stats->inTimes[at].second) / GST_MSECOND);
+	for(int n = 0; n <= at; ++n)
+		stats->inTimes.removeFirst();
+	return TRUE;
+}
+
+static int percentile(const QList<int> &samples, int pct)
+{
+	if(samples.isEmpty())
+		return -1;
+
+	QList<int> sorted = samples;
+	qSort(sorted);
+	return sorted[(sorted.count() - 1) * pct / 100];
+}
+
+// ---------------------------------------------------------------------
+// fixed corpus sources.  test sources with pinned settings, so every
+//   run and every codec sees identical input
+
+static GstElement *make_audio_src(int rate, int size, int channels, int seconds)
+{
+	GstElement *bin = gst_bin_new("audiocorpus");
+
+	GstElement *src = gst_element_factory_make("audiotestsrc", NULL);
+	g_object_set(G_OBJECT(src),
+		"wave", 0, // sine
+		"samplesperbuffer", rate / AUDIO_BUFFERS_PER_SECOND,
+		"num-buffers", seconds * AUDIO_BUFFERS_PER_SECOND,
+		NULL);
+
+	GstStructure *cs = gst_structure_new("audio/x-raw-int",
+		"rate", G_TYPE_INT, rate,
+		"width", G_TYPE_INT, size,
+		"channels", G_TYPE_INT, channels, NULL);
+	GstCaps *caps = gst_caps_new_empty();
+	gst_caps_append_structure(caps, cs);
+	GstElement *capsfilter = gst_element_factory_make("capsfilter", NULL);
+	g_object_set(G_OBJECT(capsfilter), "caps", caps, NULL);
+	gst_caps_unref(caps);
+
+	gst_bin_add(GST_BIN(bin), src);
+	gst_bin_add(GST_BIN(bin), capsfilter);
+	gst_element_link(src, capsfilter);
+
+	GstPad *pad = gst_element_get_static_pad(capsfilter, "src");
+	gst_element_add_pad(bin, gst_ghost_pad_new("src", pad));
+	gst_object_unref(GST_OBJECT(pad));
+
+	return bin;
+}
+
+static GstElement *make_video_src(const QSize &size, int fps, int seconds)
+{
+	GstElement *bin = gst_bin_new("videocorpus");
+
+	GstElement *src = gst_element_factory_make("videotestsrc", NULL);
+	g_object_set(G_OBJECT(src), "num-buffers", seconds * fps, NULL);
+
+	GstStructure *cs = gst_structure_new("video/x-raw-yuv",
+		"width", G_TYPE_INT, size.width(),
+		"height", G_TYPE_INT, size.height(), NULL);
+	gst_structure_set(cs, "framerate", GST_TYPE_FRACTION, fps, 1, NULL);
+	GstCaps *caps = gst_caps_new_empty();
+	gst_caps_append_structure(caps, cs);
+	GstElement *capsfilter = gst_element_factory_make("capsfilter", NULL);
+	g_object_set(G_OBJECT(capsfilter), "caps", caps, NULL);
+	gst_caps_unref(caps);
+
+	gst_bin_add(GST_BIN(bin), src);
+	gst_bin_add(GST_BIN(bin), capsfilter);
+	gst_element_link(src, capsfilter);
+
+	GstPad *pad = gst_element_get_static_pad(capsfilter, "src");
+	gst_element_add_pad(bin, gst_ghost_pad_new("src", pad));
+	gst_object_unref(GST_OBJECT(pad));
+
+	return bin;
+}
+
+// ---------------------------------------------------------------------
+// run one pipeline pass to eos.  takes ownership of the elements.  cpu
+//   time consumed by the pass is added to *cpuMs
+
+static bool run_pass(GstElement *src, GstElement *enc, GstElement *dec, PassStats *stats, int *cpuMs, int seconds)
+{
+	GstElement *pipeline = gst_pipeline_new(NULL);
+	GstElement *sink = gst_element_factory_make("fakesink", NULL);
+	g_object_set(G_OBJECT(sink), "sync", FALSE, NULL);
+
+	gst_bin_add(GST_BIN(pipeline), src);
+	gst_bin_add(GST_BIN(pipeline), enc);
+	if(dec)
+		gst_bin_add(GST_BIN(pipeline), dec);
+	gst_bin_add(GST_BIN(pipeline), sink);
+
+	bool linked;
+	if(dec)
+		linked = gst_element_link_many(src, enc, dec, sink, NULL);
+	else
+		linked = gst_element_link_many(src, enc, sink, NULL);
+	if(!linked)
+	{
+		g_object_unref(G_OBJECT(pipeline));
+		return false;
+	}
+
+	GstPad *pad;
+
+	pad = gst_element_get_static_pad(enc, "sink");
+	gst_pad_add_buffer_probe(pad, G_CALLBACK(media_in_probe), stats);
+	gst_object_unref(GST_OBJECT(pad));
+
+	pad = gst_element_get_static_pad(enc, "src");
+	gst_pad_add_data_probe(pad, G_CALLBACK(payload_probe), stats);
+	gst_object_unref(GST_OBJECT(pad));
+
+	if(dec)
+	{
+		pad = gst_element_get_static_pad(dec, "src");
+		gst_pad_add_buffer_probe(pad, G_CALLBACK(media_out_probe), stats);
+		gst_object_unref(GST_OBJECT(pad));
+	}
+
+	clock_t cpuStart = ::clock();
+
+	gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+	// offline runs finish faster than realtime; allow realtime plus
+	//   slack before declaring a stall
+	GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+	GstMessage *msg = gst_bus_timed_pop_filtered(bus, (guint64)(seconds + 30) * GST_SECOND,
+		(GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+	bool failed = (!msg || GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR);
+	if(msg)
+		gst_message_unref(msg);
+	gst_object_unref(GST_OBJECT(bus));
+
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+
+	*cpuMs += (int)((::clock() - cpuStart) * 1000 / CLOCKS_PER_SEC);
+
+	g_object_unref(G_OBJECT(pipeline));
+	return !failed;
+}
+
+// ---------------------------------------------------------------------
+
+static bool have_element(const char *name)
+{
+	GstElement *e = gst_element_factory_make(name, NULL);
+	if(!e)
+		return false;
+
+	g_object_unref(G_OBJECT(e));
+	return true;
+}
+
+static bool have_codec(const CodecDescriptor *c)
+{
+	return (have_element(c->enc) && have_element(c->dec) && have_element(c->pay) && have_element(c->depay));
+}
+
+// each audio codec runs at its canonical rate from modes.cpp, so the
+//   numbers line up with what a real session would do
+static int audio_rate_for_codec(const QString &name)
+{
+	if(name == "opus")
+		return 48000;
+	else if(name == "vorbis")
+		return 44100;
+	else if(name == "pcmu")
+		return 8000;
+	else
+		return 16000;
+}
+
+int main(int argc, char **argv)
+{
+	gst_init(&argc, &argv);
+
+	int seconds = DEFAULT_MEDIA_SECONDS;
+	if(argc >= 2)
+	{
+		int x = QString::fromLatin1(argv[1]).toInt();
+		if(x > 0)
+			seconds = x;
+	}
+
+	// the jitter buffer inside the decode bins would dominate the
+	//   latency numbers; zero it unless the caller pinned a value
+	if(qgetenv("PSI_RTP_LATENCY").isEmpty())
+		qputenv("PSI_RTP_LATENCY", "0");
+
+	printf("media,codec,mode,media_s,enc_cpums_per_s,dec_cpums_per_s,kbps,lat_p50_ms,lat_p95_ms,lat_p99_ms\n");
+
+	bool any = false;
+	for(int n = 0; codec_at(n); ++n)
+	{
+		const CodecDescriptor *cd = codec_at(n);
+		if(!have_codec(cd))
+		{
+			fprintf(stderr, "%s: elements not present, skipping\n", cd->name);
+			continue;
+		}
+
+		QString codec = QString::fromLatin1(cd->name);
+		QString mode;
+		PassStats encStats;
+		PassStats fullStats;
+		int encCpuMs = 0;
+		int fullCpuMs = 0;
+		bool ok = false;
+
+		if(!cd->video)
+		{
+			int rate = audio_rate_for_codec(codec);
+			mode = QString::number(rate) + "Hz";
+
+			GstElement *enc = bins_audioenc_create(codec, 96, rate, 16, 1);
+			if(enc)
+				ok = run_pass(make_audio_src(rate, 16, 1, seconds), enc, 0, &encStats, &encCpuMs, seconds);
+
+			if(ok)
+			{
+				enc = bins_audioenc_create(codec, 96, rate, 16, 1);
+				GstElement *dec = bins_audiodec_create(codec);
+				if(enc && dec)
+					ok = run_pass(make_audio_src(rate, 16, 1, seconds), enc, dec, &fullStats, &fullCpuMs, seconds);
+				else
+				{
+					// only run_pass takes ownership, so drop a
+					//   half-created pair (e.g. encoder plugin
+					//   present but decoder missing)
+					if(enc)
+						gst_object_unref(GST_OBJECT(enc));
+					if(dec)
+						gst_object_unref(GST_OBJECT(dec));
+					ok = false;
+				}
+			}
+		}
+		else
+		{
+			QSize size(320, 240);
+			int fps = 30;
+			mode = QString("%1x%2@%3").arg(size.width()).arg(size.height()).arg(fps);
+
+			GstElement *enc = bins_videoenc_create(codec, 96, 512);
+			if(enc)
+				ok = run_pass(make_video_src(size, fps, seconds), enc, 0, &encStats, &encCpuMs, seconds);
+
+			if(ok)
+			{
+				enc = bins_videoenc_create(codec, 96, 512);
+				GstElement *dec = bins_videodec_create(codec);
+				if(enc && dec)
+					ok = run_pass(make_video_src(size, fps, seconds), enc, dec, &fullStats, &fullCpuMs, seconds);
+				else
+				{
+					if(enc)
+						gst_object_unref(GST_OBJECT(enc));
+					if(dec)
+						gst_object_unref(GST_OBJECT(dec));
+					ok = false;
+				}
+			}
+		}
+
+		if(!ok)
+		{
+			fprintf(stderr, "%s: pipeline failed, skipping\n", cd->name);
+			continue;
+		}
+
+		int decCpuMs = qMax(fullCpuMs - encCpuMs, 0);
+		printf("%s,%s,%s,%d,%d,%d,%d,%d,%d,%d\n",
+			cd->video ? "video" : "audio",
+			cd->name,
+			qPrintable(mode),
+			seconds,
+			encCpuMs / seconds,
+			decCpuMs / seconds,
+			(int)(encStats.payloadBytes * 8 / 1000 / seconds),
+			percentile(fullStats.latencies, 50),
+			percentile(fullStats.latencies, 95),
+			percentile(fullStats.latencies, 99));
+		any = true;
+	}
+
+	return any ? 0 : 1;
+}
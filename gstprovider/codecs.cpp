@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "codecs.h"
+
+#include <QString>
+
+namespace PsiMedia {
+
+static const CodecDescriptor codec_table[] =
+{
+	// name      rtp name     video  enc            dec           pay             depay             oob config
+	{ "opus",   "OPUS",      false, "opusenc",     "opusdec",    "rtpopuspay",   "rtpopusdepay",   false },
+	{ "speex",  "SPEEX",     false, "speexenc",    "speexdec",   "rtpspeexpay",  "rtpspeexdepay",  false },
+	{ "vorbis", "VORBIS",    false, "vorbisenc",   "vorbisdec",  "rtpvorbispay", "rtpvorbisdepay", true  },
+	{ "pcmu",   "PCMU",      false, "mulawenc",    "mulawdec",   "rtppcmupay",   "rtppcmudepay",   false },
+	{ "g722",   "G722",      false, "ffenc_g722",  "ffdec_g722", "rtpg722pay",   "rtpg722depay",   false },
+	{ "theora", "THEORA",    true,  "theoraenc",   "theoradec",  "rtptheorapay", "rtptheoradepay", true  },
+	{ "h263p",  "H263-1998", true,  "ffenc_h263p", "ffdec_h263", "rtph263ppay",  "rtph263pdepay",  false },
+
+	// passthrough "codecs": raw media payloaded without encoding
+	//   (identity stands in for the codec element).  used to measure
+	//   framework overhead against codec-free baselines; only
+	//   advertised when PSI_NULL_CODEC is set (see modes.cpp)
+	{ "l16",      "L16",     false, "identity",    "identity",   "rtpL16pay",    "rtpL16depay",    false },
+	{ "rawvideo", "RAW",     true,  "identity",    "identity",   "rtpvrawpay",   "rtpvrawdepay",   false },
+	{ 0, 0, false, 0, 0, 0, 0, false }
+};
+
+const CodecDescriptor *codec_lookup(const QString &name, bool video)
+{
+	for(int n = 0; codec_table[n].name; ++n)
+	{
+		const CodecDescriptor *c = &codec_table[n];
+		if(c->video == video && name == QLatin1String(c->name))
+			return c;
+	}
+
+	return 0;
+}
+
+const CodecDescriptor *codec_lookup_rtp(const QString &encodingName)
+{
+	for(int n = 0; codec_table[n].name; ++n)
+	{
+		const CodecDescriptor *c = &codec_table[n];
+		if(encodingName.compare(QLatin1String(c->rtpName), Qt::CaseInsensitive) == 0)
+			return c;
+	}
+
+	return 0;
+}
+
+const CodecDescriptor *codec_at(int n)
+{
+	int count = 0;
+	while(codec_table[count].name)
+		++count;
+
+	if(n < 0 || n >= count)
+		return 0;
+
+	return &codec_table[n];
+}
+
+}
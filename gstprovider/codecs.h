@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef PSI_CODECS_H
+#define PSI_CODECS_H
+
+class QString;
+
+namespace PsiMedia {
+
+// one row per supported codec, shared by bins.cpp, modes.cpp and
+//   payloadinfo.cpp.  adding a codec means adding a row here instead of
+//   touching an if/else chain in each file.  lookups compare against
+//   the literal names directly, so the hot renegotiation paths do no
+//   string allocation
+class CodecDescriptor
+{
+public:
+	const char *name;    // our lowercase codec name, e.g. "speex"
+	const char *rtpName; // sdp/rtp encoding-name, e.g. "SPEEX"
+	bool video;
+	const char *enc;     // encoder element
+	const char *dec;     // decoder element
+	const char *pay;     // rtp payloader element
+	const char *depay;   // rtp depayloader element
+
+	// codec ships its config out-of-band in a "configuration"
+	//   parameter that is base64 on the wire and hex in PPayloadInfo
+	bool oobConfig;
+};
+
+// find by our codec name ("speex", "theora", ...) and media class
+const CodecDescriptor *codec_lookup(const QString &name, bool video);
+
+// find by rtp encoding-name, case-insensitively, either media class
+const CodecDescriptor *codec_lookup_rtp(const QString &encodingName);
+
+// row n of the table, or 0 past the end.  for tools that enumerate
+//   every codec rather than look one up (e.g. codecbench)
+const CodecDescriptor *codec_at(int n);
+
+}
+
+#endif
@@ -24,6 +24,7 @@
 #include <QString>
 #include <QSize>
 #include <QList>
+#include <QObject>
 
 namespace DeviceEnum {
 
@@ -63,6 +64,31 @@ QList<Item> audioOutputItems(const QString &driver = QString());
 QList<Item> audioInputItems(const QString &driver = QString());
 QList<Item> videoInputItems(const QString &driver = QString());
 
+// watches the system for device additions/removals, so callers don't
+//   have to poll the item functions above.  changed() means the set of
+//   devices may differ from the last enumeration; call the item
+//   functions again to get the new set.  requires a running event loop
+//   in the creating thread.  on platforms without monitoring support,
+//   isSupported() returns false and changed() is never emitted.
+class Watcher : public QObject
+{
+	Q_OBJECT
+
+public:
+	Watcher(QObject *parent = 0);
+	~Watcher();
+
+	bool isSupported() const;
+
+signals:
+	void changed();
+
+private:
+	class Private;
+	friend class Private;
+	Private *d;
+};
+
 }
 
 #endif
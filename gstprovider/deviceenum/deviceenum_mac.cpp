@@ -157,4 +157,28 @@ QList<Item> videoInputItems(const QString &driver)
 	return out;
 }
 
+//----------------------------------------------------------------------------
+// Watcher
+//----------------------------------------------------------------------------
+// no monitoring here yet.  CoreAudio has kAudioHardwarePropertyDevices
+//   listeners that could back this, if anyone wants to wire them up.
+class Watcher::Private
+{
+};
+
+Watcher::Watcher(QObject *parent) :
+	QObject(parent),
+	d(0)
+{
+}
+
+Watcher::~Watcher()
+{
+}
+
+bool Watcher::isSupported() const
+{
+	return false;
+}
+
 }
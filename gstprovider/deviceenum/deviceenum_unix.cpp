@@ -24,10 +24,16 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QDir>
+#include <QDateTime>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSocketNotifier>
+#include <QTimer>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <string.h>
 #include <errno.h>
 #include <unistd.h>
 
@@ -35,7 +41,9 @@
 # include <sys/stat.h>
 # include <dirent.h>
 # include <sys/ioctl.h>
+# include <sys/socket.h>
 # include <linux/videodev2.h>
+# include <linux/netlink.h>
 #endif
 
 namespace DeviceEnum {
@@ -43,6 +51,68 @@ namespace DeviceEnum {
 #define DIR_INPUT  1
 #define DIR_OUTPUT 2
 
+// probing can take seconds (serial /dev walking, open() checks on every
+//   node), and every caller redoes it, so completed probes are kept
+//   process-wide.  device nodes come and go under a handful of
+//   directories whose mtimes change when they do, so a cheap stat
+//   snapshot tells us when a hotplug happened and the cache must go.
+class CachedItems
+{
+public:
+	bool valid;
+	QList<Item> items;
+
+	CachedItems() :
+		valid(false)
+	{
+	}
+};
+
+static QMutex cache_mutex;
+static QString cache_snapshot;
+static CachedItems cache_audioOut, cache_audioIn, cache_videoIn;
+
+static QString dev_snapshot()
+{
+	QString out;
+	QStringList paths;
+	paths << "/dev" << "/dev/snd" << "/sys/class/video4linux" << "/proc/asound";
+	foreach(const QString &path, paths)
+	{
+		QFileInfo fi(path);
+		if(fi.exists())
+			out += path + '=' + fi.lastModified().toString(Qt::ISODate) + ';';
+		else
+			out += path + "=-;";
+	}
+	return out;
+}
+
+// call with cache_mutex held
+static void cache_check_snapshot()
+{
+	QString snapshot = dev_snapshot();
+	if(snapshot != cache_snapshot)
+	{
+		cache_audioOut.valid = false;
+		cache_audioIn.valid = false;
+		cache_videoIn.valid = false;
+		cache_snapshot = snapshot;
+	}
+}
+
+// called by the watcher when the kernel reports a hotplug.  clearing the
+//   snapshot as well forces a re-stat on the next lookup, in case the
+//   event raced with a concurrent probe
+static void cache_invalidate()
+{
+	QMutexLocker locker(&cache_mutex);
+	cache_audioOut.valid = false;
+	cache_audioIn.valid = false;
+	cache_videoIn.valid = false;
+	cache_snapshot = QString();
+}
+
 // taken from netinterface_unix (changed the split to KeepEmptyParts)
 static QStringList read_proc_as_lines(const char *procfile)
 {
@@ -540,7 +610,7 @@ static QList<Item> get_v4l2_items()
 #endif
 }
 
-QList<Item> audioOutputItems(const QString &driver)
+static QList<Item> probe_audioOutputItems(const QString &driver)
 {
 	QList<Item> out;
 	if(driver.isEmpty() || driver == "oss")
@@ -550,7 +620,7 @@ QList<Item> audioOutputItems(const QString &driver)
 	return out;
 }
 
-QList<Item> audioInputItems(const QString &driver)
+static QList<Item> probe_audioInputItems(const QString &driver)
 {
 	QList<Item> out;
 	if(driver.isEmpty() || driver == "oss")
@@ -560,7 +630,7 @@ QList<Item> audioInputItems(const QString &driver)
 	return out;
 }
 
-QList<Item> videoInputItems(const QString &driver)
+static QList<Item> probe_videoInputItems(const QString &driver)
 {
 	QList<Item> out;
 	if(driver.isEmpty() || driver == "v4l2")
@@ -568,4 +638,177 @@ QList<Item> videoInputItems(const QString &driver)
 	return out;
 }
 
+QList<Item> audioOutputItems(const QString &driver)
+{
+	// only the common "any driver" lookup is cached
+	if(!driver.isEmpty())
+		return probe_audioOutputItems(driver);
+
+	QMutexLocker locker(&cache_mutex);
+	cache_check_snapshot();
+	if(cache_audioOut.valid)
+		return cache_audioOut.items;
+
+	// probe with the mutex released, so the audio and video classes can
+	//   run in parallel
+	locker.unlock();
+	QList<Item> out = probe_audioOutputItems(driver);
+	locker.relock();
+
+	cache_audioOut.items = out;
+	cache_audioOut.valid = true;
+	return out;
+}
+
+QList<Item> audioInputItems(const QString &driver)
+{
+	if(!driver.isEmpty())
+		return probe_audioInputItems(driver);
+
+	QMutexLocker locker(&cache_mutex);
+	cache_check_snapshot();
+	if(cache_audioIn.valid)
+		return cache_audioIn.items;
+
+	locker.unlock();
+	QList<Item> out = probe_audioInputItems(driver);
+	locker.relock();
+
+	cache_audioIn.items = out;
+	cache_audioIn.valid = true;
+	return out;
+}
+
+QList<Item> videoInputItems(const QString &driver)
+{
+	if(!driver.isEmpty())
+		return probe_videoInputItems(driver);
+
+	QMutexLocker locker(&cache_mutex);
+	cache_check_snapshot();
+	if(cache_videoIn.valid)
+		return cache_videoIn.items;
+
+	locker.unlock();
+	QList<Item> out = probe_videoInputItems(driver);
+	locker.relock();
+
+	cache_videoIn.items = out;
+	cache_videoIn.valid = true;
+	return out;
+}
+
+//----------------------------------------------------------------------------
+// Watcher
+//----------------------------------------------------------------------------
+// subscribe to kernel uevents directly over a netlink socket.  this is
+//   the same feed udevd consumes, but reading it ourselves avoids a
+//   libudev dependency.  each datagram is "action@devpath" followed by
+//   nul-separated KEY=VALUE pairs; we only care that something happened
+//   in a subsystem our probes look at, not what exactly, since the next
+//   lookup re-enumerates anyway.
+class Watcher::Private : public QObject
+{
+	Q_OBJECT
+
+public:
+	Watcher *q;
+	int fd;
+	QSocketNotifier *sn;
+	QTimer settleTimer;
+
+	Private(Watcher *_q) :
+		QObject(_q),
+		q(_q),
+		fd(-1),
+		sn(0)
+	{
+#ifdef Q_OS_LINUX
+		fd = socket(AF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
+		if(fd != -1)
+		{
+			struct sockaddr_nl snl;
+			memset(&snl, 0, sizeof(snl));
+			snl.nl_family = AF_NETLINK;
+			snl.nl_groups = 1; // kernel events
+			if(bind(fd, (struct sockaddr *)&snl, sizeof(snl)) == -1)
+			{
+				close(fd);
+				fd = -1;
+			}
+		}
+
+		if(fd != -1)
+		{
+			sn = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+			connect(sn, SIGNAL(activated(int)), SLOT(nl_activated()));
+		}
+#endif
+
+		// device nodes appear in bursts (one usb headset is several
+		//   sound devices), so wait for the burst to settle before
+		//   notifying
+		settleTimer.setSingleShot(true);
+		settleTimer.setInterval(250);
+		connect(&settleTimer, SIGNAL(timeout()), SLOT(settle_timeout()));
+	}
+
+	~Private()
+	{
+		if(fd != -1)
+			close(fd);
+	}
+
+private slots:
+	void nl_activated()
+	{
+#ifdef Q_OS_LINUX
+		char buf[4096];
+		int ret = recv(fd, buf, sizeof(buf) - 1, 0);
+		if(ret <= 0)
+			return;
+		buf[ret] = 0;
+
+		bool relevant = false;
+		for(int at = 0; at < ret; at += strlen(buf + at) + 1)
+		{
+			if(strcmp(buf + at, "SUBSYSTEM=sound") == 0 ||
+				strcmp(buf + at, "SUBSYSTEM=video4linux") == 0)
+			{
+				relevant = true;
+				break;
+			}
+		}
+		if(!relevant)
+			return;
+
+		cache_invalidate();
+		settleTimer.start();
+#endif
+	}
+
+	void settle_timeout()
+	{
+		emit q->changed();
+	}
+};
+
+Watcher::Watcher(QObject *parent) :
+	QObject(parent)
+{
+	d = new Private(this);
+}
+
+Watcher::~Watcher()
+{
+	delete d;
 }
+
+bool Watcher::isSupported() const
+{
+	return (d->fd != -1);
+}
+
+}
+
+#include "deviceenum_unix.moc"
@@ -76,4 +76,28 @@ QList<Item> videoInputItems(const QString &driver)
 	return out;
 }
 
+//----------------------------------------------------------------------------
+// Watcher
+//----------------------------------------------------------------------------
+// no monitoring here yet.  WM_DEVICECHANGE via a hidden window could
+//   back this, if anyone wants to wire it up.
+class Watcher::Private
+{
+};
+
+Watcher::Watcher(QObject *parent) :
+	QObject(parent),
+	d(0)
+{
+}
+
+Watcher::~Watcher()
+{
+}
+
+bool Watcher::isSupported() const
+{
+	return false;
+}
+
 }
@@ -246,6 +246,17 @@ static QString element_name_for_driver(const QString &driver, PDevice::Type type
 		if(type == PDevice::VideoIn)
 			element_name = "ksvideosrc";
 	}
+	else if(driver == "test")
+	{
+		// synthetic devices, reachable by device id (e.g. "test,")
+		//   but never enumerated.  used by the demo's load test mode
+		if(type == PDevice::AudioOut)
+			element_name = "fakesink";
+		else if(type == PDevice::AudioIn)
+			element_name = "audiotestsrc";
+		else if(type == PDevice::VideoIn)
+			element_name = "videotestsrc";
+	}
 
 	return element_name;
 }
@@ -276,6 +287,19 @@ static GstElement *make_element_with_device(const QString &element_name, const Q
 	if(!e)
 		return 0;
 
+	// synthetic devices: make the sources behave like live capture and
+	//   the sink consume at the realtime rate
+	if(element_name == "audiotestsrc" || element_name == "videotestsrc")
+	{
+		g_object_set(G_OBJECT(e), "is-live", TRUE, NULL);
+		return e;
+	}
+	else if(element_name == "fakesink")
+	{
+		g_object_set(G_OBJECT(e), "sync", TRUE, NULL);
+		return e;
+	}
+
 	if(!device_id.isEmpty())
 	{
 		// FIXME: is there a better way to determine if "device" is a string or int?
@@ -295,6 +319,40 @@ static GstElement *make_element_with_device(const QString &element_name, const Q
 		}
 	}
 
+	// opt in to the directsound sink's event-driven output mode.  value
+	//   is the desired segment size in milliseconds (floor of 10).  the
+	//   sink reports what it actually got via its read-only
+	//   achieved-latency-time property, so the result can be verified
+	//   on a live pipeline
+	if(element_name == "directsoundsink")
+	{
+		QByteArray val = qgetenv("PSI_DSOUND_LATENCY_MS");
+		if(!val.isEmpty())
+		{
+			int ms = val.toInt();
+			if(ms < 10)
+				ms = 10;
+			g_object_set(G_OBJECT(e), "low-latency", TRUE,
+				"latency-time", (gint64)ms * 1000, NULL);
+		}
+	}
+
+	// same idea for the osx sink, which sizes the coreaudio io-proc
+	//   buffer to match.  128 frames at 48khz is about 3ms, so allow
+	//   values down to 3
+	if(element_name == "osxaudiosink")
+	{
+		QByteArray val = qgetenv("PSI_OSX_LATENCY_MS");
+		if(!val.isEmpty())
+		{
+			int ms = val.toInt();
+			if(ms < 3)
+				ms = 3;
+			g_object_set(G_OBJECT(e), "low-latency", TRUE,
+				"latency-time", (gint64)ms * 1000, NULL);
+		}
+	}
+
 	return e;
 }
 
@@ -489,4 +547,118 @@ GstElement *devices_makeElement(const QString &id, PDevice::Type type, QSize *ca
 	return e;
 }
 
+// collect every int a caps field can express.  ranges contribute both
+//   ends, which is enough for a settings dialog to show the span
+static void collect_int_values(const GValue *v, QList<int> *out)
+{
+	if(G_VALUE_TYPE(v) == G_TYPE_INT)
+	{
+		if(!out->contains(g_value_get_int(v)))
+			*out += g_value_get_int(v);
+	}
+	else if(GST_VALUE_HOLDS_INT_RANGE(v))
+	{
+		int min = gst_value_get_int_range_min(v);
+		int max = gst_value_get_int_range_max(v);
+		if(!out->contains(min))
+			*out += min;
+		if(!out->contains(max))
+			*out += max;
+	}
+	else if(GST_VALUE_HOLDS_LIST(v))
+	{
+		for(guint n = 0; n < gst_value_list_get_size(v); ++n)
+			collect_int_values(gst_value_list_get_value(v, n), out);
+	}
+}
+
+// same idea for framerates, rounded to whole fps
+static void collect_fps_values(const GValue *v, QList<int> *out)
+{
+	if(GST_VALUE_HOLDS_FRACTION(v))
+	{
+		int num = gst_value_get_fraction_numerator(v);
+		int denom = gst_value_get_fraction_denominator(v);
+		if(denom > 0)
+		{
+			int fps = (num + denom / 2) / denom;
+			if(fps > 0 && !out->contains(fps))
+				*out += fps;
+		}
+	}
+	else if(GST_VALUE_HOLDS_FRACTION_RANGE(v))
+	{
+		collect_fps_values(gst_value_get_fraction_range_min(v), out);
+		collect_fps_values(gst_value_get_fraction_range_max(v), out);
+	}
+	else if(GST_VALUE_HOLDS_LIST(v))
+	{
+		for(guint n = 0; n < gst_value_list_get_size(v); ++n)
+			collect_fps_values(gst_value_list_get_value(v, n), out);
+	}
+}
+
+void devices_probeCaps(GstDevice *dev, PDevice::Type type)
+{
+	GstElement *e = devices_makeElement(dev->id, type);
+	if(!e)
+		return;
+
+	// devices_makeElement already brought the element to READY where
+	//   it could, which is when the caps reflect the actual hardware
+	GstPad *pad = gst_element_get_static_pad(e,
+		(type == PDevice::AudioOut) ? "sink" : "src");
+	if(pad)
+	{
+		GstCaps *caps = gst_pad_get_caps(pad);
+		if(caps)
+		{
+			for(guint n = 0; n < gst_caps_get_size(caps); ++n)
+			{
+				GstStructure *cs = gst_caps_get_structure(caps, n);
+
+				if(type == PDevice::VideoIn)
+				{
+					const GValue *vw = gst_structure_get_value(cs, "width");
+					const GValue *vh = gst_structure_get_value(cs, "height");
+					if(vw && vh)
+					{
+						QList<int> widths, heights;
+						collect_int_values(vw, &widths);
+						collect_int_values(vh, &heights);
+
+						// sizes pair up positionally: a discrete
+						//   mode gives one of each, a range gives
+						//   its two corners
+						for(int i = 0; i < widths.count() && i < heights.count(); ++i)
+						{
+							QSize size(widths[i], heights[i]);
+							if(!dev->videoSizes.contains(size))
+								dev->videoSizes += size;
+						}
+					}
+
+					const GValue *vf = gst_structure_get_value(cs, "framerate");
+					if(vf)
+						collect_fps_values(vf, &dev->videoFramerates);
+				}
+				else
+				{
+					const GValue *vr = gst_structure_get_value(cs, "rate");
+					if(vr)
+						collect_int_values(vr, &dev->audioSampleRates);
+				}
+			}
+
+			gst_caps_unref(caps);
+		}
+
+		gst_object_unref(GST_OBJECT(pad));
+	}
+
+	gst_element_set_state(e, GST_STATE_NULL);
+	gst_element_get_state(e, NULL, NULL, GST_CLOCK_TIME_NONE);
+	g_object_unref(G_OBJECT(e));
+}
+
 }
@@ -23,11 +23,10 @@
 
 #include <QString>
 #include <QList>
+#include <QSize>
 #include <gst/gstelement.h>
 #include "psimediaprovider.h"
 
-class QSize;
-
 namespace PsiMedia {
 
 class GstDevice
@@ -36,11 +35,22 @@ public:
 	QString name;
 	bool isDefault;
 	QString id;
+
+	// capabilities, filled in by devices_probeCaps.  empty when the
+	//   device wasn't probed or didn't report anything usable
+	QList<QSize> videoSizes;
+	QList<int> videoFramerates; // fps, rounded
+	QList<int> audioSampleRates;
 };
 
 QList<GstDevice> devices_list(PDevice::Type type);
 GstElement *devices_makeElement(const QString &id, PDevice::Type type, QSize *captureSize = 0);
 
+// open the device once and read the supported modes off its pad caps.
+//   one full device open per call, so only do this when the app asked
+//   for capabilities
+void devices_probeCaps(GstDevice *dev, PDevice::Type type);
+
 }
 
 #endif
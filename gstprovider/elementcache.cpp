@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "elementcache.h"
+
+#include <string.h>
+#include <QHash>
+#include <QList>
+#include <QByteArray>
+#include <QMutex>
+#include <gst/gstbin.h>
+#include <gst/gstutils.h>
+
+namespace PsiMedia {
+
+// only element types with no session identity are worth parking: pure
+//   converters and plumbing that every session creates several of and
+//   configures (if at all) entirely through properties.  payloaders,
+//   codecs, sinks and sources are excluded — they carry per-session
+//   configuration, callbacks or device handles
+static const char *cacheable_factories[] =
+{
+	"audioconvert",
+	"audioresample",
+	"ffmpegcolorspace",
+	"videoscale",
+	"videorate",
+	"capsfilter",
+	"volume",
+	"queue",
+	0
+};
+
+// enough for roughly two full sessions' worth of helpers.  past that,
+//   extras just get destroyed as before
+#define ELEMENTCACHE_MAX 32
+
+static QMutex cache_mutex;
+static QHash<QByteArray, QList<GstElement*> > cache_hash;
+static int cache_count = 0;
+
+static bool factory_is_cacheable(const char *name)
+{
+	for(int n = 0; cacheable_factories[n]; ++n)
+	{
+		if(strcmp(name, cacheable_factories[n]) == 0)
+			return true;
+	}
+	return false;
+}
+
+// return every writable property to its default, so a recycled element
+//   can't leak one session's configuration (queue limits, resampler
+//   quality, filter caps) into the next
+static void reset_element_properties(GstElement *e)
+{
+	guint count = 0;
+	GParamSpec **props = g_object_class_list_properties(G_OBJECT_GET_CLASS(e), &count);
+	for(guint n = 0; n < count; ++n)
+	{
+		GParamSpec *spec = props[n];
+
+		if(!(spec->flags & G_PARAM_WRITABLE) ||
+			(spec->flags & G_PARAM_CONSTRUCT_ONLY))
+		{
+			continue;
+		}
+
+		// the object name is identity, not configuration
+		if(strcmp(spec->name, "name") == 0)
+			continue;
+
+		GValue val;
+		memset(&val, 0, sizeof(GValue));
+		g_value_init(&val, spec->value_type);
+		g_param_value_set_default(spec, &val);
+		g_object_set_property(G_OBJECT(e), spec->name, &val);
+		g_value_unset(&val);
+	}
+	g_free(props);
+}
+
+// pad probes are "have-data" signal handlers underneath.  an element
+//   still carrying one is wired to its old session (meters, gates);
+//   recycling it would fire callbacks into a dead worker, so such
+//   elements are destroyed instead of parked
+static bool pads_have_handlers(GstElement *e)
+{
+	guint sigid = g_signal_lookup("have-data", GST_TYPE_PAD);
+	GQuark details[3];
+	details[0] = 0;
+	details[1] = g_quark_from_static_string("buffer");
+	details[2] = g_quark_from_static_string("event");
+
+	bool found = false;
+	GstIterator *it = gst_element_iterate_pads(e);
+	gpointer item;
+	while(gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+	{
+		GstPad *pad = (GstPad *)item;
+		for(int n = 0; n < 3; ++n)
+		{
+			if(g_signal_has_handler_pending(pad, sigid, details[n], TRUE))
+				found = true;
+		}
+		gst_object_unref(GST_OBJECT(pad));
+	}
+	gst_iterator_free(it);
+	return found;
+}
+
+GstElement *elementcache_make(const char *factoryName)
+{
+	GstElement *e = 0;
+
+	cache_mutex.lock();
+	QHash<QByteArray, QList<GstElement*> >::Iterator it = cache_hash.find(QByteArray(factoryName));
+	if(it != cache_hash.end() && !it.value().isEmpty())
+	{
+		e = it.value().takeLast();
+		--cache_count;
+	}
+	cache_mutex.unlock();
+
+	if(!e)
+		e = gst_element_factory_make(factoryName, NULL);
+	return e;
+}
+
+// takes ownership of one ref.  parks the element if it qualifies,
+//   destroys it otherwise
+static void elementcache_park(GstElement *e)
+{
+	GstElementFactory *factory = gst_element_get_factory(e);
+	const char *name = factory ? gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)) : 0;
+
+	if(!name || !factory_is_cacheable(name) || pads_have_handlers(e))
+	{
+		gst_object_unref(GST_OBJECT(e));
+		return;
+	}
+
+	reset_element_properties(e);
+
+	cache_mutex.lock();
+	if(cache_count < ELEMENTCACHE_MAX)
+	{
+		cache_hash[QByteArray(name)] += e;
+		++cache_count;
+		cache_mutex.unlock();
+		return;
+	}
+	cache_mutex.unlock();
+
+	gst_object_unref(GST_OBJECT(e));
+}
+
+void elementcache_park_bin(GstBin *bin)
+{
+	// snapshot the children first: removing while iterating invalidates
+	//   the iterator
+	QList<GstElement*> children;
+	GstIterator *it = gst_bin_iterate_elements(bin);
+	gpointer item;
+	while(gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+	{
+		// the iterator refs each item; keep that ref as ours
+		children += (GstElement *)item;
+	}
+	gst_iterator_free(it);
+
+	foreach(GstElement *e, children)
+	{
+		if(GST_IS_BIN(e))
+		{
+			elementcache_park_bin(GST_BIN(e));
+			gst_object_unref(GST_OBJECT(e));
+			continue;
+		}
+
+		GstElementFactory *factory = gst_element_get_factory(e);
+		const char *name = factory ? gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)) : 0;
+		if(name && factory_is_cacheable(name))
+		{
+			// pulling the child out drops the bin's ref and breaks its
+			//   links; our iterator ref keeps it alive for parking
+			gst_bin_remove(bin, e);
+			elementcache_park(e);
+		}
+		else
+			gst_object_unref(GST_OBJECT(e));
+	}
+}
+
+}
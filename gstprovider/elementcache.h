@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef ELEMENTCACHE_H
+#define ELEMENTCACHE_H
+
+#include <gst/gstelement.h>
+
+namespace PsiMedia {
+
+// a small cache of stateless helper elements (converters, resamplers,
+//   queues and the like), for workloads that create and destroy many
+//   short sessions.  a cached element is parked in NULL state with all
+//   properties back at their defaults, so taking one is
+//   indistinguishable from a fresh gst_element_factory_make, minus the
+//   registry lookup and object construction.  all functions are
+//   thread-safe
+
+// like gst_element_factory_make(factoryName, NULL), but served from
+//   the cache when a parked instance is available
+GstElement *elementcache_make(const char *factoryName);
+
+// sweep a torn-down bin (recursively) for cacheable children and park
+//   them for the next session; everything else stays put and dies with
+//   the bin.  the bin and all children must already be in NULL state
+void elementcache_park_bin(GstBin *bin);
+
+}
+
+#endif
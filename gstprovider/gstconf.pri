@@ -39,4 +39,7 @@ windows {
 
 unix {
 	LIBS += -lgstvideo-0.10 -lgstinterfaces-0.10
+
+	# shm_open (shmframering.cpp) lives in librt on older glibc
+	!mac:LIBS += -lrt
 }
@@ -25,6 +25,7 @@
 GST_BOILERPLATE(GstAppRtpSink, gst_apprtpsink, GstBaseSink, GST_TYPE_BASE_SINK);
 
 static GstFlowReturn gst_apprtpsink_render(GstBaseSink *sink, GstBuffer *buffer);
+static GstFlowReturn gst_apprtpsink_render_list(GstBaseSink *sink, GstBufferList *list);
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink",
 	GST_PAD_SINK,
@@ -53,6 +54,7 @@ void gst_apprtpsink_class_init(GstAppRtpSinkClass *klass)
 	GstBaseSinkClass *basesink_class;
 	basesink_class = (GstBaseSinkClass *)klass;
 	basesink_class->render = gst_apprtpsink_render;
+	basesink_class->render_list = gst_apprtpsink_render_list;
 }
 
 // instance init
@@ -62,6 +64,7 @@ void gst_apprtpsink_init(GstAppRtpSink *sink, GstAppRtpSinkClass *gclass)
 
 	sink->appdata = 0;
 	sink->packet_ready = 0;
+	sink->packets_ready = 0;
 }
 
 GstFlowReturn gst_apprtpsink_render(GstBaseSink *sink, GstBuffer *buffer)
@@ -76,3 +79,77 @@ GstFlowReturn gst_apprtpsink_render(GstBaseSink *sink, GstBuffer *buffer)
 
 	return GST_FLOW_OK;
 }
+
+GstFlowReturn gst_apprtpsink_render_list(GstBaseSink *sink, GstBufferList *list)
+{
+	GstAppRtpSink *self = (GstAppRtpSink *)sink;
+	GstBufferListIterator *it;
+	GstAppRtpPacket *packets;
+	GstBuffer **merged;
+	guint groups;
+	int count;
+	int nmerged;
+	int n;
+
+	// each group in the list is one complete rtp packet, possibly
+	//   split over several buffers (the payloader emits header +
+	//   payload).  flatten the groups and deliver the whole list in a
+	//   single callback, so the app can batch its socket writes
+
+	groups = gst_buffer_list_n_groups(list);
+	if(groups == 0)
+		return GST_FLOW_OK;
+
+	packets = g_newa(GstAppRtpPacket, groups);
+	merged = g_newa(GstBuffer *, groups);
+	count = 0;
+	nmerged = 0;
+
+	it = gst_buffer_list_iterate(list);
+	while(gst_buffer_list_iterator_next_group(it))
+	{
+		GstBuffer *first = gst_buffer_list_iterator_next(it);
+		GstBuffer *buf;
+		GstBuffer *m = NULL;
+
+		if(!first)
+			continue;
+
+		// the single-buffer case is the common one, and needs no copy
+		while((buf = gst_buffer_list_iterator_next(it)))
+		{
+			GstBuffer *joined = gst_buffer_merge(m ? m : first, buf);
+			if(m)
+				gst_buffer_unref(m);
+			m = joined;
+		}
+
+		if(m)
+			merged[nmerged++] = m;
+		else
+			m = first;
+
+		packets[count].buf = GST_BUFFER_DATA(m);
+		packets[count].size = GST_BUFFER_SIZE(m);
+		++count;
+	}
+	gst_buffer_list_iterator_free(it);
+
+	if(count > 0)
+	{
+		if(self->packets_ready)
+		{
+			self->packets_ready(packets, count, self->appdata);
+		}
+		else if(self->packet_ready)
+		{
+			for(n = 0; n < count; ++n)
+				self->packet_ready(packets[n].buf, packets[n].size, self->appdata);
+		}
+	}
+
+	for(n = 0; n < nmerged; ++n)
+		gst_buffer_unref(merged[n]);
+
+	return GST_FLOW_OK;
+}
@@ -21,10 +21,42 @@
 #include "gstcustomelements.h"
 
 #include "gstboilerplatefixed.h"
+#include "rtppacketpool.h"
+#include "bufmon.h"
 #include <string.h>
 
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <time.h>
+# include <sys/time.h>
+#endif
+
 #define APPRTPSRC_MAX_BUF_COUNT 32
 
+// same clock as the arrival stamps the app provides (and as the
+//   provider's monotime_ns()), so the age of a packet is a plain
+//   difference
+static gint64 apprtpsrc_now_ns(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	if(freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (gint64)((double)now.QuadPart * (1000000000.0 / (double)freq.QuadPart));
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((gint64)ts.tv_sec * G_GINT64_CONSTANT(1000000000)) + ts.tv_nsec;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return ((gint64)tv.tv_sec * G_GINT64_CONSTANT(1000000000)) + ((gint64)tv.tv_usec * 1000);
+#endif
+}
+
 GST_BOILERPLATE(GstAppRtpSrc, gst_apprtpsrc, GstPushSrc, GST_TYPE_PUSH_SRC);
 
 enum
@@ -102,6 +134,7 @@ void gst_apprtpsrc_init(GstAppRtpSrc *src, GstAppRtpSrcClass *gclass)
 	src->push_cond = g_cond_new();
 	src->quit = FALSE; // not flushing
 	src->caps = 0;
+	src->bufmon_site = -1;
 
 	// set up the base (adapted from udpsrc)
 
@@ -118,7 +151,10 @@ void gst_apprtpsrc_init(GstAppRtpSrc *src, GstAppRtpSrcClass *gclass)
 static void my_foreach_func(gpointer data, gpointer user_data)
 {
 	GstBuffer *buf = (GstBuffer *)data;
-	(void)user_data;
+	GstAppRtpSrc *src = (GstAppRtpSrc *)user_data;
+
+	if(src->bufmon_site != -1)
+		psi_bufmon_remove(src->bufmon_site);
 	gst_buffer_unref(buf);
 }
 
@@ -126,7 +162,7 @@ void gst_apprtpsrc_finalize(GObject *obj)
 {
 	GstAppRtpSrc *src = (GstAppRtpSrc *)obj;
 
-	g_queue_foreach(src->buffers, my_foreach_func, NULL);
+	g_queue_foreach(src->buffers, my_foreach_func, src);
 	g_queue_free(src->buffers);
 	g_mutex_free(src->push_mutex);
 	g_cond_free(src->push_cond);
@@ -194,12 +230,20 @@ GstFlowReturn gst_apprtpsrc_create(GstPushSrc *bsrc, GstBuffer **buf)
 	*buf = (GstBuffer *)g_queue_pop_head(src->buffers);
 	gst_buffer_set_caps(*buf, src->caps);
 
+	if(src->bufmon_site != -1)
+		psi_bufmon_remove(src->bufmon_site);
+
 	g_mutex_unlock(src->push_mutex);
 
 	return GST_FLOW_OK;
 }
 
 void gst_apprtpsrc_packet_push(GstAppRtpSrc *src, const unsigned char *buf, int size)
+{
+	gst_apprtpsrc_packet_push_full(src, buf, size, -1);
+}
+
+void gst_apprtpsrc_packet_push_full(GstAppRtpSrc *src, const unsigned char *buf, int size, gint64 arrival_ns)
 {
 	GstBuffer *newbuf;
 
@@ -207,7 +251,11 @@ void gst_apprtpsrc_packet_push(GstAppRtpSrc *src, const unsigned char *buf, int
 
 	// if buffer is full, eat the oldest to make room
 	if(g_queue_get_length(src->buffers) >= APPRTPSRC_MAX_BUF_COUNT)
-		g_queue_pop_head(src->buffers);
+	{
+		gst_buffer_unref((GstBuffer *)g_queue_pop_head(src->buffers));
+		if(src->bufmon_site != -1)
+			psi_bufmon_remove(src->bufmon_site);
+	}
 
 	// ignore zero-byte packets
 	if(size < 1)
@@ -216,14 +264,58 @@ void gst_apprtpsrc_packet_push(GstAppRtpSrc *src, const unsigned char *buf, int
 		return;
 	}
 
-	newbuf = gst_buffer_new_and_alloc(size);
+	newbuf = gst_rtppacketpool_alloc(size);
 	memcpy(GST_BUFFER_DATA(newbuf), buf, size);
+
+	// when the caller knows the wire arrival time, stamp the buffer
+	//   with the running time of that moment instead of leaving it for
+	//   basesrc, which would stamp it when create() pops it off the
+	//   queue.  basesrc's do-timestamp only fills in buffers that have
+	//   no timestamp yet, so a stamp set here survives.  the delay
+	//   between socket and media thread then stops looking like network
+	//   jitter downstream
+	if(arrival_ns >= 0)
+	{
+		GstClock *clock = gst_element_get_clock(GST_ELEMENT(src));
+		if(clock)
+		{
+			GstClockTime base = gst_element_get_base_time(GST_ELEMENT(src));
+			GstClockTime now = gst_clock_get_time(clock);
+			gst_object_unref(GST_OBJECT(clock));
+
+			if(GST_CLOCK_TIME_IS_VALID(base) && now >= base)
+			{
+				GstClockTime running = now - base;
+				gint64 age = apprtpsrc_now_ns() - arrival_ns;
+
+				// a nonsense stamp (from the future, or older than
+				//   the pipeline) falls back to stamping at push time
+				if(age < 0)
+					age = 0;
+				if((GstClockTime)age <= running)
+					GST_BUFFER_TIMESTAMP(newbuf) = running - (GstClockTime)age;
+				else
+					GST_BUFFER_TIMESTAMP(newbuf) = running;
+			}
+		}
+	}
+
 	g_queue_push_tail(src->buffers, newbuf);
 
+	if(src->bufmon_site != -1)
+		psi_bufmon_add(src->bufmon_site);
+
 	g_cond_signal(src->push_cond);
 	g_mutex_unlock(src->push_mutex);
 }
 
+void gst_apprtpsrc_set_bufmon_site(GstAppRtpSrc *src, int site)
+{
+	g_mutex_lock(src->push_mutex);
+	src->bufmon_site = site;
+	g_mutex_unlock(src->push_mutex);
+}
+
 void gst_apprtpsrc_set_property(GObject *obj, guint prop_id, const GValue *value, GParamSpec *pspec)
 {
 	GstAppRtpSrc *src = (GstAppRtpSrc *)obj;
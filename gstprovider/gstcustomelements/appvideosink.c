@@ -20,16 +20,28 @@
 
 #include "gstcustomelements.h"
 
+#include <string.h>
 #include "gstboilerplatefixed.h"
 
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+# include <arm_neon.h>
+#endif
+
 GST_BOILERPLATE(GstAppVideoSink, gst_appvideosink, GstVideoSink, GST_TYPE_VIDEO_SINK);
 
 static GstFlowReturn gst_appvideosink_render(GstBaseSink *sink, GstBuffer *buffer);
 
+// we accept I420 natively and convert to 32-bit rgb ourselves, which is
+//   vectorized where possible and lets the pipeline skip the generic
+//   ffmpegcolorspace element.  I420 comes first in the caps so that
+//   negotiation prefers the direct path.
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink",
 	GST_PAD_SINK,
 	GST_PAD_ALWAYS,
 	GST_STATIC_CAPS(
+		GST_VIDEO_CAPS_YUV("I420") ";"
 #if G_BYTE_ORDER == G_LITTLE_ENDIAN
 		GST_VIDEO_CAPS_BGRx
 #else
@@ -38,6 +50,140 @@ static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink",
 		)
 	);
 
+// the conversion uses the usual bt.601 integer approximation, with the
+//   coefficients scaled to >>6.  the products fit in signed 16-bit
+//   lanes, but the per-channel sums can exceed 32767 for full-range
+//   input (e.g. b at y=255, u>=245, as produced by jpegdec), so the
+//   accumulations use saturating adds — the clamp at 32767 lands on
+//   the same 255 the scalar path produces:
+//
+//   r = (74*(y-16)           + 102*(v-128)) >> 6
+//   g = (74*(y-16) - 25*(u-128) - 52*(v-128)) >> 6
+//   b = (74*(y-16) + 129*(u-128)          ) >> 6
+
+static inline guint8 clamp_u8(int v)
+{
+	if(v < 0)
+		return 0;
+	else if(v > 255)
+		return 255;
+	else
+		return (guint8)v;
+}
+
+// convert one row of I420 to 32-bit rgb.  u/v point at the chroma row
+//   shared by this luma row
+static void i420_row_to_rgb32(const guint8 *y, const guint8 *u, const guint8 *v, guint8 *out, int width)
+{
+	int n = 0;
+
+#if defined(__SSE2__)
+	{
+		const __m128i c16 = _mm_set1_epi16(16);
+		const __m128i c128 = _mm_set1_epi16(128);
+		const __m128i cy = _mm_set1_epi16(74);
+		const __m128i crv = _mm_set1_epi16(102);
+		const __m128i cgu = _mm_set1_epi16(25);
+		const __m128i cgv = _mm_set1_epi16(52);
+		const __m128i cbu = _mm_set1_epi16(129);
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i alpha = _mm_set1_epi8((char)0xff);
+
+		for(; n + 8 <= width; n += 8)
+		{
+			__m128i yv, uv, vv, rr, gg, bb, bg, ra, lo, hi;
+
+			// 8 luma samples, 4 chroma samples doubled up
+			yv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(y + n)), zero);
+			uv = _mm_cvtsi32_si128(*(const guint32 *)(u + n / 2));
+			vv = _mm_cvtsi32_si128(*(const guint32 *)(v + n / 2));
+			uv = _mm_unpacklo_epi8(uv, uv);
+			vv = _mm_unpacklo_epi8(vv, vv);
+			uv = _mm_unpacklo_epi8(uv, zero);
+			vv = _mm_unpacklo_epi8(vv, zero);
+
+			yv = _mm_mullo_epi16(_mm_sub_epi16(yv, c16), cy);
+			uv = _mm_sub_epi16(uv, c128);
+			vv = _mm_sub_epi16(vv, c128);
+
+			rr = _mm_adds_epi16(yv, _mm_mullo_epi16(vv, crv));
+			gg = _mm_subs_epi16(yv, _mm_adds_epi16(_mm_mullo_epi16(uv, cgu), _mm_mullo_epi16(vv, cgv)));
+			bb = _mm_adds_epi16(yv, _mm_mullo_epi16(uv, cbu));
+
+			// >>6 and clamp to bytes
+			rr = _mm_packus_epi16(_mm_srai_epi16(rr, 6), zero);
+			gg = _mm_packus_epi16(_mm_srai_epi16(gg, 6), zero);
+			bb = _mm_packus_epi16(_mm_srai_epi16(bb, 6), zero);
+
+			// interleave to b,g,r,x
+			bg = _mm_unpacklo_epi8(bb, gg);
+			ra = _mm_unpacklo_epi8(rr, alpha);
+			lo = _mm_unpacklo_epi16(bg, ra);
+			hi = _mm_unpackhi_epi16(bg, ra);
+			_mm_storeu_si128((__m128i *)(out + n * 4), lo);
+			_mm_storeu_si128((__m128i *)(out + n * 4 + 16), hi);
+		}
+	}
+#elif defined(__ARM_NEON__)
+	{
+		const int16x8_t c16 = vdupq_n_s16(16);
+		const int16x8_t c128 = vdupq_n_s16(128);
+
+		for(; n + 8 <= width; n += 8)
+		{
+			uint8x8_t u4, v4;
+			int16x8_t yv, uv, vv, rr, gg, bb;
+			uint8x8x4_t pix;
+
+			yv = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + n)));
+
+			// double up 4 chroma samples to 8 lanes
+			u4 = vld1_u8(u + n / 2);
+			v4 = vld1_u8(v + n / 2);
+			u4 = vzip_u8(u4, u4).val[0];
+			v4 = vzip_u8(v4, v4).val[0];
+			uv = vreinterpretq_s16_u16(vmovl_u8(u4));
+			vv = vreinterpretq_s16_u16(vmovl_u8(v4));
+
+			yv = vmulq_n_s16(vsubq_s16(yv, c16), 74);
+			uv = vsubq_s16(uv, c128);
+			vv = vsubq_s16(vv, c128);
+
+			rr = vqaddq_s16(yv, vmulq_n_s16(vv, 102));
+			gg = vqsubq_s16(yv, vqaddq_s16(vmulq_n_s16(uv, 25), vmulq_n_s16(vv, 52)));
+			bb = vqaddq_s16(yv, vmulq_n_s16(uv, 129));
+
+			pix.val[0] = vqshrun_n_s16(bb, 6);
+			pix.val[1] = vqshrun_n_s16(gg, 6);
+			pix.val[2] = vqshrun_n_s16(rr, 6);
+			pix.val[3] = vdup_n_u8(0xff);
+			vst4_u8(out + n * 4, pix);
+		}
+	}
+#endif
+
+	for(; n < width; ++n)
+	{
+		int c = (y[n] - 16) * 74;
+		int d = u[n / 2] - 128;
+		int e = v[n / 2] - 128;
+		guint8 r = clamp_u8((c + 102 * e) >> 6);
+		guint8 g = clamp_u8((c - 25 * d - 52 * e) >> 6);
+		guint8 b = clamp_u8((c + 129 * d) >> 6);
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+		out[n * 4 + 0] = b;
+		out[n * 4 + 1] = g;
+		out[n * 4 + 2] = r;
+		out[n * 4 + 3] = 0xff;
+#else
+		out[n * 4 + 0] = 0xff;
+		out[n * 4 + 1] = r;
+		out[n * 4 + 2] = g;
+		out[n * 4 + 3] = b;
+#endif
+	}
+}
+
 void gst_appvideosink_base_init(gpointer gclass)
 {
 	static GstElementDetails element_details = GST_ELEMENT_DETAILS(
@@ -68,6 +214,13 @@ void gst_appvideosink_init(GstAppVideoSink *sink, GstAppVideoSinkClass *gclass)
 
 	sink->appdata = 0;
 	sink->show_frame = 0;
+	sink->show_frame_yuv = 0;
+	sink->shm_arena = 0;
+	sink->shm_slot_size = 0;
+	sink->shm_slot_count = 0;
+	sink->shm_next_slot = 0;
+	sink->show_frame_shm = 0;
+	sink->frame_wanted = 0;
 }
 
 GstFlowReturn gst_appvideosink_render(GstBaseSink *sink, GstBuffer *buffer)
@@ -78,6 +231,24 @@ GstFlowReturn gst_appvideosink_render(GstBaseSink *sink, GstBuffer *buffer)
 	GstStructure *structure;
 	GstAppVideoSink *self = (GstAppVideoSink *)sink;
 
+	// qos gate: if the consumer is backlogged, drop the frame before
+	//   spending anything on conversion, and tell upstream so the
+	//   decoder can shed work for as long as we stay behind.  asking
+	//   for half rate is a gentle but effective signal; the gate
+	//   reopens the moment the consumer catches up
+	if(self->frame_wanted && !self->frame_wanted(self->appdata))
+	{
+		if(GST_BUFFER_TIMESTAMP_IS_VALID(buffer))
+		{
+			GstClockTimeDiff lag = 0;
+			if(GST_BUFFER_DURATION_IS_VALID(buffer))
+				lag = (GstClockTimeDiff)GST_BUFFER_DURATION(buffer);
+			gst_pad_push_event(GST_BASE_SINK_PAD(sink),
+				gst_event_new_qos(0.5, lag, GST_BUFFER_TIMESTAMP(buffer)));
+		}
+		return GST_FLOW_OK;
+	}
+
 	caps = GST_BUFFER_CAPS(buffer);
 	structure = gst_caps_get_structure(caps, 0);
 
@@ -88,13 +259,107 @@ GstFlowReturn gst_appvideosink_render(GstBaseSink *sink, GstBuffer *buffer)
 		return GST_FLOW_ERROR;
 	}
 
+	if(strcmp(gst_structure_get_name(structure), "video/x-raw-yuv") == 0)
+	{
+		guint32 fourcc;
+		int ystride, uvstride, row;
+		const guint8 *py, *pu, *pv;
+		GstBuffer *rgb;
+
+		if(!gst_structure_get_fourcc(structure, "format", &fourcc) ||
+			fourcc != GST_MAKE_FOURCC('I', '4', '2', '0'))
+		{
+			return GST_FLOW_ERROR;
+		}
+
+		size = GST_BUFFER_SIZE(buffer);
+		if((unsigned int)size < gst_video_format_get_size(GST_VIDEO_FORMAT_I420, width, height))
+			return GST_FLOW_ERROR;
+
+		ystride = gst_video_format_get_row_stride(GST_VIDEO_FORMAT_I420, 0, width);
+		uvstride = gst_video_format_get_row_stride(GST_VIDEO_FORMAT_I420, 1, width);
+		py = GST_BUFFER_DATA(buffer) + gst_video_format_get_component_offset(GST_VIDEO_FORMAT_I420, 0, width, height);
+		pu = GST_BUFFER_DATA(buffer) + gst_video_format_get_component_offset(GST_VIDEO_FORMAT_I420, 1, width, height);
+		pv = GST_BUFFER_DATA(buffer) + gst_video_format_get_component_offset(GST_VIDEO_FORMAT_I420, 2, width, height);
+
+		// direct mode: hand over the planes untouched, no conversion
+		if(self->show_frame_yuv)
+		{
+			GstAppYuvFrame frame;
+			frame.width = width;
+			frame.height = height;
+			frame.planes[0] = py;
+			frame.planes[1] = pu;
+			frame.planes[2] = pv;
+			frame.strides[0] = ystride;
+			frame.strides[1] = uvstride;
+			frame.strides[2] = uvstride;
+			frame.buffer = buffer;
+			self->show_frame_yuv(&frame, self->appdata);
+			return GST_FLOW_OK;
+		}
+
+		// shm export: convert straight into the next ring slot, so the
+		//   renderer process reads the pixels with no further copies
+		//   anywhere inside us
+		if(self->shm_arena && self->show_frame_shm &&
+			width * height * 4 <= self->shm_slot_size)
+		{
+			int slot = self->shm_next_slot;
+			guint8 *out = self->shm_arena + slot * self->shm_slot_size;
+
+			for(row = 0; row < height; ++row)
+			{
+				i420_row_to_rgb32(py + row * ystride,
+					pu + (row / 2) * uvstride,
+					pv + (row / 2) * uvstride,
+					out + row * width * 4,
+					width);
+			}
+
+			self->shm_next_slot = (slot + 1) % self->shm_slot_count;
+			self->show_frame_shm(width, height, slot, self->appdata);
+			return GST_FLOW_OK;
+		}
+
+		rgb = gst_buffer_new_and_alloc(width * height * 4);
+		for(row = 0; row < height; ++row)
+		{
+			i420_row_to_rgb32(py + row * ystride,
+				pu + (row / 2) * uvstride,
+				pv + (row / 2) * uvstride,
+				GST_BUFFER_DATA(rgb) + row * width * 4,
+				width);
+		}
+
+		// the callback refs the buffer if it needs it past the call
+		if(self->show_frame)
+			self->show_frame(width, height, rgb, self->appdata);
+
+		gst_buffer_unref(rgb);
+		return GST_FLOW_OK;
+	}
+
 	// make sure buffer size matches width * height * 32 bit rgb
 	size = GST_BUFFER_SIZE(buffer);
 	if(width * height * 4 != size)
 		return GST_FLOW_ERROR;
 
+	// rgb arrived already converted upstream; exporting costs one copy
+	//   into the slot.  negotiation prefers I420, so this path is rare
+	if(self->shm_arena && self->show_frame_shm && size <= self->shm_slot_size)
+	{
+		int slot = self->shm_next_slot;
+
+		memcpy(self->shm_arena + slot * self->shm_slot_size,
+			GST_BUFFER_DATA(buffer), size);
+		self->shm_next_slot = (slot + 1) % self->shm_slot_count;
+		self->show_frame_shm(width, height, slot, self->appdata);
+		return GST_FLOW_OK;
+	}
+
 	if(self->show_frame)
-		self->show_frame(width, height, GST_BUFFER_DATA(buffer), self->appdata);
+		self->show_frame(width, height, buffer, self->appdata);
 
 	return GST_FLOW_OK;
 }
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2008  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "bufmon.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static gint site_live[PSI_BUFMON_SITE_COUNT];
+static gint site_high[PSI_BUFMON_SITE_COUNT];
+
+static const char *site_names[PSI_BUFMON_SITE_COUNT] =
+{
+	"audio_packets_in",
+	"video_packets_in",
+	"audio_packets_out",
+	"video_packets_out",
+	"frames",
+	"record_chunks",
+	"pool_slots"
+};
+
+// -1 = not checked yet
+static gint enabled_state = -1;
+
+int psi_bufmon_enabled(void)
+{
+	gint state = g_atomic_int_get(&enabled_state);
+	if(state == -1)
+	{
+		const char *val = getenv("PSI_BUFMON");
+		state = (val && strcmp(val, "1") == 0) ? 1 : 0;
+		g_atomic_int_set(&enabled_state, state);
+	}
+	return state;
+}
+
+void psi_bufmon_add(int site)
+{
+	gint now, high;
+
+	if(!psi_bufmon_enabled())
+		return;
+	if(site < 0 || site >= PSI_BUFMON_SITE_COUNT)
+		return;
+
+	g_atomic_int_inc(&site_live[site]);
+	now = g_atomic_int_get(&site_live[site]);
+
+	// racy max is fine to lose occasionally, but never goes backwards
+	while(1)
+	{
+		high = g_atomic_int_get(&site_high[site]);
+		if(now <= high)
+			break;
+		if(g_atomic_int_compare_and_exchange(&site_high[site], high, now))
+			break;
+	}
+}
+
+void psi_bufmon_remove(int site)
+{
+	if(!psi_bufmon_enabled())
+		return;
+	if(site < 0 || site >= PSI_BUFMON_SITE_COUNT)
+		return;
+
+	(void)g_atomic_int_dec_and_test(&site_live[site]);
+}
+
+void psi_bufmon_query(int site, int *live, int *high)
+{
+	if(site < 0 || site >= PSI_BUFMON_SITE_COUNT)
+	{
+		if(live)
+			*live = 0;
+		if(high)
+			*high = 0;
+		return;
+	}
+
+	if(live)
+		*live = (int)g_atomic_int_get(&site_live[site]);
+	if(high)
+		*high = (int)g_atomic_int_get(&site_high[site]);
+}
+
+const char *psi_bufmon_site_name(int site)
+{
+	if(site < 0 || site >= PSI_BUFMON_SITE_COUNT)
+		return "";
+	return site_names[site];
+}
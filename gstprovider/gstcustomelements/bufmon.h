@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2008  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef BUFMON_H
+#define BUFMON_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Live-object instrumentation for buffer lifecycles.  Each site is a
+//   place where buffers can sit referenced but out of sight of normal
+//   tooling (queued packets, parked frames, pool slots, record chunks).
+//   Sites count adds and removes, so a reference that never comes back
+//   shows up as a named counter that only climbs, instead of anonymous
+//   RSS growth after a soak run.
+//
+// Enabled with PSI_BUFMON=1.  When disabled, add/remove are a cached
+//   flag test and nothing else.  Counters are process-wide, like the
+//   packet pool.
+
+typedef enum
+{
+	PSI_BUFMON_PACKET_IN_AUDIO,  // app -> pipeline, queued in apprtpsrc
+	PSI_BUFMON_PACKET_IN_VIDEO,
+	PSI_BUFMON_PACKET_OUT_AUDIO, // pipeline -> app, queued in the channel
+	PSI_BUFMON_PACKET_OUT_VIDEO,
+	PSI_BUFMON_FRAME,            // frames parked in the latest-frame slots
+	PSI_BUFMON_RECORD,           // record chunks queued toward the writer
+	PSI_BUFMON_POOL,             // rtp packet pool slots checked out
+	PSI_BUFMON_SITE_COUNT
+} PsiBufmonSite;
+
+int psi_bufmon_enabled(void);
+
+void psi_bufmon_add(int site);
+void psi_bufmon_remove(int site);
+
+// current live count and the highest it has ever been
+void psi_bufmon_query(int site, int *live, int *high);
+
+// stable lowercase identifier, e.g. "audio_packets_out"
+const char *psi_bufmon_site_name(int site);
+
+G_END_DECLS
+
+#endif
@@ -83,12 +83,51 @@ typedef struct _GstAppRtpSinkClass GstAppRtpSinkClass;
 
 // GstAppVideoSink
 
+// a decoded I420 frame, described in place.  the planes point into the
+//   backing buffer; ref it to keep the data past the callback
+typedef struct
+{
+	int width;
+	int height;
+	const guint8 *planes[3]; // y, u, v
+	int strides[3];
+	GstBuffer *buffer;
+} GstAppYuvFrame;
+
 struct _GstAppVideoSink
 {
 	GstVideoSink parent;
 
 	gpointer appdata;
-	void (*show_frame)(int width, int height, const unsigned char *rgb32, gpointer appdata);
+
+	// the buffer is only guaranteed to exist for the duration of the
+	//   callback.  take a ref if you need it longer.
+	void (*show_frame)(int width, int height, GstBuffer *buf, gpointer appdata);
+
+	// optional.  if set, I420 input is handed over as-is with plane
+	//   pointers and strides, and no rgb conversion happens at all.
+	//   consumers that can take planar yuv directly (gl upload,
+	//   encoders) should use this; show_frame remains the path for
+	//   rgb-only painting
+	void (*show_frame_yuv)(const GstAppYuvFrame *frame, gpointer appdata);
+
+	// optional shared-memory export.  when arena is set (and the frame
+	//   fits a slot), converted rgb32 pixels are written straight into
+	//   ring slots in the arena instead of heap buffers, and
+	//   show_frame_shm reports which slot.  set all fields before the
+	//   pipeline starts.  frames that don't fit fall back to show_frame
+	guint8 *shm_arena;
+	int shm_slot_size;
+	int shm_slot_count;
+	int shm_next_slot;
+	void (*show_frame_shm)(int width, int height, int slot, gpointer appdata);
+
+	// optional qos gate, consulted before any conversion work.  return
+	//   FALSE to drop the buffer because the consumer hasn't kept up;
+	//   the sink then sends a qos event upstream so a decoder that
+	//   understands qos can skip effort on frames that would be
+	//   dropped anyway
+	gboolean (*frame_wanted)(gpointer appdata);
 };
 
 struct _GstAppVideoSinkClass
@@ -110,6 +149,10 @@ struct _GstAppRtpSrc
 	gboolean quit;
 
 	GstCaps *caps;
+
+	// live-object instrumentation site for the queue (see bufmon.h),
+	//   or -1 to not count
+	int bufmon_site;
 };
 
 struct _GstAppRtpSrcClass
@@ -120,14 +163,34 @@ struct _GstAppRtpSrcClass
 GType gst_apprtpsrc_get_type(void);
 void gst_apprtpsrc_packet_push(GstAppRtpSrc *src, const unsigned char *buf, int size);
 
+// like packet_push, but with the packet's wire arrival time in
+//   monotonic nanoseconds (-1 = unknown).  when known, the buffer is
+//   timestamped at its arrival rather than at push time, so queuing
+//   delay between the socket and this element doesn't read as jitter
+void gst_apprtpsrc_packet_push_full(GstAppRtpSrc *src, const unsigned char *buf, int size, gint64 arrival_ns);
+void gst_apprtpsrc_set_bufmon_site(GstAppRtpSrc *src, int site);
+
 // GstAppRtpSink
 
+// one entry of a batched packet delivery.  the data is only guaranteed
+//   to exist for the duration of the callback
+typedef struct
+{
+	const unsigned char *buf;
+	int size;
+} GstAppRtpPacket;
+
 struct _GstAppRtpSink
 {
 	GstBaseSink parent;
 
 	gpointer appdata;
 	void (*packet_ready)(const unsigned char *buf, int size, gpointer appdata);
+
+	// optional.  if set, a pushed buffer list is delivered as a single
+	//   call carrying all of its packets, instead of one packet_ready
+	//   call per buffer.  lone buffers still arrive via packet_ready.
+	void (*packets_ready)(const GstAppRtpPacket *packets, int count, gpointer appdata);
 };
 
 struct _GstAppRtpSinkClass
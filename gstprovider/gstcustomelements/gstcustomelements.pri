@@ -1,8 +1,12 @@
 HEADERS += \
-	$$PWD/gstcustomelements.h
+	$$PWD/gstcustomelements.h \
+	$$PWD/rtppacketpool.h \
+	$$PWD/bufmon.h
 
 SOURCES += \
 	$$PWD/gstcustomelements.c \
 	$$PWD/appvideosink.c \
 	$$PWD/apprtpsrc.c \
-	$$PWD/apprtpsink.c
+	$$PWD/apprtpsink.c \
+	$$PWD/rtppacketpool.c \
+	$$PWD/bufmon.c
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2008  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "rtppacketpool.h"
+#include "bufmon.h"
+
+// an rtp packet over udp can't usefully exceed the path mtu, so
+//   ethernet-sized slots cover the steady state.  the count is sized for
+//   several simultaneous sessions worth of in-flight packets.
+#define RTPPACKETPOOL_SLOT_SIZE  1500
+#define RTPPACKETPOOL_SLOT_COUNT 128
+
+static GStaticMutex pool_mutex = G_STATIC_MUTEX_INIT;
+static guint8 *pool_arena = NULL;
+static GSList *pool_free = NULL;
+
+// lifetime counters.  atomics so the fallback path (which doesn't take
+//   pool_mutex) can count too
+static gint pool_served = 0;
+static gint pool_missed = 0;
+
+// GstBuffer subclass whose finalize returns the slot to the pool rather
+//   than freeing it.  same technique as GstNetBuffer in -base.
+typedef struct _GstRtpPoolBuffer
+{
+	GstBuffer buffer;
+} GstRtpPoolBuffer;
+
+typedef struct _GstRtpPoolBufferClass
+{
+	GstBufferClass buffer_class;
+} GstRtpPoolBufferClass;
+
+static GstBufferClass *pool_buffer_parent_class = NULL;
+
+#define GST_TYPE_RTP_POOL_BUFFER (gst_rtp_pool_buffer_get_type())
+
+static GType gst_rtp_pool_buffer_get_type(void);
+
+static void pool_slot_release(guint8 *data)
+{
+	g_static_mutex_lock(&pool_mutex);
+	pool_free = g_slist_prepend(pool_free, data);
+	g_static_mutex_unlock(&pool_mutex);
+
+	psi_bufmon_remove(PSI_BUFMON_POOL);
+}
+
+static void gst_rtp_pool_buffer_finalize(GstMiniObject *obj)
+{
+	GstBuffer *buf = (GstBuffer *)obj;
+
+	pool_slot_release(GST_BUFFER_DATA(buf));
+
+	// malloc_data was never set, so the parent finalize only releases
+	//   the mini object itself
+	GST_MINI_OBJECT_CLASS(pool_buffer_parent_class)->finalize(obj);
+}
+
+static void gst_rtp_pool_buffer_class_init(gpointer klass, gpointer class_data)
+{
+	GstMiniObjectClass *mo_class = GST_MINI_OBJECT_CLASS(klass);
+	(void)class_data;
+
+	pool_buffer_parent_class = g_type_class_peek_parent(klass);
+	mo_class->finalize = gst_rtp_pool_buffer_finalize;
+}
+
+GType gst_rtp_pool_buffer_get_type(void)
+{
+	static GType type = 0;
+
+	if(G_UNLIKELY(type == 0))
+	{
+		static const GTypeInfo info = {
+			sizeof(GstRtpPoolBufferClass),
+			NULL,
+			NULL,
+			gst_rtp_pool_buffer_class_init,
+			NULL,
+			NULL,
+			sizeof(GstRtpPoolBuffer),
+			0,
+			NULL,
+			NULL
+		};
+		type = g_type_register_static(GST_TYPE_BUFFER,
+			"GstRtpPoolBuffer", &info, 0);
+	}
+	return type;
+}
+
+// call with pool_mutex held
+static void pool_ensure_init(void)
+{
+	int n;
+
+	if(pool_arena)
+		return;
+
+	pool_arena = g_malloc(RTPPACKETPOOL_SLOT_SIZE * RTPPACKETPOOL_SLOT_COUNT);
+	for(n = 0; n < RTPPACKETPOOL_SLOT_COUNT; ++n)
+	{
+		pool_free = g_slist_prepend(pool_free,
+			pool_arena + (n * RTPPACKETPOOL_SLOT_SIZE));
+	}
+}
+
+GstBuffer *gst_rtppacketpool_alloc(guint size)
+{
+	guint8 *slot;
+	GstBuffer *buf;
+
+	if(size > RTPPACKETPOOL_SLOT_SIZE)
+	{
+		g_atomic_int_inc(&pool_missed);
+		return gst_buffer_new_and_alloc(size);
+	}
+
+	g_static_mutex_lock(&pool_mutex);
+	pool_ensure_init();
+	if(pool_free)
+	{
+		slot = (guint8 *)pool_free->data;
+		pool_free = g_slist_delete_link(pool_free, pool_free);
+	}
+	else
+		slot = NULL;
+	g_static_mutex_unlock(&pool_mutex);
+
+	// exhausted?  fall back to the allocator rather than blocking the
+	//   streaming thread
+	if(!slot)
+	{
+		g_atomic_int_inc(&pool_missed);
+		return gst_buffer_new_and_alloc(size);
+	}
+
+	g_atomic_int_inc(&pool_served);
+	psi_bufmon_add(PSI_BUFMON_POOL);
+
+	buf = (GstBuffer *)gst_mini_object_new(GST_TYPE_RTP_POOL_BUFFER);
+	GST_BUFFER_DATA(buf) = slot;
+	GST_BUFFER_SIZE(buf) = size;
+	return buf;
+}
+
+void gst_rtppacketpool_stats(guint *served, guint *missed)
+{
+	if(served)
+		*served = (guint)g_atomic_int_get(&pool_served);
+	if(missed)
+		*missed = (guint)g_atomic_int_get(&pool_missed);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2008  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef RTPPACKETPOOL_H
+#define RTPPACKETPOOL_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// A process-wide recycling pool of MTU-sized buffers for the RTP packet
+//   path.  Buffers handed out here behave like any other GstBuffer, but
+//   when the last ref is dropped the underlying memory goes back on the
+//   pool's free list instead of to the allocator.  Requests larger than a
+//   slot, or made while the pool is exhausted, silently fall back to a
+//   plain gst_buffer_new_and_alloc.
+
+GstBuffer *gst_rtppacketpool_alloc(guint size);
+
+// Lifetime counters for the pool: how many requests were served from a
+//   pool slot and how many fell back to the allocator (oversized request
+//   or pool exhausted).  Process-wide, like the pool itself.  Either
+//   argument may be NULL.
+void gst_rtppacketpool_stats(guint *served, guint *missed);
+
+G_END_DECLS
+
+#endif
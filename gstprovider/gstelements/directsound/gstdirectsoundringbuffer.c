@@ -137,6 +137,10 @@ gst_directsound_ring_buffer_init (GstDirectSoundRingBuffer * ringbuffer,
   ringbuffer->should_run = FALSE;
   ringbuffer->flushing = FALSE;
 
+  ringbuffer->event_driven = FALSE;
+  ringbuffer->hPositionEvent = NULL;
+  ringbuffer->achieved_latency_time = 0;
+
   ringbuffer->volume = 1.0;
 
   ringbuffer->dsound_lock = g_mutex_new ();
@@ -239,8 +243,65 @@ gst_directsound_ring_buffer_close_device (GstRingBuffer * buf)
   return TRUE;
 }
 
+/* install one notification position per segment boundary on the
+ * playback buffer.  a single auto-reset event serves all of them; the
+ * write thread only cares that the play cursor moved into a new
+ * segment, not which one.  must be called while the buffer is not
+ * playing.  returns FALSE if notifications are unavailable, in which
+ * case the caller should fall back to timer polling */
 static gboolean
-gst_directsound_create_buffer (GstRingBuffer * buf) 
+gst_directsound_create_notify (GstRingBuffer * buf)
+{
+  GstDirectSoundRingBuffer * dsoundbuffer = GST_DIRECTSOUND_RING_BUFFER (buf);
+  HRESULT hr;
+  LPDIRECTSOUNDNOTIFY8 pDSN8;
+  DSBPOSITIONNOTIFY * notifies;
+  gint segtotal, i;
+
+  segtotal = dsoundbuffer->buffer_size / dsoundbuffer->segsize;
+
+  /* the device-reconfigure path recreates the buffer but can reuse
+   * the event */
+  if (!dsoundbuffer->hPositionEvent) {
+    dsoundbuffer->hPositionEvent = CreateEvent (NULL, FALSE, FALSE, NULL);
+    if (!dsoundbuffer->hPositionEvent) {
+      GST_WARNING ("gst_directsound_create_notify: CreateEvent failed");
+      return FALSE;
+    }
+  }
+
+  hr = IDirectSoundBuffer8_QueryInterface (dsoundbuffer->pDSB8,
+      &IID_IDirectSoundNotify, (LPVOID *) &pDSN8);
+  if (G_UNLIKELY (FAILED (hr))) {
+    GST_WARNING ("gst_directsound_create_notify: IDirectSoundBuffer8_QueryInterface, hr = %X", (unsigned int) hr);
+    return FALSE;
+  }
+
+  notifies = g_new (DSBPOSITIONNOTIFY, segtotal);
+  for (i = 0; i < segtotal; i++) {
+    notifies[i].dwOffset = i * dsoundbuffer->segsize;
+    notifies[i].hEventNotify = dsoundbuffer->hPositionEvent;
+  }
+
+  hr = IDirectSoundNotify_SetNotificationPositions (pDSN8, segtotal,
+      notifies);
+
+  g_free (notifies);
+  IDirectSoundNotify_Release (pDSN8);
+
+  if (G_UNLIKELY (FAILED (hr))) {
+    GST_WARNING ("gst_directsound_create_notify: IDirectSoundNotify_SetNotificationPositions, hr = %X", (unsigned int) hr);
+    return FALSE;
+  }
+
+  GST_DEBUG ("Installed %d notification positions, one per %d byte segment",
+      segtotal, dsoundbuffer->segsize);
+
+  return TRUE;
+}
+
+static gboolean
+gst_directsound_create_buffer (GstRingBuffer * buf)
 {
   GstDirectSoundRingBuffer * dsoundbuffer = GST_DIRECTSOUND_RING_BUFFER (buf);
   HRESULT hr;
@@ -280,6 +341,9 @@ gst_directsound_create_buffer (GstRingBuffer * buf)
     descSecondary.dwFlags = DSBCAPS_GETCURRENTPOSITION2 |
         DSBCAPS_GLOBALFOCUS | DSBCAPS_CTRLVOLUME;
 
+    if (dsoundbuffer->event_driven)
+      descSecondary.dwFlags |= DSBCAPS_CTRLPOSITIONNOTIFY;
+
     descSecondary.dwBufferBytes = dsoundbuffer->buffer_size;
     descSecondary.lpwfxFormat = (WAVEFORMATEX *) &dsoundbuffer->wave_format;
 
@@ -299,6 +363,12 @@ gst_directsound_create_buffer (GstRingBuffer * buf)
     }
 
     IDirectSoundBuffer_Release (pDSB);
+
+    if (dsoundbuffer->event_driven &&
+        !gst_directsound_create_notify (buf)) {
+      GST_WARNING ("gst_directsound_create_buffer: notification setup failed, falling back to timer polling");
+      dsoundbuffer->event_driven = FALSE;
+    }
   }
 
   return TRUE;
@@ -329,9 +399,24 @@ gst_directsound_ring_buffer_acquire (GstRingBuffer * buf, GstRingBufferSpec * sp
   wfx.nBlockAlign = spec->bytes_per_sample;
   wfx.nAvgBytesPerSec = wfx.nSamplesPerSec * wfx.nBlockAlign;
 
-  /* enforce a minimum latency of 2x the sleep_time */
-  if (spec->latency_time < (dsoundbuffer->min_sleep_time * 2 * 1000))
-    spec->latency_time = dsoundbuffer->min_sleep_time * 2 * 1000;
+  /* event-driven output doesn't poll, so the playback element may ask
+   * for it (via the low-latency property) to get segments smaller than
+   * the polling quantum allows */
+  if (!dsoundbuffer->is_src)
+    dsoundbuffer->event_driven =
+        ((GstDirectSoundSink *)(dsoundbuffer->element))->low_latency;
+
+  if (dsoundbuffer->event_driven) {
+    /* notifications wake us exactly at segment boundaries, so the only
+     * floor is what the mixer can reasonably handle: 10 ms */
+    if (spec->latency_time < 10 * 1000)
+      spec->latency_time = 10 * 1000;
+  }
+  else {
+    /* enforce a minimum latency of 2x the sleep_time */
+    if (spec->latency_time < (dsoundbuffer->min_sleep_time * 2 * 1000))
+      spec->latency_time = dsoundbuffer->min_sleep_time * 2 * 1000;
+  }
 
   /* Create directsound buffer with size based on our configured
    * buffer_size (which is 200 ms by default) */
@@ -349,6 +434,11 @@ gst_directsound_ring_buffer_acquire (GstRingBuffer * buf, GstRingBufferSpec * sp
   dsoundbuffer->segsize = spec->segsize;
   dsoundbuffer->min_buffer_size = dsoundbuffer->buffer_size / 2;
 
+  /* record the segment duration we actually ended up with, after the
+   * rounding above, so the element can report it */
+  dsoundbuffer->achieved_latency_time = gst_util_uint64_scale_int (
+      spec->segsize, GST_MSECOND, wfx.nAvgBytesPerSec);
+
   GST_INFO_OBJECT (dsoundbuffer,
       "GstRingBufferSpec->channels: %d, GstRingBufferSpec->rate: %d, GstRingBufferSpec->bytes_per_sample: %d\n"
       "WAVEFORMATEX.nSamplesPerSec: %ld, WAVEFORMATEX.wBitsPerSample: %d, WAVEFORMATEX.nBlockAlign: %d, WAVEFORMATEX.nAvgBytesPerSec: %ld\n"
@@ -391,6 +481,11 @@ gst_directsound_ring_buffer_release (GstRingBuffer * buf)
     dsoundbuffer->pDSCB8 = NULL;
   }
 
+  if (dsoundbuffer->hPositionEvent) {
+    CloseHandle (dsoundbuffer->hPositionEvent);
+    dsoundbuffer->hPositionEvent = NULL;
+  }
+
   gst_buffer_unref (buf->data);
   buf->data = NULL;
 
@@ -853,8 +948,18 @@ gst_directsound_write_proc (LPVOID lpParameter)
 
     /* it's extremely important to sleep in without the lock! */
     // ###: why >= and not > ?
-    if (len >= freeBufferSize || flushing || error)
-      Sleep (dsoundbuffer->min_sleep_time);
+    if (len >= freeBufferSize || flushing || error) {
+      /* in event-driven mode, wait until the play cursor crosses the
+       * next segment boundary instead of burning a whole scheduling
+       * quantum.  the timeout is a backstop against lost notifications;
+       * flushing and error states keep the plain sleep so we don't spin
+       * on an event nobody will signal */
+      if (dsoundbuffer->event_driven && !flushing && !error)
+        WaitForSingleObject (dsoundbuffer->hPositionEvent,
+            dsoundbuffer->min_sleep_time * 2);
+      else
+        Sleep (dsoundbuffer->min_sleep_time);
+    }
   }
   while(should_run);
 
@@ -114,6 +114,20 @@ struct _GstDirectSoundRingBuffer
   /* are we currently flushing? */
   gboolean flushing;
 
+  /* event-driven mode: instead of polling the play cursor on a timer,
+   * directsound signals hPositionEvent whenever the cursor crosses a
+   * segment boundary.  this removes the scheduling quantum from the
+   * write path and allows segments down to 10 ms.  when notification
+   * setup fails we fall back to timer polling.  playback only */
+  gboolean event_driven;
+
+  /* auto-reset event signaled at the notification positions */
+  HANDLE hPositionEvent;
+
+  /* segment duration actually negotiated, in microseconds, surfaced by
+   * the sink element as the achieved-latency-time property */
+  gint64 achieved_latency_time;
+
   /* current volume */
   gdouble volume;
 };
@@ -99,7 +99,9 @@ enum
   ARG_0,
   ARG_VOLUME,
   ARG_DEVICE,
-  ARG_DEVICE_NAME
+  ARG_DEVICE_NAME,
+  ARG_LOW_LATENCY,
+  ARG_ACHIEVED_LATENCY_TIME
 };
 
 GST_BOILERPLATE_FULL (GstDirectSoundSink, gst_directsound_sink,
@@ -231,6 +233,18 @@ gst_directsound_sink_class_init (GstDirectSoundSinkClass * klass)
           "Human-readable name of the audio device",
           NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, ARG_LOW_LATENCY,
+      g_param_spec_boolean ("low-latency", "Low latency",
+          "Use DirectSound position notifications instead of timer "
+          "polling, allowing latency-time down to 10 ms",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_ACHIEVED_LATENCY_TIME,
+      g_param_spec_int64 ("achieved-latency-time", "Achieved latency time",
+          "Segment duration actually negotiated with DirectSound, in "
+          "microseconds (0 until the ring buffer is acquired)",
+          0, G_MAXINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   gstbasesink_class->event = GST_DEBUG_FUNCPTR (gst_directsound_sink_event);
 
   gstbaseaudiosink_class->create_ringbuffer =
@@ -243,6 +257,7 @@ gst_directsound_sink_init (GstDirectSoundSink * dsoundsink,
 {
   dsoundsink->dsoundbuffer = NULL;
   dsoundsink->volume = 1.0;
+  dsoundsink->low_latency = FALSE;
   dsoundsink->device_id = NULL;
   dsoundsink->device_name = NULL;
 }
@@ -379,6 +394,10 @@ gst_directsound_sink_set_property (GObject * object,
       }
       sink->device_id = g_strdup (g_value_get_string (value));
       break;
+    case ARG_LOW_LATENCY:
+      /* takes effect the next time the ring buffer is acquired */
+      sink->low_latency = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -405,6 +424,15 @@ gst_directsound_sink_get_property (GObject * object,
         device_get_name (sink);
       g_value_set_string (value, sink->device_name);
       break;
+    case ARG_LOW_LATENCY:
+      g_value_set_boolean (value, sink->low_latency);
+      break;
+    case ARG_ACHIEVED_LATENCY_TIME:
+      if (sink->dsoundbuffer)
+        g_value_set_int64 (value, sink->dsoundbuffer->achieved_latency_time);
+      else
+        g_value_set_int64 (value, 0);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
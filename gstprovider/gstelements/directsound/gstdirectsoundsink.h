@@ -59,6 +59,10 @@ struct _GstDirectSoundSink
   /* current volume */
   gdouble volume;
 
+  /* use position notifications instead of timer polling, allowing
+   * segments down to 10 ms */
+  gboolean low_latency;
+
   gchar * device_id;
   gchar * device_name;
 };
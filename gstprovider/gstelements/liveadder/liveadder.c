@@ -36,8 +36,19 @@
 
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #define DEFAULT_LATENCY_MS 60
 
+/* data blocks kept ready for reuse by the mixing buffer pool; beyond this,
+ * released blocks go back to the allocator */
+#define POOL_MAX_BLOCKS 16
+
 GST_DEBUG_CATEGORY_STATIC (live_adder_debug);
 #define GST_CAT_DEFAULT (live_adder_debug)
 
@@ -147,15 +158,212 @@ static void name (type *out, type *in, gint bytes) {            \
 
 /* *INDENT-OFF* */
 MAKE_FUNC (add_int32, gint32, gint64, G_MININT32, G_MAXINT32)
-MAKE_FUNC (add_int16, gint16, gint32, G_MININT16, G_MAXINT16)
+MAKE_FUNC (add_int16_scalar, gint16, gint32, G_MININT16, G_MAXINT16)
 MAKE_FUNC (add_int8, gint8, gint16, G_MININT8, G_MAXINT8)
 MAKE_FUNC (add_uint32, guint32, guint64, 0, G_MAXUINT32)
-MAKE_FUNC (add_uint16, guint16, guint32, 0, G_MAXUINT16)
+MAKE_FUNC (add_uint16_scalar, guint16, guint32, 0, G_MAXUINT16)
 MAKE_FUNC (add_uint8, guint8, guint16, 0, G_MAXUINT8)
-MAKE_FUNC_NC (add_float64, gdouble, gdouble)
-MAKE_FUNC_NC (add_float32, gfloat, gfloat)
+MAKE_FUNC_NC (add_float64_scalar, gdouble, gdouble)
+MAKE_FUNC_NC (add_float32_scalar, gfloat, gfloat)
 /* *INDENT-ON* */
 
+/* vector versions for the common formats; the widen-clamp-narrow of the
+ * scalar loops maps directly onto the saturating vector adds, and the
+ * scalar versions above handle whatever tail is left over */
+
+static void
+add_int16 (gint16 * out, gint16 * in, gint bytes)
+{
+  gint samples = bytes / sizeof (gint16);
+  gint i = 0;
+
+#if defined(__SSE2__)
+  for (; i + 8 <= samples; i += 8)
+    _mm_storeu_si128 ((__m128i *) (out + i),
+        _mm_adds_epi16 (_mm_loadu_si128 ((__m128i *) (out + i)),
+            _mm_loadu_si128 ((__m128i *) (in + i))));
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+  for (; i + 8 <= samples; i += 8)
+    vst1q_s16 (out + i,
+        vqaddq_s16 (vld1q_s16 (out + i), vld1q_s16 (in + i)));
+#endif
+
+  if (i < samples)
+    add_int16_scalar (out + i, in + i, (samples - i) * sizeof (gint16));
+}
+
+static void
+add_uint16 (guint16 * out, guint16 * in, gint bytes)
+{
+  gint samples = bytes / sizeof (guint16);
+  gint i = 0;
+
+#if defined(__SSE2__)
+  for (; i + 8 <= samples; i += 8)
+    _mm_storeu_si128 ((__m128i *) (out + i),
+        _mm_adds_epu16 (_mm_loadu_si128 ((__m128i *) (out + i)),
+            _mm_loadu_si128 ((__m128i *) (in + i))));
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+  for (; i + 8 <= samples; i += 8)
+    vst1q_u16 (out + i,
+        vqaddq_u16 (vld1q_u16 (out + i), vld1q_u16 (in + i)));
+#endif
+
+  if (i < samples)
+    add_uint16_scalar (out + i, in + i, (samples - i) * sizeof (guint16));
+}
+
+static void
+add_float32 (gfloat * out, gfloat * in, gint bytes)
+{
+  gint samples = bytes / sizeof (gfloat);
+  gint i = 0;
+
+#if defined(__SSE2__)
+  for (; i + 4 <= samples; i += 4)
+    _mm_storeu_ps (out + i,
+        _mm_add_ps (_mm_loadu_ps (out + i), _mm_loadu_ps (in + i)));
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+  for (; i + 4 <= samples; i += 4)
+    vst1q_f32 (out + i, vaddq_f32 (vld1q_f32 (out + i), vld1q_f32 (in + i)));
+#endif
+
+  if (i < samples)
+    add_float32_scalar (out + i, in + i, (samples - i) * sizeof (gfloat));
+}
+
+static void
+add_float64 (gdouble * out, gdouble * in, gint bytes)
+{
+  gint samples = bytes / sizeof (gdouble);
+  gint i = 0;
+
+#if defined(__SSE2__)
+  for (; i + 2 <= samples; i += 2)
+    _mm_storeu_pd (out + i,
+        _mm_add_pd (_mm_loadu_pd (out + i), _mm_loadu_pd (in + i)));
+#endif
+
+  if (i < samples)
+    add_float64_scalar (out + i, in + i, (samples - i) * sizeof (gdouble));
+}
+
+
+/*
+ * Pool of data blocks backing the writable copies made while mixing.
+ * Mixing a stream into a queued buffer whose data is shared (subbuffers,
+ * multiply-referenced buffers) needs a private copy, and doing a fresh
+ * allocation for every overlap adds up at audio packet rates.  Blocks come
+ * back to the pool through the buffer free function, which can run after
+ * the element is gone, so the pool is refcounted separately.
+ */
+
+struct _GstLiveAdderPool
+{
+  GMutex *lock;
+  gint refcount;
+  GSList *blocks;
+  guint nblocks;
+};
+
+typedef struct
+{
+  GstLiveAdderPool *pool;
+  guint capacity;
+} GstLiveAdderPoolBlock;
+
+static GstLiveAdderPool *
+gst_live_adder_pool_new (void)
+{
+  GstLiveAdderPool *pool = g_new0 (GstLiveAdderPool, 1);
+
+  pool->lock = g_mutex_new ();
+  pool->refcount = 1;
+
+  return pool;
+}
+
+static GstLiveAdderPool *
+gst_live_adder_pool_ref (GstLiveAdderPool * pool)
+{
+  g_atomic_int_inc (&pool->refcount);
+  return pool;
+}
+
+static void
+gst_live_adder_pool_unref (GstLiveAdderPool * pool)
+{
+  if (g_atomic_int_dec_and_test (&pool->refcount)) {
+    g_slist_foreach (pool->blocks, (GFunc) g_free, NULL);
+    g_slist_free (pool->blocks);
+    g_mutex_free (pool->lock);
+    g_free (pool);
+  }
+}
+
+#ifdef GST_BUFFER_FREE_FUNC
+static void
+gst_live_adder_pool_release_block (gpointer data)
+{
+  GstLiveAdderPoolBlock *block = data;
+  GstLiveAdderPool *pool = block->pool;
+
+  g_mutex_lock (pool->lock);
+  if (pool->nblocks < POOL_MAX_BLOCKS) {
+    pool->blocks = g_slist_prepend (pool->blocks, block);
+    pool->nblocks++;
+    block = NULL;
+  }
+  g_mutex_unlock (pool->lock);
+
+  /* NULL if the pool kept it */
+  g_free (block);
+
+  gst_live_adder_pool_unref (pool);
+}
+#endif
+
+static GstBuffer *
+gst_live_adder_pool_buffer_new (GstLiveAdderPool * pool, guint size)
+{
+#ifdef GST_BUFFER_FREE_FUNC
+  GstLiveAdderPoolBlock *block = NULL;
+  GstBuffer *buffer;
+
+  g_mutex_lock (pool->lock);
+  if (pool->blocks) {
+    block = pool->blocks->data;
+    pool->blocks = g_slist_delete_link (pool->blocks, pool->blocks);
+    pool->nblocks--;
+  }
+  g_mutex_unlock (pool->lock);
+
+  if (block && block->capacity < size) {
+    g_free (block);
+    block = NULL;
+  }
+
+  if (!block) {
+    block = g_malloc (sizeof (GstLiveAdderPoolBlock) + size);
+    block->capacity = size;
+  }
+
+  block->pool = gst_live_adder_pool_ref (pool);
+
+  buffer = gst_buffer_new ();
+  GST_BUFFER_MALLOCDATA (buffer) = (guint8 *) block;
+  GST_BUFFER_FREE_FUNC (buffer) = gst_live_adder_pool_release_block;
+  GST_BUFFER_DATA (buffer) = (guint8 *) (block + 1);
+  GST_BUFFER_SIZE (buffer) = size;
+
+  return buffer;
+#else
+  /* this GStreamer has no buffer free function, so blocks can't find their
+   * way back; plain allocation then */
+  return gst_buffer_new_and_alloc (size);
+#endif
+}
+
 
 static void
 gst_live_adder_base_init (gpointer klass)
@@ -228,6 +436,8 @@ gst_live_adder_init (GstLiveAdder * adder, GstLiveAdderClass *klass)
   adder->latency_ms = DEFAULT_LATENCY_MS;
 
   adder->buffers = g_queue_new ();
+
+  adder->pool = gst_live_adder_pool_new ();
 }
 
 
@@ -245,6 +455,9 @@ gst_live_adder_finalize (GObject * object)
 
   g_list_free (adder->sinkpads);
 
+  /* outstanding buffers hold their own refs on the pool */
+  gst_live_adder_pool_unref (adder->pool);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -1073,8 +1286,19 @@ gst_live_live_adder_chain (GstPad *pad, GstBuffer *buffer)
     }
 
     /* Now we are on the overlapping part */
-    oldbuffer = gst_buffer_make_writable (oldbuffer);
-    item->data = oldbuffer;
+    if (!gst_buffer_is_writable (oldbuffer)) {
+      /* take the writable copy from the pool instead of letting
+       * gst_buffer_make_writable allocate a fresh one for every mix */
+      GstBuffer *mixbuffer = gst_live_adder_pool_buffer_new (adder->pool,
+          GST_BUFFER_SIZE (oldbuffer));
+
+      memcpy (GST_BUFFER_DATA (mixbuffer), GST_BUFFER_DATA (oldbuffer),
+          GST_BUFFER_SIZE (oldbuffer));
+      gst_buffer_copy_metadata (mixbuffer, oldbuffer, GST_BUFFER_COPY_ALL);
+      gst_buffer_unref (oldbuffer);
+      oldbuffer = mixbuffer;
+      item->data = oldbuffer;
+    }
 
     old_skip = GST_BUFFER_TIMESTAMP (buffer) + skip -
         GST_BUFFER_TIMESTAMP (oldbuffer);
@@ -40,6 +40,7 @@ G_BEGIN_DECLS
 
 typedef struct _GstLiveAdder             GstLiveAdder;
 typedef struct _GstLiveAdderClass        GstLiveAdderClass;
+typedef struct _GstLiveAdderPool         GstLiveAdderPool;
 
 typedef enum {
   GST_LIVE_ADDER_FORMAT_UNSET,
@@ -69,6 +70,9 @@ struct _GstLiveAdder {
   GQueue         *buffers;
   GCond          *not_empty_cond;
 
+  /* pool of data blocks reused for writable mixing copies */
+  GstLiveAdderPool *pool;
+
   GstClockTime    next_timestamp;
 
   /* the next are valid for both int and float */
@@ -91,7 +91,9 @@ enum
 {
   ARG_0,
   ARG_DEVICE,
-  ARG_VOLUME
+  ARG_VOLUME,
+  ARG_LOW_LATENCY,
+  ARG_ACHIEVED_LATENCY_TIME
 };
 
 #define DEFAULT_VOLUME 1.0
@@ -182,6 +184,18 @@ gst_osx_audio_sink_class_init (GstOsxAudioSinkClass * klass)
       g_param_spec_double ("volume", "Volume", "Volume of this stream",
           0, 1.0, 1.0, G_PARAM_READWRITE));
 
+  g_object_class_install_property (gobject_class, ARG_LOW_LATENCY,
+      g_param_spec_boolean ("low-latency", "Low latency",
+          "Negotiate the device's IO proc buffer down to match "
+          "latency-time, allowing buffers down to 128 frames",
+          FALSE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, ARG_ACHIEVED_LATENCY_TIME,
+      g_param_spec_int64 ("achieved-latency-time", "Achieved latency time",
+          "Segment duration actually negotiated with the device, in "
+          "microseconds (0 until the ring buffer is acquired)",
+          0, G_MAXINT64, 0, G_PARAM_READABLE));
+
   gstbaseaudiosink_class->create_ringbuffer =
       GST_DEBUG_FUNCPTR (gst_osx_audio_sink_create_ringbuffer);
 }
@@ -193,6 +207,8 @@ gst_osx_audio_sink_init (GstOsxAudioSink * sink, GstOsxAudioSinkClass * gclass)
 
   sink->device_id = kAudioDeviceUnknown;
   sink->volume = DEFAULT_VOLUME;
+  sink->low_latency = FALSE;
+  sink->osxbuf = NULL;
 }
 
 static void
@@ -209,6 +225,9 @@ gst_osx_audio_sink_set_property (GObject * object, guint prop_id,
       sink->volume = g_value_get_double (value);
       gst_osx_audio_sink_set_volume (sink);
       break;
+    case ARG_LOW_LATENCY:
+      sink->low_latency = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -227,6 +246,13 @@ gst_osx_audio_sink_get_property (GObject * object, guint prop_id,
     case ARG_VOLUME:
       g_value_set_double (value, sink->volume);
       break;
+    case ARG_LOW_LATENCY:
+      g_value_set_boolean (value, sink->low_latency);
+      break;
+    case ARG_ACHIEVED_LATENCY_TIME:
+      g_value_set_int64 (value,
+          sink->osxbuf ? sink->osxbuf->achieved_latency_time : 0);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -253,6 +279,9 @@ gst_osx_audio_sink_create_ringbuffer (GstBaseAudioSink * sink)
 
   ringbuffer->element = GST_OSX_AUDIO_ELEMENT_GET_INTERFACE (osxsink);
   ringbuffer->device_id = osxsink->device_id;
+  ringbuffer->low_latency = osxsink->low_latency;
+
+  osxsink->osxbuf = ringbuffer;
 
   return GST_RING_BUFFER (ringbuffer);
 }
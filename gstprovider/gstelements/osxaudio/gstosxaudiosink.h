@@ -72,6 +72,15 @@ struct _GstOsxAudioSink
   AudioDeviceID device_id;
   AudioUnit audiounit;
   double volume;
+
+  /* when TRUE, the ring buffer negotiates the device's io-proc buffer
+   * down to match latency-time (floor of 128 frames), so each render
+   * callback consumes exactly one segment */
+  gboolean low_latency;
+
+  /* borrowed ref to the ring buffer, for reading back the achieved
+   * latency */
+  GstOsxRingBuffer *osxbuf;
 };
 
 struct _GstOsxAudioSinkClass 
@@ -421,6 +421,50 @@ gst_osx_ring_buffer_acquire (GstRingBuffer * buf, GstRingBufferSpec * spec)
       spec->bytes_per_sample;
   spec->segtotal = spec->buffer_time / spec->latency_time;
 
+  /* in low-latency mode, negotiate the device's io-proc buffer down to
+   * the requested latency-time and size segments to exactly the granted
+   * value, so each io-proc callback moves one whole segment in a single
+   * memcpy instead of carrying partial segments across callbacks */
+  if (!osxbuf->is_src && osxbuf->low_latency) {
+    frameSize = spec->latency_time * spec->rate / G_USEC_PER_SEC;
+    if (frameSize < 128)
+      frameSize = 128;
+
+    propertySize = sizeof (frameSize);
+    status = AudioUnitSetProperty (osxbuf->audiounit,
+        kAudioDevicePropertyBufferFrameSize, kAudioUnitScope_Global, 0,
+        &frameSize, propertySize);
+    if (status) {
+      GST_WARNING_OBJECT (osxbuf,
+          "Failed to set io-proc buffer size to %u frames: %lx",
+          (guint) frameSize, (gulong) status);
+    }
+
+    /* read back what the device actually granted; it may clamp to its
+     * own supported range */
+    propertySize = sizeof (frameSize);
+    status = AudioUnitGetProperty (osxbuf->audiounit,
+        kAudioDevicePropertyBufferFrameSize, kAudioUnitScope_Global, 0,
+        &frameSize, &propertySize);
+    if (status == noErr && frameSize > 0) {
+      spec->segsize = frameSize * spec->bytes_per_sample;
+      spec->segtotal =
+          (spec->buffer_time * spec->rate / G_USEC_PER_SEC) / frameSize;
+      if (spec->segtotal < 2)
+        spec->segtotal = 2;
+
+      GST_DEBUG_OBJECT (osxbuf, "low-latency: io-proc buffer is %u frames",
+          (guint) frameSize);
+    } else {
+      GST_WARNING_OBJECT (osxbuf, "Failed to get io-proc buffer size: %lx",
+          (gulong) status);
+    }
+  }
+
+  osxbuf->achieved_latency_time =
+      gst_util_uint64_scale_int (spec->segsize / spec->bytes_per_sample,
+      G_USEC_PER_SEC, spec->rate);
+
   /* create AudioBufferList needed for recording */
   if (osxbuf->is_src) {
     propertySize = sizeof (frameSize);
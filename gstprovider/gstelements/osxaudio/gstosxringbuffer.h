@@ -80,6 +80,17 @@ struct _GstOsxRingBuffer
   guint segoffset;
   AudioBufferList * recBufferList;
   GstOsxAudioElementInterface * element;
+
+  /* when TRUE, acquire negotiates the device's io-proc buffer down to
+   * match latency-time (floor of 128 frames) and sizes segments to the
+   * granted value, so each io-proc callback moves exactly one segment.
+   * copied from the owning element, which exposes it as a property */
+  gboolean low_latency;
+
+  /* segment duration actually negotiated with the device, in
+   * microseconds.  0 until acquired.  exported by the sink element as
+   * the achieved-latency-time property */
+  gint64 achieved_latency_time;
 };
 
 struct _GstOsxRingBufferClass
@@ -715,6 +715,8 @@ gst_osx_video_src_init (GstOSXVideoSrc * self, GstOSXVideoSrcClass * klass)
 
   gst_base_src_set_format (GST_BASE_SRC (self), GST_FORMAT_TIME);
   gst_base_src_set_live (GST_BASE_SRC (self), TRUE);
+
+  self->pool_lock = g_mutex_new ();
 }
 
 static void
@@ -746,6 +748,10 @@ gst_osx_video_src_finalize (GstOSXVideoSrc * self)
 {
   GST_DEBUG_OBJECT (self, G_STRFUNC);
 
+  /* in-flight frame buffers hold a ref on us, so by the time we get here
+   * every slot has either been recycled or had its memory freed. */
+  g_mutex_free (self->pool_lock);
+
   G_OBJECT_CLASS (parent_class)->finalize (G_OBJECT (self));
 }
 
@@ -1058,6 +1064,180 @@ gst_osx_video_src_query (GstBaseSrc * bsrc, GstQuery * query)
   return res;
 }
 
+/* GstOSXFrameBuffer: a buffer wrapping one pool slot directly.  when the
+ * last ref drops, the slot goes back into rotation instead of the pixels
+ * being freed, so steady-state capture does no allocation and no copy. */
+
+typedef struct _GstOSXFrameBuffer GstOSXFrameBuffer;
+
+struct _GstOSXFrameBuffer
+{
+  GstBuffer buffer;
+
+  GstOSXVideoSrc * src;
+  gint slot;
+};
+
+static GstBufferClass * frame_buffer_parent_class = NULL;
+
+static void
+gst_osx_frame_buffer_finalize (GstMiniObject * obj)
+{
+  GstOSXFrameBuffer * fbuf = (GstOSXFrameBuffer *) obj;
+  GstOSXVideoSrc * self = fbuf->src;
+  GstOSXVideoSrcFrameSlot * slot = &self->slots[fbuf->slot];
+
+  g_mutex_lock (self->pool_lock);
+  if (slot->world != NULL) {
+    /* pool is still alive: hand the slot back for the next frame */
+    slot->in_flight = FALSE;
+  } else {
+    /* capture was torn down while this frame was downstream */
+    g_free (slot->data);
+    slot->data = NULL;
+    slot->in_flight = FALSE;
+  }
+  g_mutex_unlock (self->pool_lock);
+
+  gst_object_unref (self);
+
+  GST_MINI_OBJECT_CLASS (frame_buffer_parent_class)->finalize (obj);
+}
+
+static void
+gst_osx_frame_buffer_class_init (gpointer klass, gpointer class_data)
+{
+  GstMiniObjectClass * mo_class = GST_MINI_OBJECT_CLASS (klass);
+
+  frame_buffer_parent_class = g_type_class_peek_parent (klass);
+  mo_class->finalize = gst_osx_frame_buffer_finalize;
+}
+
+static GType
+gst_osx_frame_buffer_get_type (void)
+{
+  static GType type = 0;
+
+  if (G_UNLIKELY (type == 0)) {
+    static const GTypeInfo info = {
+      sizeof (GstBufferClass),
+      NULL, NULL,
+      gst_osx_frame_buffer_class_init,
+      NULL, NULL,
+      sizeof (GstOSXFrameBuffer),
+      0, NULL, NULL
+    };
+    type = g_type_register_static (GST_TYPE_BUFFER, "GstOSXFrameBuffer",
+        &info, 0);
+  }
+  return type;
+}
+
+/* the caller must already have marked the slot in flight */
+static GstBuffer *
+gst_osx_frame_buffer_new (GstOSXVideoSrc * self, gint slot)
+{
+  GstOSXFrameBuffer * fbuf;
+
+  fbuf = (GstOSXFrameBuffer *)
+      gst_mini_object_new (gst_osx_frame_buffer_get_type ());
+  fbuf->src = GST_OSX_VIDEO_SRC (gst_object_ref (self));
+  fbuf->slot = slot;
+
+  GST_BUFFER_DATA (fbuf) = self->slots[slot].data;
+  GST_BUFFER_SIZE (fbuf) = self->frame_size;
+
+  return GST_BUFFER (fbuf);
+}
+
+static void destroy_frame_pool (GstOSXVideoSrc * self);
+
+/* build the pinned frame pool: each slot gets its own pixel memory, a
+ * gworld over that memory and a decompression sequence targeting it, so
+ * the decompressor writes frames straight into buffer-owned storage. */
+static gboolean
+create_frame_pool (GstOSXVideoSrc * self, ImageDescriptionHandle imageDesc,
+    MatrixRecord * scaleMatrix)
+{
+  OSErr err;
+  int width, height, rowBytes;
+  int i;
+
+  width = self->rect.right - self->rect.left;
+  height = self->rect.bottom - self->rect.top;
+  rowBytes = width * 2;
+  self->frame_size = rowBytes * height;
+
+  for (i = 0; i < GST_OSX_VIDEO_SRC_POOL_SIZE; ++i) {
+    GstOSXVideoSrcFrameSlot * slot = &self->slots[i];
+
+    slot->data = g_malloc (self->frame_size);
+    slot->in_flight = FALSE;
+
+    err = QTNewGWorldFromPtr (&slot->world, k422YpCbCr8PixelFormat,
+        &self->rect, 0, NULL, 0, slot->data, rowBytes);
+    if (err != noErr) {
+      GST_ERROR_OBJECT (self, "QTNewGWorldFromPtr returned %d", (int) err);
+      g_free (slot->data);
+      slot->data = NULL;
+      destroy_frame_pool (self);
+      return FALSE;
+    }
+
+    LockPixels (GetGWorldPixMap (slot->world));
+
+    err = DecompressSequenceBegin (&slot->dec_seq, imageDesc, slot->world,
+        NULL, NULL, scaleMatrix, srcCopy, NULL, 0, codecNormalQuality,
+        bestSpeedCodec);
+    if (err != noErr) {
+      GST_ERROR_OBJECT (self, "DecompressSequenceBegin returned %d",
+          (int) err);
+      DisposeGWorld (slot->world);
+      slot->world = NULL;
+      g_free (slot->data);
+      slot->data = NULL;
+      destroy_frame_pool (self);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static void
+destroy_frame_pool (GstOSXVideoSrc * self)
+{
+  ComponentResult err;
+  int i;
+
+  g_mutex_lock (self->pool_lock);
+
+  for (i = 0; i < GST_OSX_VIDEO_SRC_POOL_SIZE; ++i) {
+    GstOSXVideoSrcFrameSlot * slot = &self->slots[i];
+
+    if (slot->dec_seq) {
+      err = CDSequenceEnd (slot->dec_seq);
+      if (err != noErr)
+        GST_WARNING_OBJECT (self, "CDSequenceEnd returned %d", (int) err);
+      slot->dec_seq = 0;
+    }
+
+    if (slot->world) {
+      DisposeGWorld (slot->world);
+      slot->world = NULL;
+    }
+
+    /* slots still referenced downstream keep their memory; the frame
+     * buffer finalizer frees it once world is seen to be NULL */
+    if (slot->data && !slot->in_flight) {
+      g_free (slot->data);
+      slot->data = NULL;
+    }
+  }
+
+  g_mutex_unlock (self->pool_lock);
+}
+
 static GstStateChangeReturn
 gst_osx_video_src_change_state (GstElement * element,
     GstStateChange transition)
@@ -1111,14 +1291,10 @@ gst_osx_video_src_change_state (GstElement * element,
       SetRect (&sourceRect, 0, 0, (**imageDesc).width, (**imageDesc).height);
       RectMatrix(&scaleMatrix, &sourceRect, &self->rect);
 
-      err = DecompressSequenceBegin (&self->dec_seq, imageDesc, self->world,
-          NULL, NULL, &scaleMatrix, srcCopy, NULL, 0, codecNormalQuality,
-          bestSpeedCodec);
-      if (err != noErr) {
+      if (!create_frame_pool (self, imageDesc, &scaleMatrix)) {
         SGStop (self->seq_grab);
         SGRelease (self->seq_grab);
         DisposeHandle ((Handle) imageDesc);
-        GST_ERROR_OBJECT (self, "DecompressSequenceBegin returned %d", (int) err);
         return GST_STATE_CHANGE_FAILURE;
       }
 
@@ -1138,10 +1314,7 @@ gst_osx_video_src_change_state (GstElement * element,
     case GST_STATE_CHANGE_PAUSED_TO_READY:
       SGStop (self->seq_grab);
 
-      err = CDSequenceEnd (self->dec_seq);
-      if (err != noErr)
-        GST_WARNING_OBJECT (self, "CDSequenceEnd returned %d", (int) err);
-      self->dec_seq = 0;
+      destroy_frame_pool (self);
 
       SGRelease (self->seq_grab);
       break;
@@ -1218,12 +1391,8 @@ data_proc (SGChannel c, Ptr p, long len, long * offset, long chRefCon,
   GstClockTime duration, timestamp, latency;
   CodecFlags flags;
   ComponentResult err;
-  PixMapHandle hPixMap;
-  Rect portRect;
-  int pix_rowBytes;
-  void *pix_ptr;
-  int pix_height;
-  int pix_size;
+  gint slot;
+  int i;
 
   self = GST_OSX_VIDEO_SRC (refCon);
 
@@ -1232,22 +1401,38 @@ data_proc (SGChannel c, Ptr p, long len, long * offset, long chRefCon,
     self->buffer = NULL;
   }
 
-  err = DecompressSequenceFrameS (self->dec_seq, p, len, 0, &flags, NULL);
+  /* grab a free slot to decompress into.  if downstream is holding every
+   * slot we drop the frame, same as we'd drop an unconsumed pending one. */
+  slot = -1;
+  g_mutex_lock (self->pool_lock);
+  for (i = 0; i < GST_OSX_VIDEO_SRC_POOL_SIZE; ++i) {
+    if (self->slots[i].data && !self->slots[i].in_flight) {
+      self->slots[i].in_flight = TRUE;
+      slot = i;
+      break;
+    }
+  }
+  g_mutex_unlock (self->pool_lock);
+
+  if (slot == -1) {
+    GST_DEBUG_OBJECT (self, "no free frame slot, dropping frame");
+    return noErr;
+  }
+
+  /* each slot has its own decompression sequence whose gworld sits over
+   * the slot's memory, so the frame lands there without a copy */
+  err = DecompressSequenceFrameS (self->slots[slot].dec_seq, p, len, 0,
+      &flags, NULL);
   if (err != noErr) {
     GST_ERROR_OBJECT (self, "DecompressSequenceFrameS returned %d", (int) err);
+    g_mutex_lock (self->pool_lock);
+    self->slots[slot].in_flight = FALSE;
+    g_mutex_unlock (self->pool_lock);
     return err;
   }
 
-  hPixMap = GetGWorldPixMap (self->world);
-  LockPixels (hPixMap);
-  GetPortBounds (self->world, &portRect);
-  pix_rowBytes = (int) GetPixRowBytes (hPixMap);
-  pix_ptr = GetPixBaseAddr (hPixMap);
-  pix_height = (portRect.bottom - portRect.top);
-  pix_size = pix_rowBytes * pix_height;
-
-  GST_DEBUG_OBJECT (self, "num=%5d, height=%d, rowBytes=%d, size=%d",
-      self->seq_num, pix_height, pix_rowBytes, pix_size);
+  GST_DEBUG_OBJECT (self, "num=%5d, slot=%d, size=%d",
+      self->seq_num, slot, self->frame_size);
 
   fps_n = FRAMERATE;
   fps_d = 1;
@@ -1262,15 +1447,12 @@ data_proc (SGChannel c, Ptr p, long len, long * offset, long chRefCon,
   else
     timestamp = 0;
 
-  self->buffer = gst_buffer_new_and_alloc (pix_size);
+  self->buffer = gst_osx_frame_buffer_new (self, slot);
   GST_BUFFER_OFFSET (self->buffer) = self->seq_num;
   GST_BUFFER_TIMESTAMP (self->buffer) = timestamp;
-  memcpy (GST_BUFFER_DATA (self->buffer), pix_ptr, pix_size);
 
   self->seq_num++;
 
-  UnlockPixels (hPixMap);
-
   return noErr;
 }
 
@@ -45,6 +45,18 @@ G_BEGIN_DECLS
 typedef struct _GstOSXVideoSrc GstOSXVideoSrc;
 typedef struct _GstOSXVideoSrcClass GstOSXVideoSrcClass;
 
+/* number of frame slots in the capture pool.  each slot owns the pixel
+ * memory of one frame in flight; the decompressor writes straight into a
+ * slot and the resulting buffer is pushed downstream without a copy. */
+#define GST_OSX_VIDEO_SRC_POOL_SIZE 3
+
+typedef struct {
+  guint8 * data;
+  GWorldPtr world;
+  ImageSequence dec_seq;
+  gboolean in_flight;
+} GstOSXVideoSrcFrameSlot;
+
 struct _GstOSXVideoSrc
 {
   GstPushSrc pushsrc;
@@ -55,7 +67,12 @@ struct _GstOSXVideoSrc
   SGChannel video_chan;
   GWorldPtr world;
   Rect rect;
-  ImageSequence dec_seq;
+
+  /* pinned frame pool.  slots are recycled when the buffer wrapping them
+   * is finalized, so no per-frame allocation happens while capturing. */
+  GMutex * pool_lock;
+  GstOSXVideoSrcFrameSlot slots[GST_OSX_VIDEO_SRC_POOL_SIZE];
+  guint frame_size;
 
   GstBuffer * buffer;
   guint seq_num;
@@ -154,6 +154,15 @@ gst_speex_dsp_query_type (GstPad * pad);
 static gboolean
 gst_speex_dsp_query (GstPad * pad, GstQuery * query);
 
+static gboolean
+gst_speex_dsp_src_activate_push (GstPad * pad, gboolean active);
+
+static void
+gst_speex_dsp_loop (gpointer data);
+
+static void
+gst_speex_dsp_flush_start (GstSpeexDSP * self);
+
 static void
 gst_speex_dsp_reset_locked (GstSpeexDSP * self);
 
@@ -383,6 +392,39 @@ adapter_push_at (GstAdapter * adapter, GstBuffer * buffer, int offset)
   gst_buffer_unref (buffer);
 }
 
+/* single producer (probe streaming thread), single consumer (dsp worker
+ * or flush, always under the dsp object lock).  only the producer side
+ * needs to be lock-free. */
+
+static gboolean
+play_ring_push (GstSpeexDSPPlayRing * ring, GstBuffer * buf)
+{
+  gint head = g_atomic_int_get (&ring->head);
+  gint tail = g_atomic_int_get (&ring->tail);
+
+  if ((head + 1) % GST_SPEEX_DSP_PLAY_RING_SIZE == tail)
+    return FALSE;
+
+  ring->bufs[head] = buf;
+  g_atomic_int_set (&ring->head, (head + 1) % GST_SPEEX_DSP_PLAY_RING_SIZE);
+  return TRUE;
+}
+
+static GstBuffer *
+play_ring_pop (GstSpeexDSPPlayRing * ring)
+{
+  gint head = g_atomic_int_get (&ring->head);
+  gint tail = g_atomic_int_get (&ring->tail);
+  GstBuffer * buf;
+
+  if (tail == head)
+    return NULL;
+
+  buf = ring->bufs[tail];
+  g_atomic_int_set (&ring->tail, (tail + 1) % GST_SPEEX_DSP_PLAY_RING_SIZE);
+  return buf;
+}
+
 // -----
 
 static void
@@ -525,6 +567,8 @@ gst_speex_dsp_init (GstSpeexDSP * self, GstSpeexDSPClass *klass)
       GST_DEBUG_FUNCPTR (gst_speex_dsp_query));
   gst_pad_set_query_type_function (self->rec_srcpad,
       GST_DEBUG_FUNCPTR (gst_speex_dsp_query_type));
+  gst_pad_set_activatepush_function (self->rec_srcpad,
+      GST_DEBUG_FUNCPTR (gst_speex_dsp_src_activate_push));
   gst_element_add_pad (GST_ELEMENT (self), self->rec_srcpad);
 
   template = gst_static_pad_template_get (&gst_speex_dsp_rec_sink_template);
@@ -562,6 +606,10 @@ gst_speex_dsp_init (GstSpeexDSP * self, GstSpeexDSPClass *klass)
   self->noise_suppress = DEFAULT_NOISE_SUPPRESS;
   self->buffers = g_queue_new();
 
+  self->work_queue = g_queue_new ();
+  self->work_cond = g_cond_new ();
+  self->srcresult = GST_FLOW_WRONG_STATE;
+
   g_static_mutex_lock (&pairlog_mutex);
   if (!pairlog && have_env("SPEEXDSP_LOG"))
     pairlog = pairlog_new ("gst_play.raw", "gst_rec.raw");
@@ -601,6 +649,16 @@ gst_speex_dsp_finalize (GObject * object)
   g_queue_foreach (self->buffers, (GFunc) gst_mini_object_unref, NULL);
   g_queue_free (self->buffers);
 
+  {
+    GstBuffer * buf;
+    while ((buf = play_ring_pop (&self->play_ring)))
+      gst_buffer_unref (buf);
+  }
+
+  g_queue_foreach (self->work_queue, (GFunc) gst_mini_object_unref, NULL);
+  g_queue_free (self->work_queue);
+  g_cond_free (self->work_cond);
+
   if (self->preprocstate)
     speex_preprocess_state_destroy (self->preprocstate);
   if (self->echostate)
@@ -994,6 +1052,55 @@ done:
   return ret;
 }
 
+static void
+gst_speex_dsp_flush_start (GstSpeexDSP * self)
+{
+  GstBuffer * buf;
+
+  GST_DEBUG_OBJECT (self, "Stopping the dsp worker");
+
+  GST_OBJECT_LOCK (self);
+  /* mark ourselves as flushing */
+  self->srcresult = GST_FLOW_WRONG_STATE;
+
+  g_queue_foreach (self->work_queue, (GFunc) gst_mini_object_unref, NULL);
+  g_queue_clear (self->work_queue);
+
+  while ((buf = play_ring_pop (&self->play_ring)))
+    gst_buffer_unref (buf);
+
+  g_cond_broadcast (self->work_cond);
+  GST_OBJECT_UNLOCK (self);
+}
+
+static gboolean
+gst_speex_dsp_src_activate_push (GstPad * pad, gboolean active)
+{
+  gboolean result = TRUE;
+  GstSpeexDSP * self = GST_SPEEX_DSP (gst_pad_get_parent (pad));
+
+  if (active) {
+    GST_OBJECT_LOCK (self);
+    self->srcresult = GST_FLOW_OK;
+    GST_OBJECT_UNLOCK (self);
+
+    GST_DEBUG_OBJECT (self, "Starting dsp worker task on srcpad");
+    gst_pad_start_task (self->rec_srcpad,
+        (GstTaskFunction) gst_speex_dsp_loop, self);
+  }
+  else {
+    /* make sure all data processing stops ASAP */
+    gst_speex_dsp_flush_start (self);
+
+    GST_DEBUG_OBJECT (self, "Stopping dsp worker task on srcpad");
+    result = gst_pad_stop_task (pad);
+  }
+
+  gst_object_unref (self);
+
+  return result;
+}
+
 static gboolean
 gst_speex_dsp_rec_event (GstPad * pad, GstEvent * event)
 {
@@ -1001,6 +1108,9 @@ gst_speex_dsp_rec_event (GstPad * pad, GstEvent * event)
   gboolean res = FALSE;
 
   switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      gst_speex_dsp_flush_start (self);
+      break;
     case GST_EVENT_FLUSH_STOP: /* synchronized */
       gst_adapter_clear (self->rec_adapter);
       self->rec_offset = 0;
@@ -1010,7 +1120,10 @@ gst_speex_dsp_rec_event (GstPad * pad, GstEvent * event)
       g_queue_clear (self->buffers);
       GST_OBJECT_LOCK (self);
       gst_speex_dsp_reset_locked (self);
+      self->srcresult = GST_FLOW_OK;
       GST_OBJECT_UNLOCK (self);
+      gst_pad_start_task (self->rec_srcpad,
+          (GstTaskFunction) gst_speex_dsp_loop, self);
       break;
     case GST_EVENT_NEWSEGMENT: /* synchronized */
       {
@@ -1156,6 +1269,11 @@ gst_speex_dsp_rec_chain (GstPad * pad, GstBuffer * buffer)
     GST_OBJECT_LOCK (self);
     g_queue_foreach (self->buffers, (GFunc) gst_mini_object_unref, NULL);
     g_queue_clear (self->buffers);
+    {
+      GstBuffer * rbuf;
+      while ((rbuf = play_ring_pop (&self->play_ring)))
+        gst_buffer_unref (rbuf);
+    }
     GST_OBJECT_UNLOCK (self);
   }
 
@@ -1218,7 +1336,6 @@ gst_speex_dsp_rec_chain (GstPad * pad, GstBuffer * buffer)
   //goto out;
 
   while (TRUE) {
-    GstBuffer * outbuffer = NULL;
     //GstClockTime rec_rt = 0;
 
     // buffer at least 500ms + 1 frame before processing
@@ -1237,51 +1354,22 @@ gst_speex_dsp_rec_chain (GstPad * pad, GstBuffer * buffer)
     //rec_rt = gst_segment_to_running_time (&self->rec_segment, GST_FORMAT_TIME,
     //    self->rec_time);
 
+    self->rec_time += duration;
+    self->rec_offset += sampsize; // FIXME: does this work for >1 channels?
+
+    /* hand the frame to the dsp worker.  the speex filters run on its
+     * thread, so the capture thread gets away with a queue push here
+     */
     GST_OBJECT_LOCK (self);
-    outbuffer = try_echo_cancel (
-        self->echostate,
-        recbuffer,
-        self->rec_time + skew_fix /*- (((GstClockTime)self->latency_tune) * GST_MSECOND)*/,
-        base_time,
-        self->buffers,
-        rate,
-        self->rec_srcpad,
-        GST_PAD_CAPS (self->rec_sinkpad),
-        &res,
-        self);
-    GST_OBJECT_UNLOCK (self);
-    if (outbuffer) {
-      /* if cancel succeeds, then post-processing occurs on the newly returned
-       * buffer and we can free the original one.  newly returned buffer has
-       * appropriate caps.
-       */
+    res = self->srcresult;
+    if (res != GST_FLOW_OK) {
+      GST_OBJECT_UNLOCK (self);
       gst_buffer_unref (recbuffer);
+      goto out;
     }
-    else {
-      /* if cancel fails, it's possible it was due to a flow error when
-       * creating a new buffer */
-      if (res != GST_FLOW_OK)
-        goto out;
-
-      /* if cancel fails, then post-processing occurs on the original buffer,
-       * just make it writable and set appropriate caps.
-       */
-      outbuffer = gst_buffer_make_writable (recbuffer);
-      gst_buffer_set_caps (outbuffer, GST_PAD_CAPS (self->rec_sinkpad));
-    }
-
-    GST_OBJECT_LOCK (self);
-    speex_preprocess_run (self->preprocstate,
-        (spx_int16_t *) GST_BUFFER_DATA (outbuffer));
+    g_queue_push_tail (self->work_queue, recbuffer);
+    g_cond_signal (self->work_cond);
     GST_OBJECT_UNLOCK (self);
-
-    self->rec_time += duration;
-    self->rec_offset += sampsize; // FIXME: does this work for >1 channels?
-
-    GST_LOG_OBJECT (self, "Sending out buffer %p", outbuffer);
-    res = gst_pad_push (self->rec_srcpad, outbuffer);
-    if (res != GST_FLOW_OK)
-      break;
   }
 
 out:
@@ -1291,6 +1379,108 @@ out:
   return res;
 }
 
+/* runs on its own thread (the srcpad task), so the echo canceller and
+ * preprocessor never steal time from the capture thread */
+static void
+gst_speex_dsp_loop (gpointer data)
+{
+  GstSpeexDSP * self = GST_SPEEX_DSP (data);
+  GstBuffer * recbuffer = NULL;
+  GstBuffer * outbuffer = NULL;
+  GstBuffer * play_buffer;
+  GstFlowReturn res = GST_FLOW_OK;
+  GstClockTime base_time;
+  gint rate;
+
+  GST_OBJECT_LOCK (self);
+
+  for (;;) {
+    if (self->srcresult != GST_FLOW_OK)
+      goto flushing;
+    if (!g_queue_is_empty (self->work_queue))
+      break;
+    g_cond_wait (self->work_cond, GST_OBJECT_GET_LOCK (self));
+  }
+
+  recbuffer = g_queue_pop_head (self->work_queue);
+  rate = self->rate;
+  GST_OBJECT_UNLOCK (self);
+
+  base_time = gst_element_get_base_time (GST_ELEMENT_CAST (self));
+
+  GST_OBJECT_LOCK (self);
+
+  /* collect the frames the probe has handed over since last time */
+  while ((play_buffer = play_ring_pop (&self->play_ring)))
+    g_queue_push_head (self->buffers, play_buffer);
+
+  outbuffer = try_echo_cancel (
+      self->echostate,
+      recbuffer,
+      GST_BUFFER_TIMESTAMP (recbuffer) + base_time /*- (((GstClockTime)self->latency_tune) * GST_MSECOND)*/,
+      base_time,
+      self->buffers,
+      rate,
+      self->rec_srcpad,
+      GST_PAD_CAPS (self->rec_sinkpad),
+      &res,
+      self);
+  GST_OBJECT_UNLOCK (self);
+  if (outbuffer) {
+    /* if cancel succeeds, then post-processing occurs on the newly returned
+     * buffer and we can free the original one.  newly returned buffer has
+     * appropriate caps.
+     */
+    gst_buffer_unref (recbuffer);
+  }
+  else {
+    /* if cancel fails, it's possible it was due to a flow error when
+     * creating a new buffer */
+    if (res != GST_FLOW_OK) {
+      gst_buffer_unref (recbuffer);
+      goto pause;
+    }
+
+    /* if cancel fails, then post-processing occurs on the original buffer,
+     * just make it writable and set appropriate caps.
+     */
+    outbuffer = gst_buffer_make_writable (recbuffer);
+    gst_buffer_set_caps (outbuffer, GST_PAD_CAPS (self->rec_sinkpad));
+  }
+
+  GST_OBJECT_LOCK (self);
+  speex_preprocess_run (self->preprocstate,
+      (spx_int16_t *) GST_BUFFER_DATA (outbuffer));
+  GST_OBJECT_UNLOCK (self);
+
+  GST_LOG_OBJECT (self, "Sending out buffer %p", outbuffer);
+  res = gst_pad_push (self->rec_srcpad, outbuffer);
+  if (res != GST_FLOW_OK)
+    goto pause;
+
+  return;
+
+ flushing:
+  {
+    GST_DEBUG_OBJECT (self, "dsp worker is flushing");
+    gst_pad_pause_task (self->rec_srcpad);
+    GST_OBJECT_UNLOCK (self);
+    return;
+  }
+
+ pause:
+  {
+    GST_DEBUG_OBJECT (self, "pausing dsp worker, reason %s",
+        gst_flow_get_name (res));
+    GST_OBJECT_LOCK (self);
+    /* the next capture buffer will pick this up and return it upstream */
+    self->srcresult = res;
+    gst_pad_pause_task (self->rec_srcpad);
+    GST_OBJECT_UNLOCK (self);
+    return;
+  }
+}
+
 static void
 gst_speex_dsp_reset_locked (GstSpeexDSP * self)
 {
@@ -1362,13 +1552,11 @@ gst_speex_dsp_add_capture_buffer (GstSpeexDSP * self, GstBuffer * buf)
   GstStructure * structure;
   int rate = 0;
 
-  GST_OBJECT_LOCK (self);
-  if (self->rate != 0) {
-    rate = self->rate;
-    GST_OBJECT_UNLOCK (self);
-  }
-  else {
-    GST_OBJECT_UNLOCK (self);
+  /* don't take the object lock here: the dsp worker holds it while it is
+   * deep in the speex filters, and the playback thread must not wait for
+   * that.  a plain word read of the rate is good enough for logging. */
+  rate = g_atomic_int_get (&self->rate);
+  if (rate == 0) {
     caps = GST_BUFFER_CAPS (buf);
     if (caps) {
       structure = gst_caps_get_structure (GST_BUFFER_CAPS (buf), 0);
@@ -1397,9 +1585,10 @@ gst_speex_dsp_add_capture_buffer (GstSpeexDSP * self, GstBuffer * buf)
   }
   g_static_mutex_unlock (&pairlog_mutex);
 
-  GST_OBJECT_LOCK (self);
-  g_queue_push_head (self->buffers, buf);
-  GST_OBJECT_UNLOCK (self);
+  if (!play_ring_push (&self->play_ring, buf)) {
+    GST_LOG_OBJECT (self, "Played frame ring full, dropping frame");
+    gst_buffer_unref (buf);
+  }
 }
 
 /* global_mutex locked during this call */
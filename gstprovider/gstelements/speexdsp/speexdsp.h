@@ -52,6 +52,21 @@ GST_DEBUG_CATEGORY_EXTERN (speex_dsp_debug);
 
 typedef struct _GstSpeexDSP GstSpeexDSP;
 typedef struct _GstSpeexDSPClass GstSpeexDSPClass;
+typedef struct _GstSpeexDSPPlayRing GstSpeexDSPPlayRing;
+
+/* Played frames cross from the probe's streaming thread to the dsp worker
+ * through this fixed-size ring.  The producer side (probe) only touches
+ * 'head', the consumer side (worker, always under the dsp object lock)
+ * only touches 'tail', both with atomic ops, so the playback thread never
+ * waits on the dsp. */
+#define GST_SPEEX_DSP_PLAY_RING_SIZE 64
+
+struct _GstSpeexDSPPlayRing
+{
+  GstBuffer * bufs[GST_SPEEX_DSP_PLAY_RING_SIZE];
+  volatile gint head; /* next slot to write, owned by the producer */
+  volatile gint tail; /* next slot to read, owned by the consumer */
+};
 
 struct _GstSpeexDSP
 {
@@ -86,6 +101,15 @@ struct _GstSpeexDSP
   GstSpeexEchoProbe * probe;
   GQueue * buffers;
 
+  /* Lock-free handoff of played frames from the probe */
+  GstSpeexDSPPlayRing play_ring;
+
+  /* Captured frames waiting for the dsp worker, protected by the object
+   * lock */
+  GQueue * work_queue;
+  GCond * work_cond;
+  GstFlowReturn srcresult;
+
   /* Protected by the object lock */
   gint latency_tune;
   gboolean agc;
@@ -40,6 +40,18 @@ static GstStaticPadTemplate gst_videomaxrate_sink_template =
     GST_STATIC_CAPS ("video/x-raw-yuv; video/x-raw-rgb")
     );
 
+#define DEFAULT_BURST 2
+
+enum
+{
+  PROP_0,
+  PROP_BURST
+};
+
+static void gst_videomaxrate_set_property (GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec);
+static void gst_videomaxrate_get_property (GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec);
 static gboolean gst_videomaxrate_sink_event (GstPad *pad, GstEvent *event);
 static GstCaps *gst_videomaxrate_transform_caps (GstBaseTransform *trans,
     GstPadDirection direction, GstCaps *caps);
@@ -67,12 +79,24 @@ gst_videomaxrate_base_init (gpointer gclass)
 static void
 gst_videomaxrate_class_init (GstVideoMaxRateClass *klass)
 {
+  GObjectClass *gobject_class;
   GstBaseTransformClass *base_class;
+
+  gobject_class = (GObjectClass *)klass;
   base_class = (GstBaseTransformClass *)klass;
 
+  gobject_class->set_property = gst_videomaxrate_set_property;
+  gobject_class->get_property = gst_videomaxrate_get_property;
+
   base_class->transform_caps = gst_videomaxrate_transform_caps;
   base_class->set_caps = gst_videomaxrate_set_caps;
   base_class->transform_ip = gst_videomaxrate_transform_ip;
+
+  g_object_class_install_property (gobject_class, PROP_BURST,
+      g_param_spec_uint ("burst", "Burst tolerance",
+          "Number of frames that may pass back-to-back above the average"
+          " rate", 0, G_MAXUINT, DEFAULT_BURST,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -83,12 +107,45 @@ gst_videomaxrate_init (GstVideoMaxRate *videomaxrate,
 
   videomaxrate->to_rate_numerator = -1;
   videomaxrate->to_rate_denominator = -1;
-  videomaxrate->have_last_ts = FALSE;
+  videomaxrate->burst = DEFAULT_BURST;
+  videomaxrate->have_bucket = FALSE;
 
   gst_pad_set_event_function (GST_BASE_TRANSFORM_SINK_PAD (videomaxrate),
       gst_videomaxrate_sink_event);
 }
 
+static void
+gst_videomaxrate_set_property (GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
+{
+  GstVideoMaxRate *videomaxrate = GST_VIDEOMAXRATE (object);
+
+  switch (prop_id) {
+    case PROP_BURST:
+      videomaxrate->burst = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_videomaxrate_get_property (GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+  GstVideoMaxRate *videomaxrate = GST_VIDEOMAXRATE (object);
+
+  switch (prop_id) {
+    case PROP_BURST:
+      g_value_set_uint (value, videomaxrate->burst);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 gboolean
 gst_videomaxrate_sink_event (GstPad *pad, GstEvent *event)
 {
@@ -99,7 +156,7 @@ gst_videomaxrate_sink_event (GstPad *pad, GstEvent *event)
   switch (GST_EVENT_TYPE(event)) {
     case GST_EVENT_NEWSEGMENT:
     case GST_EVENT_FLUSH_STOP:
-      videomaxrate->have_last_ts = FALSE;
+      videomaxrate->have_bucket = FALSE;
       break;
     default:
       break;
@@ -162,21 +219,43 @@ GstFlowReturn
 gst_videomaxrate_transform_ip (GstBaseTransform *trans, GstBuffer *buf)
 {
   GstVideoMaxRate *videomaxrate;
-  GstClockTime ts;
+  GstClockTime ts, frame_dur, max_credit;
 
   videomaxrate = (GstVideoMaxRate *)trans;
   ts = GST_BUFFER_TIMESTAMP (buf);
 
-  /* drop frames if they exceed our output rate */
-  if (videomaxrate->have_last_ts) {
-    if (ts < videomaxrate->last_ts + gst_util_uint64_scale (1,
-            videomaxrate->to_rate_denominator * GST_SECOND,
-            videomaxrate->to_rate_numerator)) {
-      return GST_BASE_TRANSFORM_FLOW_DROPPED;
-    }
+  frame_dur = gst_util_uint64_scale (1,
+      videomaxrate->to_rate_denominator * GST_SECOND,
+      videomaxrate->to_rate_numerator);
+
+  /* drop frames if they exceed our output rate, averaged over the bucket.
+   * strict per-frame spacing turns an irregular camera into a steady
+   * drop-drop-pass stutter; allowing a small burst keeps motion smooth as
+   * long as the average stays under the target */
+  max_credit = frame_dur * (videomaxrate->burst + 1);
+
+  if (!videomaxrate->have_bucket) {
+    videomaxrate->have_bucket = TRUE;
+    videomaxrate->credit = frame_dur; /* let the first frame through */
+    videomaxrate->bucket_ts = ts;
+  }
+  else {
+    if (ts > videomaxrate->bucket_ts)
+      videomaxrate->credit += ts - videomaxrate->bucket_ts;
+    if (videomaxrate->credit > max_credit)
+      videomaxrate->credit = max_credit;
+    videomaxrate->bucket_ts = ts;
+  }
+
+  if (videomaxrate->credit < frame_dur) {
+    /* tell upstream how long until we will take a frame again, so the
+     * convert/scale elements ahead of us don't process frames we are
+     * going to drop anyway */
+    gst_pad_push_event (GST_BASE_TRANSFORM_SINK_PAD (videomaxrate),
+        gst_event_new_qos (1.0, frame_dur - videomaxrate->credit, ts));
+    return GST_BASE_TRANSFORM_FLOW_DROPPED;
   }
 
-  videomaxrate->last_ts = ts;
-  videomaxrate->have_last_ts = TRUE;
+  videomaxrate->credit -= frame_dur;
   return GST_FLOW_OK;
 }
@@ -47,8 +47,13 @@ struct _GstVideoMaxRate
   gint to_rate_numerator;
   gint to_rate_denominator;
 
-  gboolean have_last_ts;
-  GstClockTime last_ts;
+  /* token-bucket state.  credit accumulates with the passage of stream
+   * time and each passed frame costs one frame duration, so frames pass
+   * while the average rate stays under the target */
+  guint burst;
+  gboolean have_bucket;
+  GstClockTime credit;
+  GstClockTime bucket_ts;
 };
 
 struct _GstVideoMaxRateClass
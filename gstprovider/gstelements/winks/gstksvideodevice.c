@@ -56,7 +56,7 @@ typedef struct
 typedef struct
 {
   KSSTREAM_READ_PARAMS params;
-  guint8 *buf_unaligned;
+  GstBuffer *gstbuf;
   guint8 *buf;
   OVERLAPPED overlapped;
 } ReadRequest;
@@ -89,6 +89,13 @@ typedef struct
   GArray *requests;
   GArray *request_events;
   GstClockTime last_timestamp;
+
+  /* recycling pool for the frame memory handed downstream.  when the
+   * last ref on a frame buffer drops, its memory comes back here and is
+   * re-armed into a pending read request instead of being freed */
+  GMutex *frame_pool_lock;
+  GSList *frame_pool;
+  guint frame_pool_alloc_size;
 } GstKsVideoDevicePrivate;
 
 #define GST_KS_VIDEO_DEVICE_GET_PRIVATE(o) \
@@ -96,12 +103,15 @@ typedef struct
     GstKsVideoDevicePrivate))
 
 static void gst_ks_video_device_dispose (GObject * object);
+static void gst_ks_video_device_finalize (GObject * object);
 static void gst_ks_video_device_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec);
 static void gst_ks_video_device_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
 
 static void gst_ks_video_device_reset_caps (GstKsVideoDevice * self);
+static GstBuffer *gst_ks_frame_buffer_new (GstKsVideoDevice * self);
+static void gst_ks_video_device_flush_frame_pool (GstKsVideoDevice * self);
 
 GST_BOILERPLATE (GstKsVideoDevice, gst_ks_video_device, GObject, G_TYPE_OBJECT);
 
@@ -118,6 +128,7 @@ gst_ks_video_device_class_init (GstKsVideoDeviceClass * klass)
   g_type_class_add_private (klass, sizeof (GstKsVideoDevicePrivate));
 
   gobject_class->dispose = gst_ks_video_device_dispose;
+  gobject_class->finalize = gst_ks_video_device_finalize;
   gobject_class->get_property = gst_ks_video_device_get_property;
   gobject_class->set_property = gst_ks_video_device_set_property;
 
@@ -140,6 +151,10 @@ gst_ks_video_device_init (GstKsVideoDevice * self,
 
   priv->open = FALSE;
   priv->state = KSSTATE_STOP;
+
+  priv->frame_pool_lock = g_mutex_new ();
+  priv->frame_pool = NULL;
+  priv->frame_pool_alloc_size = 0;
 }
 
 static void
@@ -159,6 +174,22 @@ gst_ks_video_device_dispose (GObject * object)
   G_OBJECT_CLASS (parent_class)->dispose (object);
 }
 
+static void
+gst_ks_video_device_finalize (GObject * object)
+{
+  GstKsVideoDevice *self = GST_KS_VIDEO_DEVICE (object);
+  GstKsVideoDevicePrivate *priv = GST_KS_VIDEO_DEVICE_GET_PRIVATE (self);
+
+  /* in-flight frame buffers hold a ref on us, so by the time we get
+   * here nothing can return a slot to the pool anymore */
+  gst_ks_video_device_flush_frame_pool (self);
+
+  g_mutex_free (priv->frame_pool_lock);
+  priv->frame_pool_lock = NULL;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
 static void
 gst_ks_video_device_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec)
@@ -239,6 +270,140 @@ gst_ks_video_device_parse_win32_error (const gchar * func_name,
   }
 }
 
+/*
+ * GstKsFrameBuffer: a GstBuffer subclass wrapping one of the kernel
+ * streaming capture slots directly, so the source can push descriptors
+ * downstream instead of copying a full frame per capture.  When the
+ * last ref is dropped the slot goes back on the device's frame pool,
+ * from where the next read request picks it up.  Same technique as
+ * GstNetBuffer in -base.
+ */
+typedef struct
+{
+  GstBuffer buffer;
+
+  GstKsVideoDevice *dev;
+  guint8 *buf_unaligned;
+  guint alloc_size;
+} GstKsFrameBuffer;
+
+typedef struct
+{
+  GstBufferClass buffer_class;
+} GstKsFrameBufferClass;
+
+static GstBufferClass *frame_buffer_parent_class = NULL;
+
+#define GST_TYPE_KS_FRAME_BUFFER (gst_ks_frame_buffer_get_type ())
+
+static GType gst_ks_frame_buffer_get_type (void);
+
+static void
+gst_ks_frame_buffer_finalize (GstMiniObject * obj)
+{
+  GstKsFrameBuffer *fbuf = (GstKsFrameBuffer *) obj;
+  GstKsVideoDevice *self = fbuf->dev;
+  GstKsVideoDevicePrivate *priv = GST_KS_VIDEO_DEVICE_GET_PRIVATE (self);
+
+  g_mutex_lock (priv->frame_pool_lock);
+  if (fbuf->alloc_size == priv->frame_pool_alloc_size) {
+    priv->frame_pool = g_slist_prepend (priv->frame_pool,
+        fbuf->buf_unaligned);
+  } else {
+    /* caps changed while this frame was in flight, its slot is useless */
+    g_free (fbuf->buf_unaligned);
+  }
+  g_mutex_unlock (priv->frame_pool_lock);
+
+  g_object_unref (self);
+
+  /* malloc_data was never set, so the parent finalize only releases the
+   * mini object itself */
+  GST_MINI_OBJECT_CLASS (frame_buffer_parent_class)->finalize (obj);
+}
+
+static void
+gst_ks_frame_buffer_class_init (gpointer klass, gpointer class_data)
+{
+  GstMiniObjectClass *mo_class = GST_MINI_OBJECT_CLASS (klass);
+
+  frame_buffer_parent_class = g_type_class_peek_parent (klass);
+  mo_class->finalize = gst_ks_frame_buffer_finalize;
+}
+
+static GType
+gst_ks_frame_buffer_get_type (void)
+{
+  static GType type = 0;
+
+  if (G_UNLIKELY (type == 0)) {
+    static const GTypeInfo info = {
+      sizeof (GstKsFrameBufferClass),
+      NULL,
+      NULL,
+      gst_ks_frame_buffer_class_init,
+      NULL,
+      NULL,
+      sizeof (GstKsFrameBuffer),
+      0,
+      NULL,
+      NULL
+    };
+    type = g_type_register_static (GST_TYPE_BUFFER, "GstKsFrameBuffer",
+        &info, 0);
+  }
+  return type;
+}
+
+static GstBuffer *
+gst_ks_frame_buffer_new (GstKsVideoDevice * self)
+{
+  GstKsVideoDevicePrivate *priv = GST_KS_VIDEO_DEVICE_GET_PRIVATE (self);
+  GstKsFrameBuffer *fbuf;
+  guint alloc_size;
+  guint8 *data = NULL;
+
+  g_mutex_lock (priv->frame_pool_lock);
+  alloc_size = priv->frame_pool_alloc_size;
+  if (priv->frame_pool != NULL) {
+    data = priv->frame_pool->data;
+    priv->frame_pool = g_slist_delete_link (priv->frame_pool,
+        priv->frame_pool);
+  }
+  g_mutex_unlock (priv->frame_pool_lock);
+
+  /* pool empty: downstream is holding on to more frames than we have
+   * requests, grow by one rather than stalling the capture thread */
+  if (data == NULL)
+    data = g_malloc (alloc_size);
+
+  fbuf = (GstKsFrameBuffer *) gst_mini_object_new (GST_TYPE_KS_FRAME_BUFFER);
+  fbuf->dev = g_object_ref (self);
+  fbuf->buf_unaligned = data;
+  fbuf->alloc_size = alloc_size;
+
+  GST_BUFFER_DATA (fbuf) = (guint8 *) (((gsize) data + BUFFER_ALIGNMENT - 1)
+      & ~(BUFFER_ALIGNMENT - 1));
+  GST_BUFFER_SIZE (fbuf) = gst_ks_video_device_get_frame_size (self);
+
+  return GST_BUFFER_CAST (fbuf);
+}
+
+static void
+gst_ks_video_device_flush_frame_pool (GstKsVideoDevice * self)
+{
+  GstKsVideoDevicePrivate *priv = GST_KS_VIDEO_DEVICE_GET_PRIVATE (self);
+  GSList *cur;
+
+  g_mutex_lock (priv->frame_pool_lock);
+  for (cur = priv->frame_pool; cur != NULL; cur = cur->next)
+    g_free (cur->data);
+  g_slist_free (priv->frame_pool);
+  priv->frame_pool = NULL;
+  priv->frame_pool_alloc_size = 0;
+  g_mutex_unlock (priv->frame_pool_lock);
+}
+
 static void
 gst_ks_video_device_clear_buffers (GstKsVideoDevice * self)
 {
@@ -264,7 +429,7 @@ gst_ks_video_device_clear_buffers (GstKsVideoDevice * self)
     ReadRequest *req = &g_array_index (priv->requests, ReadRequest, i);
     HANDLE ev = g_array_index (priv->request_events, HANDLE, i);
 
-    g_free (req->buf_unaligned);
+    gst_buffer_unref (req->gstbuf);
 
     if (ev)
       CloseHandle (ev);
@@ -275,6 +440,10 @@ gst_ks_video_device_clear_buffers (GstKsVideoDevice * self)
 
   g_array_free (priv->request_events, TRUE);
   priv->request_events = NULL;
+
+  /* frames still held downstream free their slots on unref, since the
+   * pool size no longer matches */
+  gst_ks_video_device_flush_frame_pool (self);
 }
 
 static void
@@ -295,12 +464,15 @@ gst_ks_video_device_prepare_buffers (GstKsVideoDevice * self)
 
   frame_size = gst_ks_video_device_get_frame_size (self);
 
+  g_mutex_lock (priv->frame_pool_lock);
+  priv->frame_pool_alloc_size = frame_size + BUFFER_ALIGNMENT - 1;
+  g_mutex_unlock (priv->frame_pool_lock);
+
   for (i = 0; i < priv->num_requests; i++) {
     ReadRequest req = { 0, };
 
-    req.buf_unaligned = g_malloc (frame_size + BUFFER_ALIGNMENT - 1);
-    req.buf = (guint8 *) (((gsize) req.buf_unaligned + BUFFER_ALIGNMENT - 1)
-        & ~(BUFFER_ALIGNMENT - 1));
+    req.gstbuf = gst_ks_frame_buffer_new (self);
+    req.buf = GST_BUFFER_DATA (req.gstbuf);
 
     req.overlapped.hEvent = CreateEvent (NULL, TRUE, FALSE, NULL);
 
@@ -908,9 +1080,8 @@ error_ioctl:
 }
 
 GstFlowReturn
-gst_ks_video_device_read_frame (GstKsVideoDevice * self, guint8 * buf,
-    gulong buf_size, gulong * bytes_read, GstClockTime * presentation_time,
-    gulong * error_code, gchar ** error_str)
+gst_ks_video_device_read_frame (GstKsVideoDevice * self, GstBuffer ** buffer,
+    GstClockTime * presentation_time, gulong * error_code, gchar ** error_str)
 {
   GstKsVideoDevicePrivate *priv = GST_KS_VIDEO_DEVICE_GET_PRIVATE (self);
   guint req_idx;
@@ -920,6 +1091,8 @@ gst_ks_video_device_read_frame (GstKsVideoDevice * self, guint8 * buf,
 
   g_assert (priv->cur_media_type != NULL);
 
+  *buffer = NULL;
+
   /* First time we're called, submit the requests. */
   if (G_UNLIKELY (!priv->requests_submitted)) {
     priv->requests_submitted = TRUE;
@@ -945,13 +1118,12 @@ gst_ks_video_device_read_frame (GstKsVideoDevice * self, guint8 * buf,
     if (WaitForSingleObject (priv->cancel_event, 0) == WAIT_OBJECT_0)
       goto error_cancel;
 
-    *bytes_read = 0;
-
     /* Find the last ReadRequest that finished and get the result, immediately
      * re-issuing each request that has completed. */
     for (req_idx = wait_ret - WAIT_OBJECT_0;
         req_idx < priv->num_requests; req_idx++) {
       ReadRequest *req = &g_array_index (priv->requests, ReadRequest, req_idx);
+      gulong bytes_read = 0;
 
       /*
        * Completed? WaitForMultipleObjects() returns the lowest index if
@@ -980,10 +1152,7 @@ gst_ks_video_device_read_frame (GstKsVideoDevice * self, guint8 * buf,
           duration = hdr->Duration * 100;
 
         /* Assume it's a good frame */
-        *bytes_read = hdr->DataUsed;
-
-        if (G_LIKELY (presentation_time != NULL))
-          *presentation_time = timestamp;
+        bytes_read = hdr->DataUsed;
 
         if (G_UNLIKELY (GST_DEBUG_IS_ENABLED ())) {
           gchar *options_flags_str =
@@ -1008,49 +1177,59 @@ gst_ks_video_device_read_frame (GstKsVideoDevice * self, guint8 * buf,
                 ", timestamp=%" GST_TIME_FORMAT ")",
                 GST_TIME_ARGS (priv->last_timestamp),
                 GST_TIME_ARGS (timestamp));
-            *bytes_read = 0;
+            bytes_read = 0;
           } else {
             priv->last_timestamp = timestamp;
           }
         }
 
-        if (*bytes_read > 0) {
-          /* Grab the frame data */
-          g_assert (buf_size >= hdr->DataUsed);
-          memcpy (buf, req->buf, hdr->DataUsed);
-
-          if (priv->is_mjpeg) {
-            /*
-             * Workaround for cameras/drivers that intermittently provide us
-             * with incomplete or corrupted MJPEG frames.
-             *
-             * Happens with for instance Microsoft LifeCam VX-7000.
-             */
-
-            gboolean valid = FALSE;
-            guint padding = 0;
-
-            /* JFIF SOI marker */
-            if (*bytes_read > MJPEG_MAX_PADDING
-                && buf[0] == 0xff && buf[1] == 0xd8) {
-              guint8 *p = buf + *bytes_read - 2;
-
-              /* JFIF EOI marker (but skip any padding) */
-              while (padding < MJPEG_MAX_PADDING - 1 - 2 && !valid) {
-                if (p[0] == 0xff && p[1] == 0xd9) {
-                  valid = TRUE;
-                } else {
-                  padding++;
-                  p--;
-                }
+        if (bytes_read > 0 && priv->is_mjpeg) {
+          /*
+           * Workaround for cameras/drivers that intermittently provide us
+           * with incomplete or corrupted MJPEG frames.
+           *
+           * Happens with for instance Microsoft LifeCam VX-7000.
+           */
+
+          gboolean valid = FALSE;
+          guint padding = 0;
+
+          /* JFIF SOI marker */
+          if (bytes_read > MJPEG_MAX_PADDING
+              && req->buf[0] == 0xff && req->buf[1] == 0xd8) {
+            guint8 *p = req->buf + bytes_read - 2;
+
+            /* JFIF EOI marker (but skip any padding) */
+            while (padding < MJPEG_MAX_PADDING - 1 - 2 && !valid) {
+              if (p[0] == 0xff && p[1] == 0xd9) {
+                valid = TRUE;
+              } else {
+                padding++;
+                p--;
               }
             }
-
-            if (valid)
-              *bytes_read -= padding;
-            else
-              *bytes_read = 0;
           }
+
+          if (valid)
+            bytes_read -= padding;
+          else
+            bytes_read = 0;
+        }
+
+        if (bytes_read > 0) {
+          /* Hand the kernel streaming buffer straight to the caller
+           * (newest completed frame wins, like the old copying code),
+           * and re-arm the request with a fresh slot from the pool */
+          if (*buffer != NULL)
+            gst_buffer_unref (*buffer);
+          *buffer = req->gstbuf;
+          GST_BUFFER_SIZE (*buffer) = bytes_read;
+
+          if (G_LIKELY (presentation_time != NULL))
+            *presentation_time = timestamp;
+
+          req->gstbuf = gst_ks_frame_buffer_new (self);
+          req->buf = GST_BUFFER_DATA (req->gstbuf);
         }
       } else if (GetLastError () != ERROR_OPERATION_ABORTED)
         goto error_get_result;
@@ -1059,13 +1238,18 @@ gst_ks_video_device_read_frame (GstKsVideoDevice * self, guint8 * buf,
       if (!gst_ks_video_device_request_frame (self, req, error_code, error_str))
         goto error_request_failed;
     }
-  } while (*bytes_read == 0);
+  } while (*buffer == NULL);
 
   return GST_FLOW_OK;
 
   /* ERRORS */
 error_request_failed:
   {
+    if (*buffer != NULL) {
+      gst_buffer_unref (*buffer);
+      *buffer = NULL;
+    }
+
     return GST_FLOW_ERROR;
   }
 error_timeout:
@@ -1100,6 +1284,11 @@ error_get_result:
     gst_ks_video_device_parse_win32_error ("GetOverlappedResult",
         GetLastError (), error_code, error_str);
 
+    if (*buffer != NULL) {
+      gst_buffer_unref (*buffer);
+      *buffer = NULL;
+    }
+
     return GST_FLOW_ERROR;
   }
 }
@@ -66,7 +66,10 @@ guint gst_ks_video_device_get_frame_size (GstKsVideoDevice * self);
 GstClockTime gst_ks_video_device_get_duration (GstKsVideoDevice * self);
 gboolean gst_ks_video_device_get_latency (GstKsVideoDevice * self, GstClockTime * min_latency, GstClockTime * max_latency);
 
-GstFlowReturn gst_ks_video_device_read_frame (GstKsVideoDevice * self, guint8 * buf, gulong buf_size, gulong * bytes_read, GstClockTime * presentation_time, gulong * error_code, gchar ** error_str);
+/* Returns a buffer wrapping the kernel streaming capture slot directly;
+ * when the last ref drops, the slot is recycled into a pending read
+ * request rather than freed. */
+GstFlowReturn gst_ks_video_device_read_frame (GstKsVideoDevice * self, GstBuffer ** buffer, GstClockTime * presentation_time, gulong * error_code, gchar ** error_str);
 void gst_ks_video_device_postprocess_frame (GstKsVideoDevice * self, guint8 * buf, guint buf_size);
 void gst_ks_video_device_cancel (GstKsVideoDevice * self);
 void gst_ks_video_device_cancel_stop (GstKsVideoDevice * self);
@@ -899,7 +899,6 @@ gst_ks_video_src_create (GstPushSrc * pushsrc, GstBuffer ** buffer)
 {
   GstKsVideoSrc *self = GST_KS_VIDEO_SRC (pushsrc);
   GstKsVideoSrcPrivate *priv = GST_KS_VIDEO_SRC_GET_PRIVATE (self);
-  guint buf_size;
   GstCaps *caps;
   GstBuffer *buf = NULL;
   GstFlowReturn result;
@@ -912,17 +911,9 @@ gst_ks_video_src_create (GstPushSrc * pushsrc, GstBuffer ** buffer)
   if (!gst_ks_video_device_has_caps (priv->device))
     goto error_no_caps;
 
-  buf_size = gst_ks_video_device_get_frame_size (priv->device);
-  g_assert (buf_size);
-
   caps = gst_pad_get_negotiated_caps (GST_BASE_SRC_PAD (self));
   if (caps == NULL)
     goto error_no_caps;
-  result = gst_pad_alloc_buffer (GST_BASE_SRC_PAD (self), priv->offset,
-      buf_size, caps, &buf);
-  gst_caps_unref (caps);
-  if (G_UNLIKELY (result != GST_FLOW_OK))
-    goto error_alloc_buffer;
 
   if (G_UNLIKELY (!priv->running)) {
     KS_WORKER_LOCK (priv);
@@ -938,17 +929,20 @@ gst_ks_video_src_create (GstPushSrc * pushsrc, GstBuffer ** buffer)
   }
 
   do {
-    gulong bytes_read;
-
-    result = gst_ks_video_device_read_frame (priv->device,
-        GST_BUFFER_DATA (buf), buf_size, &bytes_read, &presentation_time,
-        &error_code, &error_str);
+    result = gst_ks_video_device_read_frame (priv->device, &buf,
+        &presentation_time, &error_code, &error_str);
     if (G_UNLIKELY (result != GST_FLOW_OK))
       goto error_read_frame;
 
-    GST_BUFFER_SIZE (buf) = bytes_read;
+    if (!gst_ks_video_src_timestamp_buffer (self, buf, presentation_time)) {
+      gst_buffer_unref (buf);
+      buf = NULL;
+    }
   }
-  while (!gst_ks_video_src_timestamp_buffer (self, buf, presentation_time));
+  while (buf == NULL);
+
+  gst_buffer_set_caps (buf, caps);
+  gst_caps_unref (caps);
 
   if (G_UNLIKELY (priv->do_stats))
     gst_ks_video_src_update_statistics (self);
@@ -973,14 +967,9 @@ error_start_capture:
         ("could not start capture"),
         ("failed to change pin state to KSSTATE_RUN"));
 
+    gst_caps_unref (caps);
     return GST_FLOW_ERROR;
   }
-error_alloc_buffer:
-  {
-    GST_ELEMENT_ERROR (self, CORE, PAD, ("alloc_buffer failed"), (NULL));
-
-    return result;
-  }
 error_read_frame:
   {
     if (result != GST_FLOW_WRONG_STATE && result != GST_FLOW_UNEXPECTED) {
@@ -990,7 +979,7 @@ error_read_frame:
     }
 
     g_free (error_str);
-    gst_buffer_unref (buf);
+    gst_caps_unref (caps);
 
     return result;
   }
@@ -21,16 +21,23 @@
 #include "psimediaprovider.h"
 
 #include <QStringList>
+#include <QSet>
 #include <QImage>
 #include <QMutex>
+#include <QAtomicInt>
 #include <QWaitCondition>
 #include <QTime>
+#include <QTimer>
 #include <QtPlugin>
 #include <QIODevice>
+#include <QFile>
 #include "devices.h"
 #include "modes.h"
+#include "deviceenum/deviceenum.h"
 #include "gstthread.h"
 #include "rwcontrol.h"
+#include "rtcp.h"
+#include "gstcustomelements/bufmon.h"
 
 #ifdef QT_GUI_LIB
 #include <QWidget>
@@ -45,6 +52,9 @@ static PDevice gstDeviceToPDevice(const GstDevice &dev, PDevice::Type type)
 	out.type = type;
 	out.name = dev.name;
 	out.id = dev.id;
+	out.videoSizes = dev.videoSizes;
+	out.videoFramerates = dev.videoFramerates;
+	out.audioSampleRates = dev.audioSampleRates;
 	return out;
 }
 
@@ -57,11 +67,24 @@ class GstVideoWidget : public QObject
 
 public:
 	VideoWidgetContext *context;
-	QImage curImage;
+
+	// holding the frame (not just the image) keeps the backing GstBuffer
+	//   alive while we paint from it
+	RtpWorker::Frame curFrame;
+	int frameGen;
+
+	// cache of the last scale result, keyed by (frame generation,
+	//   target size).  repainting an unchanged frame at an unchanged
+	//   size (expose events, overlap) is then just a blit
+	QImage scaledImage;
+	QSize scaledSize;
+	int scaledGen;
 
 	GstVideoWidget(VideoWidgetContext *_context, QObject *parent = 0) :
 		QObject(parent),
-		context(_context)
+		context(_context),
+		frameGen(0),
+		scaledGen(-1)
 	{
 		QPalette palette;
 		palette.setColor(context->qwidget()->backgroundRole(), Qt::black);
@@ -72,9 +95,10 @@ public:
 		connect(context->qobject(), SIGNAL(paintEvent(QPainter *)), SLOT(context_paintEvent(QPainter *)));
 	}
 
-	void show_frame(const QImage &image)
+	void show_frame(const RtpWorker::Frame &frame)
 	{
-		curImage = image;
+		curFrame = frame;
+		++frameGen;
 		context->qwidget()->update();
 	}
 
@@ -86,6 +110,7 @@ private slots:
 
 	void context_paintEvent(QPainter *p)
 	{
+		const QImage &curImage = curFrame.image;
 		if(curImage.isNull())
 			return;
 
@@ -104,9 +129,15 @@ private slots:
 		QImage i;
 		if(curImage.size() != newSize)
 		{
-			// the IgnoreAspectRatio is okay here, since we
-			//   used KeepAspectRatio earlier
-			i = curImage.scaled(newSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+			if(scaledGen != frameGen || scaledSize != newSize)
+			{
+				// the IgnoreAspectRatio is okay here, since we
+				//   used KeepAspectRatio earlier
+				scaledImage = curImage.scaled(newSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+				scaledSize = newSize;
+				scaledGen = frameGen;
+			}
+			i = scaledImage;
 		}
 		else
 			i = curImage;
@@ -118,56 +149,141 @@ private slots:
 //----------------------------------------------------------------------------
 // GstFeaturesContext
 //----------------------------------------------------------------------------
-static QList<PDevice> get_audioOutputDevices()
+static QList<PDevice> get_devices(PDevice::Type type, bool probeCaps)
 {
 	QList<PDevice> list;
-	foreach(const GstDevice &i, devices_list(PDevice::AudioOut))
-		list += gstDeviceToPDevice(i, PDevice::AudioOut);
+	foreach(GstDevice i, devices_list(type))
+	{
+		// one extra device open per entry, so only when asked for
+		if(probeCaps)
+			devices_probeCaps(&i, type);
+		list += gstDeviceToPDevice(i, type);
+	}
 	return list;
 }
 
-static QList<PDevice> get_audioInputDevices()
+class DeviceEnumThread : public QThread
 {
-	QList<PDevice> list;
-	foreach(const GstDevice &i, devices_list(PDevice::AudioIn))
-		list += gstDeviceToPDevice(i, PDevice::AudioIn);
-	return list;
-}
+public:
+	PDevice::Type type;
+	bool probeCaps;
+	QList<PDevice> results;
 
-static QList<PDevice> get_videoInputDevices()
-{
-	QList<PDevice> list;
-	foreach(const GstDevice &i, devices_list(PDevice::VideoIn))
-		list += gstDeviceToPDevice(i, PDevice::VideoIn);
-	return list;
-}
+	DeviceEnumThread(PDevice::Type _type, bool _probeCaps = false) :
+		type(_type),
+		probeCaps(_probeCaps)
+	{
+	}
+
+	virtual void run()
+	{
+		results = get_devices(type, probeCaps);
+	}
+};
 
 class FeaturesThread : public QThread
 {
         Q_OBJECT
 
 public:
+	GstThread *gstThread;
 	int types;
-	PFeatures results;
 
-	FeaturesThread(QObject *parent = 0) :
-		QThread(parent)
+	FeaturesThread(GstThread *_gstThread, QObject *parent = 0) :
+		QThread(parent),
+		gstThread(_gstThread)
+	{
+	}
+
+	// partial results are published as categories complete, and the
+	//   app thread may read them while probing is still running
+	PFeatures snapshot() const
 	{
+		QMutexLocker locker(&results_mutex);
+		return results;
 	}
 
 	virtual void run()
 	{
 		PFeatures out;
+
+		// gstreamer may still be initializing in the background.
+		//   we're on a worker thread, so just block until it is
+		//   usable.  if init failed, report empty results
+		if(!gstThread->waitForReady(-1))
+		{
+			publish(out);
+			return;
+		}
+
+		// probe each device class on its own thread, so the total
+		//   cost is the slowest single class instead of the sum of
+		//   all three
+		QList<DeviceEnumThread*> enumThreads;
+		bool probeCaps = (types & FeaturesContext::DeviceCaps) ? true : false;
 		if(types & FeaturesContext::AudioOut)
-			out.audioOutputDevices = get_audioOutputDevices();
+			enumThreads += new DeviceEnumThread(PDevice::AudioOut, probeCaps);
 		if(types & FeaturesContext::AudioIn)
-			out.audioInputDevices = get_audioInputDevices();
+			enumThreads += new DeviceEnumThread(PDevice::AudioIn, probeCaps);
 		if(types & FeaturesContext::VideoIn)
-			out.videoInputDevices = get_videoInputDevices();
+			enumThreads += new DeviceEnumThread(PDevice::VideoIn, probeCaps);
+		foreach(DeviceEnumThread *t, enumThreads)
+			t->start();
+
+		// the mode tables are instant: report them right away instead
+		//   of holding them hostage to device probing
+		int modeTypes = types & (FeaturesContext::AudioModes | FeaturesContext::VideoModes);
 		if(types & FeaturesContext::AudioModes)
 			out.supportedAudioModes = modes_supportedAudio();
 		if(types & FeaturesContext::VideoModes)
 			out.supportedVideoModes = modes_supportedVideo();
+		if(modeTypes)
+		{
+			publish(out);
+			emit progress(modeTypes);
+		}
+
+		// audio classes enumerate in milliseconds while a webcam scan
+		//   can take seconds, so waiting in creation order still gets
+		//   each class out roughly as it lands
+		foreach(DeviceEnumThread *t, enumThreads)
+		{
+			t->wait();
+			int doneType;
+			if(t->type == PDevice::AudioOut)
+			{
+				out.audioOutputDevices = t->results;
+				doneType = FeaturesContext::AudioOut;
+			}
+			else if(t->type == PDevice::AudioIn)
+			{
+				out.audioInputDevices = t->results;
+				doneType = FeaturesContext::AudioIn;
+			}
+			else // PDevice::VideoIn
+			{
+				out.videoInputDevices = t->results;
+				doneType = FeaturesContext::VideoIn;
+			}
+			delete t;
+
+			publish(out);
+			emit progress(doneType);
+		}
+	}
+
+signals:
+	// a category's results just became readable via snapshot().  types
+	//   is a bitmask of FeaturesContext::Type flags
+	void progress(int types);
+
+private:
+	PFeatures results;
+	mutable QMutex results_mutex;
+
+	void publish(const PFeatures &out)
+	{
+		QMutexLocker locker(&results_mutex);
 		results = out;
 	}
 };
@@ -180,13 +296,21 @@ class GstFeaturesContext : public QObject, public FeaturesContext
 public:
 	GstThread *gstThread;
 	FeaturesThread *thread;
+	DeviceEnum::Watcher *watcher;
 
 	GstFeaturesContext(GstThread *_gstThread, QObject *parent = 0) :
 		QObject(parent),
 		gstThread(_gstThread)
 	{
-		thread = new FeaturesThread(this);
+		thread = new FeaturesThread(gstThread, this);
 		connect(thread, SIGNAL(finished()), SIGNAL(finished()));
+		connect(thread, SIGNAL(progress(int)), SIGNAL(progress(int)));
+
+		// the watcher invalidates the enumeration cache on hotplug,
+		//   so a lookup made in response to devicesChanged sees the
+		//   new device set
+		watcher = new DeviceEnum::Watcher(this);
+		connect(watcher, SIGNAL(changed()), SIGNAL(devicesChanged()));
 	}
 
 	~GstFeaturesContext()
@@ -216,11 +340,13 @@ public:
 
 	virtual PFeatures results() const
 	{
-		return thread->results;
+		return thread->snapshot();
 	}
 
 signals:
 	void finished();
+	void progress(int types);
+	void devicesChanged();
 };
 
 //----------------------------------------------------------------------------
@@ -229,14 +355,80 @@ signals:
 // for a live transmission we really shouldn't have excessive queuing (or
 //   *any* queuing!), so we'll cap the queue sizes.  if the system gets
 //   overloaded and the thread scheduling skews such that our queues get
-//   filled before they can be emptied, then we'll start dropping old
-//   items making room for new ones.  on a live transmission there's no
-//   sense in keeping ancient data around.  we just drop and move on.
-#define QUEUE_PACKET_MAX 25
+//   filled before they can be emptied, then we'll start dropping items.
+//   on a live transmission there's no sense in keeping ancient data
+//   around.  we just drop and move on.
+//
+// must be a power of two, since the ring below masks with it
+#define QUEUE_PACKET_MAX 32
 
 // don't wake the main thread more often than this, for performance reasons
 #define WAKE_PACKET_MIN 40
 
+// watermarks for the backpressure signal, in ring slots
+#define QUEUE_PACKET_HIGH (QUEUE_PACKET_MAX * 3 / 4)
+#define QUEUE_PACKET_LOW (QUEUE_PACKET_MAX / 4)
+
+// milliseconds between rtcp reports
+#define RTCP_INTERVAL 5000
+
+// fixed-capacity single-producer/single-consumer ring.  the gst streaming
+//   thread is the only producer and the qt eventloop is the only consumer,
+//   so each index is advanced by exactly one thread and neither side ever
+//   blocks on the other.  head/tail are free-running counters (wraparound
+//   in two's complement keeps the arithmetic valid) and the slot index is
+//   masked.  if the ring is full we drop the incoming packet, since the
+//   producer cannot safely reclaim the oldest slot.
+class RtpPacketRing
+{
+public:
+	RtpPacketRing() :
+		head(0),
+		tail(0)
+	{
+	}
+
+	// producer side.  returns false if the ring was full and the packet
+	//   was dropped.
+	bool push(const PRtpPacket &rtp)
+	{
+		int t = tail; // we are the only writer of tail
+		int h = head.fetchAndAddAcquire(0);
+		if(t - h >= QUEUE_PACKET_MAX)
+			return false;
+		slots[t & (QUEUE_PACKET_MAX - 1)] = rtp;
+		tail.fetchAndStoreRelease(t + 1);
+		return true;
+	}
+
+	// consumer side.  returns false if the ring was empty.
+	bool pop(PRtpPacket *rtp)
+	{
+		int h = head; // we are the only writer of head
+		int t = tail.fetchAndAddAcquire(0);
+		if(h == t)
+			return false;
+		*rtp = slots[h & (QUEUE_PACKET_MAX - 1)];
+
+		// release the bytearray right away rather than holding it
+		//   until the slot gets overwritten
+		slots[h & (QUEUE_PACKET_MAX - 1)] = PRtpPacket();
+		head.fetchAndStoreRelease(h + 1);
+		return true;
+	}
+
+	// approximate fill level, safe to read from either side
+	int count() const
+	{
+		return (int)tail - (int)head;
+	}
+
+private:
+	PRtpPacket slots[QUEUE_PACKET_MAX];
+	QAtomicInt head;
+	QAtomicInt tail;
+};
+
 class GstRtpSessionContext;
 
 class GstRtpChannel : public QObject, public RtpChannelContext
@@ -245,23 +437,56 @@ class GstRtpChannel : public QObject, public RtpChannelContext
 	Q_INTERFACES(PsiMedia::RtpChannelContext)
 
 public:
-	bool enabled;
-	QMutex m;
+	QAtomicInt enabled;
 	GstRtpSessionContext *session;
 	QList<PRtpPacket> in;
 
-	//QTime wake_time;
-	bool wake_pending;
-	QList<PRtpPacket> pending_in;
+	QTime wake_time;
+	QTimer *wake_timer;
+	QAtomicInt wake_pending;
+	RtpPacketRing pending_in;
 
 	int written_pending;
 
+	// direct mode: write() may be called from any thread, so the
+	//   packetsWritten bookkeeping must use atomics
+	QAtomicInt direct_write;
+	QAtomicInt direct_written;
+	QAtomicInt direct_wake_pending;
+
+	// backpressure bookkeeping.  is_video and dropping_frame are only
+	//   touched by the producer (the streaming thread)
+	bool is_video;
+	bool dropping_frame;
+	QAtomicInt dropped;
+	QAtomicInt under_pressure;
+
+	// live-object instrumentation site for packets queued toward the
+	//   app (see bufmon.h), or -1 to not count
+	int bufmonSite;
+
 	GstRtpChannel() :
 		QObject(),
-		enabled(false),
-		wake_pending(false),
-		written_pending(0)
+		enabled(0),
+		written_pending(0),
+		is_video(false),
+		dropping_frame(false),
+		bufmonSite(-1)
 	{
+		wake_timer = new QTimer(this);
+		wake_timer->setSingleShot(true);
+		connect(wake_timer, SIGNAL(timeout()), SLOT(drainIn()));
+	}
+
+	~GstRtpChannel()
+	{
+		// whatever the app never read is no longer live
+		if(bufmonSite != -1)
+		{
+			int left = in.count() + pending_in.count();
+			while(left-- > 0)
+				psi_bufmon_remove(bufmonSite);
+		}
 	}
 
 	virtual QObject *qobject()
@@ -271,8 +496,7 @@ public:
 
 	virtual void setEnabled(bool b)
 	{
-		QMutexLocker locker(&m);
-		enabled = b;
+		enabled.fetchAndStoreOrdered(b ? 1 : 0);
 	}
 
 	virtual int packetsAvailable() const
@@ -282,15 +506,40 @@ public:
 
 	virtual PRtpPacket read()
 	{
+		if(bufmonSite != -1)
+			psi_bufmon_remove(bufmonSite);
 		return in.takeFirst();
 	}
 
+	virtual QList<PRtpPacket> readAll()
+	{
+		QList<PRtpPacket> out = in;
+		in.clear();
+		if(bufmonSite != -1)
+		{
+			for(int n = 0; n < out.count(); ++n)
+				psi_bufmon_remove(bufmonSite);
+		}
+		return out;
+	}
+
 	virtual void write(const PRtpPacket &rtp)
 	{
-		m.lock();
-		if(!enabled)
+		if(!(int)enabled)
 			return;
-		m.unlock();
+
+		if((int)direct_write)
+		{
+			// we may be on the caller's socket thread.  the push
+			//   goes straight through to the worker, which is safe
+			//   from any thread, and packetsWritten is signaled
+			//   back to our own thread
+			receiver_push_packet_for_write(rtp);
+			direct_written.ref();
+			if(direct_wake_pending.testAndSetOrdered(0, 1))
+				QMetaObject::invokeMethod(this, "processDirectOut", Qt::QueuedConnection);
+			return;
+		}
 
 		receiver_push_packet_for_write(rtp);
 		++written_pending;
@@ -300,45 +549,114 @@ public:
 			QMetaObject::invokeMethod(this, "processOut", Qt::QueuedConnection);
 	}
 
-	// session calls this, which may be in another thread
+	virtual void setDirectWriteEnabled(bool b)
+	{
+		direct_write.fetchAndStoreOrdered(b ? 1 : 0);
+	}
+
+	// session calls this, which is in the gst streaming thread.  lock-free:
+	//   the packet goes into the ring and we only make a cross-thread call
+	//   if one isn't already pending.
 	void push_packet_for_read(const PRtpPacket &rtp)
 	{
-		QMutexLocker locker(&m);
-		if(!enabled)
+		if(!(int)enabled)
 			return;
 
-		// if the queue is full, bump off the oldest to make room
-		if(pending_in.count() >= QUEUE_PACKET_MAX)
-			pending_in.removeFirst();
+		// once part of a video frame has been dropped, the rest of the
+		//   frame is useless downstream, so discard it too instead of
+		//   clipping some later stream position.  the marker bit flags
+		//   the last packet of a frame.
+		if(dropping_frame)
+		{
+			dropped.ref();
+			if(rtp.rawValue.size() >= 2 && ((unsigned char)rtp.rawValue[1] & 0x80))
+				dropping_frame = false;
+			return;
+		}
 
-		pending_in += rtp;
+		if(!pending_in.push(rtp))
+		{
+			dropped.ref();
+			if(is_video && !(rtp.rawValue.size() >= 2 && ((unsigned char)rtp.rawValue[1] & 0x80)))
+				dropping_frame = true;
+			return;
+		}
 
-		// TODO: use WAKE_PACKET_MIN and wake_time ?
+		if(bufmonSite != -1)
+			psi_bufmon_add(bufmonSite);
 
-		if(!wake_pending)
+		if((int)under_pressure == 0 && pending_in.count() >= QUEUE_PACKET_HIGH)
 		{
-			wake_pending = true;
+			// the consumer is falling behind.  let the app know, from
+			//   its own thread.
+			if(under_pressure.testAndSetOrdered(0, 1))
+				QMetaObject::invokeMethod(this, "notifyPressure", Qt::QueuedConnection);
+		}
+
+		if(wake_pending.testAndSetOrdered(0, 1))
 			QMetaObject::invokeMethod(this, "processIn", Qt::QueuedConnection);
+		else if(pending_in.count() == QUEUE_PACKET_MAX / 2)
+		{
+			// a wake is already pending, possibly held back by the
+			//   rate limiter.  the ring is filling up, so force a
+			//   drain rather than risk dropping packets.
+			QMetaObject::invokeMethod(this, "drainIn", Qt::QueuedConnection);
 		}
 	}
 
 signals:
 	void readyRead();
 	void packetsWritten(int count);
+	void pressureChanged(bool underPressure);
 
 private slots:
 	void processIn()
+	{
+		// rate-limit wakes: if we drained recently, hold this batch
+		//   until the window expires.  wake_pending stays set while we
+		//   wait, so the streaming thread queues no further calls and
+		//   packets simply accumulate in the ring.
+		if(!wake_time.isNull())
+		{
+			int since = wake_time.elapsed();
+			if(since >= 0 && since < WAKE_PACKET_MIN)
+			{
+				if(!wake_timer->isActive())
+					wake_timer->start(WAKE_PACKET_MIN - since);
+				return;
+			}
+		}
+
+		drainIn();
+	}
+
+	void drainIn()
 	{
 		int oldcount = in.count();
 
-		m.lock();
-		wake_pending = false;
-		in += pending_in;
-		pending_in.clear();
-		m.unlock();
+		wake_time.start();
+		wake_pending.fetchAndStoreOrdered(0);
+		PRtpPacket rtp;
+		while(pending_in.pop(&rtp))
+			in += rtp;
 
 		if(in.count() > oldcount)
 			emit readyRead();
+
+		// draining empties the ring, so pressure is over
+		if((int)under_pressure && pending_in.count() <= QUEUE_PACKET_LOW)
+		{
+			under_pressure.fetchAndStoreOrdered(0);
+			emit pressureChanged(false);
+		}
+	}
+
+	void notifyPressure()
+	{
+		// only report if the pressure didn't already clear in the
+		//   meantime
+		if((int)under_pressure)
+			emit pressureChanged(true);
 	}
 
 	void processOut()
@@ -348,6 +666,14 @@ private slots:
 		emit packetsWritten(count);
 	}
 
+	void processDirectOut()
+	{
+		direct_wake_pending.fetchAndStoreOrdered(0);
+		int count = direct_written.fetchAndStoreOrdered(0);
+		if(count > 0)
+			emit packetsWritten(count);
+	}
+
 private:
 	void receiver_push_packet_for_write(const PRtpPacket &rtp);
 };
@@ -355,6 +681,182 @@ private:
 //----------------------------------------------------------------------------
 // GstRecorder
 //----------------------------------------------------------------------------
+
+// interval between cue points in the seek index sidecar written next to
+//   file recordings.  in seconds
+#define DEFAULT_RECORD_CUE_SECS 5
+
+static int get_record_cue_secs()
+{
+	QString val = QString::fromLatin1(qgetenv("PSI_RECORD_CUE_SECS"));
+	if(!val.isEmpty())
+	{
+		int x = val.toInt();
+		if(x > 0)
+			return x;
+	}
+	return DEFAULT_RECORD_CUE_SECS;
+}
+
+// dedicated disk writer for file recording.  chunks are handed over
+//   from the streaming thread with just a mutexed enqueue, and the
+//   thread batches everything queued into a single write per wakeup, so
+//   a disk stall backpressures neither the media pipeline nor the ui
+class RecordFileWriter : public QThread
+{
+public:
+	// one seek cue: at elapsedMs into the recording, a container chunk
+	//   boundary sits at byteOffset in the file
+	class Cue
+	{
+	public:
+		int elapsedMs;
+		qint64 byteOffset;
+	};
+
+	QString path;
+
+	QMutex m;
+	QWaitCondition w;
+	QList<QByteArray> pending;
+	bool end_pending;
+
+	// seek index.  chunks arrive one container unit at a time (an ogg
+	//   page or a matroska piece), so the offset where a chunk starts
+	//   is a resync point a player can seek to.  timestamps are wall
+	//   clock from the first chunk, which for a live recording tracks
+	//   stream time to within pipeline latency
+	QTime clock;
+	bool clockStarted;
+	qint64 bytesQueued;
+	int nextCueMs;
+	int cueIntervalMs;
+	QList<Cue> cues;
+
+	RecordFileWriter(const QString &_path, QObject *parent = 0) :
+		QThread(parent),
+		path(_path),
+		end_pending(false),
+		clockStarted(false),
+		bytesQueued(0),
+		nextCueMs(0)
+	{
+		cueIntervalMs = get_record_cue_secs() * 1000;
+	}
+
+	// called from any thread
+	void write(const QByteArray &buf)
+	{
+		QMutexLocker locker(&m);
+
+		if(!clockStarted)
+		{
+			clockStarted = true;
+			clock.start();
+		}
+		else
+		{
+			int ms = clock.elapsed();
+			if(ms >= nextCueMs)
+			{
+				Cue cue;
+				cue.elapsedMs = ms;
+				cue.byteOffset = bytesQueued;
+				cues += cue;
+				nextCueMs = ms + cueIntervalMs;
+			}
+		}
+		bytesQueued += buf.size();
+
+		pending += buf;
+		psi_bufmon_add(PSI_BUFMON_RECORD);
+		w.wakeOne();
+	}
+
+	// called from any thread.  flushes what's queued, then the thread
+	//   finishes
+	void end()
+	{
+		QMutexLocker locker(&m);
+		end_pending = true;
+		w.wakeOne();
+	}
+
+protected:
+	virtual void run()
+	{
+		QFile f(path);
+		bool open = f.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered);
+
+		while(1)
+		{
+			m.lock();
+			while(pending.isEmpty() && !end_pending)
+				w.wait(&m);
+			QList<QByteArray> in = pending;
+			pending.clear();
+			bool end = end_pending;
+			m.unlock();
+
+			for(int n = 0; n < in.count(); ++n)
+				psi_bufmon_remove(PSI_BUFMON_RECORD);
+
+			// batch all queued chunks into one write
+			if(open && !in.isEmpty())
+			{
+				QByteArray block;
+				foreach(const QByteArray &buf, in)
+					block += buf;
+				f.write(block);
+			}
+
+			// hand the allocations back for reuse
+			foreach(const QByteArray &buf, in)
+				RtpWorker::recycleRecordBuffer(buf);
+			in.clear();
+
+			if(end)
+				break;
+		}
+
+		if(open)
+		{
+			f.close();
+			writeIndex();
+		}
+	}
+
+private:
+	// sidecar index, finalized once the recording is complete.  plain
+	//   text so review tools don't need a parser: a tag line, then one
+	//   "<ms> <offset>" line per cue
+	void writeIndex()
+	{
+		QList<Cue> cues_;
+		m.lock();
+		cues_ = cues;
+		m.unlock();
+
+		if(cues_.isEmpty())
+			return;
+
+		QFile f(path + ".idx");
+		if(!f.open(QIODevice::WriteOnly | QIODevice::Truncate))
+			return;
+
+		QByteArray out = "psimedia-record-index 1\n";
+		foreach(const Cue &cue, cues_)
+		{
+			out += QByteArray::number(cue.elapsedMs);
+			out += ' ';
+			out += QByteArray::number(cue.byteOffset);
+			out += '\n';
+		}
+		f.write(out);
+		f.close();
+	}
+};
+
 class GstRecorder : public QObject
 {
 	Q_OBJECT
@@ -362,6 +864,9 @@ class GstRecorder : public QObject
 public:
 	RwControlLocal *control;
 	QIODevice *recordDevice, *nextRecordDevice;
+	RecordFileWriter *fileWriter;
+	QString nextRecordFile;
+	bool haveNextRecordFile;
 	bool record_cancel;
 
 	QMutex m;
@@ -373,6 +878,8 @@ public:
 		control(0),
 		recordDevice(0),
 		nextRecordDevice(0),
+		fileWriter(0),
+		haveNextRecordFile(false),
 		record_cancel(false),
 		wake_pending(false)
 	{
@@ -380,8 +887,8 @@ public:
 
 	void setDevice(QIODevice *dev)
 	{
-		Q_ASSERT(!recordDevice);
-		Q_ASSERT(!nextRecordDevice);
+		Q_ASSERT(!recordDevice && !fileWriter);
+		Q_ASSERT(!nextRecordDevice && !haveNextRecordFile);
 
 		if(control)
 		{
@@ -398,16 +905,39 @@ public:
 		}
 	}
 
+	void setFile(const QString &path)
+	{
+		Q_ASSERT(!recordDevice && !fileWriter);
+		Q_ASSERT(!nextRecordDevice && !haveNextRecordFile);
+
+		if(control)
+		{
+			startFileWriter(path);
+
+			RwControlRecord record;
+			record.enabled = true;
+			control->setRecord(record);
+		}
+		else
+		{
+			// queue up the file for later
+			nextRecordFile = path;
+			haveNextRecordFile = true;
+		}
+	}
+
 	void stop()
 	{
-		Q_ASSERT(recordDevice || nextRecordDevice);
+		Q_ASSERT(recordDevice || fileWriter || nextRecordDevice || haveNextRecordFile);
 		Q_ASSERT(!record_cancel);
 
-		if(nextRecordDevice)
+		if(nextRecordDevice || haveNextRecordFile)
 		{
-			// if there was only a queued device, then there's
+			// if there was only a queued target, then there's
 			//   nothing to do but dequeue it
 			nextRecordDevice = 0;
+			nextRecordFile = QString();
+			haveNextRecordFile = false;
 		}
 		else
 		{
@@ -421,10 +951,21 @@ public:
 
 	void startNext()
 	{
-		if(control && !recordDevice && nextRecordDevice)
+		if(control && !recordDevice && !fileWriter)
 		{
-			recordDevice = nextRecordDevice;
-			nextRecordDevice = 0;
+			if(nextRecordDevice)
+			{
+				recordDevice = nextRecordDevice;
+				nextRecordDevice = 0;
+			}
+			else if(haveNextRecordFile)
+			{
+				startFileWriter(nextRecordFile);
+				nextRecordFile = QString();
+				haveNextRecordFile = false;
+			}
+			else
+				return;
 
 			RwControlRecord record;
 			record.enabled = true;
@@ -436,7 +977,19 @@ public:
 	void push_data_for_read(const QByteArray &buf)
 	{
 		QMutexLocker locker(&m);
+
+		// file mode: hand data straight to the writer thread, so
+		//   disk i/o rides neither the streaming thread nor the ui
+		//   thread.  EOF still goes through the ui thread, for the
+		//   stopped bookkeeping
+		if(fileWriter && !buf.isEmpty())
+		{
+			fileWriter->write(buf);
+			return;
+		}
+
 		pending_in += buf;
+		psi_bufmon_add(PSI_BUFMON_RECORD);
 		if(!wake_pending)
 		{
 			wake_pending = true;
@@ -447,6 +1000,17 @@ public:
 signals:
 	void stopped();
 
+private:
+	void startFileWriter(const QString &path)
+	{
+		QMutexLocker locker(&m);
+		fileWriter = new RecordFileWriter(path);
+
+		// the writer cleans itself up once it has flushed
+		connect(fileWriter, SIGNAL(finished()), fileWriter, SLOT(deleteLater()));
+		fileWriter->start();
+	}
+
 private slots:
 	void processIn()
 	{
@@ -456,6 +1020,9 @@ private slots:
 		pending_in.clear();
 		m.unlock();
 
+		for(int n = 0; n < in.count(); ++n)
+			psi_bufmon_remove(PSI_BUFMON_RECORD);
+
 		QPointer<QObject> self = this;
 
 		while(!in.isEmpty())
@@ -465,11 +1032,24 @@ private slots:
 			if(!buf.isEmpty())
 			{
 				recordDevice->write(buf);
+
+				// hand the allocation back for the next chunk
+				RtpWorker::recycleRecordBuffer(buf);
 			}
 			else // EOF
 			{
-				recordDevice->close();
-				recordDevice = 0;
+				if(recordDevice)
+				{
+					recordDevice->close();
+					recordDevice = 0;
+				}
+				else if(fileWriter)
+				{
+					m.lock();
+					fileWriter->end();
+					fileWriter = 0;
+					m.unlock();
+				}
 
 				bool wasCancelled = record_cancel;
 				record_cancel = false;
@@ -488,6 +1068,44 @@ private slots:
 //----------------------------------------------------------------------------
 // GstRtpSessionContext
 //----------------------------------------------------------------------------
+static quint32 rtp_read32(const unsigned char *p)
+{
+	return ((quint32)p[0] << 24) | ((quint32)p[1] << 16) | ((quint32)p[2] << 8) | (quint32)p[3];
+}
+
+// rtcp bookkeeping for one media type.  guarded by the session's
+//   rtcp_mutex
+class RtcpMediaState
+{
+public:
+	quint32 lastSrNtpMid; // 0 = no SR received yet
+	QTime lastSrArrival;
+	int rttMs; // -1 until a round trip completes
+	int remoteLost; // cumulative, from the peer's last report block
+
+	// receive counts at our previous report, for the fraction field
+	int prevExpected;
+	int prevLost;
+
+	RtcpMediaState() :
+		lastSrNtpMid(0),
+		rttMs(-1),
+		remoteLost(0),
+		prevExpected(0),
+		prevLost(0)
+	{
+	}
+};
+
+// opt-in sender-side congestion response: when PSI_ADAPT_VIDEO=1, the
+//   session watches the loss the peer reports against our video stream
+//   and halves the encoded size while it persists, stepping back up
+//   once the path has been clean for a while
+static bool get_adapt_video_enabled()
+{
+	return (qgetenv("PSI_ADAPT_VIDEO") == "1");
+}
+
 class GstRtpSessionContext : public QObject, public RtpSessionContext
 {
 	Q_OBJECT
@@ -514,9 +1132,40 @@ public:
 	// keep these parentless, so they can switch threads
 	GstRtpChannel audioRtp;
 	GstRtpChannel videoRtp;
+	GstRtpChannel audioRtcp;
+	GstRtpChannel videoRtcp;
 	QMutex write_mutex;
 	bool allow_writes;
 
+	// combined input mode: the audio channel carries the multiplexed
+	//   stream and we sort by payload type.  both guarded by
+	//   write_mutex, since writes may come from the caller's socket
+	//   thread
+	bool combinedInput;
+	QSet<int> videoPtIn;
+
+	QTimer *rtcpTimer;
+	quint32 rtcpSsrc; // our reporting identity when we have no send stream
+
+	// rtp header observations for the rtcp reports.  the out fields are
+	//   written in the streaming thread, the in fields on the write path
+	QAtomicInt audioSsrcOut, audioRtpTimeOut;
+	QAtomicInt videoSsrcOut, videoRtpTimeOut;
+	QAtomicInt audioSsrcIn;
+	QAtomicInt videoSsrcIn;
+
+	mutable QMutex rtcp_mutex;
+	RtcpMediaState audioRtcpState;
+	RtcpMediaState videoRtcpState;
+
+	// sender-side video adaptation state, driven from rtcp_timeout
+	//   (see adaptVideoSend)
+	int adaptDownscale;
+	int adaptBadTicks;
+	int adaptGoodTicks;
+	int adaptPrevSent;
+	int adaptPrevLost;
+
 	GstRtpSessionContext(GstThread *_gstThread, QObject *parent = 0) :
 		QObject(parent),
 		gstThread(_gstThread),
@@ -525,7 +1174,13 @@ public:
 		isStopping(false),
 		pending_status(false),
 		recorder(this),
-		allow_writes(false)
+		allow_writes(false),
+		combinedInput(false),
+		adaptDownscale(0),
+		adaptBadTicks(0),
+		adaptGoodTicks(0),
+		adaptPrevSent(0),
+		adaptPrevLost(0)
 	{
 #ifdef QT_GUI_LIB
 		outputWidget = 0;
@@ -540,6 +1195,17 @@ public:
 
 		audioRtp.session = this;
 		videoRtp.session = this;
+		videoRtp.is_video = true;
+		audioRtp.bufmonSite = PSI_BUFMON_PACKET_OUT_AUDIO;
+		videoRtp.bufmonSite = PSI_BUFMON_PACKET_OUT_VIDEO;
+		audioRtcp.session = this;
+		videoRtcp.session = this;
+
+		// only needs to be unlikely to collide with the peer
+		rtcpSsrc = ((quint32)qrand() << 16) ^ (quint32)qrand() ^ (quint32)(quintptr)this;
+
+		rtcpTimer = new QTimer(this);
+		connect(rtcpTimer, SIGNAL(timeout()), SLOT(rtcp_timeout()));
 
 		connect(&recorder, SIGNAL(stopped()), SLOT(recorder_stopped()));
 	}
@@ -557,9 +1223,9 @@ public:
 	void cleanup()
 	{
 		if(outputWidget)
-			outputWidget->show_frame(QImage());
+			outputWidget->show_frame(RtpWorker::Frame());
 		if(previewWidget)
-			previewWidget->show_frame(QImage());
+			previewWidget->show_frame(RtpWorker::Frame());
 
 		codecs = RwControlConfigCodecs();
 
@@ -567,6 +1233,8 @@ public:
 		isStopping = false;
 		pending_status = false;
 
+		rtcpTimer->stop();
+
 		recorder.control = 0;
 
 		write_mutex.lock();
@@ -663,6 +1331,18 @@ public:
 			previewWidget = new GstVideoWidget(widget, this);
 
 		devices.useVideoPreview = widget ? true : false;
+
+		// the thumbnail doesn't benefit from full camera rate, so cap
+		//   it.  PSI_PREVIEW_FPS overrides (<1 = no cap)
+		if(widget)
+		{
+			int fps = 10;
+			QByteArray val = qgetenv("PSI_PREVIEW_FPS");
+			if(!val.isEmpty())
+				fps = val.toInt();
+			devices.previewFps = fps;
+		}
+
 		if(control)
 			control->updateDevices(devices);
 	}
@@ -676,6 +1356,14 @@ public:
 		recorder.setDevice(recordDevice);
 	}
 
+	virtual void setRecordingFile(const QString &fileName)
+	{
+		// can't assign a new recording target after stopping
+		Q_ASSERT(!isStopping);
+
+		recorder.setFile(fileName);
+	}
+
 	virtual void stopRecording()
 	{
 		recorder.stop();
@@ -696,6 +1384,55 @@ public:
 	virtual void setMaximumSendingBitrate(int kbps)
 	{
 		codecs.maximumSendingBitrate = kbps;
+
+		// if the session is live, nudge the encoder right away
+		//   instead of waiting for a codec update transaction
+		if(control)
+			control->setMaximumSendingBitrate(kbps);
+	}
+
+	virtual void setPathMtu(int bytes)
+	{
+		// applying it means repacketizing, so it takes effect at
+		//   start or on the next updatePreferences transaction
+		codecs.pathMtu = bytes;
+	}
+
+	virtual void setDtxEnabled(bool enabled)
+	{
+		// applying it means reconfiguring the encoder, so it takes
+		//   effect at start or on the next updatePreferences
+		//   transaction
+		codecs.dtxEnabled = enabled;
+	}
+
+	virtual void setAudioJitterLatencyRange(int minMs, int maxMs)
+	{
+		devices.jitterMinLatency = minMs;
+		devices.jitterMaxLatency = maxMs;
+		if(control)
+			control->updateDevices(devices);
+	}
+
+	virtual void setVideoBurstBudget(int packets)
+	{
+		devices.videoPaceBurst = packets;
+		if(control)
+			control->updateDevices(devices);
+	}
+
+	virtual void setOutgoingSrtpKey(const QByteArray &keyAndSalt)
+	{
+		devices.srtpOutKey = keyAndSalt;
+		if(control)
+			control->updateDevices(devices);
+	}
+
+	virtual void setIncomingSrtpKey(const QByteArray &keyAndSalt)
+	{
+		devices.srtpInKey = keyAndSalt;
+		if(control)
+			control->updateDevices(devices);
 	}
 
 	virtual void setRemoteAudioPreferences(const QList<PPayloadInfo> &info)
@@ -708,6 +1445,25 @@ public:
 	{
 		codecs.useRemoteVideoPayloadInfo = true;
 		codecs.remoteVideoPayloadInfo = info;
+
+		// remember the video payload types, for combined input sorting
+		QMutexLocker locker(&write_mutex);
+		videoPtIn.clear();
+		foreach(const PPayloadInfo &i, info)
+			videoPtIn += i.id;
+	}
+
+	virtual void setCombinedRtpInputEnabled(bool enabled)
+	{
+		QMutexLocker locker(&write_mutex);
+		combinedInput = enabled;
+	}
+
+	virtual void setVideoShmExportEnabled(bool enabled)
+	{
+		devices.shmVideoExport = enabled;
+		if(control)
+			control->updateDevices(devices);
 	}
 
 	virtual void start()
@@ -718,10 +1474,12 @@ public:
 
 		control = new RwControlLocal(gstThread, this);
 		connect(control, SIGNAL(statusReady(const RwControlStatus &)), SLOT(control_statusReady(const RwControlStatus &)));
-		connect(control, SIGNAL(previewFrame(const QImage &)), SLOT(control_previewFrame(const QImage &)));
-		connect(control, SIGNAL(outputFrame(const QImage &)), SLOT(control_outputFrame(const QImage &)));
+		connect(control, SIGNAL(previewFrame(const RtpWorker::Frame &)), SLOT(control_previewFrame(const RtpWorker::Frame &)));
+		connect(control, SIGNAL(outputFrame(const RtpWorker::Frame &)), SLOT(control_outputFrame(const RtpWorker::Frame &)));
+		connect(control, SIGNAL(shmOutputFrame(const RtpWorker::ShmFrame &)), SLOT(control_shmOutputFrame(const RtpWorker::ShmFrame &)));
 		connect(control, SIGNAL(audioOutputIntensityChanged(int)), SLOT(control_audioOutputIntensityChanged(int)));
 		connect(control, SIGNAL(audioInputIntensityChanged(int)), SLOT(control_audioInputIntensityChanged(int)));
+		connect(control, SIGNAL(audioTalkingChanged(bool)), SLOT(control_audioTalkingChanged(bool)));
 
 		control->app = this;
 		control->cb_rtpAudioOut = cb_control_rtpAudioOut;
@@ -733,6 +1491,23 @@ public:
 
 		recorder.control = control;
 
+		audioSsrcOut.fetchAndStoreOrdered(0);
+		audioRtpTimeOut.fetchAndStoreOrdered(0);
+		videoSsrcOut.fetchAndStoreOrdered(0);
+		videoRtpTimeOut.fetchAndStoreOrdered(0);
+		audioSsrcIn.fetchAndStoreOrdered(0);
+		videoSsrcIn.fetchAndStoreOrdered(0);
+		rtcp_mutex.lock();
+		audioRtcpState = RtcpMediaState();
+		videoRtcpState = RtcpMediaState();
+		rtcp_mutex.unlock();
+		adaptDownscale = 0;
+		adaptBadTicks = 0;
+		adaptGoodTicks = 0;
+		adaptPrevSent = 0;
+		adaptPrevLost = 0;
+		rtcpTimer->start(RTCP_INTERVAL);
+
 		lastStatus = RwControlStatus();
 		isStarted = false;
 		pending_status = true;
@@ -771,6 +1546,12 @@ public:
 		control->setTransmit(transmit);
 	}
 
+	virtual void requestKeyframe()
+	{
+		if(control)
+			control->requestVideoKeyframe();
+	}
+
 	virtual void stop()
 	{
 		Q_ASSERT(control && !isStopping);
@@ -824,6 +1605,66 @@ public:
 		return lastStatus.canTransmitVideo;
 	}
 
+	virtual PRtpSessionStats statistics() const
+	{
+		PRtpSessionStats out;
+		if(control)
+			out = control->statistics();
+
+		// channel queue drops, on top of the worker's branch-queue drops
+		out.audioPacketsDropped += (int)audioRtp.dropped;
+		out.videoPacketsDropped += (int)videoRtp.dropped;
+
+		// what the peer's rtcp reports told us about our sending
+		QMutexLocker rtcpLocker(&rtcp_mutex);
+		out.audioRttMs = audioRtcpState.rttMs;
+		out.videoRttMs = videoRtcpState.rttMs;
+		out.audioPacketsLostRemote = audioRtcpState.remoteLost;
+		out.videoPacketsLostRemote = videoRtcpState.remoteLost;
+
+		// live-object counters, process-wide (see bufmon.h)
+		if(psi_bufmon_enabled())
+		{
+			for(int n = 0; n < PSI_BUFMON_SITE_COUNT; ++n)
+			{
+				PObjectCounter c;
+				c.name = QString::fromLatin1(psi_bufmon_site_name(n));
+				psi_bufmon_query(n, &c.live, &c.highWatermark);
+				out.objectCounters += c;
+			}
+		}
+
+		return out;
+	}
+
+	virtual int audioInputIntensity() const
+	{
+		if(!control)
+			return 0;
+		return control->audioInputIntensity();
+	}
+
+	virtual int audioOutputIntensity() const
+	{
+		if(!control)
+			return -1;
+		return control->audioOutputIntensity();
+	}
+
+	virtual PResourceUsage resourceUsage() const
+	{
+		if(!control)
+			return PResourceUsage();
+		return control->resourceUsage();
+	}
+
+	virtual void setAudioIntensityInterval(int ms)
+	{
+		devices.audioIntensityInterval = ms;
+		if(control)
+			control->updateDevices(devices);
+	}
+
 	virtual int outputVolume() const
 	{
 		return devices.audioOutVolume;
@@ -863,17 +1704,117 @@ public:
 		return &videoRtp;
 	}
 
+	virtual RtpChannelContext *audioRtcpChannel()
+	{
+		return &audioRtcp;
+	}
+
+	virtual RtpChannelContext *videoRtcpChannel()
+	{
+		return &videoRtcp;
+	}
+
 	// channel calls this, which may be in another thread
 	void push_packet_for_write(GstRtpChannel *from, const PRtpPacket &rtp)
 	{
+		// incoming rtcp never touches the pipeline, it's consumed here
+		if(from == &audioRtcp || from == &videoRtcp)
+		{
+			processIncomingRtcp(from, rtp);
+			return;
+		}
+
 		QMutexLocker locker(&write_mutex);
 		if(!allow_writes || !control)
 			return;
 
-		if(from == &audioRtp)
-			control->rtpAudioIn(rtp);
-		else if(from == &videoRtp)
+		bool isVideo = (from == &videoRtp);
+
+		// combined input: the audio channel carries the multiplexed
+		//   stream, sorted here by payload type.  one byte compare,
+		//   and the worker's ingress filter sees a pre-sorted stream
+		if(combinedInput && from == &audioRtp && rtp.rawValue.size() >= 2)
+		{
+			int pt = (unsigned char)rtp.rawValue.at(1) & 0x7f;
+			if(videoPtIn.contains(pt))
+				isVideo = true;
+		}
+
+		// note the remote ssrc, for addressing our report blocks
+		if(rtp.rawValue.size() >= 12)
+		{
+			const unsigned char *p = (const unsigned char *)rtp.rawValue.data();
+			if(isVideo)
+				videoSsrcIn.fetchAndStoreRelaxed((int)rtp_read32(p + 8));
+			else
+				audioSsrcIn.fetchAndStoreRelaxed((int)rtp_read32(p + 8));
+		}
+
+		if(isVideo)
 			control->rtpVideoIn(rtp);
+		else
+			control->rtpAudioIn(rtp);
+	}
+
+	// consumes the SRs/RRs the peer sent us.  may run on the caller's
+	//   socket thread in direct write mode, hence the lock
+	void processIncomingRtcp(GstRtpChannel *from, const PRtpPacket &rtp)
+	{
+		quint32 aOut = (quint32)(int)audioSsrcOut;
+		quint32 vOut = (quint32)(int)videoSsrcOut;
+
+		// a PLI means the peer lost our picture; refresh right away
+		if(vOut != 0 && rtcpContainsPli(rtp.rawValue, vOut))
+		{
+			QMutexLocker locker(&write_mutex);
+			if(allow_writes && control)
+				control->requestVideoKeyframe();
+		}
+
+		QList<RtcpReport> reports;
+		if(!rtcpParse(rtp.rawValue, &reports))
+			return;
+
+		quint32 ntpSec, ntpFrac;
+		rtcpNtpTime(&ntpSec, &ntpFrac);
+		quint32 nowMid = rtcpNtpMiddle(ntpSec, ntpFrac);
+
+		QMutexLocker locker(&rtcp_mutex);
+
+		foreach(const RtcpReport &r, reports)
+		{
+			// remember the SR time, for the LSR/DLSR we echo back
+			if(r.haveSenderInfo)
+			{
+				RtcpMediaState *state = (from == &audioRtcp) ? &audioRtcpState : &videoRtcpState;
+				state->lastSrNtpMid = rtcpNtpMiddle(r.ntpSec, r.ntpFrac);
+				state->lastSrArrival.start();
+			}
+
+			// blocks about our own streams tell us loss and rtt.
+			//   match on ssrc rather than arrival channel, in case
+			//   the peer muxes its reports
+			foreach(const RtcpReportBlock &b, r.blocks)
+			{
+				RtcpMediaState *state = 0;
+				if(aOut != 0 && b.ssrc == aOut)
+					state = &audioRtcpState;
+				else if(vOut != 0 && b.ssrc == vOut)
+					state = &videoRtcpState;
+				if(!state)
+					continue;
+
+				state->remoteLost = b.cumulativeLost;
+				if(b.lsr != 0)
+				{
+					// rfc 3550 round trip: now - dlsr - lsr,
+					//   in 1/65536 second units
+					quint32 delta = nowMid - b.lsr - b.dlsr;
+					if(delta < 0x80000000u)
+						state->rttMs = (int)(((quint64)delta * 1000) >> 16);
+				}
+			}
+		}
 	}
 
 signals:
@@ -881,14 +1822,26 @@ signals:
 	void preferencesUpdated();
 	void audioOutputIntensityChanged(int intensity);
 	void audioInputIntensityChanged(int intensity);
+	void audioInputTalkingChanged(bool talking);
+	void stalled(const QString &stage);
 	void stoppedRecording();
 	void stopped();
 	void finished();
 	void error();
+	void videoShmFrameReady(const PsiMedia::PVideoShmFrame &frame);
 
 private slots:
 	void control_statusReady(const RwControlStatus &status)
 	{
+		// spontaneous watchdog report: a pipeline stage stopped
+		//   making progress.  the session stays active, so don't
+		//   disturb the start/stop state machine with it
+		if(!status.stallStage.isEmpty())
+		{
+			emit stalled(status.stallStage);
+			return;
+		}
+
 		lastStatus = status;
 
 		if(status.finished)
@@ -935,16 +1888,28 @@ private slots:
 		}
 	}
 
-	void control_previewFrame(const QImage &img)
+	void control_previewFrame(const RtpWorker::Frame &frame)
 	{
 		if(previewWidget)
-			previewWidget->show_frame(img);
+			previewWidget->show_frame(frame);
 	}
 
-	void control_outputFrame(const QImage &img)
+	void control_outputFrame(const RtpWorker::Frame &frame)
 	{
 		if(outputWidget)
-			outputWidget->show_frame(img);
+			outputWidget->show_frame(frame);
+	}
+
+	void control_shmOutputFrame(const RtpWorker::ShmFrame &frame)
+	{
+		PVideoShmFrame out;
+		out.fd = frame.fd;
+		out.ringSize = frame.ringSize;
+		out.offset = frame.offset;
+		out.width = frame.width;
+		out.height = frame.height;
+		out.stride = frame.stride;
+		emit videoShmFrameReady(out);
 	}
 
 	void control_audioOutputIntensityChanged(int intensity)
@@ -957,12 +1922,158 @@ private slots:
 		emit audioInputIntensityChanged(intensity);
 	}
 
+	void control_audioTalkingChanged(bool talking)
+	{
+		emit audioInputTalkingChanged(talking);
+	}
+
 	void recorder_stopped()
 	{
 		emit stoppedRecording();
 	}
 
+	void rtcp_timeout()
+	{
+		if(!control || !isStarted)
+			return;
+
+		PRtpSessionStats snap = statistics();
+
+		sendMediaReport(&audioRtcp, &audioRtcpState,
+			(quint32)(int)audioSsrcOut, (quint32)(int)audioRtpTimeOut,
+			snap.audioPacketsSent, snap.audioBytesSent,
+			snap.audioPacketsReceived, snap.audioPacketsLost,
+			jitterUnits(snap.audioJitterMs, lastStatus.remoteAudioPayloadInfo),
+			(quint32)(int)audioSsrcIn);
+
+		sendMediaReport(&videoRtcp, &videoRtcpState,
+			(quint32)(int)videoSsrcOut, (quint32)(int)videoRtpTimeOut,
+			snap.videoPacketsSent, snap.videoBytesSent,
+			snap.videoPacketsReceived, snap.videoPacketsLost,
+			0, // no interarrival jitter estimate for video
+			(quint32)(int)videoSsrcIn);
+
+		if(get_adapt_video_enabled())
+			adaptVideoSend(snap);
+	}
+
 private:
+	// crude congestion response for the video sender: compare the loss
+	//   the peer reported against what we sent since the last rtcp
+	//   tick.  two bad intervals in a row halve the encoded size (down
+	//   to quarter size), a sustained clean run steps back up.  the
+	//   thresholds are deliberately sluggish: reports only arrive every
+	//   few seconds, and resolution flapping looks worse than a little
+	//   loss
+	void adaptVideoSend(const PRtpSessionStats &snap)
+	{
+		rtcp_mutex.lock();
+		int lost = videoRtcpState.remoteLost;
+		rtcp_mutex.unlock();
+
+		int dSent = snap.videoPacketsSent - adaptPrevSent;
+		int dLost = lost - adaptPrevLost;
+		adaptPrevSent = snap.videoPacketsSent;
+		adaptPrevLost = lost;
+
+		// not enough traffic to judge
+		if(dSent < 20)
+			return;
+
+		if(dLost * 20 > dSent) // over 5%
+		{
+			++adaptBadTicks;
+			adaptGoodTicks = 0;
+		}
+		else
+		{
+			++adaptGoodTicks;
+			adaptBadTicks = 0;
+		}
+
+		if(adaptBadTicks >= 2 && adaptDownscale < 2)
+		{
+			++adaptDownscale;
+			adaptBadTicks = 0;
+			control->setVideoSendDownscale(adaptDownscale);
+		}
+		else if(adaptGoodTicks >= 12 && adaptDownscale > 0)
+		{
+			--adaptDownscale;
+			adaptGoodTicks = 0;
+			control->setVideoSendDownscale(adaptDownscale);
+		}
+	}
+
+	// the RR jitter field wants rtp clock units, but the stats surface
+	//   reports milliseconds.  convert using the negotiated clockrate
+	static int jitterUnits(int jitterMs, const QList<PPayloadInfo> &info)
+	{
+		if(info.isEmpty())
+			return 0;
+		return (int)((qint64)jitterMs * info.first().clockrate / 1000);
+	}
+
+	// builds and queues one SR or RR for a media type, from counters
+	//   snapshotted out of statistics()
+	void sendMediaReport(GstRtpChannel *ch, RtcpMediaState *state, quint32 ssrcOut, quint32 rtpTime, int packetsSent, int bytesSent, int packetsReceived, int packetsLost, int jitter, quint32 ssrcIn)
+	{
+		bool sending = (ssrcOut != 0 && packetsSent > 0);
+		bool receiving = (packetsReceived > 0 && ssrcIn != 0);
+		if(!sending && !receiving)
+			return;
+
+		QList<RtcpReportBlock> blocks;
+
+		rtcp_mutex.lock();
+		if(receiving)
+		{
+			RtcpReportBlock b;
+			b.ssrc = ssrcIn;
+
+			// we don't track the true extended highest sequence at
+			//   this layer, so the expected-packet count stands in.
+			//   peers normally judge loss from the fraction and
+			//   cumulative fields, which are exact
+			int expected = packetsReceived + packetsLost;
+			b.cumulativeLost = packetsLost;
+			b.extHighestSeq = (quint32)expected;
+
+			int dExpected = expected - state->prevExpected;
+			int dLost = packetsLost - state->prevLost;
+			if(dExpected > 0 && dLost > 0)
+				b.fractionLost = qMin(255, (dLost << 8) / dExpected);
+			state->prevExpected = expected;
+			state->prevLost = packetsLost;
+
+			b.jitter = (quint32)jitter;
+
+			if(state->lastSrNtpMid != 0)
+			{
+				b.lsr = state->lastSrNtpMid;
+				b.dlsr = (quint32)(((quint64)state->lastSrArrival.elapsed() << 16) / 1000);
+			}
+
+			blocks += b;
+		}
+		rtcp_mutex.unlock();
+
+		PRtpPacket packet;
+		if(sending)
+		{
+			quint32 ntpSec, ntpFrac;
+			rtcpNtpTime(&ntpSec, &ntpFrac);
+			packet.rawValue = rtcpCreateSenderReport(ssrcOut, ntpSec, ntpFrac, rtpTime, (quint32)packetsSent, (quint32)bytesSent, blocks);
+		}
+		else
+			packet.rawValue = rtcpCreateReceiverReport(rtcpSsrc, blocks);
+
+		// rtcp rides the adjacent port by convention
+		packet.portOffset = 1;
+
+		ch->push_packet_for_read(packet);
+	}
+
 	static void cb_control_rtpAudioOut(const PRtpPacket &packet, void *app)
 	{
 		((GstRtpSessionContext *)app)->control_rtpAudioOut(packet);
@@ -981,12 +2092,28 @@ private:
 	// note: this is executed from a different thread
 	void control_rtpAudioOut(const PRtpPacket &packet)
 	{
+		// track our ssrc and timestamp position for the SRs
+		if(packet.rawValue.size() >= 12)
+		{
+			const unsigned char *p = (const unsigned char *)packet.rawValue.data();
+			audioRtpTimeOut.fetchAndStoreRelaxed((int)rtp_read32(p + 4));
+			audioSsrcOut.fetchAndStoreRelaxed((int)rtp_read32(p + 8));
+		}
+
 		audioRtp.push_packet_for_read(packet);
 	}
 
 	// note: this is executed from a different thread
 	void control_rtpVideoOut(const PRtpPacket &packet)
 	{
+		// track our ssrc and timestamp position for the SRs
+		if(packet.rawValue.size() >= 12)
+		{
+			const unsigned char *p = (const unsigned char *)packet.rawValue.data();
+			videoRtpTimeOut.fetchAndStoreRelaxed((int)rtp_read32(p + 4));
+			videoSsrcOut.fetchAndStoreRelaxed((int)rtp_read32(p + 8));
+		}
+
 		videoRtp.push_packet_for_read(packet);
 	}
 
@@ -1012,10 +2139,10 @@ class GstProvider : public QObject, public Provider
 	Q_INTERFACES(PsiMedia::Provider)
 
 public:
-	GstThread *thread;
+	GstThreadPool *pool;
 
 	GstProvider() :
-		thread(0)
+		pool(0)
 	{
 	}
 
@@ -1026,11 +2153,11 @@ public:
 
 	virtual bool init(const QString &resourcePath)
 	{
-		thread = new GstThread(this);
-		if(!thread->start(resourcePath))
+		pool = new GstThreadPool(this);
+		if(!pool->start(resourcePath))
 		{
-			delete thread;
-			thread = 0;
+			delete pool;
+			pool = 0;
 			return false;
 		}
 
@@ -1039,7 +2166,7 @@ public:
 
 	~GstProvider()
 	{
-		delete thread;
+		delete pool;
 	}
 
 	virtual QString creditName()
@@ -1055,18 +2182,20 @@ public:
 		"more information, see http://www.gstreamer.net/\n\n"
 		"If you enjoy this software, please give the GStreamer "
 		"people a million dollars."
-		).arg(thread->gstVersion());
+		).arg(pool->primary()->gstVersion());
 		return str;
 	}
 
 	virtual FeaturesContext *createFeatures()
 	{
-		return new GstFeaturesContext(thread);
+		return new GstFeaturesContext(pool->primary());
 	}
 
 	virtual RtpSessionContext *createRtpSession()
 	{
-		return new GstRtpSessionContext(thread);
+		// sessions fan out across the pool, so their glib-side work
+		//   can run in parallel
+		return new GstRtpSessionContext(pool->threadForSession());
 	}
 };
 
@@ -9,20 +9,36 @@ include(gstcustomelements/gstcustomelements.pri)
 
 HEADERS += \
 	$$PWD/devices.h \
+	$$PWD/codecs.h \
 	$$PWD/modes.h \
 	$$PWD/payloadinfo.h \
 	$$PWD/pipeline.h \
+	$$PWD/shmframering.h \
 	$$PWD/bins.h \
+	$$PWD/rtcp.h \
+	$$PWD/ulpfec.h \
+	$$PWD/monotime.h \
+	$$PWD/elementcache.h \
+	$$PWD/srtp.h \
+	$$PWD/latencytracer.h \
 	$$PWD/rtpworker.h \
 	$$PWD/gstthread.h \
 	$$PWD/rwcontrol.h
 
 SOURCES += \
 	$$PWD/devices.cpp \
+	$$PWD/codecs.cpp \
 	$$PWD/modes.cpp \
 	$$PWD/payloadinfo.cpp \
 	$$PWD/pipeline.cpp \
+	$$PWD/shmframering.cpp \
 	$$PWD/bins.cpp \
+	$$PWD/rtcp.cpp \
+	$$PWD/ulpfec.cpp \
+	$$PWD/monotime.cpp \
+	$$PWD/elementcache.cpp \
+	$$PWD/srtp.cpp \
+	$$PWD/latencytracer.cpp \
 	$$PWD/rtpworker.cpp \
 	$$PWD/gstthread.cpp \
 	$$PWD/rwcontrol.cpp \
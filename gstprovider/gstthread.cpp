@@ -26,9 +26,19 @@
 #include <QCoreApplication>
 #include <QMutex>
 #include <QWaitCondition>
+#include <QAtomicPointer>
 #include <QApplication>
 #include <QStyle>
 #include <QIcon>
+#include <limits.h>
+#include <string.h>
+#ifdef Q_OS_UNIX
+# include <pthread.h>
+# include <sched.h>
+#endif
+#ifdef Q_OS_WIN
+# include <windows.h>
+#endif
 #include <gst/gst.h>
 #include "gstcustomelements/gstcustomelements.h"
 #include "gstelements/static/gstelements.h"
@@ -168,6 +178,19 @@ public:
 			qputenv("GST_PLUGIN_PATH", "");
 		}
 
+		// locked-down deployments can skip the registry scan
+		//   entirely.  the bundled elements are registered statically
+		//   below regardless, and everything else is served from the
+		//   registry cache shipped with the image, so startup does no
+		//   plugin disk i/o at all.  only use this if the image pins
+		//   its gstreamer plugins, since new or changed plugins won't
+		//   be picked up
+		if(QString::fromLatin1(qgetenv("PSI_GST_NO_REGISTRY_SCAN")) == "1")
+		{
+			qputenv("GST_REGISTRY_UPDATE", "no");
+			qputenv("GST_REGISTRY_FORK", "no");
+		}
+
 		// you can also use NULLs here if you don't want to pass args
 		GError *error;
 		if(!gst_init_check(&args.argc, &args.argv, &error))
@@ -275,20 +298,82 @@ public:
 //----------------------------------------------------------------------------
 // GstThread
 //----------------------------------------------------------------------------
+
+// task mailbox item.  the mailbox is an intrusive stack: producers push
+//   with an atomic swap (no locks), and the dispatcher takes the whole
+//   chain at once
+class GstTaskItem
+{
+public:
+	GstThread::TaskFunc func;
+	void *arg;
+	GstTaskItem *next;
+};
+
+// the permanent source servicing the task mailbox, in the style of the
+//   rwcontrol mailbox source
+struct GstTaskSource
+{
+	GSource source;
+	GstThread *thread;
+};
+
+static gboolean task_source_prepare(GSource *source, gint *timeout)
+{
+	*timeout = -1;
+	return ((GstTaskSource *)source)->thread->tasksPending() ? TRUE : FALSE;
+}
+
+static gboolean task_source_check(GSource *source)
+{
+	return ((GstTaskSource *)source)->thread->tasksPending() ? TRUE : FALSE;
+}
+
+static gboolean task_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+	Q_UNUSED(callback);
+	Q_UNUSED(user_data);
+
+	((GstTaskSource *)source)->thread->processTasks();
+	return TRUE;
+}
+
+static GSourceFuncs task_source_funcs =
+{
+	task_source_prepare,
+	task_source_check,
+	task_source_dispatch,
+	NULL,
+	NULL,
+	NULL
+};
+
 class GstThread::Private
 {
 public:
+	GstThread *q;
 	QString pluginPath;
 	GstSession *gstSession;
+	bool follower;
+	bool ready;
 	bool success;
 	GMainContext *mainContext;
 	GMainLoop *mainLoop;
 	QMutex m;
 	QWaitCondition w;
-
-	Private() :
+	QWaitCondition rw;
+	QAtomicPointer<GstTaskItem> taskStack;
+	GSource *taskSource;
+
+	Private(GstThread *_q) :
+		q(_q),
+		gstSession(0),
+		follower(false),
+		ready(false),
+		success(false),
 		mainContext(0),
-		mainLoop(0)
+		mainLoop(0),
+		taskSource(0)
 	{
 	}
 
@@ -299,16 +384,89 @@ public:
 
 	gboolean loop_started()
 	{
+		// a follower thread does no gstreamer init of its own; it
+		//   becomes ready when the primary thread reports its outcome
+		//   (see follower_ready)
+		if(follower)
+		{
+			w.wakeOne();
+			m.unlock();
+			return FALSE;
+		}
+
+		// wake start() right away.  the heavy gstreamer init below
+		//   then happens with start() already returned, so the
+		//   caller's startup is not held up by registry scanning
 		w.wakeOne();
 		m.unlock();
+
+		// registry load plus preloading the element factories the
+		//   bins use.  gstreamer reads its binary registry cache
+		//   here, so after the first run this is mostly mmap rather
+		//   than a filesystem scan
+		GstSession *session = new GstSession(pluginPath);
+
+		QMutexLocker locker(&m);
+		gstSession = session;
+		success = session->success;
+		ready = true;
+
+		// attach the task mailbox only now, so no posted task can
+		//   run against an uninitialized gstreamer.  anything posted
+		//   in the meantime was queued and runs next
+		taskSource = g_source_new(&task_source_funcs, sizeof(GstTaskSource));
+		((GstTaskSource *)taskSource)->thread = q;
+		g_source_attach(taskSource, mainContext);
+
+		rw.wakeAll();
+		emit q->ready(success);
 		return FALSE;
 	}
+
+	bool tasksPending() const
+	{
+		return ((GstTaskItem *)taskStack != 0);
+	}
+
+	void processTasks()
+	{
+		// grab the whole chain.  the stack is newest-first, so
+		//   reverse it to run tasks in the order they were posted
+		GstTaskItem *chain = taskStack.fetchAndStoreOrdered(0);
+		GstTaskItem *list = 0;
+		while(chain)
+		{
+			GstTaskItem *next = chain->next;
+			chain->next = list;
+			list = chain;
+			chain = next;
+		}
+
+		while(list)
+		{
+			GstTaskItem *next = list->next;
+			list->func(list->arg);
+			delete list;
+			list = next;
+		}
+	}
+
+	void discardTasks()
+	{
+		GstTaskItem *chain = taskStack.fetchAndStoreOrdered(0);
+		while(chain)
+		{
+			GstTaskItem *next = chain->next;
+			delete chain;
+			chain = next;
+		}
+	}
 };
 
 GstThread::GstThread(QObject *parent) :
 	QThread(parent)
 {
-	d = new Private;
+	d = new Private(this);
 
 	// HACK: if gstreamer initializes before certain Qt internal
 	//   initialization occurs, then the app becomes unstable.
@@ -335,7 +493,65 @@ bool GstThread::start(const QString &pluginPath)
 	d->pluginPath = pluginPath;
 	QThread::start();
 	d->w.wait(&d->m);
-	return d->success;
+
+	// the thread and eventloop are now up.  gstreamer init is still
+	//   running in the background; see waitForReady() and ready()
+	return true;
+}
+
+bool GstThread::startFollower(GstThread *primary)
+{
+	{
+		QMutexLocker locker(&d->m);
+		d->follower = true;
+		QThread::start();
+		d->w.wait(&d->m);
+	}
+
+	// adopt the primary's init outcome, whether already known or still
+	//   pending.  follower_ready tolerates being called twice, so the
+	//   connect-then-check order cannot lose the result
+	connect(primary, SIGNAL(ready(bool)), SLOT(follower_ready(bool)));
+
+	primary->d->m.lock();
+	bool done = primary->d->ready;
+	bool ok = primary->d->success;
+	primary->d->m.unlock();
+	if(done)
+		follower_ready(ok);
+
+	return true;
+}
+
+void GstThread::follower_ready(bool success)
+{
+	QMutexLocker locker(&d->m);
+	if(d->ready)
+		return;
+
+	d->success = success;
+	d->ready = true;
+
+	// attach the task mailbox now, same as the primary does after its
+	//   own init.  g_source_attach is safe from outside the loop thread
+	if(d->mainContext)
+	{
+		d->taskSource = g_source_new(&task_source_funcs, sizeof(GstTaskSource));
+		((GstTaskSource *)d->taskSource)->thread = this;
+		g_source_attach(d->taskSource, d->mainContext);
+		g_main_context_wakeup(d->mainContext);
+	}
+
+	d->rw.wakeAll();
+	emit ready(success);
+}
+
+bool GstThread::waitForReady(int msecs)
+{
+	QMutexLocker locker(&d->m);
+	if(!d->ready)
+		d->rw.wait(&d->m, msecs < 0 ? ULONG_MAX : msecs);
+	return (d->ready && d->success);
 }
 
 void GstThread::stop()
@@ -354,7 +570,9 @@ void GstThread::stop()
 QString GstThread::gstVersion() const
 {
 	QMutexLocker locker(&d->m);
-	return d->gstSession->version;
+	while(!d->ready)
+		d->rw.wait(&d->m);
+	return d->gstSession ? d->gstSession->version : QString();
 }
 
 GMainContext *GstThread::mainContext()
@@ -363,35 +581,89 @@ GMainContext *GstThread::mainContext()
 	return d->mainContext;
 }
 
-void GstThread::run()
+void GstThread::postTask(TaskFunc func, void *arg)
 {
-	//printf("GStreamer thread started\n");
+	GstTaskItem *i = new GstTaskItem;
+	i->func = func;
+	i->arg = arg;
 
-	// this will be unlocked as soon as the mainloop runs
-	d->m.lock();
+	GstTaskItem *old;
+	do
+	{
+		old = (GstTaskItem *)d->taskStack;
+		i->next = old;
+	} while(!d->taskStack.testAndSetOrdered(old, i));
 
-	d->gstSession = new GstSession(d->pluginPath);
+	// rouse the eventloop, in case it is sitting in poll
+	g_main_context_wakeup(d->mainContext);
+}
 
-	// report error
-	if(!d->gstSession->success)
-	{
-		d->success = false;
-		delete d->gstSession;
-		d->gstSession = 0;
-		d->w.wakeOne();
-		d->m.unlock();
-		//printf("GStreamer thread completed (error)\n");
+bool GstThread::tasksPending()
+{
+	return d->tasksPending();
+}
+
+void GstThread::processTasks()
+{
+	d->processTasks();
+}
+
+// elevate the calling thread so audio deadlines survive cpu contention
+//   from compile jobs and the like.  opt-in through PSI_RT_PRIORITY,
+//   since realtime scheduling usually needs privileges (rtprio rlimit
+//   on linux).  the pipeline streaming threads are spawned from this
+//   thread with default attributes, so on posix they inherit the
+//   policy; on windows the directsound ringbuffer element raises its
+//   own io threads already
+static void apply_rt_priority()
+{
+	QByteArray val = qgetenv("PSI_RT_PRIORITY");
+	if(val.isEmpty())
 		return;
-	}
 
-	d->success = true;
+#if defined(Q_OS_UNIX)
+	int min = sched_get_priority_min(SCHED_RR);
+	int max = sched_get_priority_max(SCHED_RR);
+	int prio = qBound(min, val.toInt(), max);
+
+	sched_param param;
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = prio;
+	if(pthread_setschedparam(pthread_self(), SCHED_RR, &param) == 0)
+		printf("media thread using SCHED_RR priority %d\n", prio);
+	else
+		printf("unable to set realtime priority (insufficient privileges?)\n");
+#elif defined(Q_OS_WIN)
+	// prefer mmcss ("Pro Audio"), which is what the os reserves for
+	//   exactly this.  avrt.dll only exists on vista and up, so load
+	//   it dynamically and fall back to a plain priority boost
+	typedef HANDLE (WINAPI *AvSetFunc)(LPCWSTR, LPDWORD);
+	QLibrary avrt("avrt");
+	AvSetFunc AvSet = (AvSetFunc)avrt.resolve("AvSetMmThreadCharacteristicsW");
+	DWORD taskIndex = 0;
+	if(AvSet && AvSet(L"Pro Audio", &taskIndex))
+		printf("media thread registered with mmcss (Pro Audio)\n");
+	else if(SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST))
+		printf("media thread priority raised\n");
+	else
+		printf("unable to raise media thread priority\n");
+#endif
+}
+
+void GstThread::run()
+{
+	//printf("GStreamer thread started\n");
+
+	apply_rt_priority();
 
-	//printf("Using GStreamer version %s\n", qPrintable(d->gstSession->version));
+	// this will be unlocked as soon as the mainloop runs
+	d->m.lock();
 
 	d->mainContext = g_main_context_new();
 	d->mainLoop = g_main_loop_new(d->mainContext, FALSE);
 
-	// deferred call to loop_started()
+	// deferred call to loop_started(), which wakes start() and then
+	//   performs the gstreamer init in the background
 	GSource *timer = g_timeout_source_new(0);
 	g_source_attach(timer, d->mainContext);
 	g_source_set_callback(timer, GstThread::Private::cb_loop_started, d, NULL);
@@ -400,6 +672,16 @@ void GstThread::run()
 	g_main_loop_run(d->mainLoop);
 
 	QMutexLocker locker(&d->m);
+	if(d->taskSource)
+	{
+		g_source_destroy(d->taskSource);
+		g_source_unref(d->taskSource);
+		d->taskSource = 0;
+	}
+
+	// anything posted after the loop stopped never runs
+	d->discardTasks();
+
 	g_main_loop_unref(d->mainLoop);
 	d->mainLoop = 0;
 	g_main_context_unref(d->mainContext);
@@ -411,4 +693,65 @@ void GstThread::run()
 	//printf("GStreamer thread completed\n");
 }
 
+//----------------------------------------------------------------------------
+// GstThreadPool
+//----------------------------------------------------------------------------
+GstThreadPool::GstThreadPool(QObject *parent) :
+	QObject(parent),
+	nextAt(0)
+{
+}
+
+GstThreadPool::~GstThreadPool()
+{
+	stop();
+}
+
+bool GstThreadPool::start(const QString &pluginPath)
+{
+	int count = 1;
+	QByteArray val = qgetenv("PSI_GST_THREADS");
+	if(!val.isEmpty())
+		count = qBound(1, val.toInt(), 16);
+
+	GstThread *first = new GstThread(this);
+	if(!first->start(pluginPath))
+	{
+		delete first;
+		return false;
+	}
+	threads += first;
+
+	// followers come up immediately and become ready once the primary
+	//   finishes gstreamer init
+	for(int n = 1; n < count; ++n)
+	{
+		GstThread *t = new GstThread(this);
+		t->startFollower(first);
+		threads += t;
+	}
+
+	return true;
+}
+
+void GstThreadPool::stop()
+{
+	// followers first, so the thread that owns gstreamer goes last
+	while(!threads.isEmpty())
+		delete threads.takeLast();
+	nextAt = 0;
+}
+
+GstThread *GstThreadPool::primary() const
+{
+	return threads.isEmpty() ? 0 : threads.first();
+}
+
+GstThread *GstThreadPool::threadForSession()
+{
+	GstThread *t = threads[nextAt];
+	nextAt = (nextAt + 1) % threads.count();
+	return t;
+}
+
 }
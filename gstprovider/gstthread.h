@@ -22,14 +22,21 @@
 #define PSI_GSTTHREAD_H
 
 #include <QThread>
+#include <QList>
 #include <glib.h>
 
 namespace PsiMedia {
 
 // this class is kind of like QCA::SyncThread but for glib.  It atomically
-//   starts up a thread, initializes gstreamer, and sets up a glib eventloop
-//   ready for use.  if you want to do stuff in the other thread, set
-//   up a glib timeout of 0 against mainContext(), and go from there.
+//   starts up a thread and sets up a glib eventloop ready for use.  if you
+//   want to do stuff in the other thread, use postTask(), or set up your
+//   own glib source against mainContext().
+//
+// gstreamer initialization (registry load and element preload) can take
+//   hundreds of milliseconds, so it happens in the background after
+//   start() returns.  tasks posted in the meantime are queued and run
+//   once initialization completes.  connect to ready() or call
+//   waitForReady() if you need to know the outcome.
 
 class GstThread : public QThread
 {
@@ -39,20 +46,79 @@ public:
 	GstThread(QObject *parent = 0);
 	~GstThread();
 
+	// returns as soon as the thread and eventloop are up, with
+	//   gstreamer init still in progress
 	bool start(const QString &pluginPath);
+
+	// like start(), but gstreamer init is left to the primary thread;
+	//   this thread just adopts its outcome.  used by GstThreadPool
+	bool startFollower(GstThread *primary);
+
 	void stop();
 
+	// blocks until gstreamer init completes (or msecs expires), and
+	//   returns whether it succeeded
+	bool waitForReady(int msecs = -1); // -1 = no timeout
+
 	QString gstVersion() const;
 	GMainContext *mainContext();
 
+	// run a function on the glib thread.  safe to call from any thread
+	//   between start() and stop().  tasks go into a lock-free mailbox
+	//   serviced by one permanent source, so a post costs an enqueue
+	//   and a context wakeup rather than a per-call source allocation
+	typedef void (*TaskFunc)(void *arg);
+	void postTask(TaskFunc func, void *arg);
+
+	// called by the task source funcs only
+	bool tasksPending();
+	void processTasks();
+
+signals:
+	// emitted when background gstreamer init completes.  success is
+	//   false if gstreamer could not be initialized or a required
+	//   element is missing
+	void ready(bool success);
+
 protected:
 	virtual void run();
 
+private slots:
+	void follower_ready(bool success);
+
 private:
 	class Private;
 	Private *d;
 };
 
+// a small pool of glib threads, so concurrent sessions can spread their
+//   glib-side work (rwcontrol message processing and timer dispatch)
+//   across cores instead of serializing on one main context.  the first
+//   thread owns gstreamer initialization; the rest follow its outcome.
+//   pool size comes from PSI_GST_THREADS (default 1, the old
+//   single-thread behavior)
+class GstThreadPool : public QObject
+{
+	Q_OBJECT
+
+public:
+	GstThreadPool(QObject *parent = 0);
+	~GstThreadPool();
+
+	bool start(const QString &pluginPath);
+	void stop();
+
+	// the init-owning thread, for version and feature queries
+	GstThread *primary() const;
+
+	// pick a thread for a new session, round-robin
+	GstThread *threadForSession();
+
+private:
+	QList<GstThread*> threads;
+	int nextAt;
+};
+
 }
 
 #endif
@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "latencytracer.h"
+
+#include <stdio.h>
+#include <QAtomicInt>
+#include <QTime>
+#include "monotime.h"
+
+// histogram layout: LATENCY_BUCKETS buckets of LATENCY_BUCKET_MS each,
+//   the last bucket collecting everything beyond the range
+#define LATENCY_BUCKETS   32
+#define LATENCY_BUCKET_MS 10
+
+// recent raw samples, for spotting spikes the histogram smears out
+#define LATENCY_RING      32
+
+// how often a non-forced dump may print
+#define DUMP_INTERVAL_MS  10000
+
+namespace PsiMedia {
+
+static const char *stage_names[] =
+{
+	"src   ",
+	"encin ",
+	"encout",
+	"rtpout",
+	"rtpin ",
+	"decout",
+	"sink  "
+};
+
+//----------------------------------------------------------------------------
+// LatencyTracer
+//----------------------------------------------------------------------------
+class LatencyTracer::StageProbe
+{
+public:
+	// written at attach/detach time only (worker thread).  the element
+	//   is not reffed: probes are detached before the worker releases
+	//   its pipelines
+	GstPad *pad;
+	GstElement *element;
+	gulong probeId;
+
+	// written from the streaming threads, atomics only
+	QAtomicInt counts[LATENCY_BUCKETS];
+	QAtomicInt samples;
+	QAtomicInt ring[LATENCY_RING];
+	QAtomicInt ringPos;
+
+	// maps monotime_ns() onto the element clock's timeline.  touched
+	//   only by this pad's streaming thread
+	qint64 clockOffset;
+	bool haveClockOffset;
+
+	StageProbe() :
+		pad(0),
+		element(0),
+		probeId(0),
+		clockOffset(0),
+		haveClockOffset(false)
+	{
+	}
+};
+
+class LatencyTracer::Private
+{
+public:
+	const char *name;
+	StageProbe stages[StageCount];
+	QTime lastDump;
+
+	static gboolean probe_cb(GstPad *pad, GstBuffer *buf, gpointer data)
+	{
+		Q_UNUSED(pad);
+
+		StageProbe *sp = (StageProbe *)data;
+
+		GstClockTime ts = GST_BUFFER_TIMESTAMP(buf);
+
+		// direct field reads, to keep the probe off the element lock.
+		//   worst case during a state change we record one bogus
+		//   sample
+		GstClock *clock = GST_ELEMENT_CLOCK(sp->element);
+		GstClockTime base = GST_ELEMENT_CAST(sp->element)->base_time;
+
+		if(!clock || !GST_CLOCK_TIME_IS_VALID(ts) || !GST_CLOCK_TIME_IS_VALID(base))
+			return TRUE;
+
+		// the pipeline clock takes a mutex per read, which is exactly
+		//   the kind of cross-thread contention a probe must not add.
+		//   read the raw monotonic source instead and map it onto the
+		//   clock's timeline, recalibrating every so often in case the
+		//   two drift apart
+		if(!sp->haveClockOffset || ((int)sp->samples & 0x3ff) == 0x3ff)
+		{
+			sp->clockOffset = (qint64)gst_clock_get_time(clock) - monotime_ns();
+			sp->haveClockOffset = true;
+		}
+
+		GstClockTime now = (GstClockTime)(monotime_ns() + sp->clockOffset);
+		if(now < base)
+			return TRUE;
+
+		GstClockTime running = now - base;
+		int lagMs = 0;
+		if(running > ts)
+			lagMs = (int)((running - ts) / GST_MSECOND);
+
+		int bucket = lagMs / LATENCY_BUCKET_MS;
+		if(bucket >= LATENCY_BUCKETS)
+			bucket = LATENCY_BUCKETS - 1;
+
+		sp->counts[bucket].ref();
+		sp->samples.ref();
+
+		int at = sp->ringPos.fetchAndAddRelaxed(1) % LATENCY_RING;
+		sp->ring[at].fetchAndStoreRelaxed(lagMs);
+
+		return TRUE; // keep the buffer
+	}
+};
+
+bool LatencyTracer::isEnabled()
+{
+	return (qgetenv("PSI_TRACE_LATENCY") == "1");
+}
+
+LatencyTracer::LatencyTracer(const char *name)
+{
+	d = new Private;
+	d->name = name;
+	d->lastDump.start();
+}
+
+LatencyTracer::~LatencyTracer()
+{
+	detachAll();
+	delete d;
+}
+
+void LatencyTracer::attach(Stage stage, GstElement *element, const char *padName)
+{
+	if(!element)
+		return;
+
+	StageProbe *sp = &d->stages[stage];
+	if(sp->pad)
+		return; // already probing this stage
+
+	GstPad *pad = gst_element_get_static_pad(element, padName);
+	if(!pad)
+		return;
+
+	sp->element = element;
+	sp->probeId = gst_pad_add_buffer_probe(pad, G_CALLBACK(Private::probe_cb), sp);
+	sp->pad = pad;
+}
+
+void LatencyTracer::attachByName(Stage stage, GstBin *bin, const char *elementName, const char *padName)
+{
+	if(!bin)
+		return;
+
+	GstElement *e = gst_bin_get_by_name(bin, elementName);
+	if(!e)
+		return;
+
+	attach(stage, e, padName);
+	gst_object_unref(e);
+}
+
+void LatencyTracer::detachAll()
+{
+	for(int n = 0; n < StageCount; ++n)
+	{
+		StageProbe *sp = &d->stages[n];
+		if(sp->pad)
+		{
+			gst_pad_remove_buffer_probe(sp->pad, sp->probeId);
+			gst_object_unref(sp->pad);
+			sp->pad = 0;
+			sp->element = 0;
+			sp->probeId = 0;
+		}
+	}
+}
+
+// value at or below which the given fraction of samples fall
+static int histogram_percentile(const int *counts, int total, int pct)
+{
+	int need = (total * pct + 99) / 100;
+	int sum = 0;
+	for(int n = 0; n < LATENCY_BUCKETS; ++n)
+	{
+		sum += counts[n];
+		if(sum >= need)
+			return (n + 1) * LATENCY_BUCKET_MS;
+	}
+	return LATENCY_BUCKETS * LATENCY_BUCKET_MS;
+}
+
+void LatencyTracer::dump(bool force)
+{
+	if(!force && d->lastDump.elapsed() < DUMP_INTERVAL_MS)
+		return;
+	d->lastDump.restart();
+
+	bool any = false;
+	for(int n = 0; n < StageCount; ++n)
+	{
+		if((int)d->stages[n].samples > 0)
+		{
+			any = true;
+			break;
+		}
+	}
+	if(!any)
+		return;
+
+	printf("latency trace [%s]:\n", d->name);
+	for(int n = 0; n < StageCount; ++n)
+	{
+		StageProbe *sp = &d->stages[n];
+		int total = (int)sp->samples;
+		if(total < 1)
+			continue;
+
+		// snapshot the histogram.  concurrent increments just land in
+		//   the next dump
+		int counts[LATENCY_BUCKETS];
+		for(int i = 0; i < LATENCY_BUCKETS; ++i)
+			counts[i] = (int)sp->counts[i];
+
+		int last = (int)sp->ring[((int)sp->ringPos + LATENCY_RING - 1) % LATENCY_RING];
+
+		printf("  %s n=%-7d p50<=%dms p90<=%dms p99<=%dms last=%dms\n",
+			stage_names[n], total,
+			histogram_percentile(counts, total, 50),
+			histogram_percentile(counts, total, 90),
+			histogram_percentile(counts, total, 99),
+			last);
+	}
+}
+
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef LATENCYTRACER_H
+#define LATENCYTRACER_H
+
+#include <gst/gst.h>
+
+namespace PsiMedia {
+
+// optional per-stage pipeline latency tracing, enabled with
+//   PSI_TRACE_LATENCY=1.  a buffer probe at each stage boundary
+//   measures how far the buffer runs behind its ideal running time
+//   (pipeline clock, minus base time, minus buffer timestamp) and
+//   counts it into a preallocated histogram with a single atomic
+//   increment - no locks and no allocation on the streaming threads,
+//   so it is cheap enough to leave on during live calls.  comparing
+//   adjacent stages shows where a pipeline loses time
+class LatencyTracer
+{
+public:
+	enum Stage
+	{
+		Stage_Src,    // capture/file source output
+		Stage_EncIn,  // encoder input
+		Stage_EncOut, // encoder output
+		Stage_RtpOut, // payloaded packets entering the rtp sink
+		Stage_RtpIn,  // packets leaving the rtp source
+		Stage_DecOut, // decoder output
+		Stage_Sink,   // playout/display sink input
+		StageCount
+	};
+
+	static bool isEnabled();
+
+	LatencyTracer(const char *name); // e.g. "audio", "video"
+	~LatencyTracer();
+
+	// probe a static pad.  a null element is ignored, so callers can
+	//   pass optional chain pieces blindly
+	void attach(Stage stage, GstElement *element, const char *padName);
+
+	// same, for an element buried inside a bin
+	void attachByName(Stage stage, GstBin *bin, const char *elementName, const char *padName);
+
+	// drop the probes.  the histograms survive for a final dump
+	void detachAll();
+
+	// print the histograms.  rate-limited internally so it can hang
+	//   off the stats poll; force skips the rate limit
+	void dump(bool force = false);
+
+private:
+	class StageProbe;
+	class Private;
+	Private *d;
+
+	LatencyTracer(const LatencyTracer &);
+	LatencyTracer &operator=(const LatencyTracer &);
+};
+
+}
+
+#endif
@@ -21,14 +21,15 @@
 #include "modes.h"
 
 #include <gst/gst.h>
+#include "codecs.h"
 
 namespace PsiMedia {
 
-// FIXME: any better way besides hardcoding?
+// element names come from the codec descriptor table (codecs.h)
 
-/*static bool have_element(const QString &name)
+static bool have_element(const char *name)
 {
-	GstElement *e = gst_element_factory_make(name.toLatin1().data(), NULL);
+	GstElement *e = gst_element_factory_make(name, NULL);
 	if(!e)
 		return false;
 
@@ -36,29 +37,80 @@ namespace PsiMedia {
 	return true;
 }
 
-static bool have_codec(const QString &enc, const QString &dec, const QString &pay, const QString &depay)
+static bool have_codec(const CodecDescriptor *c)
 {
-	if(have_element(enc) && have_element(dec) && have_element(pay) && have_element(depay))
+	if(c && have_element(c->enc) && have_element(c->dec) && have_element(c->pay) && have_element(c->depay))
 		return true;
 	else
 		return false;
 }
 
-static bool have_pcmu()
+static bool have_opus()
 {
-	return have_codec("mulawenc", "mulawdec", "rtppcmupay", "rtppcmudepay");
+	return have_codec(codec_lookup("opus", false));
+}
+
+static bool have_g722()
+{
+	return have_codec(codec_lookup("g722", false));
+}
+
+/*static bool have_pcmu()
+{
+	return have_codec(codec_lookup("pcmu", false));
 }
 
 static bool have_h263p()
 {
-	return have_codec("ffenc_h263p", "ffdec_h263", "rtph263ppay", "rtph263pdepay");
+	return have_codec(codec_lookup("h263p", true));
 }*/
 
-// speex, theora, and vorbis are guaranteed to exist
+// speex, theora, and vorbis are guaranteed to exist.  opus and g722
+//   come from separate plugins, so they must be probed for.
+
+// set PSI_NULL_CODEC=1 to advertise the passthrough "codecs" (l16
+//   audio, raw video) ahead of the real ones.  they payload media
+//   without encoding, so a session measures pure framework overhead.
+//   apps that take the first mode then A/B by toggling the variable
+static bool null_codec_enabled()
+{
+	return (qgetenv("PSI_NULL_CODEC") == "1");
+}
 
 QList<PAudioParams> modes_supportedAudio()
 {
 	QList<PAudioParams> list;
+	if(null_codec_enabled())
+	{
+		PAudioParams p;
+		p.codec = "l16";
+		p.sampleRate = 16000;
+		p.sampleSize = 16;
+		p.channels = 1;
+		list += p;
+	}
+	// opus first, so apps taking the first mode prefer it
+	if(have_opus())
+	{
+		PAudioParams p;
+		p.codec = "opus";
+		p.sampleRate = 48000;
+		p.sampleSize = 16;
+		p.channels = 1;
+		list += p;
+	}
+	// g722: wideband audio at a fraction of speex's encoder cost, for
+	//   hosts where cycles matter more than bitrate.  the rtp clock
+	//   rate is 8000 by historical accident, but the audio is 16khz
+	if(have_g722())
+	{
+		PAudioParams p;
+		p.codec = "g722";
+		p.sampleRate = 16000;
+		p.sampleSize = 16;
+		p.channels = 1;
+		list += p;
+	}
 	/*if(have_pcmu())
 	{
 		PAudioParams p;
@@ -106,6 +158,14 @@ QList<PAudioParams> modes_supportedAudio()
 QList<PVideoParams> modes_supportedVideo()
 {
 	QList<PVideoParams> list;
+	if(null_codec_enabled())
+	{
+		PVideoParams p;
+		p.codec = "rawvideo";
+		p.size = QSize(320, 240);
+		p.fps = 30;
+		list += p;
+	}
 	/*if(have_h263p())
 	{
 		PVideoParams p;
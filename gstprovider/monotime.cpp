@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "monotime.h"
+
+#ifdef Q_OS_WIN
+# include <windows.h>
+#else
+# include <time.h>
+# include <sys/time.h>
+#endif
+
+namespace PsiMedia {
+
+#ifdef Q_OS_WIN
+
+qint64 monotime_ns()
+{
+	// the performance counter is the cheapest monotonic source the
+	//   platform offers.  its frequency is fixed at boot, so sampling
+	//   it once is enough.  a racing first call just samples it twice
+	static LARGE_INTEGER freq;
+	if(freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (qint64)((double)now.QuadPart * (1000000000.0 / (double)freq.QuadPart));
+}
+
+#elif defined(CLOCK_MONOTONIC)
+
+qint64 monotime_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (qint64)ts.tv_sec * Q_INT64_C(1000000000) + ts.tv_nsec;
+}
+
+#else
+
+qint64 monotime_ns()
+{
+	// last resort: wall time.  not monotonic, but the consumers only
+	//   take short differences
+	timeval tv;
+	gettimeofday(&tv, 0);
+	return (qint64)tv.tv_sec * Q_INT64_C(1000000000) + (qint64)tv.tv_usec * 1000;
+}
+
+#endif
+
+}
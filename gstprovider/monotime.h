@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef MONOTIME_H
+#define MONOTIME_H
+
+#include <QtGlobal>
+
+namespace PsiMedia {
+
+// nanoseconds on a monotonic timeline with an arbitrary origin.  reads
+//   take the kernel's vdso fast path (or the performance counter on
+//   windows): the tsc with calibration maintained for us, tens of
+//   nanoseconds per call and never a lock.  cheap enough for
+//   per-buffer instrumentation on the streaming threads.  only
+//   differences between two reads are meaningful; units match
+//   GstClockTime, so deltas convert with a plain cast
+qint64 monotime_ns();
+
+}
+
+#endif
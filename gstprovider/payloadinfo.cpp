@@ -22,9 +22,34 @@
 
 #include <QByteArray>
 #include <QStringList>
+#include <QSet>
+#include <QHash>
+#include <QMutex>
+#include "codecs.h"
 
 namespace PsiMedia {
 
+// status messages rebuild the payload parameter lists over and over
+//   during negotiation, each time converting the same handful of
+//   strings out of the gst structures.  interning makes every rebuild
+//   share one allocation per distinct value instead of allocating
+//   fresh copies each pass.  worker threads build these too, hence
+//   the lock; the vocabulary is tiny, so the cache is bounded just as
+//   a safety net against hostile input
+static QString internString(const QString &in)
+{
+	static QSet<QString> cache;
+	static QMutex cache_mutex;
+
+	QMutexLocker locker(&cache_mutex);
+	QSet<QString>::const_iterator it = cache.constFind(in);
+	if(it != cache.constEnd())
+		return *it;
+	if(cache.count() < 256)
+		cache.insert(in);
+	return in;
+}
+
 static QString hexEncode(const QByteArray &in)
 {
 	QString out;
@@ -87,23 +112,80 @@ gboolean my_foreach_func(GQuark field_id, const GValue *value, gpointer user_dat
 	{
 		QString svalue = QString::fromLatin1(g_value_get_string(value));
 
-		// FIXME: is there a better way to detect when we should do this conversion?
-		if(name == "configuration" && (state.out->name == "THEORA" || state.out->name == "VORBIS"))
+		// codecs carrying out-of-band config (see codecs.h) use
+		//   base64 on the wire and hex in PPayloadInfo
+		const CodecDescriptor *cd = codec_lookup_rtp(state.out->name);
+		if(name == "configuration" && cd && cd->oobConfig)
 		{
 			QByteArray config = QByteArray::fromBase64(svalue.toLatin1());
 			svalue = hexEncode(config);
 		}
 
 		PPayloadInfo::Parameter i;
-		i.name = name;
-		i.value = svalue;
+		i.name = internString(name);
+		// oob config blobs are unique per stream; don't pin those in
+		//   the cache
+		i.value = (svalue.length() < 64) ? internString(svalue) : svalue;
 		state.list->append(i);
 	}
 
 	return TRUE;
 }
 
-GstStructure *payloadInfoToStructure(const PPayloadInfo &info, const QString &media)
+uint payloadInfoHash(const PPayloadInfo &info)
+{
+	uint h = qHash(info.name);
+	h = h * 31 + (uint)info.id;
+	h = h * 31 + (uint)info.clockrate;
+	h = h * 31 + (uint)info.channels;
+	h = h * 31 + (uint)info.ptime;
+	h = h * 31 + (uint)info.maxptime;
+	foreach(const PPayloadInfo::Parameter &i, info.parameters)
+	{
+		h = h * 31 + qHash(i.name);
+		h = h * 31 + qHash(i.value);
+	}
+	return h;
+}
+
+bool payloadInfoEqual(const PPayloadInfo &a, const PPayloadInfo &b)
+{
+	if(a.id != b.id ||
+		a.clockrate != b.clockrate ||
+		a.channels != b.channels ||
+		a.ptime != b.ptime ||
+		a.maxptime != b.maxptime ||
+		a.name != b.name)
+	{
+		return false;
+	}
+
+	if(a.parameters.count() != b.parameters.count())
+		return false;
+	for(int n = 0; n < a.parameters.count(); ++n)
+	{
+		if(a.parameters[n].name != b.parameters[n].name ||
+			a.parameters[n].value != b.parameters[n].value)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool payloadInfoListEqual(const QList<PPayloadInfo> &a, const QList<PPayloadInfo> &b)
+{
+	if(a.count() != b.count())
+		return false;
+	for(int n = 0; n < a.count(); ++n)
+	{
+		if(!payloadInfoEqual(a[n], b[n]))
+			return false;
+	}
+	return true;
+}
+
+static GstStructure *payloadInfoToStructureUncached(const PPayloadInfo &info, const QString &media)
 {
 	GstStructure *out = gst_structure_empty_new("application/x-rtp");
 
@@ -167,8 +249,8 @@ GstStructure *payloadInfoToStructure(const PPayloadInfo &info, const QString &me
 	{
 		QString value = i.value;
 
-		// FIXME: is there a better way to detect when we should do this conversion?
-		if(i.name == "configuration" && (info.name.toUpper() == "THEORA" || info.name.toUpper() == "VORBIS"))
+		const CodecDescriptor *cd = codec_lookup_rtp(info.name);
+		if(i.name == "configuration" && cd && cd->oobConfig)
 		{
 			QByteArray config = hexDecode(value);
 			if(config.isEmpty())
@@ -190,6 +272,61 @@ GstStructure *payloadInfoToStructure(const PPayloadInfo &info, const QString &me
 	return out;
 }
 
+// codec updates rebuild the same structures over and over (signaling
+//   commonly resends full payload lists verbatim), and the build above
+//   is string-heavy.  memoize on the payload hash: a hit verifies the
+//   full fields against the stored info to rule out collisions, then
+//   hands back a copy of the cached structure
+class PayloadStructureCacheEntry
+{
+public:
+	PPayloadInfo info;
+	QString media;
+	GstStructure *structure;
+};
+
+GstStructure *payloadInfoToStructure(const PPayloadInfo &info, const QString &media)
+{
+	static QHash<uint, PayloadStructureCacheEntry> cache;
+	static QMutex cache_mutex;
+
+	uint h = payloadInfoHash(info);
+
+	QMutexLocker locker(&cache_mutex);
+
+	QHash<uint, PayloadStructureCacheEntry>::const_iterator it = cache.constFind(h);
+	if(it != cache.constEnd() && it->media == media && payloadInfoEqual(it->info, info))
+		return gst_structure_copy(it->structure);
+
+	GstStructure *out = payloadInfoToStructureUncached(info, media);
+	if(!out)
+		return 0;
+
+	// a stale entry under the same hash gets replaced, not leaked
+	QHash<uint, PayloadStructureCacheEntry>::iterator old = cache.find(h);
+	if(old != cache.end())
+	{
+		gst_structure_free(old.value().structure);
+		cache.erase(old);
+	}
+	else if(cache.count() >= 64)
+	{
+		// the vocabulary is a handful of payloads per session; the
+		//   bound is just a safety net against hostile input
+		foreach(const PayloadStructureCacheEntry &e, cache)
+			gst_structure_free(e.structure);
+		cache.clear();
+	}
+
+	PayloadStructureCacheEntry entry;
+	entry.info = info;
+	entry.media = media;
+	entry.structure = gst_structure_copy(out);
+	cache.insert(h, entry);
+
+	return out;
+}
+
 PPayloadInfo structureToPayloadInfo(GstStructure *structure, QString *media)
 {
 	PPayloadInfo out;
@@ -240,15 +377,22 @@ PPayloadInfo structureToPayloadInfo(GstStructure *structure, QString *media)
 		out.channels = n;
 	}
 
-	// TODO: vbr, cng, mode?
-	// see: http://tools.ietf.org/html/draft-ietf-avt-rtp-speex-05
-
 	// note: if we ever change away from the whitelist approach, be sure
 	//   not to grab the earlier static fields (e.g. clock-rate) as
 	//   dynamic parameters
 	QStringList whitelist;
 	whitelist << "sampling" << "width" << "height" << "delivery-method" << "configuration";
 
+	// raw video (rfc 4175) carries its format in fmtp
+	whitelist << "depth" << "colorimetry";
+
+	// opus fmtp parameters (rfc 7587)
+	whitelist << "minptime" << "maxplaybackrate" << "stereo" << "useinbandfec" << "usedtx";
+
+	// speex fmtp parameters (rfc 5574): vbr may be "on", "off" or
+	//   "vad"; cng announces comfort-noise generation during dtx
+	whitelist << "vbr" << "cng" << "mode";
+
 	QList<PPayloadInfo::Parameter> list;
 
 	my_foreach_state state;
@@ -30,6 +30,12 @@ namespace PsiMedia {
 GstStructure *payloadInfoToStructure(const PPayloadInfo &info, const QString &media);
 PPayloadInfo structureToPayloadInfo(GstStructure *structure, QString *media = 0);
 
+// cheap hash and field-by-field equality, for change detection and the
+//   caps memoization.  list equality is order-sensitive
+uint payloadInfoHash(const PPayloadInfo &info);
+bool payloadInfoEqual(const PPayloadInfo &a, const PPayloadInfo &b);
+bool payloadInfoListEqual(const QList<PPayloadInfo> &a, const QList<PPayloadInfo> &b);
+
 }
 
 #endif
@@ -25,6 +25,7 @@
 #include <QSet>
 #include <gst/gst.h>
 #include "devices.h"
+#include "bins.h"
 
 // FIXME: this file is heavily commented out and a mess, mainly because
 //   all of my attempts at a dynamic pipeline were futile.  someday we
@@ -38,8 +39,6 @@
 // in milliseconds
 #define DEFAULT_LATENCY 20
 
-//#define USE_LIVEADDER
-
 namespace PsiMedia {
 
 static int get_fixed_rate()
@@ -72,6 +71,23 @@ static int get_latency_time()
 		return DEFAULT_LATENCY;
 }
 
+// grace period, in milliseconds, that released input devices stay open
+//   awaiting a re-acquire.  a transport-layer reconnect that destroys
+//   and recreates a session with the same devices then skips the
+//   hardware reopen (the dominant part of the ~1s rebuild cost).  0
+//   (the default) releases devices immediately, as before
+static int get_reconnect_linger_ms()
+{
+	QString val = QString::fromLatin1(qgetenv("PSI_RECONNECT_LINGER_MS"));
+	if(!val.isEmpty())
+	{
+		int x = val.toInt();
+		if(x > 0)
+			return x;
+	}
+	return 0;
+}
+
 static const char *type_to_str(PDevice::Type type)
 {
 	switch(type)
@@ -141,7 +157,7 @@ static GstElement *filter_for_capture_size(const QSize &size)
 	return capsfilter;
 }
 
-static GstElement *filter_for_desired_size(const QSize &size)
+static GstCaps *caps_for_desired_size(const QSize &size)
 {
 	QList<int> widths;
 	widths << 160 << 320 << 640 << 800 << 1024;
@@ -154,7 +170,6 @@ static GstElement *filter_for_desired_size(const QSize &size)
 		}
 	}
 
-	GstElement *capsfilter = gst_element_factory_make("capsfilter", NULL);
 	GstCaps *caps = gst_caps_new_empty();
 
 	for(int n = 0; n < widths.count(); ++n)
@@ -174,14 +189,27 @@ static GstElement *filter_for_desired_size(const QSize &size)
 	GstStructure *cs = gst_structure_new("image/jpeg", NULL);
 	gst_caps_append_structure(caps, cs);
 
+	return caps;
+}
+
+static GstElement *filter_for_desired_size(const QSize &size)
+{
+	GstElement *capsfilter = gst_element_factory_make("capsfilter", NULL);
+	GstCaps *caps = caps_for_desired_size(size);
 	g_object_set(G_OBJECT(capsfilter), "caps", caps, NULL);
 	gst_caps_unref(caps);
 
 	return capsfilter;
 }
 
-static GstElement *make_devicebin(const QString &id, PDevice::Type type, const QSize &desiredSize)
+// sizeFilter, if provided, receives the desired-size capsfilter when one
+//   is installed (0 otherwise).  the caller can later renegotiate capture
+//   quality by replacing that filter's caps
+static GstElement *make_devicebin(const QString &id, PDevice::Type type, const QSize &desiredSize, GstElement **sizeFilter = 0)
 {
+	if(sizeFilter)
+		*sizeFilter = 0;
+
 	QSize captureSize;
 	GstElement *e = devices_makeElement(id, type, &captureSize);
 	if(!e)
@@ -191,7 +219,10 @@ static GstElement *make_devicebin(const QString &id, PDevice::Type type, const Q
 	if(/*type == PDevice::AudioIn ||*/ type == PDevice::AudioOut)
 	{
 		int latency_ms = get_latency_time();
-		if(latency_ms > 0)
+
+		// not all sinks have the property (e.g. the synthetic test
+		//   device is a fakesink)
+		if(latency_ms > 0 && g_object_class_find_property(G_OBJECT_GET_CLASS(e), "latency-time"))
 		{
 			gint64 lt = latency_ms * 1000; // microseconds
 			g_object_set(G_OBJECT(e), "latency-time", lt, NULL);
@@ -207,6 +238,7 @@ static GstElement *make_devicebin(const QString &id, PDevice::Type type, const Q
 
 		GstElement *audioconvert = gst_element_factory_make("audioconvert", NULL);
 		GstElement *audioresample = gst_element_factory_make("audioresample", NULL);
+		bins_audioresample_configure(audioresample);
 
 		GstElement *capsfilter = gst_element_factory_make("capsfilter", NULL);
 		GstCaps *caps = gst_caps_new_empty();
@@ -259,7 +291,11 @@ static GstElement *make_devicebin(const QString &id, PDevice::Type type, const Q
 		if(captureSize.isValid())
 			capsfilter = filter_for_capture_size(captureSize);
 		else if(desiredSize.isValid())
+		{
 			capsfilter = filter_for_desired_size(desiredSize);
+			if(sizeFilter)
+				*sizeFilter = capsfilter;
+		}
 
 		gst_bin_add(GST_BIN(bin), e);
 
@@ -286,6 +322,7 @@ static GstElement *make_devicebin(const QString &id, PDevice::Type type, const Q
 	{
 		GstElement *audioconvert = gst_element_factory_make("audioconvert", NULL);
 		GstElement *audioresample = gst_element_factory_make("audioresample", NULL);
+		bins_audioresample_configure(audioresample);
 		gst_bin_add(GST_BIN(bin), audioconvert);
 		gst_bin_add(GST_BIN(bin), audioresample);
 		gst_bin_add(GST_BIN(bin), e);
@@ -318,8 +355,31 @@ public:
 
 	// queue for srcs, adder for sinks
 	GstElement *element;
+
+	// if set, incremented whenever the branch queue discards a buffer
+	QAtomicInt *dropCounter;
 };
 
+// the branch queues are leaky, so an overrun means a buffer was thrown
+//   away to make room.  note: called from the streaming thread
+static void branchqueue_overrun(GstElement *element, gpointer data)
+{
+	Q_UNUSED(element);
+	PipelineDeviceContextPrivate *context = (PipelineDeviceContextPrivate *)data;
+	if(context->dropCounter)
+		context->dropCounter->ref();
+}
+
+// pad (un)block completion for the quality renegotiation below.  nothing
+//   to do here: the block just keeps buffers with stale caps from racing
+//   past the filter while it is being retargeted
+static void sizefilter_blocked(GstPad *pad, gboolean blocked, gpointer data)
+{
+	Q_UNUSED(pad);
+	Q_UNUSED(blocked);
+	Q_UNUSED(data);
+}
+
 class PipelineDevice
 {
 public:
@@ -336,7 +396,18 @@ public:
 	GstElement *speexdsp;
 	GstElement *tee;
 
-	// for sinks (audio only, video sinks are always unshared)
+	// for video srcs: the demand-driven size filter inside the device
+	//   bin, if one was installed (0 when the device has a fixed capture
+	//   size), and the hint it is currently set for
+	GstElement *sizeFilter;
+	QSize appliedVideoSize;
+
+	// for sinks (audio only, video sinks are always unshared).  when
+	//   mixing is set, adder is a live mixer fronting one persistent
+	//   output chain, and any number of contexts can attach to it as
+	//   inputs.  otherwise adder is just an alias for capsfilter and
+	//   the device supports a single context
+	bool mixing;
 	GstElement *adder;
 	GstElement *audioconvert;
 	GstElement *audioresample;
@@ -350,15 +421,19 @@ public:
 		activated(false),
 		speexdsp(0),
 		tee(0),
+		sizeFilter(0),
+		mixing(false),
 		adder(0),
 		speexprobe(0)
 	{
 		pipeline = context->pipeline->element();
 
-		bin = make_devicebin(id, type, context->opts.videoSize);
+		bin = make_devicebin(id, type, context->opts.videoSize, &sizeFilter);
 		if(!bin)
 			return;
 
+		appliedVideoSize = context->opts.videoSize;
+
 		// TODO: use context->opts.fps?
 
 		if(type == PDevice::AudioIn || type == PDevice::VideoIn)
@@ -392,15 +467,33 @@ public:
 				gst_element_link_many(bin, speexdsp, tee, NULL);
 			else
 				gst_element_link(bin, tee);
+
+			// if the pipeline is already running, bring the new
+			//   elements up to speed in place so a device can be
+			//   added without restarting everything
+			if(GST_STATE(pipeline) >= GST_STATE_PAUSED)
+			{
+				gst_element_sync_state_with_parent(tee);
+				if(speexdsp)
+					gst_element_sync_state_with_parent(speexdsp);
+				gst_element_sync_state_with_parent(bin);
+			}
 		}
 		else // AudioOut
 		{
-#ifdef USE_LIVEADDER
+			// front the output chain with a live mixer, so that
+			//   several sessions can attach as inputs and share one
+			//   device, one resampler and one echo probe.  if
+			//   liveadder isn't available, fall back to a direct
+			//   connection and this device stays single-context
 			adder = gst_element_factory_make("liveadder", NULL);
-
-			audioconvert = gst_element_factory_make("audioconvert", NULL);
-			audioresample = gst_element_factory_make("audioresample", NULL);
-#endif
+			if(adder)
+			{
+				mixing = true;
+				audioconvert = gst_element_factory_make("audioconvert", NULL);
+				audioresample = gst_element_factory_make("audioresample", NULL);
+				bins_audioresample_configure(audioresample);
+			}
 
 			capsfilter = gst_element_factory_make("capsfilter", NULL);
 			GstCaps *caps = gst_caps_new_empty();
@@ -436,29 +529,45 @@ public:
 			}
 
 			gst_bin_add(GST_BIN(pipeline), bin);
-#ifdef USE_LIVEADDER
-			gst_bin_add(GST_BIN(pipeline), adder);
-			gst_bin_add(GST_BIN(pipeline), audioconvert);
-			gst_bin_add(GST_BIN(pipeline), audioresample);
-#endif
+			if(mixing)
+			{
+				gst_bin_add(GST_BIN(pipeline), adder);
+				gst_bin_add(GST_BIN(pipeline), audioconvert);
+				gst_bin_add(GST_BIN(pipeline), audioresample);
+			}
 			gst_bin_add(GST_BIN(pipeline), capsfilter);
 
 			if(speexprobe)
 				gst_bin_add(GST_BIN(pipeline), speexprobe);
 
-#ifdef USE_LIVEADDER
-			gst_element_link_many(adder, audioconvert, audioresample, capsfilter, NULL);
-#endif
+			if(mixing)
+				gst_element_link_many(adder, audioconvert, audioresample, capsfilter, NULL);
 
 			if(speexprobe)
 				gst_element_link_many(capsfilter, speexprobe, bin, NULL);
 			else
 				gst_element_link(capsfilter, bin);
 
-#ifndef USE_LIVEADDER
-			// HACK
-			adder = capsfilter;
-#endif
+			if(!mixing)
+			{
+				// HACK
+				adder = capsfilter;
+			}
+
+			// as above: support being added to a running pipeline
+			if(GST_STATE(pipeline) >= GST_STATE_PAUSED)
+			{
+				gst_element_sync_state_with_parent(bin);
+				if(speexprobe)
+					gst_element_sync_state_with_parent(speexprobe);
+				gst_element_sync_state_with_parent(capsfilter);
+				if(mixing)
+				{
+					gst_element_sync_state_with_parent(audioresample);
+					gst_element_sync_state_with_parent(audioconvert);
+					gst_element_sync_state_with_parent(adder);
+				}
+			}
 
 			/*gst_element_set_state(bin, GST_STATE_PLAYING);
 			if(speexprobe)
@@ -484,26 +593,34 @@ public:
 
 		if(type == PDevice::AudioIn || type == PDevice::VideoIn)
 		{
+			// flush before removal, in case the pipeline is live
+			gst_element_set_state(bin, GST_STATE_NULL);
+			gst_element_get_state(bin, NULL, NULL, GST_CLOCK_TIME_NONE);
 			gst_bin_remove(GST_BIN(pipeline), bin);
 
 			if(speexdsp)
 			{
+				gst_element_set_state(speexdsp, GST_STATE_NULL);
 				gst_bin_remove(GST_BIN(pipeline), speexdsp);
 				g_speexdsp = 0;
 			}
 
 			if(tee)
+			{
+				gst_element_set_state(tee, GST_STATE_NULL);
 				gst_bin_remove(GST_BIN(pipeline), tee);
+			}
 		}
 		else // AudioOut
 		{
 			if(adder)
 			{
-#ifdef USE_LIVEADDER
-				gst_element_set_state(adder, GST_STATE_NULL);
-				gst_element_set_state(audioconvert, GST_STATE_NULL);
-				gst_element_set_state(audioresample, GST_STATE_NULL);
-#endif
+				if(mixing)
+				{
+					gst_element_set_state(adder, GST_STATE_NULL);
+					gst_element_set_state(audioconvert, GST_STATE_NULL);
+					gst_element_set_state(audioresample, GST_STATE_NULL);
+				}
 
 				gst_element_set_state(capsfilter, GST_STATE_NULL);
 				if(speexprobe)
@@ -514,14 +631,17 @@ public:
 
 			if(adder)
 			{
-				/*gst_element_get_state(adder, NULL, NULL, GST_CLOCK_TIME_NONE);
-				gst_bin_remove(GST_BIN(pipeline), adder);
+				if(mixing)
+				{
+					gst_element_get_state(adder, NULL, NULL, GST_CLOCK_TIME_NONE);
+					gst_bin_remove(GST_BIN(pipeline), adder);
 
-				gst_element_get_state(audioconvert, NULL, NULL, GST_CLOCK_TIME_NONE);
-				gst_bin_remove(GST_BIN(pipeline), audioconvert);
+					gst_element_get_state(audioconvert, NULL, NULL, GST_CLOCK_TIME_NONE);
+					gst_bin_remove(GST_BIN(pipeline), audioconvert);
 
-				gst_element_get_state(audioresample, NULL, NULL, GST_CLOCK_TIME_NONE);
-				gst_bin_remove(GST_BIN(pipeline), audioresample);*/
+					gst_element_get_state(audioresample, NULL, NULL, GST_CLOCK_TIME_NONE);
+					gst_bin_remove(GST_BIN(pipeline), audioresample);
+				}
 
 				gst_element_get_state(capsfilter, NULL, NULL, GST_CLOCK_TIME_NONE);
 				gst_bin_remove(GST_BIN(pipeline), capsfilter);
@@ -542,8 +662,6 @@ public:
 	{
 		Q_ASSERT(!contexts.contains(context));
 
-		// TODO: consider context->opts for refs after first
-
 		if(type == PDevice::AudioIn || type == PDevice::VideoIn)
 		{
 			// create a queue from the tee, and hand it off.  app
@@ -551,9 +669,29 @@ public:
 			//   device
 			GstElement *queue = gst_element_factory_make("queue", NULL);
 			context->element = queue;
+
+			// bound the branch and let it leak oldest-first.  without
+			//   this, one consumer falling behind (e.g. a preview
+			//   widget on a busy ui thread) fills its queue and the
+			//   tee backpressures every other branch of the device.
+			//   with it, the slow branch just loses its oldest data
+			//   and the rest keep flowing
+			g_object_set(G_OBJECT(queue),
+				"leaky", 2, // downstream (drop oldest)
+				"max-size-buffers", (guint)0,
+				"max-size-bytes", (guint)0,
+				"max-size-time", (guint64)(200 * GST_MSECOND),
+				NULL);
+			g_signal_connect(G_OBJECT(queue),
+				"overrun",
+				G_CALLBACK(branchqueue_overrun), context);
+
 			//gst_element_set_locked_state(queue, TRUE);
 			gst_bin_add(GST_BIN(pipeline), queue);
 			gst_element_link(tee, queue);
+
+			if(GST_STATE(pipeline) >= GST_STATE_PAUSED)
+				gst_element_sync_state_with_parent(queue);
 		}
 		else // AudioOut
 		{
@@ -565,25 +703,56 @@ public:
 
 		contexts += context;
 		++refs;
+
+		// a later ref may raise the quality demand
+		update();
 	}
 
 	void removeRef(PipelineDeviceContextPrivate *context)
 	{
 		Q_ASSERT(contexts.contains(context));
 
-		// TODO: recalc video properties
-
 		if(type == PDevice::AudioIn || type == PDevice::VideoIn)
 		{
 			// deactivate if not done so already
 			deactivate(context);
 
 			GstElement *queue = context->element;
+			gst_element_set_state(queue, GST_STATE_NULL);
+			gst_element_get_state(queue, NULL, NULL, GST_CLOCK_TIME_NONE);
 			gst_bin_remove(GST_BIN(pipeline), queue);
 		}
+		else if(mixing) // AudioOut
+		{
+			// the departing session has already unlinked from the
+			//   mixer.  drop whatever request pads are left dangling,
+			//   so they don't pile up as calls come and go
+			QList<GstPad*> unused;
+			GstIterator *it = gst_element_iterate_sink_pads(adder);
+			gpointer item;
+			while(gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+			{
+				GstPad *pad = GST_PAD(item);
+				GstPad *peer = gst_pad_get_peer(pad);
+				if(peer)
+					gst_object_unref(GST_OBJECT(peer));
+				else
+					unused += pad;
+				gst_object_unref(GST_OBJECT(pad));
+			}
+			gst_iterator_free(it);
+
+			foreach(GstPad *pad, unused)
+				gst_element_release_request_pad(adder, pad);
+		}
 
 		contexts.remove(context);
 		--refs;
+
+		// when the most demanding consumer leaves, let the device
+		//   downshift for whoever remains
+		if(refs > 0)
+			update();
 	}
 
 	void activate(PipelineDeviceContextPrivate *context)
@@ -689,34 +858,218 @@ public:
 		activated = false;
 	}
 
+	// warm-standby device swap: open and pre-roll the replacement device
+	//   in the running pipeline while the current one keeps flowing, then
+	//   switch the link over.  the tee (for srcs) and the shared sink
+	//   chain (for sinks) stay in place, so the contexts' elements remain
+	//   valid and downstream keeps its negotiated caps where possible.
+	bool switchTo(const QString &newId)
+	{
+		if(!bin || newId == id)
+			return false;
+
+		QSize videoSize = maxVideoSize();
+
+		GstElement *newSizeFilter = 0;
+		GstElement *newbin = make_devicebin(newId, type, videoSize, &newSizeFilter);
+		if(!newbin)
+			return false;
+
+		bool running = (GST_STATE(pipeline) >= GST_STATE_PAUSED);
+
+		if(type == PDevice::AudioIn || type == PDevice::VideoIn)
+		{
+			// warm up the new device unlinked, in PAUSED.  a live
+			//   source opens the hardware on the way to PAUSED but
+			//   doesn't push any data until PLAYING, so there is no
+			//   not-linked error to worry about.  the old device
+			//   keeps running during this, so the user sees no gap
+			//   while the (potentially slow) open happens
+			gst_bin_add(GST_BIN(pipeline), newbin);
+
+			if(running)
+			{
+				gst_element_set_state(newbin, GST_STATE_PAUSED);
+
+				// bounded wait.  live sources report no-preroll,
+				//   which is fine; only outright failure aborts
+				GstStateChangeReturn ret = gst_element_get_state(newbin, NULL, NULL, GST_SECOND);
+				if(ret == GST_STATE_CHANGE_FAILURE)
+				{
+#ifdef PIPELINE_DEBUG
+					printf("switchTo %s:[%s]: new device failed to open\n", type_to_str(type), qPrintable(newId));
+#endif
+					gst_element_set_state(newbin, GST_STATE_NULL);
+					gst_element_get_state(newbin, NULL, NULL, GST_CLOCK_TIME_NONE);
+					gst_bin_remove(GST_BIN(pipeline), newbin);
+					return false;
+				}
+			}
+
+			// the switch itself: stop the old device first, so its
+			//   final pushes end in a clean flushing return rather
+			//   than a not-linked error, then hand its link to the
+			//   already-open replacement
+			GstElement *downstream = speexdsp ? speexdsp : tee;
+
+			gst_element_set_state(bin, GST_STATE_NULL);
+			gst_element_get_state(bin, NULL, NULL, GST_CLOCK_TIME_NONE);
+			gst_element_unlink(bin, downstream);
+			gst_bin_remove(GST_BIN(pipeline), bin);
+
+			gst_element_link(newbin, downstream);
+			if(running)
+				gst_element_sync_state_with_parent(newbin);
+		}
+		else // AudioOut
+		{
+			// sinks don't need a parking spot: bringing the bin up
+			//   opens the device, and it simply waits for data
+			gst_bin_add(GST_BIN(pipeline), newbin);
+			if(running)
+				gst_element_sync_state_with_parent(newbin);
+
+			GstElement *upstream = speexprobe ? speexprobe : capsfilter;
+
+			gst_element_unlink(upstream, bin);
+			gst_element_link(upstream, newbin);
+
+			gst_element_set_state(bin, GST_STATE_NULL);
+			gst_element_get_state(bin, NULL, NULL, GST_CLOCK_TIME_NONE);
+			gst_bin_remove(GST_BIN(pipeline), bin);
+		}
+
+		bin = newbin;
+		id = newId;
+		sizeFilter = newSizeFilter;
+		appliedVideoSize = videoSize;
+
+#ifdef PIPELINE_DEBUG
+		printf("Switched %s to [%s]\n", type_to_str(type), qPrintable(id));
+#endif
+		return true;
+	}
+
+	// the device must satisfy its most demanding consumer; everyone
+	//   smaller scales down from what it produces
+	QSize maxVideoSize() const
+	{
+		QSize out;
+		foreach(const PipelineDeviceContextPrivate *c, contexts)
+		{
+			const QSize &s = c->opts.videoSize;
+			if(s.isValid() && (!out.isValid() || s.width() * s.height() > out.width() * out.height()))
+				out = s;
+		}
+		return out;
+	}
+
+	// re-evaluate the quality demand across all refs, and renegotiate
+	//   the capture caps if it changed.  this is how capture downshifts
+	//   when the last high-res consumer leaves, instead of staying at
+	//   full size for a consumer that only wants a thumbnail
 	void update()
 	{
-		// TODO: change video properties based on options
+		QSize videoSize = maxVideoSize();
+		if(videoSize == appliedVideoSize)
+			return;
+
+		appliedVideoSize = videoSize;
+
+		if(type != PDevice::VideoIn || !sizeFilter)
+			return;
+
+		GstCaps *caps = caps_for_desired_size(videoSize);
+
+		if(GST_STATE(pipeline) >= GST_STATE_PAUSED)
+		{
+			// live renegotiation.  hold dataflow at the filter while
+			//   the allowed caps change, so no buffer with stale caps
+			//   races past it mid-switch.  the block is asynchronous:
+			//   it takes effect between buffers, without waiting on
+			//   the streaming thread from here
+			GstPad *pad = gst_element_get_static_pad(sizeFilter, "src");
+			gst_pad_set_blocked_async(pad, TRUE, sizefilter_blocked, NULL);
+
+			g_object_set(G_OBJECT(sizeFilter), "caps", caps, NULL);
+
+			// most capture sources only examine the allowed caps when
+			//   opening negotiation, and won't resize a live stream on
+			//   their own.  cycle the device bin through READY so the
+			//   next preroll picks the new maximum.  the tee and all
+			//   consumer branches stay in place throughout, so this
+			//   looks like a caps change downstream, not a rebuild
+			gst_element_set_state(bin, GST_STATE_READY);
+			gst_element_get_state(bin, NULL, NULL, GST_CLOCK_TIME_NONE);
+			gst_element_sync_state_with_parent(bin);
+
+			gst_pad_set_blocked_async(pad, FALSE, sizefilter_blocked, NULL);
+			gst_object_unref(GST_OBJECT(pad));
+		}
+		else
+		{
+			// not running yet: the new caps simply apply at preroll
+			g_object_set(G_OBJECT(sizeFilter), "caps", caps, NULL);
+		}
+
+		gst_caps_unref(caps);
+
+#ifdef PIPELINE_DEBUG
+		printf("Retargeted %s:[%s] to %dx%d\n", type_to_str(type), qPrintable(id), videoSize.width(), videoSize.height());
+#endif
 	}
 };
 
 class PipelineContext::Private
 {
 public:
+	// an input device kept open after its last release, waiting for a
+	//   quick re-acquire.  a fakesink parks the tee so the device can
+	//   keep flowing with no consumer branches, and the timer tears
+	//   everything down for real once the grace period passes
+	class LingeringDevice
+	{
+	public:
+		Private *priv;
+		PipelineDevice *dev; // 0 once reclaimed
+		GstElement *parksink;
+		GSource *timer;
+	};
+
 	GstElement *pipeline;
+	GMainContext *mainContext;
+	GstClock *extClock;
 	bool activated;
+	bool deactivatePending;
 	QSet<PipelineDevice*> devices;
+	QList<LingeringDevice*> lingering;
 
-	Private() :
-		activated(false)
+	Private(GMainContext *_mainContext) :
+		mainContext(_mainContext),
+		extClock(0),
+		activated(false),
+		deactivatePending(false)
 	{
 		pipeline = gst_pipeline_new(NULL);
 	}
 
 	~Private()
 	{
+		// expire any lingering devices now.  destroying a timer runs
+		//   its finalizer, which deletes the device and unlists it
+		while(!lingering.isEmpty())
+			g_source_destroy(lingering.first()->timer);
+
 		Q_ASSERT(devices.isEmpty());
 		deactivate();
+		if(extClock)
+			gst_object_unref(GST_OBJECT(extClock));
 		g_object_unref(G_OBJECT(pipeline));
 	}
 
 	void activate()
 	{
+		deactivatePending = false;
 		if(!activated)
 		{
 			gst_element_set_state(pipeline, GST_STATE_PLAYING);
@@ -727,6 +1080,19 @@ public:
 
 	void deactivate()
 	{
+		// a lingering device is only worth anything if the pipeline
+		//   stays live.  with linger enabled, hold the pipeline up
+		//   while devices are still held or lingering (the session
+		//   deactivates before releasing its device refs), and finish
+		//   the job in maybeDeactivate() once they resolve
+		if(get_reconnect_linger_ms() > 0 && mainContext
+			&& (!devices.isEmpty() || !lingering.isEmpty()))
+		{
+			deactivatePending = true;
+			return;
+		}
+
+		deactivatePending = false;
 		if(activated)
 		{
 			gst_element_set_state(pipeline, GST_STATE_NULL);
@@ -734,11 +1100,117 @@ public:
 			activated = false;
 		}
 	}
+
+	void maybeDeactivate()
+	{
+		if(deactivatePending && devices.isEmpty() && lingering.isEmpty())
+			deactivate();
+	}
+
+	// take over a released device instead of destroying it.  only
+	//   input devices are worth keeping: their open cost dominates,
+	//   while output chains come up quickly.  returns false if linger
+	//   doesn't apply and the caller should destroy the device
+	bool lingerDevice(PipelineDevice *dev)
+	{
+		int ms = get_reconnect_linger_ms();
+		if(ms < 1 || !mainContext || !activated)
+			return false;
+		if(dev->type != PDevice::AudioIn && dev->type != PDevice::VideoIn)
+			return false;
+
+		// park the tee on a fakesink, so the device keeps flowing
+		//   with no consumer branches attached
+		GstElement *parksink = gst_element_factory_make("fakesink", NULL);
+		if(!parksink)
+			return false;
+		g_object_set(G_OBJECT(parksink), "sync", FALSE, "async", FALSE, NULL);
+		gst_bin_add(GST_BIN(pipeline), parksink);
+		gst_element_link(dev->tee, parksink);
+		gst_element_sync_state_with_parent(parksink);
+
+		LingeringDevice *ld = new LingeringDevice;
+		ld->priv = this;
+		ld->dev = dev;
+		ld->parksink = parksink;
+		ld->timer = g_timeout_source_new(ms);
+		g_source_set_callback(ld->timer, cb_linger_expired, ld, linger_finalize);
+		g_source_attach(ld->timer, mainContext);
+		g_source_unref(ld->timer);
+
+		lingering += ld;
+
+#ifdef PIPELINE_DEBUG
+		printf("Lingering %s:[%s] for %dms\n", type_to_str(dev->type), qPrintable(dev->id), ms);
+#endif
+		return true;
+	}
+
+	// reclaim a lingering device for a new context, if one matches
+	PipelineDevice *takeLingering(const QString &id, PDevice::Type type)
+	{
+		foreach(LingeringDevice *ld, lingering)
+		{
+			if(ld->dev && ld->dev->id == id && ld->dev->type == type)
+			{
+				PipelineDevice *dev = ld->dev;
+				ld->dev = 0; // finalizer: reclaimed, don't destroy
+
+				unpark(dev, ld->parksink);
+				ld->parksink = 0;
+
+				lingering.removeAll(ld);
+				g_source_destroy(ld->timer);
+
+#ifdef PIPELINE_DEBUG
+				printf("Reclaimed %s:[%s]\n", type_to_str(dev->type), qPrintable(dev->id));
+#endif
+				return dev;
+			}
+		}
+		return 0;
+	}
+
+	void unpark(PipelineDevice *dev, GstElement *parksink)
+	{
+		Q_UNUSED(dev);
+		gst_element_set_state(parksink, GST_STATE_NULL);
+		gst_element_get_state(parksink, NULL, NULL, GST_CLOCK_TIME_NONE);
+		gst_bin_remove(GST_BIN(pipeline), parksink);
+	}
+
+	static gboolean cb_linger_expired(gpointer data)
+	{
+		Q_UNUSED(data);
+
+		// one shot.  the actual teardown happens in the finalizer, so
+		//   that a main context dying mid-linger cleans up the same way
+		return FALSE;
+	}
+
+	static void linger_finalize(gpointer data)
+	{
+		LingeringDevice *ld = (LingeringDevice *)data;
+		Private *priv = ld->priv;
+
+		if(ld->dev)
+		{
+			priv->lingering.removeAll(ld);
+			priv->unpark(ld->dev, ld->parksink);
+			delete ld->dev;
+
+			// if a deactivate was deferred for our sake and we were
+			//   the last holdout, let it happen now
+			priv->maybeDeactivate();
+		}
+
+		delete ld;
+	}
 };
 
-PipelineContext::PipelineContext()
+PipelineContext::PipelineContext(GMainContext *mainContext)
 {
-	d = new Private;
+	d = new Private(mainContext);
 }
 
 PipelineContext::~PipelineContext()
@@ -746,6 +1218,11 @@ PipelineContext::~PipelineContext()
 	delete d;
 }
 
+int PipelineContext::reconnectLingerMs()
+{
+	return get_reconnect_linger_ms();
+}
+
 void PipelineContext::activate()
 {
 	d->activate();
@@ -756,6 +1233,26 @@ void PipelineContext::deactivate()
 	d->deactivate();
 }
 
+void PipelineContext::useExternalClock(GstClock *clock)
+{
+	if(d->extClock)
+		gst_object_unref(GST_OBJECT(d->extClock));
+
+	d->extClock = clock;
+	if(d->extClock)
+	{
+		gst_object_ref(GST_OBJECT(d->extClock));
+		gst_pipeline_use_clock(GST_PIPELINE(d->pipeline), d->extClock);
+	}
+	else
+		gst_pipeline_auto_clock(GST_PIPELINE(d->pipeline));
+}
+
+GstClock *PipelineContext::externalClock() const
+{
+	return d->extClock;
+}
+
 GstElement *PipelineContext::element()
 {
 	return d->pipeline;
@@ -768,6 +1265,7 @@ PipelineDeviceContext::PipelineDeviceContext()
 {
 	d = new PipelineDeviceContextPrivate;
 	d->device = 0;
+	d->dropCounter = 0;
 }
 
 PipelineDeviceContext *PipelineDeviceContext::create(PipelineContext *pipeline, const QString &id, PDevice::Type type, const PipelineDeviceOptions &opts)
@@ -778,8 +1276,18 @@ PipelineDeviceContext *PipelineDeviceContext::create(PipelineContext *pipeline,
 	that->d->opts = opts;
 	that->d->activated = false;
 
+	// a recently released device may still be open, waiting for exactly
+	//   this: grab it back and skip the hardware reopen
+	PipelineDevice *dev = pipeline->d->takeLingering(id, type);
+	if(dev)
+	{
+		dev->addRef(that->d);
+		pipeline->d->devices += dev;
+		that->d->device = dev;
+		return that;
+	}
+
 	// see if we're already using this device, so we can attempt to share
-	PipelineDevice *dev = 0;
 	foreach(PipelineDevice *i, pipeline->d->devices)
 	{
 		if(i->id == id && i->type == type)
@@ -803,11 +1311,20 @@ PipelineDeviceContext *PipelineDeviceContext::create(PipelineContext *pipeline,
 	}
 	else
 	{
-		// FIXME: make sharing work
-		//dev->addRef(that->d);
+		if(type == PDevice::AudioOut && dev->mixing)
+		{
+			// shared audio output: attach to the persistent sink
+			//   chain as another input on the mixer
+			dev->addRef(that->d);
+		}
+		else
+		{
+			// FIXME: make input sharing work
+			//dev->addRef(that->d);
 
-		delete that;
-		return 0;
+			delete that;
+			return 0;
+		}
 	}
 
 	that->d->device = dev;
@@ -831,7 +1348,9 @@ PipelineDeviceContext::~PipelineDeviceContext()
 		if(dev->refs == 0)
 		{
 			d->pipeline->d->devices.remove(dev);
-			delete dev;
+			if(!d->pipeline->d->lingerDevice(dev))
+				delete dev;
+			d->pipeline->d->maybeDeactivate();
 		}
 	}
 
@@ -853,10 +1372,30 @@ GstElement *PipelineDeviceContext::element()
 	return d->element;
 }
 
+void PipelineDeviceContext::setDropCounter(QAtomicInt *counter)
+{
+	d->dropCounter = counter;
+}
+
 void PipelineDeviceContext::setOptions(const PipelineDeviceOptions &opts)
 {
 	d->opts = opts;
 	d->device->update();
 }
 
+bool PipelineDeviceContext::switchDevice(const QString &id)
+{
+	PipelineDevice *dev = d->device;
+	if(!dev)
+		return false;
+
+	// a swap affects every context on the device, so only allow it
+	//   when we are the sole ref.  a shared audio output with other
+	//   sessions attached falls back to a per-session rebuild instead
+	if(dev->refs > 1)
+		return false;
+
+	return dev->switchTo(id);
+}
+
 }
@@ -22,6 +22,7 @@
 #define PSI_PIPELINE_H
 
 #include <QString>
+#include <QAtomicInt>
 #include <gst/gstelement.h>
 #include "psimediaprovider.h"
 
@@ -33,15 +34,33 @@ class PipelineDeviceContextPrivate;
 class PipelineContext
 {
 public:
-	PipelineContext();
+	// pass a glib main context to enable the device linger grace
+	//   period (see PSI_RECONNECT_LINGER_MS in pipeline.cpp): released
+	//   input devices are then kept open for a short while so an
+	//   immediate re-acquire skips the expensive hardware reopen.
+	//   without a context, release destroys devices right away
+	PipelineContext(GMainContext *mainContext = 0);
 	~PipelineContext();
 
+	// the configured grace period, in milliseconds (0 = disabled)
+	static int reconnectLingerMs();
+
 	// set the pipeline to playing (activate) or to null (deactivate)
 	// FIXME: when we make dynamic pipelines work, we can remove these
 	//   functions.
 	void activate();
 	void deactivate();
 
+	// pin the pipeline to an externally provided clock, instead of
+	//   letting it elect its own.  every pipeline pinned to the same
+	//   clock runs on one timebase, so streams recorded from them need
+	//   no drift correction to line up.  takes its own ref.  call
+	//   before the first activate
+	void useExternalClock(GstClock *clock);
+
+	// the pinned clock, or 0 if none was set
+	GstClock *externalClock() const;
+
 	GstElement *element();
 
 private:
@@ -57,7 +76,9 @@ private:
 //   possible quality to satisfy the maximum hinted of all the references.
 //   thus, if one ref is made, set to 640x480, and another ref is made, set to
 //   320x240, the quality generated by the device (and therefore, both refs)
-//   will probably be 640x480.
+//   will probably be 640x480.  the demand is re-evaluated whenever a ref
+//   comes, goes, or changes its options, so when the 640x480 ref above is
+//   released the device renegotiates down to what the remaining refs want.
 class PipelineDeviceOptions
 {
 public:
@@ -95,8 +116,33 @@ public:
 	void deactivate();
 
 	GstElement *element();
+
+	// change this context's quality hint on a live device.  the device
+	//   recomputes the maximum demand across all of its refs and, if it
+	//   changed, renegotiates the capture caps in place (dataflow is
+	//   briefly blocked at the size filter while it is retargeted).
+	//   everything downstream of the tee just sees a caps change
 	void setOptions(const PipelineDeviceOptions &opts);
 
+	// input (src) contexts are isolated from each other by a bounded
+	//   leaky queue, so a slow consumer drops its own data instead of
+	//   backpressuring the tee and stalling the other branches.  pass a
+	//   counter here to find out when that happens: it is incremented
+	//   from the streaming thread each time the branch queue discards a
+	//   buffer.  the counter must outlive this context.  no-op for
+	//   output (sink) contexts
+	void setDropCounter(QAtomicInt *counter);
+
+	// swap the underlying device for another one of the same type,
+	//   without tearing this context down.  the new device is opened and
+	//   brought up to the pipeline state in parallel, while the old one
+	//   keeps running, and only then is the link switched over.  on
+	//   success, element() is unchanged and downstream never sees the
+	//   swap beyond a momentary gap.  on failure, the old device is left
+	//   running and false is returned (the caller can fall back to a
+	//   full rebuild).
+	bool switchDevice(const QString &id);
+
 private:
 	PipelineDeviceContext();
 
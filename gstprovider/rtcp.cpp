@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "rtcp.h"
+
+#include <QDateTime>
+
+// seconds between the ntp epoch (1900) and the unix epoch (1970)
+#define NTP_UNIX_OFFSET 2208988800ull
+
+#define RTCP_PT_SR 200
+#define RTCP_PT_RR 201
+#define RTCP_PT_PSFB 206
+#define RTCP_PSFB_PLI 1
+
+namespace PsiMedia {
+
+static void write32(QByteArray *out, quint32 i)
+{
+	char buf[4];
+	buf[0] = (char)(i >> 24);
+	buf[1] = (char)((i >> 16) & 0xff);
+	buf[2] = (char)((i >> 8) & 0xff);
+	buf[3] = (char)(i & 0xff);
+	out->append(buf, 4);
+}
+
+static quint32 read32(const unsigned char *p)
+{
+	return ((quint32)p[0] << 24) | ((quint32)p[1] << 16) | ((quint32)p[2] << 8) | (quint32)p[3];
+}
+
+static void writeReportBlocks(QByteArray *out, const QList<RtcpReportBlock> &blocks)
+{
+	foreach(const RtcpReportBlock &b, blocks)
+	{
+		write32(out, b.ssrc);
+		write32(out, ((quint32)(b.fractionLost & 0xff) << 24) | ((quint32)b.cumulativeLost & 0xffffff));
+		write32(out, b.extHighestSeq);
+		write32(out, b.jitter);
+		write32(out, b.lsr);
+		write32(out, b.dlsr);
+	}
+}
+
+static void writeHeader(QByteArray *out, int pt, int count, int wordsAfterHeader)
+{
+	out->append((char)(0x80 | (count & 0x1f))); // version 2, no padding
+	out->append((char)pt);
+	out->append((char)(wordsAfterHeader >> 8));
+	out->append((char)(wordsAfterHeader & 0xff));
+}
+
+QByteArray rtcpCreateSenderReport(quint32 ssrc, quint32 ntpSec, quint32 ntpFrac, quint32 rtpTime, quint32 packetCount, quint32 octetCount, const QList<RtcpReportBlock> &blocks)
+{
+	QByteArray out;
+	writeHeader(&out, RTCP_PT_SR, blocks.count(), 6 + blocks.count() * 6);
+	write32(&out, ssrc);
+	write32(&out, ntpSec);
+	write32(&out, ntpFrac);
+	write32(&out, rtpTime);
+	write32(&out, packetCount);
+	write32(&out, octetCount);
+	writeReportBlocks(&out, blocks);
+	return out;
+}
+
+QByteArray rtcpCreateReceiverReport(quint32 ssrc, const QList<RtcpReportBlock> &blocks)
+{
+	QByteArray out;
+	writeHeader(&out, RTCP_PT_RR, blocks.count(), 1 + blocks.count() * 6);
+	write32(&out, ssrc);
+	writeReportBlocks(&out, blocks);
+	return out;
+}
+
+static bool parseReportBlocks(const unsigned char *p, int count, int avail, QList<RtcpReportBlock> *blocks)
+{
+	if(avail < count * 24)
+		return false;
+
+	for(int n = 0; n < count; ++n)
+	{
+		RtcpReportBlock b;
+		b.ssrc = read32(p);
+		quint32 lossWord = read32(p + 4);
+		b.fractionLost = (int)(lossWord >> 24);
+		b.cumulativeLost = (int)(lossWord & 0xffffff);
+		if(b.cumulativeLost & 0x800000) // 24-bit signed
+			b.cumulativeLost -= 0x1000000;
+		b.extHighestSeq = read32(p + 8);
+		b.jitter = read32(p + 12);
+		b.lsr = read32(p + 16);
+		b.dlsr = read32(p + 20);
+		*blocks += b;
+		p += 24;
+	}
+
+	return true;
+}
+
+bool rtcpParse(const QByteArray &packet, QList<RtcpReport> *reports)
+{
+	const unsigned char *p = (const unsigned char *)packet.data();
+	int remaining = packet.size();
+	bool any = false;
+
+	while(remaining >= 4)
+	{
+		if((p[0] & 0xc0) != 0x80) // version must be 2
+			return any;
+
+		int count = p[0] & 0x1f;
+		int pt = p[1];
+		int len = (((int)p[2] << 8) | (int)p[3]) * 4 + 4;
+		if(len > remaining)
+			return any;
+
+		if(pt == RTCP_PT_SR && len >= 28)
+		{
+			RtcpReport r;
+			r.haveSenderInfo = true;
+			r.senderSsrc = read32(p + 4);
+			r.ntpSec = read32(p + 8);
+			r.ntpFrac = read32(p + 12);
+			r.rtpTime = read32(p + 16);
+			r.packetCount = read32(p + 20);
+			r.octetCount = read32(p + 24);
+			if(parseReportBlocks(p + 28, count, len - 28, &r.blocks))
+			{
+				*reports += r;
+				any = true;
+			}
+		}
+		else if(pt == RTCP_PT_RR && len >= 8)
+		{
+			RtcpReport r;
+			r.senderSsrc = read32(p + 4);
+			if(parseReportBlocks(p + 8, count, len - 8, &r.blocks))
+			{
+				*reports += r;
+				any = true;
+			}
+		}
+
+		// other packet types (SDES, BYE, APP, feedback) are skipped
+
+		p += len;
+		remaining -= len;
+	}
+
+	return any;
+}
+
+bool rtcpContainsPli(const QByteArray &packet, quint32 mediaSsrc)
+{
+	const unsigned char *p = (const unsigned char *)packet.data();
+	int remaining = packet.size();
+
+	while(remaining >= 4)
+	{
+		if((p[0] & 0xc0) != 0x80)
+			return false;
+
+		// for feedback packets the count field carries the message type
+		int fmt = p[0] & 0x1f;
+		int pt = p[1];
+		int len = (((int)p[2] << 8) | (int)p[3]) * 4 + 4;
+		if(len > remaining)
+			return false;
+
+		if(pt == RTCP_PT_PSFB && fmt == RTCP_PSFB_PLI && len >= 12 && read32(p + 8) == mediaSsrc)
+			return true;
+
+		p += len;
+		remaining -= len;
+	}
+
+	return false;
+}
+
+void rtcpNtpTime(quint32 *sec, quint32 *frac)
+{
+	QDateTime now = QDateTime::currentDateTime();
+	*sec = (quint32)((quint64)now.toTime_t() + NTP_UNIX_OFFSET);
+
+	// 2^32 fractional units per second
+	*frac = (quint32)(((quint64)now.time().msec() << 32) / 1000);
+}
+
+quint32 rtcpNtpMiddle(quint32 sec, quint32 frac)
+{
+	return (sec << 16) | (frac >> 16);
+}
+
+}
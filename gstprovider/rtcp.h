@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef RTCP_H
+#define RTCP_H
+
+#include <QByteArray>
+#include <QList>
+
+namespace PsiMedia {
+
+// rfc 3550 report block, as carried in an SR or RR
+class RtcpReportBlock
+{
+public:
+	quint32 ssrc; // source this block reports on
+	int fractionLost; // 0-255, loss since the previous report
+	int cumulativeLost;
+	quint32 extHighestSeq;
+	quint32 jitter; // in rtp clock units
+	quint32 lsr; // middle 32 bits of the last SR's ntp timestamp
+	quint32 dlsr; // delay since that SR, in 1/65536 seconds
+
+	inline RtcpReportBlock() :
+		ssrc(0),
+		fractionLost(0),
+		cumulativeLost(0),
+		extHighestSeq(0),
+		jitter(0),
+		lsr(0),
+		dlsr(0)
+	{
+	}
+};
+
+// one SR or RR out of a compound packet.  for an RR, the sender info
+//   fields are zero and haveSenderInfo is false
+class RtcpReport
+{
+public:
+	bool haveSenderInfo;
+	quint32 senderSsrc;
+	quint32 ntpSec;
+	quint32 ntpFrac;
+	quint32 rtpTime;
+	quint32 packetCount;
+	quint32 octetCount;
+	QList<RtcpReportBlock> blocks;
+
+	inline RtcpReport() :
+		haveSenderInfo(false),
+		senderSsrc(0),
+		ntpSec(0),
+		ntpFrac(0),
+		rtpTime(0),
+		packetCount(0),
+		octetCount(0)
+	{
+	}
+};
+
+QByteArray rtcpCreateSenderReport(quint32 ssrc, quint32 ntpSec, quint32 ntpFrac, quint32 rtpTime, quint32 packetCount, quint32 octetCount, const QList<RtcpReportBlock> &blocks);
+QByteArray rtcpCreateReceiverReport(quint32 ssrc, const QList<RtcpReportBlock> &blocks);
+
+// walks a compound packet and extracts the SRs and RRs, skipping any
+//   other packet types.  returns false if the data isn't rtcp at all
+bool rtcpParse(const QByteArray &packet, QList<RtcpReport> *reports);
+
+// true if the compound packet carries an rfc 4585 picture loss
+//   indication addressed to the given media source
+bool rtcpContainsPli(const QByteArray &packet, quint32 mediaSsrc);
+
+// wall clock as an ntp timestamp, and the middle 32 bits used for
+//   the LSR/DLSR round-trip exchange
+void rtcpNtpTime(quint32 *sec, quint32 *frac);
+quint32 rtcpNtpMiddle(quint32 sec, quint32 frac);
+
+}
+
+#endif
@@ -21,18 +21,57 @@
 #include "rtpworker.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <QStringList>
+#include <QSet>
 #include <QTime>
 #include "devices.h"
 #include "payloadinfo.h"
 #include "pipeline.h"
 #include "bins.h"
+#include "codecs.h"
+#include "ulpfec.h"
+#include "latencytracer.h"
+#include "gstcustomelements/rtppacketpool.h"
+#include "gstcustomelements/bufmon.h"
+#include "shmframering.h"
+#include "elementcache.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
 
 // TODO: support playing from bytearray
-// TODO: support recording
 
 #define RTPWORKER_DEBUG
 
+// payload type we advertise for receiving rfc 5109 fec on the video
+//   port, and how many media packets each fec packet protects by
+//   default (overridable with PSI_FEC_GROUP)
+#define VIDEO_FEC_PT 117
+#define VIDEO_FEC_GROUP 4
+
+// the video pacer sends this many packets per tick.  2 packets every
+//   2ms spreads a 30-packet keyframe over about one frame interval at
+//   30fps, instead of one microsecond burst
+#define PACE_TICK_MS 2
+#define PACE_PACKETS_PER_TICK 2
+
+// payload type for the low-resolution simulcast layer
+#define VIDEO_SIMULCAST_PT 118
+
+// how many delivered-but-unpainted frames the ui may owe before the
+//   video sink starts dropping.  one in flight is normal (the
+//   latest-frame slot), a couple more covers scheduling jitter
+#define QOS_MAX_UNPAINTED 3
+
+// slots in the shared-memory frame ring.  the writer announces a slot
+//   and is then 7 frames away from touching it again, which is plenty
+//   of headroom for a renderer that keeps up
+#define SHM_RING_SLOTS 8
+
 namespace PsiMedia {
 
 static GstStaticPadTemplate raw_audio_src_template = GST_STATIC_PAD_TEMPLATE("src",
@@ -131,6 +170,99 @@ public:
 	}
 };
 
+//----------------------------------------------------------------------------
+// RtpIngressFilter
+//----------------------------------------------------------------------------
+// cheap sanity pass over incoming rtp before it reaches the depayloader.
+//   malformed input is otherwise discovered deep inside the gst elements
+//   at much higher cost, and garbage has been seen to stall the pipeline.
+//   checks: minimum header size, version bits, an optional payload type
+//   whitelist, and duplicate drop over a small sliding sequence window.
+//   all state is guarded by the same mutex as the rtpsrc it feeds
+class RtpIngressFilter
+{
+public:
+	QSet<int> allowedTypes; // empty = accept any payload type
+
+	// packets of this type skip the duplicate window.  fec rides its
+	//   own sequence space, so it would poison the window
+	int dupExemptType;
+
+	RtpIngressFilter() :
+		dupExemptType(-1),
+		haveSeq(false),
+		ssrc(0),
+		highSeq(0),
+		window(0)
+	{
+	}
+
+	// returns false if the packet should be dropped
+	bool check(const QByteArray &buf)
+	{
+		if(buf.size() < 12)
+			return false;
+
+		const unsigned char *p = (const unsigned char *)buf.data();
+
+		// version field must be 2
+		if((p[0] & 0xc0) != 0x80)
+			return false;
+
+		int pt = p[1] & 0x7f;
+		if(!allowedTypes.isEmpty() && !allowedTypes.contains(pt))
+			return false;
+
+		if(pt == dupExemptType)
+			return true;
+
+		quint32 s = ((quint32)p[8] << 24) | ((quint32)p[9] << 16) | ((quint32)p[10] << 8) | (quint32)p[11];
+		quint16 seq = ((quint16)p[2] << 8) | (quint16)p[3];
+
+		// new or restarted stream: accept and restart the window
+		if(!haveSeq || s != ssrc)
+		{
+			haveSeq = true;
+			ssrc = s;
+			highSeq = seq;
+			window = 1;
+			return true;
+		}
+
+		qint16 diff = (qint16)(seq - highSeq);
+		if(diff > 0)
+		{
+			// new highest sequence.  slide the window forward
+			if(diff >= 64)
+				window = 0;
+			else
+				window <<= diff;
+			window |= 1;
+			highSeq = seq;
+			return true;
+		}
+
+		// at or behind the highest seen
+		int back = -(int)diff;
+		if(back >= 64)
+		{
+			// too old to judge, and ancient data is useless on a
+			//   live stream anyway
+			return false;
+		}
+		if(window & (Q_UINT64_C(1) << back))
+			return false; // duplicate
+		window |= (Q_UINT64_C(1) << back);
+		return true;
+	}
+
+private:
+	bool haveSeq;
+	quint32 ssrc;
+	quint16 highSeq;
+	quint64 window;
+};
+
 #ifdef RTPWORKER_DEBUG
 static void dump_pipeline(GstElement *in, int indent = 0)
 {
@@ -181,16 +313,118 @@ static GstElement *spipeline = 0;
 static GstElement *rpipeline = 0;
 //static GstBus *sbus = 0;
 static bool send_in_use = false;
-static bool recv_in_use = false;
+
+// number of sessions with a receive branch in the shared recv pipeline.
+//   multiple sessions can receive at once: each owns its own recvbin and
+//   they meet at the per-device shared audio sink (see pipeline.cpp)
+static int recv_refs = 0;
+
+// when the send pipeline is in use, the owning worker encodes once and
+//   fans the resulting rtp out to any other workers sending from the
+//   same devices.  this way a conference with N peers costs one encoder,
+//   not N.  guarded by a mutex because packets arrive from streaming
+//   threads while sessions come and go on the worker thread.
+static RtpWorker *send_owner = 0;
+static QList<RtpWorker*> send_consumers;
+static QMutex send_consumers_mutex;
 
 static bool use_shared_clock = true;
 static GstClock *shared_clock = 0;
+
+// externally clocked mode (PSI_EXTERNAL_CLOCK=1): both pipelines are
+//   pinned to the monotonic system clock instead of electing their own.
+//   every session in the process (and anything else on the host pinned
+//   the same way, e.g. a recording server's mixdown pipeline) then runs
+//   on one timebase, so cross-session alignment needs no drift
+//   correction.  replaces the internal master/slave clock juggling
+static bool use_external_clock = false;
 static bool send_clock_is_shared = false;
 //static bool recv_clock_is_shared = false;
 
+// workers may live on different glib threads (see GstThreadPool), but
+//   the pipeline state above is process-global.  setup and teardown
+//   serialize on this mutex; steady-state streaming never takes it
+static QMutex worker_setup_mutex;
+
+// pool of reusable record chunk buffers.  chunks flow from a streaming
+//   thread to the app side, so without pooling every mux page is a
+//   malloc on one thread and a free on another.  consumers return
+//   buffers via RtpWorker::recycleRecordBuffer; a recycled buffer's
+//   allocation is taken over in place by the next page that fits
+#define RECORD_POOL_MAX 32
+static QMutex record_pool_mutex;
+static QList<QByteArray> record_pool;
+
+static QByteArray record_buffer_acquire(const unsigned char *buf, int size)
+{
+	QByteArray out;
+	record_pool_mutex.lock();
+	if(!record_pool.isEmpty())
+		out = record_pool.takeLast();
+	record_pool_mutex.unlock();
+
+	// in-place when the buffer came back unique with enough capacity,
+	//   a plain allocation otherwise (no worse than before)
+	out.resize(size);
+	memcpy(out.data(), buf, size);
+	return out;
+}
+
+void RtpWorker::recycleRecordBuffer(const QByteArray &buf)
+{
+	if(buf.isEmpty())
+		return;
+
+	QMutexLocker locker(&record_pool_mutex);
+	if(record_pool.count() < RECORD_POOL_MAX)
+		record_pool += buf;
+}
+
+// when the reconnect linger is enabled (PSI_RECONNECT_LINGER_MS, see
+//   pipeline.cpp), the shared pipeline contexts outlive the last session
+//   for the grace period too, so the devices they keep open are still
+//   there for a quick re-acquire.  the epoch invalidates a scheduled
+//   teardown when a new session reclaims the contexts first
+static int pipelines_linger_epoch = 0;
+
+static gboolean cb_pipelines_linger_expired(gpointer data)
+{
+	int epoch = *((int *)data);
+
+	QMutexLocker locker(&worker_setup_mutex);
+	if(epoch == pipelines_linger_epoch && worker_refs == 0 && send_pipelineContext)
+	{
+		delete send_pipelineContext;
+		send_pipelineContext = 0;
+
+		delete recv_pipelineContext;
+		recv_pipelineContext = 0;
+
+		spipeline = 0;
+		rpipeline = 0;
+	}
+
+	return FALSE;
+}
+
+// note: must not take worker_setup_mutex here.  destroying the source can
+//   run this synchronously under a caller already holding the mutex
+static void pipelines_linger_free(gpointer data)
+{
+	g_free(data);
+}
+
 RtpWorker::RtpWorker(GMainContext *mainContext) :
 	loopFile(false),
 	maxbitrate(-1),
+	pathMtu(-1),
+	dtxEnabled(false),
+	jitterMinLatency(-1),
+	jitterMaxLatency(-1),
+	previewFps(-1),
+	shmVideoExport(false),
+	intensityInterval(-1),
+	audioOutputIntensity(-1),
 	canTransmitAudio(false),
 	canTransmitVideo(false),
 	outputVolume(100),
@@ -202,12 +436,38 @@ RtpWorker::RtpWorker(GMainContext *mainContext) :
 	cb_error(0),
 	cb_audioOutputIntensity(0),
 	cb_audioInputIntensity(0),
+	cb_stalled(0),
 	cb_previewFrame(0),
 	cb_outputFrame(0),
+	cb_shmOutputFrame(0),
 	cb_rtpAudioOut(0),
 	cb_rtpVideoOut(0),
+	cb_audioTalkingChanged(0),
 	mainContext_(mainContext),
 	timer(0),
+	sendStartPending(false),
+	startNotifyPending(false),
+	updateNotifyPending(false),
+	startTimeout(0),
+	busWatch(0),
+	audiojbuf(0),
+	jbufTimer(0),
+	intensityTimer(0),
+	watchdogTimer(0),
+	videoencoder(0),
+	videoencbin(0),
+	videoprepScaleFilter(0),
+	videoSendDownscale(0),
+	videoAdaptCaps(0),
+	videoFecEnc(0),
+	videoFecDec(0),
+	shmRing(0),
+	shmOutputSink(0),
+	audioIngress(0),
+	videoIngress(0),
+	paceTimer(0),
+	frameBurstUsed(0),
+	cpuSlotCount(0),
 	pd_audiosrc(0),
 	pd_videosrc(0),
 	pd_audiosink(0),
@@ -217,31 +477,72 @@ RtpWorker::RtpWorker(GMainContext *mainContext) :
 	videortpsrc(0),
 	volumein(0),
 	volumeout(0),
+	lastAppliedInputVolume(-1),
+	lastAppliedOutputVolume(-1),
 	rtpaudioout(false),
-	rtpvideoout(false)
-	//recordTimer(0)
+	rtpvideoout(false),
+	send_shared(false),
+	recording(false),
+	recordTapped(false),
+	recordMuxIsMatroska(false),
+	recordHeadersDone(false),
+	recordHeadersSent(false),
+	audioTalking(true),
+	audioSilenceRun(0),
+	audioSilenceKeep(0),
+	audioDtxSeqOffset(0)
 {
+	for(int n = 0; n < WatchStageCount; ++n)
+	{
+		watch[n].lastSeen = 0;
+		watch[n].alive = false;
+		watch[n].reported = false;
+	}
+
 	audioStats = new Stats("audio");
 	videoStats = new Stats("video");
 
+	audioTrace = 0;
+	videoTrace = 0;
+	if(LatencyTracer::isEnabled())
+	{
+		audioTrace = new LatencyTracer("audio");
+		videoTrace = new LatencyTracer("video");
+	}
+
+	QMutexLocker locker(&worker_setup_mutex);
+
 	if(worker_refs == 0)
 	{
-		send_pipelineContext = new PipelineContext;
-		recv_pipelineContext = new PipelineContext;
+		if(send_pipelineContext)
+		{
+			// the contexts are still up from a recently ended
+			//   session (reconnect linger).  reclaim them, along
+			//   with whatever devices they kept open, and void the
+			//   scheduled teardown
+			++pipelines_linger_epoch;
+		}
+		else
+		{
+			send_pipelineContext = new PipelineContext(mainContext);
+			recv_pipelineContext = new PipelineContext(mainContext);
 
-		spipeline = send_pipelineContext->element();
-		rpipeline = recv_pipelineContext->element();
+			spipeline = send_pipelineContext->element();
+			rpipeline = recv_pipelineContext->element();
 
-#ifdef RTPWORKER_DEBUG
-		/*sbus = gst_pipeline_get_bus(GST_PIPELINE(spipeline));
-		GSource *source = gst_bus_create_watch(bus);
-		gst_object_unref(bus);
-		g_source_set_callback(source, (GSourceFunc)cb_bus_call, this, NULL);
-		g_source_attach(source, mainContext_);*/
-#endif
+			if(qgetenv("PSI_EXTERNAL_CLOCK") == "1")
+			{
+				use_external_clock = true;
+
+				GstClock *sysclock = gst_system_clock_obtain();
+				send_pipelineContext->useExternalClock(sysclock);
+				recv_pipelineContext->useExternalClock(sysclock);
+				gst_object_unref(GST_OBJECT(sysclock));
+			}
+		}
 
 		QByteArray val = qgetenv("PSI_NO_SHARED_CLOCK");
-		if(!val.isEmpty())
+		if(!val.isEmpty() || use_external_clock)
 			use_shared_clock = false;
 	}
 
@@ -262,22 +563,65 @@ RtpWorker::~RtpWorker()
 		recordTimer = 0;
 	}*/
 
+	QMutexLocker locker(&worker_setup_mutex);
+
 	cleanup();
 
 	--worker_refs;
 	if(worker_refs == 0)
 	{
-		delete send_pipelineContext;
-		send_pipelineContext = 0;
+		int ms = PipelineContext::reconnectLingerMs();
+		if(ms > 0)
+		{
+			// keep the contexts (and their lingering devices) alive
+			//   for the grace period, in case a session with the
+			//   same devices comes right back
+			int *epoch = g_new(int, 1);
+			*epoch = pipelines_linger_epoch;
+			GSource *ltimer = g_timeout_source_new(ms);
+			g_source_set_callback(ltimer, cb_pipelines_linger_expired, epoch, pipelines_linger_free);
+			g_source_attach(ltimer, mainContext_);
+			g_source_unref(ltimer);
+		}
+		else
+		{
+			delete send_pipelineContext;
+			send_pipelineContext = 0;
 
-		delete recv_pipelineContext;
-		recv_pipelineContext = 0;
+			delete recv_pipelineContext;
+			recv_pipelineContext = 0;
+
+			spipeline = 0;
+			rpipeline = 0;
+		}
+
+		// no sessions left, so nothing will reuse pooled buffers
+		record_pool_mutex.lock();
+		record_pool.clear();
+		record_pool_mutex.unlock();
 
 		//sbus = 0;
 	}
 
 	delete audioStats;
 	delete videoStats;
+	delete audioTrace;
+	delete videoTrace;
+}
+
+// how long teardown waits for one state change before giving up, in
+//   milliseconds
+#define TEARDOWN_WAIT_MS 4000
+
+// bounded wait for an async state change during teardown.  a wedged
+//   driver can sit in a transition forever; past the timeout we abandon
+//   the wait and keep dismantling, preferring a leaked element over a
+//   hung thread
+static void teardown_wait(GstElement *elem)
+{
+	GstStateChangeReturn ret = gst_element_get_state(elem, NULL, NULL, TEARDOWN_WAIT_MS * GST_MSECOND);
+	if(ret == GST_STATE_CHANGE_ASYNC)
+		printf("teardown: state change timed out, abandoning wait\n");
 }
 
 void RtpWorker::cleanup()
@@ -285,20 +629,123 @@ void RtpWorker::cleanup()
 #ifdef RTPWORKER_DEBUG
 	printf("cleaning up...\n");
 #endif
-	volumein_mutex.lock();
-	volumein = 0;
-	volumein_mutex.unlock();
+	// drop the latency probes before their pads go away, and get a
+	//   final dump out
+	if(audioTrace)
+	{
+		audioTrace->dump(true);
+		audioTrace->detachAll();
+	}
+	if(videoTrace)
+	{
+		videoTrace->dump(true);
+		videoTrace->detachAll();
+	}
+
+	// if we were sharing another session's encoder, just detach
+	if(send_shared)
+	{
+		send_consumers_mutex.lock();
+		send_consumers.removeAll(this);
+		send_consumers_mutex.unlock();
+		send_shared = false;
+	}
 
-	volumeout_mutex.lock();
+	volumein = 0;
 	volumeout = 0;
-	volumeout_mutex.unlock();
+
+	// the record chain goes down with the sendbin
+	record_mutex.lock();
+	recording = false;
+	recordTapped = false;
+	recordMuxIsMatroska = false;
+	recordHeadersDone = false;
+	recordHeadersSent = false;
+	recordHeaders.clear();
+	record_mutex.unlock();
+
+	// abandon any in-flight async startup
+	sendStartPending = false;
+	startNotifyPending = false;
+	updateNotifyPending = false;
+
+	if(startTimeout)
+	{
+		g_source_destroy(startTimeout);
+		startTimeout = 0;
+	}
+
+	if(busWatch)
+	{
+		g_source_destroy(busWatch);
+		busWatch = 0;
+	}
+
+	if(jbufTimer)
+	{
+		g_source_destroy(jbufTimer);
+		jbufTimer = 0;
+	}
+
+	if(intensityTimer)
+	{
+		g_source_destroy(intensityTimer);
+		intensityTimer = 0;
+	}
+
+	if(watchdogTimer)
+	{
+		g_source_destroy(watchdogTimer);
+		watchdogTimer = 0;
+	}
+
+	if(audiojbuf)
+	{
+		gst_object_unref(audiojbuf);
+		audiojbuf = 0;
+	}
+
+	if(videoencoder)
+	{
+		gst_object_unref(videoencoder);
+		videoencoder = 0;
+	}
+
+	if(videoencbin)
+	{
+		gst_object_unref(videoencbin);
+		videoencbin = 0;
+	}
+
+	if(videoprepScaleFilter)
+	{
+		gst_object_unref(videoprepScaleFilter);
+		videoprepScaleFilter = 0;
+	}
+
+	videoSendBaseSize = QSize();
+	videoSendDownscale = 0;
+
+	videoadapt_mutex.lock();
+	if(videoAdaptCaps)
+	{
+		gst_caps_unref(videoAdaptCaps);
+		videoAdaptCaps = 0;
+	}
+	videoadapt_mutex.unlock();
 
 	audiortpsrc_mutex.lock();
 	audiortpsrc = 0;
+	delete audioIngress;
+	audioIngress = 0;
 	audiortpsrc_mutex.unlock();
 
 	videortpsrc_mutex.lock();
 	videortpsrc = 0;
+	delete videoFecDec;
+	videoFecDec = 0;
+	delete videoIngress;
+	videoIngress = 0;
 	videortpsrc_mutex.unlock();
 
 	rtpaudioout_mutex.lock();
@@ -307,8 +754,20 @@ void RtpWorker::cleanup()
 
 	rtpvideoout_mutex.lock();
 	rtpvideoout = false;
+	delete videoFecEnc;
+	videoFecEnc = 0;
 	rtpvideoout_mutex.unlock();
 
+	pace_mutex.lock();
+	paceQueue.clear();
+	frameBurstUsed = 0;
+	if(paceTimer)
+	{
+		g_source_destroy(paceTimer);
+		paceTimer = 0;
+	}
+	pace_mutex.unlock();
+
 	//if(pd_audiosrc)
 	//	pd_audiosrc->deactivate();
 
@@ -323,11 +782,11 @@ void RtpWorker::cleanup()
 			shared_clock = 0;
 			send_clock_is_shared = false;
 
-			if(recv_in_use)
+			if(recv_refs > 0)
 			{
 				printf("recv clock reverts to auto\n");
 				gst_element_set_state(rpipeline, GST_STATE_READY);
-				gst_element_get_state(rpipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+				teardown_wait(rpipeline);
 				gst_pipeline_auto_clock(GST_PIPELINE(rpipeline));
 
 				// only restart the receive pipeline if it is
@@ -341,12 +800,30 @@ void RtpWorker::cleanup()
 		}
 
 		send_pipelineContext->deactivate();
-		gst_pipeline_auto_clock(GST_PIPELINE(spipeline));
-		//gst_element_set_state(sendbin, GST_STATE_NULL);
-		//gst_element_get_state(sendbin, NULL, NULL, GST_CLOCK_TIME_NONE);
+
+		// keep the pinned clock in externally clocked mode
+		if(!use_external_clock)
+			gst_pipeline_auto_clock(GST_PIPELINE(spipeline));
+
+		// deactivation may have been deferred for lingering devices
+		//   (see pipeline.cpp), leaving the pipeline live: flush our
+		//   bin before pulling it out.  no-op when already null
+		gst_element_set_state(sendbin, GST_STATE_NULL);
+		teardown_wait(sendbin);
+
+		// salvage the stateless helpers for the next session before
+		//   the bin takes the rest down with it
+		elementcache_park_bin(GST_BIN(sendbin));
+
 		gst_bin_remove(GST_BIN(spipeline), sendbin);
 		sendbin = 0;
 		send_in_use = false;
+
+		// any consumers sharing this encoder stop receiving packets.
+		//   they remain active sessions and must be stopped on their own.
+		send_consumers_mutex.lock();
+		send_owner = 0;
+		send_consumers_mutex.unlock();
 	}
 
 	if(recvbin)
@@ -377,13 +854,44 @@ void RtpWorker::cleanup()
 			}
 		}*/
 
-		recv_pipelineContext->deactivate();
-		gst_pipeline_auto_clock(GST_PIPELINE(rpipeline));
-		//gst_element_set_state(recvbin, GST_STATE_NULL);
-		//gst_element_get_state(recvbin, NULL, NULL, GST_CLOCK_TIME_NONE);
+		--recv_refs;
+		if(recv_refs == 0)
+		{
+			recv_pipelineContext->deactivate();
+			if(!use_external_clock)
+				gst_pipeline_auto_clock(GST_PIPELINE(rpipeline));
+
+			// as with the sendbin above: the pipeline may still be
+			//   live if deactivation was deferred
+			gst_element_set_state(recvbin, GST_STATE_NULL);
+			teardown_wait(recvbin);
+		}
+		else
+		{
+			// other sessions are still receiving.  flush only our
+			//   own branch and detach it from the shared sink, so
+			//   their audio keeps flowing without interruption
+			gst_element_set_state(recvbin, GST_STATE_NULL);
+			teardown_wait(recvbin);
+			if(pd_audiosink)
+				gst_element_unlink(recvbin, pd_audiosink->element());
+		}
+
+		// as with the sendbin: recover reusable helpers first
+		elementcache_park_bin(GST_BIN(recvbin));
+
 		gst_bin_remove(GST_BIN(rpipeline), recvbin);
 		recvbin = 0;
-		recv_in_use = false;
+	}
+
+	// the sink died with recvbin, so nothing writes into the ring
+	//   anymore.  the renderer's own mapping stays valid until it
+	//   unmaps; we just drop ours
+	shmOutputSink = 0;
+	if(shmRing)
+	{
+		delete shmRing;
+		shmRing = 0;
 	}
 
 	if(pd_audiosrc)
@@ -464,51 +972,299 @@ void RtpWorker::stop()
 
 void RtpWorker::rtpAudioIn(const PRtpPacket &packet)
 {
+	if(packet.portOffset != 0)
+		return;
+
 	QMutexLocker locker(&audiortpsrc_mutex);
-	if(packet.portOffset == 0 && audiortpsrc)
-		gst_apprtpsrc_packet_push((GstAppRtpSrc *)audiortpsrc, (const unsigned char *)packet.rawValue.data(), packet.rawValue.size());
+
+	// srtp comes off first, in place, so everything downstream (the
+	//   ingress filter, the counters, the pipeline) sees plain rtp.
+	//   packets that fail to authenticate or replay are dropped here
+	QByteArray raw = packet.rawValue;
+	if(srtpIn.isActive() && !srtpIn.unprotect(&raw))
+		return;
+
+	// reject malformed/duplicate packets before they feed the
+	//   counters or cost a trip through the pipeline
+	if(audioIngress && !audioIngress->check(raw))
+		return;
+
+	audioRtpStats.countIn(packet);
+
+	// watchdog feeder: playback is only expected to move while input
+	//   keeps arriving
+	watch[Watch_AudioIngress].heartbeat.ref();
+
+	if(audiortpsrc)
+		gst_apprtpsrc_packet_push_full((GstAppRtpSrc *)audiortpsrc, (const unsigned char *)raw.data(), raw.size(), packet.arrivalNsecs);
 }
 
 void RtpWorker::rtpVideoIn(const PRtpPacket &packet)
 {
+	if(packet.portOffset != 0)
+		return;
+
 	QMutexLocker locker(&videortpsrc_mutex);
-	if(packet.portOffset == 0 && videortpsrc)
-		gst_apprtpsrc_packet_push((GstAppRtpSrc *)videortpsrc, (const unsigned char *)packet.rawValue.data(), packet.rawValue.size());
+
+	// srtp comes off first, in place, so everything downstream (the
+	//   ingress filter, the fec decoder, the counters, the pipeline)
+	//   sees plain rtp.  packets that fail to authenticate or replay
+	//   are dropped here
+	QByteArray raw = packet.rawValue;
+	if(srtpIn.isActive() && !srtpIn.unprotect(&raw))
+		return;
+
+	// reject malformed/duplicate packets before they feed the fec
+	//   decoder, the counters or the pipeline
+	if(videoIngress && !videoIngress->check(raw))
+		return;
+
+	if(videoFecDec)
+	{
+		bool isFec;
+		QList<QByteArray> recovered = videoFecDec->update(raw, &isFec);
+
+		// recovered packets go to the depayloader like any others, and
+		//   undo the loss that was counted when the gap was noticed.
+		//   countIn() isn't used here because their old sequence
+		//   numbers would confuse the gap tracker
+		foreach(const QByteArray &buf, recovered)
+		{
+			videoRtpStats.packetsIn.ref();
+			videoRtpStats.bytesIn.fetchAndAddRelaxed(buf.size());
+			videoRtpStats.packetsLost.fetchAndAddRelaxed(-1);
+			if(videortpsrc)
+				gst_apprtpsrc_packet_push((GstAppRtpSrc *)videortpsrc, (const unsigned char *)buf.data(), buf.size());
+		}
+
+		// fec packets ride their own sequence space, so they must not
+		//   feed the loss/jitter counters or the depayloader
+		if(isFec)
+			return;
+	}
+
+	videoRtpStats.countIn(packet);
+
+	watch[Watch_VideoIngress].heartbeat.ref();
+
+	if(videortpsrc)
+		gst_apprtpsrc_packet_push_full((GstAppRtpSrc *)videortpsrc, (const unsigned char *)raw.data(), raw.size(), packet.arrivalNsecs);
 }
 
-void RtpWorker::setOutputVolume(int level)
+// stage names, indexed by WatchStage.  shared by the watchdog report
+//   and the stall tallies in the stats snapshot
+static const char *watch_stage_names[] =
+{
+	"audio-capture",
+	"audio-encode",
+	"audio-playback",
+	"video-capture",
+	"video-encode",
+	"video-decode",
+	"audio-ingress",
+	"video-ingress"
+};
+
+PRtpSessionStats RtpWorker::statsSnapshot() const
+{
+	PRtpSessionStats out;
+	out.audioPacketsSent = (int)audioRtpStats.packetsOut;
+	out.audioBytesSent = (int)audioRtpStats.bytesOut;
+	out.videoPacketsSent = (int)videoRtpStats.packetsOut;
+	out.videoBytesSent = (int)videoRtpStats.bytesOut;
+	out.audioPacketsReceived = (int)audioRtpStats.packetsIn;
+	out.audioBytesReceived = (int)audioRtpStats.bytesIn;
+	out.audioPacketsLost = (int)audioRtpStats.packetsLost;
+	out.videoPacketsReceived = (int)videoRtpStats.packetsIn;
+	out.videoBytesReceived = (int)videoRtpStats.bytesIn;
+	out.videoPacketsLost = (int)videoRtpStats.packetsLost;
+	out.previewFrames = (int)previewFrames;
+	out.outputFrames = (int)outputFrames;
+	out.audioJitterMs = audioRtpStats.jitterMs();
+	out.audioJitterBufferMs = (int)audioJbufLatency;
+
+	// buffers thrown away by the capture branch queues.  the session
+	//   adds its own channel-queue drops on top of these
+	out.audioPacketsDropped = (int)audioSrcDrops;
+	out.videoPacketsDropped = (int)videoSrcDrops;
+
+	// cumulative stall tallies from the pipeline watchdog, named by
+	//   stage.  only stages that have actually stalled appear
+	for(int n = 0; n < WatchStageCount; ++n)
+	{
+		int count = (int)stallCounts[n];
+		if(count > 0)
+		{
+			PStallCounter c;
+			c.stage = QString::fromLatin1(watch_stage_names[n]);
+			c.count = count;
+			out.stallCounters += c;
+		}
+	}
+
+	// ride the stats poll for trace output (rate-limited internally)
+	if(audioTrace)
+		audioTrace->dump();
+	if(videoTrace)
+		videoTrace->dump();
+
+	return out;
+}
+
+// cpu time the calling thread has consumed so far, in nanoseconds.
+//   -1 if the platform can't tell us
+static qint64 thread_cpu_ns()
+{
+#ifdef Q_OS_WIN
+	FILETIME creation, exit, kernel, user;
+	if(!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+		return -1;
+
+	// filetimes are 100ns units
+	qint64 k = ((qint64)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+	qint64 u = ((qint64)user.dwHighDateTime << 32) | user.dwLowDateTime;
+	return (k + u) * 100;
+#else
+	struct timespec ts;
+	if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+		return -1;
+	return (qint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// fold the calling thread's cpu clock into the slot table.  called
+//   from the streaming-thread hot paths, so it must stay cheap: one
+//   clock read and a short critical section
+void RtpWorker::accountThreadCpu()
 {
-	QMutexLocker locker(&volumeout_mutex);
-	outputVolume = level;
-	if(volumeout)
+	qint64 ns = thread_cpu_ns();
+	if(ns < 0)
+		return;
+
+	GThread *self = g_thread_self();
+
+	QMutexLocker locker(&cpu_mutex);
+	for(int n = 0; n < cpuSlotCount; ++n)
+	{
+		if(cpuSlots[n].thread == self)
+		{
+			// a fresh thread can reuse the id of a dead one, and its
+			//   cpu clock starts over.  re-base so the accumulated
+			//   time carries forward instead of going negative
+			if(ns < cpuSlots[n].lastNs)
+				cpuSlots[n].baseNs = ns - (cpuSlots[n].lastNs - cpuSlots[n].baseNs);
+
+			cpuSlots[n].lastNs = ns;
+			return;
+		}
+	}
+
+	// table full?  just stop tracking new threads.  pipelines use a
+	//   handful of streaming threads, so this doesn't happen in practice
+	if(cpuSlotCount < MaxCpuSlots)
 	{
-		double vol = (double)level / 100;
-		g_object_set(G_OBJECT(volumeout), "volume", vol, NULL);
+		cpuSlots[cpuSlotCount].thread = self;
+		cpuSlots[cpuSlotCount].baseNs = ns;
+		cpuSlots[cpuSlotCount].lastNs = ns;
+		++cpuSlotCount;
 	}
 }
 
-void RtpWorker::setInputVolume(int level)
+PResourceUsage RtpWorker::resourceSnapshot() const
 {
-	QMutexLocker locker(&volumein_mutex);
-	inputVolume = level;
-	if(volumein)
+	PResourceUsage out;
+
 	{
-		double vol = (double)level / 100;
-		g_object_set(G_OBJECT(volumein), "volume", vol, NULL);
+		QMutexLocker locker(&cpu_mutex);
+		for(int n = 0; n < cpuSlotCount; ++n)
+			out.cpuNsecs += cpuSlots[n].lastNs - cpuSlots[n].baseNs;
+		out.streamingThreads = cpuSlotCount;
 	}
+
+	// the packet pool is shared between sessions, so these are
+	//   process-wide (documented as such on PResourceUsage)
+	guint served, missed;
+	gst_rtppacketpool_stats(&served, &missed);
+	out.poolPacketsServed = (int)served;
+	out.poolPacketsMissed = (int)missed;
+
+	return out;
+}
+
+// wait-free: the level lands in an atomic, and the probe on the volume
+//   element's src pad applies any change from the streaming thread on
+//   the next buffer.  no lock is shared with a media path, so a slider
+//   drag can never stall one
+void RtpWorker::setOutputVolume(int level)
+{
+	outputVolume.fetchAndStoreOrdered(level);
+}
+
+void RtpWorker::setInputVolume(int level)
+{
+	inputVolume.fetchAndStoreOrdered(level);
+}
+
+void RtpWorker::framesRetired(bool preview, bool output)
+{
+	if(preview)
+		previewFramesRetired.ref();
+	if(output)
+		outputFramesRetired.ref();
+}
+
+// return true if the buffer is an ogg page carrying only header
+//   packets (granulepos 0).  oggmux pushes one page per buffer
+static bool is_ogg_header_page(const unsigned char *buf, int size)
+{
+	if(size < 27 || memcmp(buf, "OggS", 4) != 0)
+		return false;
+
+	quint64 gp = 0;
+	for(int n = 0; n < 8; ++n)
+		gp |= (quint64)buf[6 + n] << (8 * n);
+	return (gp == 0);
+}
+
+// return true if the buffer starts a matroska cluster, i.e. the first
+//   data unit after the headers.  matroskamux begins a fresh buffer
+//   with the cluster id
+static bool is_mkv_cluster_start(const unsigned char *buf, int size)
+{
+	return (size >= 4 && buf[0] == 0x1f && buf[1] == 0x43
+		&& buf[2] == 0xb6 && buf[3] == 0x75);
 }
 
 void RtpWorker::recordStart()
 {
-	// FIXME: for now we just send EOF/error
-	if(cb_recordData)
-		cb_recordData(QByteArray(), app);
+	QMutexLocker locker(&record_mutex);
+
+	if(!recordTapped)
+	{
+		// no send encoders to tap (e.g. receive-only or file
+		//   playback session).  nothing to record, so report EOF
+		if(cb_recordData)
+			cb_recordData(QByteArray(), app);
+		return;
+	}
+
+	recording = true;
+	recordHeadersSent = false;
 }
 
 void RtpWorker::recordStop()
 {
-	// TODO: assert recording
-	// FIXME: don't just do nothing
+	QMutexLocker locker(&record_mutex);
+
+	if(!recording)
+		return;
+
+	recording = false;
+	recordHeadersSent = false;
+
+	// EOF closes out the recording on the app side
+	if(cb_recordData)
+		cb_recordData(QByteArray(), app);
 }
 
 gboolean RtpWorker::cb_doStart(gpointer data)
@@ -546,42 +1302,531 @@ gboolean RtpWorker::cb_bus_call(GstBus *bus, GstMessage *msg, gpointer data)
 	return ((RtpWorker *)data)->bus_call(bus, msg);
 }
 
-void RtpWorker::cb_show_frame_preview(int width, int height, const unsigned char *rgb32, gpointer data)
+void RtpWorker::cb_show_frame_preview(int width, int height, GstBuffer *buf, gpointer data)
 {
-	((RtpWorker *)data)->show_frame_preview(width, height, rgb32);
+	((RtpWorker *)data)->show_frame_preview(width, height, buf);
 }
 
-void RtpWorker::cb_show_frame_output(int width, int height, const unsigned char *rgb32, gpointer data)
+void RtpWorker::cb_show_frame_output(int width, int height, GstBuffer *buf, gpointer data)
 {
-	((RtpWorker *)data)->show_frame_output(width, height, rgb32);
+	((RtpWorker *)data)->show_frame_output(width, height, buf);
 }
 
-void RtpWorker::cb_packet_ready_rtp_audio(const unsigned char *buf, int size, gpointer data)
+void RtpWorker::cb_show_frame_shm_output(int width, int height, int slot, gpointer data)
 {
-	((RtpWorker *)data)->packet_ready_rtp_audio(buf, size);
+	((RtpWorker *)data)->show_frame_shm_output(width, height, slot);
 }
 
-void RtpWorker::cb_packet_ready_rtp_video(const unsigned char *buf, int size, gpointer data)
+// called by the video sinks before converting a frame.  the delivered
+//   counters run ahead of the retired ones by however many frames are
+//   still in flight toward the ui; past a small allowance the ui is
+//   behind, and converting more frames would only add to the backlog
+gboolean RtpWorker::cb_frame_wanted_preview(gpointer data)
 {
-	((RtpWorker *)data)->packet_ready_rtp_video(buf, size);
+	RtpWorker *self = (RtpWorker *)data;
+	return ((int)self->previewFrames - (int)self->previewFramesRetired <= QOS_MAX_UNPAINTED) ? TRUE : FALSE;
 }
 
-gboolean RtpWorker::cb_fileReady(gpointer data)
+gboolean RtpWorker::cb_frame_wanted_output(gpointer data)
 {
-	return ((RtpWorker *)data)->fileReady();
+	RtpWorker *self = (RtpWorker *)data;
+	return ((int)self->outputFrames - (int)self->outputFramesRetired <= QOS_MAX_UNPAINTED) ? TRUE : FALSE;
 }
 
-gboolean RtpWorker::doStart()
+// subscription gates, sitting at the entrance of the display branches.
+//   while no widget is attached, returning FALSE from the buffer probe
+//   discards the raw frame right at the tee/decoder boundary, so an
+//   unwatched branch never pays for queuing or colorspace conversion.
+//   unlike the qos gate above, which is per-frame backpressure, this is
+//   all-or-nothing and follows widget attach/detach live
+gboolean RtpWorker::cb_video_preview_gate(GstPad *pad, GstBuffer *buf, gpointer data)
 {
-	timer = 0;
+	Q_UNUSED(pad);
+	Q_UNUSED(buf);
 
-	fileDemux = 0;
-	audiosrc = 0;
-	videosrc = 0;
-	audiortpsrc = 0;
+	RtpWorker *self = (RtpWorker *)data;
+
+	// runs for every camera buffer whether or not a preview is shown,
+	//   which makes it a good heartbeat for the capture device itself
+	self->watch[Watch_VideoCapture].heartbeat.ref();
+
+	return ((int)self->wantPreviewFrames) ? TRUE : FALSE;
+}
+
+gboolean RtpWorker::cb_video_output_gate(GstPad *pad, GstBuffer *buf, gpointer data)
+{
+	Q_UNUSED(pad);
+	Q_UNUSED(buf);
+
+	RtpWorker *self = (RtpWorker *)data;
+
+	// runs for every decoded frame whether or not a widget consumes
+	//   it, which makes it a good heartbeat for the decode branch
+	self->watch[Watch_VideoDecode].heartbeat.ref();
+
+	// the shm ring has its own consumer and doesn't depend on a widget
+	if(self->shmVideoExport)
+		return TRUE;
+
+	return ((int)self->wantOutputFrames) ? TRUE : FALSE;
+}
+
+void RtpWorker::cb_packet_ready_rtp_audio(const unsigned char *buf, int size, gpointer data)
+{
+	((RtpWorker *)data)->packet_ready_rtp_audio(buf, size);
+}
+
+void RtpWorker::cb_packets_ready_rtp_audio(const GstAppRtpPacket *packets, int count, gpointer data)
+{
+	((RtpWorker *)data)->packets_ready_rtp_audio(packets, count);
+}
+
+void RtpWorker::cb_packet_ready_rtp_video(const unsigned char *buf, int size, gpointer data)
+{
+	((RtpWorker *)data)->packet_ready_rtp_video(buf, size);
+}
+
+void RtpWorker::cb_packet_ready_rtp_video_low(const unsigned char *buf, int size, gpointer data)
+{
+	((RtpWorker *)data)->packet_ready_rtp_video_low(buf, size);
+}
+
+void RtpWorker::cb_record_mux_packet(const unsigned char *buf, int size, gpointer data)
+{
+	((RtpWorker *)data)->record_mux_packet(buf, size);
+}
+
+gboolean RtpWorker::cb_fileReady(gpointer data)
+{
+	return ((RtpWorker *)data)->fileReady();
+}
+
+// translate the configured path mtu into a payloader budget: leave
+//   room for the ip and udp headers, the srtp auth tag when protection
+//   is on, and on video the fec headers, so a fec packet covering a
+//   full-size media packet still fits in one ip packet.  -1 = leave
+//   the payloader's default alone
+int RtpWorker::payloaderMtu(bool video) const
+{
+	if(pathMtu < 1)
+		return -1;
+
+	int mtu = pathMtu - 28; // ipv4 + udp headers
+	if(srtpOut.isActive())
+		mtu -= 10;
+
+	if(video)
+	{
+		// same test as the fec encoder setup: will the stream toward
+		//   this peer carry fec?
+		foreach(const PPayloadInfo &ri, remoteVideoPayloadInfo)
+		{
+			if(ri.name.toLower() == "ulpfec" && ri.clockrate == 90000)
+			{
+				mtu -= 14; // fec + level headers beyond the rtp header
+				break;
+			}
+		}
+	}
+
+	// keep a sane floor in case the app passes something absurd
+	if(mtu < 128)
+		mtu = 128;
+	return mtu;
+}
+
+void RtpWorker::setMaximumSendingBitrate(int kbps)
+{
+	maxbitrate = kbps;
+
+	if(videoencoder)
+	{
+		// same split as addVideoChain
+		int videokbps = kbps;
+		if(audiortppay)
+			videokbps -= 45;
+
+		// encoders take the new value on the next frame.  probe for
+		//   the property, since a hardware encoder may not have one
+		//   (or not in these units)
+		if(g_object_class_find_property(G_OBJECT_GET_CLASS(videoencoder), "bitrate"))
+		{
+			g_object_set(G_OBJECT(videoencoder), "bitrate", videokbps, NULL);
+#ifdef RTPWORKER_DEBUG
+			printf("video bitrate -> %dkbps\n", videokbps);
+#endif
+		}
+	}
+}
+
+void RtpWorker::requestVideoKeyframe()
+{
+	if(!videoencoder)
+		return;
+
+	// the standard upstream force-key-unit event.  encoders that don't
+	//   handle it (it's newer than some) just drop it, which is safe
+	GstStructure *s = gst_structure_new("GstForceKeyUnit",
+		"all-headers", G_TYPE_BOOLEAN, TRUE, NULL);
+	GstEvent *event = gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM, s);
+	gst_element_send_event(videoencoder, event);
+#ifdef RTPWORKER_DEBUG
+	printf("keyframe requested from video encoder\n");
+#endif
+}
+
+void RtpWorker::setVideoSendDownscale(int halvings)
+{
+	if(!videoprepScaleFilter || !videoencbin || !videoSendBaseSize.isValid())
+		return;
+
+	if(halvings < 0)
+		halvings = 0;
+
+	// don't bother going below qcif-ish, the savings are noise there
+	while(halvings > 0 && (videoSendBaseSize.width() >> halvings) < 160)
+		--halvings;
+
+	if(halvings == videoSendDownscale)
+		return;
+
+	videoSendDownscale = halvings;
+
+	int w = videoSendBaseSize.width() >> halvings;
+	int h = videoSendBaseSize.height() >> halvings;
+
+	// videoscale wants even dimensions for the planar formats
+	w &= ~1;
+	h &= ~1;
+
+#ifdef RTPWORKER_DEBUG
+	printf("video send downscale -> %d (%dx%d)\n", halvings, w, h);
+#endif
+
+	// same structure pair as bins_videoprep_create
+	GstCaps *caps = gst_caps_new_empty();
+	GstStructure *cs = gst_structure_new("video/x-raw-yuv",
+		"width", G_TYPE_INT, w,
+		"height", G_TYPE_INT, h, NULL);
+	gst_caps_append_structure(caps, cs);
+	cs = gst_structure_new("video/x-raw-rgb",
+		"width", G_TYPE_INT, w,
+		"height", G_TYPE_INT, h, NULL);
+	gst_caps_append_structure(caps, cs);
+
+	// stage the caps and let the blocked callback apply them on the
+	//   streaming thread, once the scaler's output pad is idle.  a
+	//   second call before the first lands simply replaces the staged
+	//   caps
+	videoadapt_mutex.lock();
+	if(videoAdaptCaps)
+		gst_caps_unref(videoAdaptCaps);
+	videoAdaptCaps = caps;
+	videoadapt_mutex.unlock();
+
+	// the pad ref taken here is dropped when the unblock completes
+	GstPad *pad = gst_element_get_static_pad(videoprepScaleFilter, "src");
+	gst_pad_set_blocked_async(pad, TRUE, cb_videoprep_blocked, this);
+}
+
+void RtpWorker::cb_videoprep_blocked(GstPad *pad, gboolean blocked, gpointer data)
+{
+	((RtpWorker *)data)->videoprep_blocked(pad, blocked);
+}
+
+void RtpWorker::videoprep_blocked(GstPad *pad, gboolean blocked)
+{
+	if(blocked)
+	{
+		GstCaps *caps;
+		videoadapt_mutex.lock();
+		caps = videoAdaptCaps;
+		videoAdaptCaps = 0;
+		videoadapt_mutex.unlock();
+
+		if(caps)
+		{
+			// apply the new size, then bounce the encode branch so
+			//   the codec renegotiates.  0.10 video encoders won't
+			//   take a live caps change, but a trip through READY
+			//   clears the negotiated state, and the branch comes
+			//   back with headers for the new geometry.  the branch
+			//   sits behind its own queue, so nothing upstream of
+			//   the block is disturbed
+			g_object_set(G_OBJECT(videoprepScaleFilter), "caps", caps, NULL);
+			gst_caps_unref(caps);
+
+			gst_element_set_state(videoencbin, GST_STATE_READY);
+			gst_element_get_state(videoencbin, NULL, NULL, GST_CLOCK_TIME_NONE);
+			gst_element_sync_state_with_parent(videoencbin);
+		}
+
+		gst_pad_set_blocked_async(pad, FALSE, cb_videoprep_blocked, this);
+	}
+	else
+	{
+		// unblock finished; drop the ref taken by setVideoSendDownscale
+		gst_object_unref(GST_OBJECT(pad));
+	}
+}
+
+gboolean RtpWorker::cb_doAdaptJbuf(gpointer data)
+{
+	return ((RtpWorker *)data)->doAdaptJbuf();
+}
+
+gboolean RtpWorker::doAdaptJbuf()
+{
+	// size for several times the measured jitter, plus room for one
+	//   packet of scheduling slop
+	int target = 20 + audioRtpStats.jitterMs() * 3;
+	target = qBound(jitterMinLatency, target, jitterMaxLatency);
+
+	// only nudge on meaningful moves, to avoid disturbing playout
+	int cur = (int)audioJbufLatency;
+	if(audiojbuf && qAbs(target - cur) >= 20)
+	{
+#ifdef RTPWORKER_DEBUG
+		printf("jitter buffer latency %dms -> %dms\n", cur, target);
+#endif
+		g_object_set(G_OBJECT(audiojbuf), "latency", (guint)target, NULL);
+		audioJbufLatency.fetchAndStoreRelaxed(target);
+	}
+
+	return TRUE;
+}
+
+// compute a 0-100 meter level from a raw audio buffer.  only 16-bit
+//   int samples are handled; anything else returns -1 and leaves the
+//   meter alone
+static int buffer_intensity(GstBuffer *buf)
+{
+	GstCaps *caps = GST_BUFFER_CAPS(buf);
+	if(!caps)
+		return -1;
+
+	GstStructure *cs = gst_caps_get_structure(caps, 0);
+	int width = 0;
+	if(!gst_structure_has_name(cs, "audio/x-raw-int") ||
+		!gst_structure_get_int(cs, "width", &width) ||
+		width != 16)
+	{
+		return -1;
+	}
+
+	const qint16 *samples = (const qint16 *)GST_BUFFER_DATA(buf);
+	int count = GST_BUFFER_SIZE(buf) / 2;
+	int peak = 0;
+	for(int n = 0; n < count; ++n)
+	{
+		int v = samples[n];
+		if(v < 0)
+			v = -v;
+		if(v > peak)
+			peak = v;
+	}
+
+	return peak * 100 / 32768;
+}
+
+// note: called on streaming threads.  the meters are plain atomics, so
+//   updating them costs nothing beyond the peak scan; nobody is woken
+gboolean RtpWorker::cb_audio_in_buffer(GstPad *pad, GstBuffer *buf, gpointer data)
+{
+	RtpWorker *self = (RtpWorker *)data;
+	self->accountThreadCpu();
+
+	// the probe sits on the volume element's src pad, so the pad's
+	//   parent is the element itself: apply any pending level change
+	//   here, from the thread that owns the element, instead of
+	//   poking it from the ui under a lock
+	int level = (int)self->inputVolume;
+	if(level != self->lastAppliedInputVolume)
+	{
+		self->lastAppliedInputVolume = level;
+		g_object_set(G_OBJECT(GST_PAD_PARENT(pad)), "volume", (double)level / 100, NULL);
+	}
+
+	int v = buffer_intensity(buf);
+	if(v != -1)
+		self->audioInputIntensity.fetchAndStoreRelaxed(v);
+
+	self->watch[Watch_AudioCapture].heartbeat.ref();
+	return TRUE;
+}
+
+gboolean RtpWorker::cb_audio_out_buffer(GstPad *pad, GstBuffer *buf, gpointer data)
+{
+	RtpWorker *self = (RtpWorker *)data;
+	self->accountThreadCpu();
+
+	int level = (int)self->outputVolume;
+	if(level != self->lastAppliedOutputVolume)
+	{
+		self->lastAppliedOutputVolume = level;
+		g_object_set(G_OBJECT(GST_PAD_PARENT(pad)), "volume", (double)level / 100, NULL);
+	}
+
+	int v = buffer_intensity(buf);
+	if(v != -1)
+		self->audioOutputIntensity.fetchAndStoreRelaxed(v);
+
+	self->watch[Watch_AudioPlayback].heartbeat.ref();
+	return TRUE;
+}
+
+gboolean RtpWorker::cb_doIntensity(gpointer data)
+{
+	return ((RtpWorker *)data)->doIntensity();
+}
+
+// the opt-in signal path: a worker-context timer samples the meters and
+//   fires the callbacks at the configured rate.  nothing crosses
+//   threads when the interval is unset
+gboolean RtpWorker::doIntensity()
+{
+	if(cb_audioInputIntensity)
+		cb_audioInputIntensity((int)audioInputIntensity, app);
+	if(cb_audioOutputIntensity)
+		cb_audioOutputIntensity((int)audioOutputIntensity, app);
+	return TRUE;
+}
+
+void RtpWorker::updateIntensityTimer()
+{
+	if(intensityTimer)
+	{
+		g_source_destroy(intensityTimer);
+		intensityTimer = 0;
+	}
+
+	if(intensityInterval > 0)
+	{
+		intensityTimer = g_timeout_source_new(intensityInterval);
+		g_source_set_callback(intensityTimer, cb_doIntensity, this, NULL);
+		g_source_attach(intensityTimer, mainContext_);
+	}
+}
+
+// stall detection window in milliseconds (PSI_WATCHDOG_MS).  0 disables
+//   the watchdog
+static int get_watchdog_ms()
+{
+	static int x = -1;
+	if(x == -1)
+	{
+		bool ok;
+		int n = QString::fromLatin1(qgetenv("PSI_WATCHDOG_MS")).toInt(&ok);
+		if(ok && n >= 0)
+			x = n;
+		else
+			x = 5000;
+	}
+	return x;
+}
+
+gboolean RtpWorker::cb_doWatchdog(gpointer data)
+{
+	return ((RtpWorker *)data)->doWatchdog();
+}
+
+gboolean RtpWorker::doWatchdog()
+{
+	// feeder names the stage that must itself have progressed in the
+	//   same window for a stall here to be a pipeline fault: a silent
+	//   audio sink is only wedged if rtp input kept arriving, and a
+	//   quiet encoder is only wedged if capture kept flowing.
+	//   non-reporting stages exist purely to feed others
+	struct StageInfo { int feeder; bool reports; };
+	static const StageInfo info[WatchStageCount] =
+	{
+		{ -1,                 true  }, // audio-capture
+		{ Watch_AudioCapture, true  }, // audio-encode
+		{ Watch_AudioIngress, true  }, // audio-playback
+		{ -1,                 true  }, // video-capture
+		{ Watch_VideoCapture, true  }, // video-encode
+		{ Watch_VideoIngress, true  }, // video-decode
+		{ -1,                 false }, // audio-ingress
+		{ -1,                 false }  // video-ingress
+	};
+
+	bool progressed[WatchStageCount];
+	for(int n = 0; n < WatchStageCount; ++n)
+	{
+		int hb = (int)watch[n].heartbeat;
+		progressed[n] = (hb != watch[n].lastSeen);
+		watch[n].lastSeen = hb;
+		if(progressed[n])
+		{
+			// a stage must prove itself once before it is held to
+			//   the window, so absent branches never false-alarm
+			watch[n].alive = true;
+			watch[n].reported = false; // recovered, re-arm
+		}
+	}
+
+	for(int n = 0; n < WatchStageCount; ++n)
+	{
+		if(!info[n].reports || progressed[n] || !watch[n].alive || watch[n].reported)
+			continue;
+
+		if(info[n].feeder != -1 && !progressed[info[n].feeder])
+			continue;
+
+		watch[n].reported = true;
+		stallCounts[n].ref();
+
+#ifdef RTPWORKER_DEBUG
+		printf("watchdog: %s stalled\n", watch_stage_names[n]);
+#endif
+		if(cb_stalled)
+			cb_stalled(QString::fromLatin1(watch_stage_names[n]), app);
+	}
+
+	return TRUE;
+}
+
+// (re)arm the watchdog.  called after every setup pass, because a
+//   codec or device update can legitimately remove a branch: each
+//   stage has to show fresh progress before it is monitored again
+void RtpWorker::restartWatchdog()
+{
+	if(watchdogTimer)
+	{
+		g_source_destroy(watchdogTimer);
+		watchdogTimer = 0;
+	}
+
+	int ms = get_watchdog_ms();
+	if(ms < 1)
+		return;
+
+	for(int n = 0; n < WatchStageCount; ++n)
+	{
+		watch[n].lastSeen = (int)watch[n].heartbeat;
+		watch[n].alive = false;
+		watch[n].reported = false;
+	}
+
+	watchdogTimer = g_timeout_source_new(ms);
+	g_source_set_callback(watchdogTimer, cb_doWatchdog, this, NULL);
+	g_source_attach(watchdogTimer, mainContext_);
+}
+
+gboolean RtpWorker::doStart()
+{
+	QMutexLocker locker(&worker_setup_mutex);
+
+	timer = 0;
+
+	fileDemux = 0;
+	audiosrc = 0;
+	videosrc = 0;
+	audiortpsrc = 0;
 	videortpsrc = 0;
 	audiortppay = 0;
 	videortppay = 0;
+	videortppay2 = 0;
 
 	// default to 400kbps
 	if(maxbitrate == -1)
@@ -594,8 +1839,15 @@ gboolean RtpWorker::doStart()
 	}
 	else
 	{
+		updateIntensityTimer();
+		restartWatchdog();
+
+		// if the send pipeline is still coming up, started is
+		//   signaled from checkSendStarted when caps are known
+		if(sendStartPending)
+			startNotifyPending = true;
 		// don't signal started here if using files
-		if(!fileDemux && cb_started)
+		else if(!fileDemux && cb_started)
 			cb_started(app);
 	}
 
@@ -604,6 +1856,8 @@ gboolean RtpWorker::doStart()
 
 gboolean RtpWorker::doUpdate()
 {
+	QMutexLocker locker(&worker_setup_mutex);
+
 	timer = 0;
 
 	if(!setupSendRecv())
@@ -613,7 +1867,13 @@ gboolean RtpWorker::doUpdate()
 	}
 	else
 	{
-		if(cb_updated)
+		updateIntensityTimer();
+		restartWatchdog();
+
+		// as with doStart, wait for async completion if necessary
+		if(sendStartPending)
+			updateNotifyPending = true;
+		else if(cb_updated)
 			cb_updated(app);
 	}
 
@@ -624,11 +1884,57 @@ gboolean RtpWorker::doStop()
 {
 	timer = 0;
 
-	cleanup();
+	// detach from the outside world first, so hangup is perceptually
+	//   instant: inbound packets start dropping, outbound packet and
+	//   record delivery cease, and the app gets its stopped
+	//   notification before any pipeline is dismantled
+	audiortpsrc_mutex.lock();
+	audiortpsrc = 0;
+	audiortpsrc_mutex.unlock();
+
+	videortpsrc_mutex.lock();
+	videortpsrc = 0;
+	videortpsrc_mutex.unlock();
+
+	rtpaudioout_mutex.lock();
+	rtpaudioout = false;
+	rtpaudioout_mutex.unlock();
+
+	rtpvideoout_mutex.lock();
+	rtpvideoout = false;
+	rtpvideoout_mutex.unlock();
+
+	record_mutex.lock();
+	recording = false;
+	record_mutex.unlock();
 
 	if(cb_stopped)
 		cb_stopped(app);
 
+	// the actual dismantling (blocking state waits, device release)
+	//   runs on a follow-up tick, off the app's critical path.  if the
+	//   worker is deleted before the tick fires, the destructor cancels
+	//   the source and performs the same cleanup itself
+	timer = g_timeout_source_new(0);
+	g_source_set_callback(timer, cb_doDeferredCleanup, this, NULL);
+	g_source_attach(timer, mainContext_);
+
+	return FALSE;
+}
+
+gboolean RtpWorker::cb_doDeferredCleanup(gpointer data)
+{
+	return ((RtpWorker *)data)->doDeferredCleanup();
+}
+
+gboolean RtpWorker::doDeferredCleanup()
+{
+	QMutexLocker locker(&worker_setup_mutex);
+
+	timer = 0;
+
+	cleanup();
+
 	return FALSE;
 }
 
@@ -767,6 +2073,16 @@ gboolean RtpWorker::bus_call(GstBus *bus, GstMessage *msg)
 			g_print("Error: %s: %s\n", gst_element_get_name(GST_MESSAGE_SRC(msg)), err->message);
 			g_error_free(err);
 
+			// an error during async startup means the session
+			//   won't come up; fail it now instead of waiting
+			//   for the timeout
+			if(sendStartPending)
+			{
+				QMutexLocker locker(&worker_setup_mutex);
+				sendStartPending = false;
+				failSendStart();
+			}
+
 			//g_main_loop_quit(loop);
 			break;
 		}
@@ -798,6 +2114,7 @@ gboolean RtpWorker::bus_call(GstBus *bus, GstMessage *msg)
 			GstState oldstate, newstate, pending;
 
 			gst_message_parse_state_changed(msg, &oldstate, &newstate, &pending);
+#ifdef RTPWORKER_DEBUG
 			printf("State changed: %s: %s->%s",
 				gst_element_get_name(GST_MESSAGE_SRC(msg)),
 				state_to_str(oldstate),
@@ -805,79 +2122,500 @@ gboolean RtpWorker::bus_call(GstBus *bus, GstMessage *msg)
 			if(pending != GST_STATE_VOID_PENDING)
 				printf(" (%s)", state_to_str(pending));
 			printf("\n");
+#endif
+
+			// reaching PLAYING is one of the completion triggers
+			//   (the other is caps negotiation, which may come
+			//   later)
+			if(GST_MESSAGE_SRC(msg) == GST_OBJECT(spipeline) && newstate == GST_STATE_PLAYING)
+				checkSendStarted();
 			break;
 		}
 		case GST_MESSAGE_ASYNC_DONE:
 		{
+#ifdef RTPWORKER_DEBUG
 			printf("Async done: %s\n", gst_element_get_name(GST_MESSAGE_SRC(msg)));
+#endif
+			if(GST_MESSAGE_SRC(msg) == GST_OBJECT(spipeline))
+				checkSendStarted();
 			break;
 		}
 		default:
+#ifdef RTPWORKER_DEBUG
 			printf("Bus message: %s\n", GST_MESSAGE_TYPE_NAME(msg));
+#endif
 			break;
 	}
 
 	return TRUE;
 }
 
-void RtpWorker::show_frame_preview(int width, int height, const unsigned char *rgb32)
+// instead of copying the frame out of the GstBuffer, we ref the buffer and
+//   wrap a QImage around its data.  the FrameBuffer keeps the buffer alive
+//   for as long as any copy of the frame (and thus the image) exists.
+void RtpWorker::show_frame_preview(int width, int height, GstBuffer *buf)
 {
-	QImage image(width, height, QImage::Format_RGB32);
-	memcpy(image.bits(), rgb32, image.numBytes());
+	accountThreadCpu();
 
 	Frame frame;
-	frame.image = image;
+	frame.buffer = new FrameBuffer(buf);
+	frame.image = QImage((const uchar *)GST_BUFFER_DATA(buf), width, height, QImage::Format_RGB32);
+
+	previewFrames.ref();
 
 	if(cb_previewFrame)
 		cb_previewFrame(frame, app);
 }
 
-void RtpWorker::show_frame_output(int width, int height, const unsigned char *rgb32)
+void RtpWorker::show_frame_output(int width, int height, GstBuffer *buf)
 {
-	QImage image(width, height, QImage::Format_RGB32);
-	memcpy(image.bits(), rgb32, image.numBytes());
+	accountThreadCpu();
+
+	// shm export enabled but no usable ring yet: create one sized for
+	//   this frame and attach it to the sink, so the next frame is
+	//   converted straight into shared memory.  we run on the sink's
+	//   streaming thread here, so poking its fields is safe even though
+	//   the pipeline is live.  this frame still goes out the normal way
+	if(shmOutputSink && (!shmRing || width * height * 4 > shmRing->slotSize()))
+	{
+		if(!shmRing)
+			shmRing = new ShmFrameRing;
+		if(shmRing->create(width * height * 4, SHM_RING_SLOTS))
+		{
+			shmOutputSink->shm_arena = (guint8 *)shmRing->base();
+			shmOutputSink->shm_slot_size = shmRing->slotSize();
+			shmOutputSink->shm_slot_count = shmRing->slotCount();
+			shmOutputSink->shm_next_slot = 0;
+		}
+		else
+		{
+			// no shared memory on this system; stay on the image path
+			delete shmRing;
+			shmRing = 0;
+			shmOutputSink->shm_arena = 0;
+		}
+	}
 
 	Frame frame;
-	frame.image = image;
+	frame.buffer = new FrameBuffer(buf);
+	frame.image = QImage((const uchar *)GST_BUFFER_DATA(buf), width, height, QImage::Format_RGB32);
+
+	outputFrames.ref();
 
 	if(cb_outputFrame)
 		cb_outputFrame(frame, app);
 }
 
+void RtpWorker::show_frame_shm_output(int width, int height, int slot)
+{
+	accountThreadCpu();
+
+	ShmFrame frame;
+	frame.fd = shmRing->fd();
+	frame.ringSize = shmRing->totalSize();
+	frame.offset = slot * shmRing->slotSize();
+	frame.width = width;
+	frame.height = height;
+	frame.stride = width * 4;
+
+	outputFrames.ref();
+
+	if(cb_shmOutputFrame)
+		cb_shmOutputFrame(frame, app);
+}
+
+// dtx gate for an outgoing audio packet.  with dtx on, the encoder
+//   emits tiny comfort-noise frames during silence; most of those are
+//   withheld from the wire here, with one let through periodically so
+//   the receiver can refresh its noise fill and the flow stays alive
+//   for nats.  returns true if the packet should be withheld.  runs on
+//   the streaming thread, before any srtp or fan-out, so suppressed
+//   packets cost no crypto and every consumer sees the same stream
+bool RtpWorker::dtxProcessAudioPacket(QByteArray *buf)
+{
+	if(!dtxEnabled && audioDtxSeqOffset == 0)
+		return false;
+
+	if(buf->size() < 12)
+		return false;
+
+	unsigned char *p = (unsigned char *)buf->data();
+
+	// keep the wire sequence consecutive across withheld packets, as
+	//   rfc 3551 wants for dtx: the receiver must see silence as a
+	//   timestamp jump, not as packet loss
+	if(audioDtxSeqOffset != 0)
+	{
+		quint16 seq = (p[2] << 8) | p[3];
+		seq -= audioDtxSeqOffset;
+		p[2] = (unsigned char)(seq >> 8);
+		p[3] = (unsigned char)(seq & 0xff);
+	}
+
+	if(!dtxEnabled)
+		return false;
+
+	// silence heuristic: speex dtx frames are 5 bytes and opus dtx
+	//   frames at most 2, while the smallest speech frames are far
+	//   larger.  a multi-frame ptime can push packed silence over the
+	//   threshold; that only costs the suppression, not correctness
+	if(buf->size() - 12 > 16)
+	{
+		if(!audioTalking)
+		{
+			// speech resumed: mark the start of the talkspurt so
+			//   the receiver's jitter buffer can resync on it
+			p[1] |= 0x80;
+
+			audioTalking = true;
+			if(cb_audioTalkingChanged)
+				cb_audioTalkingChanged(true, app);
+		}
+
+		audioSilenceRun = 0;
+		return false;
+	}
+
+	// hangover: don't declare silence on the first quiet frame, or
+	//   word endings get clipped.  12 packets at the default 20ms
+	//   ptime is roughly a quarter second
+	if(audioTalking)
+	{
+		++audioSilenceRun;
+		if(audioSilenceRun < 12)
+			return false;
+
+		audioTalking = false;
+		audioSilenceKeep = 0;
+		if(cb_audioTalkingChanged)
+			cb_audioTalkingChanged(false, app);
+	}
+
+	if(audioSilenceKeep > 0)
+	{
+		--audioSilenceKeep;
+		++audioDtxSeqOffset;
+		return true;
+	}
+
+	// comfort-noise refresh, about every 400ms at 20ms ptime
+	audioSilenceKeep = 19;
+	return false;
+}
+
 void RtpWorker::packet_ready_rtp_audio(const unsigned char *buf, int size)
 {
+	accountThreadCpu();
+
+	// heartbeat before the dtx gate: withheld silence is progress too
+	watch[Watch_AudioEncode].heartbeat.ref();
+
 	QByteArray ba((const char *)buf, size);
+	if(dtxProcessAudioPacket(&ba))
+		return;
+
 	PRtpPacket packet;
 	packet.rawValue = ba;
 	packet.portOffset = 0;
 
+	audioRtpStats.countOut(ba.size());
+
 #ifdef RTPWORKER_DEBUG
 	audioStats->print_stats(packet.rawValue.size());
 #endif
 
-	QMutexLocker locker(&rtpaudioout_mutex);
-	if(cb_rtpAudioOut && rtpaudioout)
-		cb_rtpAudioOut(packet, app);
+	// srtp happens in place on the packet buffer.  consumers sharing
+	//   this encoder protect with their own keys, so they keep a
+	//   plaintext reference (cheap: the byte array only detaches when
+	//   the cipher writes)
+	PRtpPacket plain = packet;
+	if(srtpOut.isActive())
+	{
+		if(!srtpOut.protect(&packet.rawValue))
+			return;
+	}
+
+	{
+		QMutexLocker locker(&rtpaudioout_mutex);
+		if(cb_rtpAudioOut && rtpaudioout)
+			cb_rtpAudioOut(packet, app);
+	}
+
+	// fan out to any sessions sharing this encoder
+	send_consumers_mutex.lock();
+	foreach(RtpWorker *c, send_consumers)
+		c->consumer_packet_audio(plain);
+	send_consumers_mutex.unlock();
+}
+
+// batched variant, used when the payloader pushes buffer lists.  the
+//   locks are taken once for the whole batch instead of per packet
+void RtpWorker::packets_ready_rtp_audio(const GstAppRtpPacket *packets, int count)
+{
+	accountThreadCpu();
+
+	watch[Watch_AudioEncode].heartbeat.ref();
+
+	QList<PRtpPacket> out;
+	for(int n = 0; n < count; ++n)
+	{
+		QByteArray ba((const char *)packets[n].buf, packets[n].size);
+		if(dtxProcessAudioPacket(&ba))
+			continue;
+
+		PRtpPacket packet;
+		packet.rawValue = ba;
+		packet.portOffset = 0;
+		out += packet;
+
+		audioRtpStats.countOut(ba.size());
+
+#ifdef RTPWORKER_DEBUG
+		audioStats->print_stats(packets[n].size);
+#endif
+	}
+
+	// srtp in place across the batch.  consumers keep the plaintext
+	//   list; the two only detach when the cipher writes
+	QList<PRtpPacket> sendOut = out;
+	if(srtpOut.isActive())
+	{
+		for(int n = 0; n < sendOut.count(); ++n)
+		{
+			if(!srtpOut.protect(&sendOut[n].rawValue))
+			{
+				sendOut.removeAt(n);
+				--n;
+			}
+		}
+	}
+
+	{
+		QMutexLocker locker(&rtpaudioout_mutex);
+		if(cb_rtpAudioOut && rtpaudioout)
+		{
+			foreach(const PRtpPacket &packet, sendOut)
+				cb_rtpAudioOut(packet, app);
+		}
+	}
+
+	// fan out to any sessions sharing this encoder
+	send_consumers_mutex.lock();
+	foreach(RtpWorker *c, send_consumers)
+	{
+		foreach(const PRtpPacket &packet, out)
+			c->consumer_packet_audio(packet);
+	}
+	send_consumers_mutex.unlock();
 }
 
 void RtpWorker::packet_ready_rtp_video(const unsigned char *buf, int size)
 {
+	accountThreadCpu();
+
+	watch[Watch_VideoEncode].heartbeat.ref();
+
 	QByteArray ba((const char *)buf, size);
 	PRtpPacket packet;
 	packet.rawValue = ba;
 	packet.portOffset = 0;
 
+	videoRtpStats.countOut(size);
+
 #ifdef RTPWORKER_DEBUG
 	videoStats->print_stats(packet.rawValue.size());
 #endif
 
+	// generate protection, sending any completed fec packet right
+	//   behind the last media packet it covers
+	PRtpPacket fecPacket;
+	{
+		QMutexLocker locker(&rtpvideoout_mutex);
+		if(videoFecEnc)
+		{
+			QByteArray fec = videoFecEnc->update(packet.rawValue);
+			if(!fec.isEmpty())
+			{
+				fecPacket.rawValue = fec;
+				videoRtpStats.countOut(fec.size());
+			}
+		}
+	}
+
+	// fec is computed over the plaintext, then media and fec packets
+	//   are each protected in place — the receiver unprotects before
+	//   feeding its fec decoder.  consumers keep a plaintext reference
+	//   and protect with their own keys
+	PRtpPacket plain = packet;
+	if(srtpOut.isActive())
+	{
+		if(!srtpOut.protect(&packet.rawValue))
+			return;
+		if(!fecPacket.rawValue.isEmpty() && !srtpOut.protect(&fecPacket.rawValue))
+			fecPacket.rawValue.clear();
+	}
+
+	paceOrSendVideo(packet);
+	if(!fecPacket.rawValue.isEmpty())
+		paceOrSendVideo(fecPacket);
+
+	// fan out to any sessions sharing this encoder.  fec is not
+	//   forwarded: each consumer's peer negotiates it separately
+	send_consumers_mutex.lock();
+	foreach(RtpWorker *c, send_consumers)
+		c->consumer_packet_video(plain);
+	send_consumers_mutex.unlock();
+}
+
+// the low simulcast layer has its own ssrc and sequence space, so it
+//   bypasses fec (whose groups assume one space) but shares the pacer
+void RtpWorker::packet_ready_rtp_video_low(const unsigned char *buf, int size)
+{
+	QByteArray ba((const char *)buf, size);
+	PRtpPacket packet;
+	packet.rawValue = ba;
+	packet.portOffset = 0;
+
+	videoRtpStats.countOut(size);
+
+	if(srtpOut.isActive() && !srtpOut.protect(&packet.rawValue))
+		return;
+
+	paceOrSendVideo(packet);
+}
+
+// called on a streaming thread with each ogg page from the record mux
+void RtpWorker::record_mux_packet(const unsigned char *buf, int size)
+{
+	QMutexLocker locker(&record_mutex);
+
+	// cache the header pages, so a recording started mid-call can be
+	//   prefixed with them and still make a valid file.  for matroska,
+	//   everything up to the first cluster is headers
+	if(!recordHeadersDone)
+	{
+		bool isHeader;
+		if(recordMuxIsMatroska)
+			isHeader = !is_mkv_cluster_start(buf, size);
+		else
+			isHeader = is_ogg_header_page(buf, size);
+
+		if(isHeader)
+		{
+			recordHeaders += QByteArray((const char *)buf, size);
+			return;
+		}
+
+		recordHeadersDone = true;
+	}
+
+	if(!recording || !cb_recordData)
+		return;
+
+	if(!recordHeadersSent)
+	{
+		recordHeadersSent = true;
+		if(!recordHeaders.isEmpty())
+			cb_recordData(recordHeaders, app);
+	}
+
+	cb_recordData(record_buffer_acquire(buf, size), app);
+}
+
+void RtpWorker::sendVideoPacketNow(const PRtpPacket &packet)
+{
 	QMutexLocker locker(&rtpvideoout_mutex);
 	if(cb_rtpVideoOut && rtpvideoout)
 		cb_rtpVideoOut(packet, app);
 }
 
+// decides whether a packet goes out immediately or joins the paced
+//   queue.  called in the streaming thread
+void RtpWorker::paceOrSendVideo(const PRtpPacket &packet)
+{
+	int burst = (int)videoPaceBurst;
+
+	bool defer = false;
+	if(burst > 0)
+	{
+		QMutexLocker locker(&pace_mutex);
+
+		// order must hold, so once anything is queued, everything
+		//   queues behind it
+		if(!paceQueue.isEmpty() || frameBurstUsed >= burst)
+		{
+			defer = true;
+			paceQueue += packet;
+			if(!paceTimer)
+			{
+				paceTimer = g_timeout_source_new(PACE_TICK_MS);
+				g_source_set_callback(paceTimer, cb_doPaceVideo, this, NULL);
+				g_source_attach(paceTimer, mainContext_);
+			}
+		}
+		else
+			++frameBurstUsed;
+
+		// the marker closes the frame, opening a fresh burst allowance
+		if(packet.rawValue.size() >= 2 && ((unsigned char)packet.rawValue[1] & 0x80))
+			frameBurstUsed = 0;
+	}
+
+	if(!defer)
+		sendVideoPacketNow(packet);
+}
+
+gboolean RtpWorker::cb_doPaceVideo(gpointer data)
+{
+	return ((RtpWorker *)data)->doPaceVideo();
+}
+
+gboolean RtpWorker::doPaceVideo()
+{
+	QList<PRtpPacket> toSend;
+
+	pace_mutex.lock();
+	for(int n = 0; n < PACE_PACKETS_PER_TICK && !paceQueue.isEmpty(); ++n)
+		toSend += paceQueue.takeFirst();
+	bool done = paceQueue.isEmpty();
+	if(done)
+		paceTimer = 0; // our FALSE return removes the source
+	pace_mutex.unlock();
+
+	foreach(const PRtpPacket &packet, toSend)
+		sendVideoPacketNow(packet);
+
+	return done ? FALSE : TRUE;
+}
+
+void RtpWorker::consumer_packet_audio(const PRtpPacket &packet)
+{
+	// the producer hands over plaintext; protection is per session
+	PRtpPacket p = packet;
+	if(srtpOut.isActive() && !srtpOut.protect(&p.rawValue))
+		return;
+
+	QMutexLocker locker(&rtpaudioout_mutex);
+	if(cb_rtpAudioOut && rtpaudioout)
+		cb_rtpAudioOut(p, app);
+}
+
+void RtpWorker::consumer_packet_video(const PRtpPacket &packet)
+{
+	// the producer hands over plaintext; protection is per session
+	PRtpPacket p = packet;
+	if(srtpOut.isActive() && !srtpOut.protect(&p.rawValue))
+		return;
+
+	QMutexLocker locker(&rtpvideoout_mutex);
+	if(cb_rtpVideoOut && rtpvideoout)
+		cb_rtpVideoOut(p, app);
+}
+
 gboolean RtpWorker::fileReady()
 {
+	QMutexLocker locker(&worker_setup_mutex);
+
 	if(loopFile)
 	{
 		//gst_element_set_state(sendPipeline, GST_STATE_PAUSED);
@@ -906,6 +2644,48 @@ gboolean RtpWorker::fileReady()
 	return FALSE;
 }
 
+// compare remote payload info, so update() can tell which branches a
+//   codec change actually touches.  name matching is case-insensitive,
+//   as elsewhere
+static bool payloadInfoEqual(const PPayloadInfo &a, const PPayloadInfo &b)
+{
+	if(a.id != b.id ||
+		a.name.compare(b.name, Qt::CaseInsensitive) != 0 ||
+		a.clockrate != b.clockrate ||
+		a.channels != b.channels ||
+		a.ptime != b.ptime ||
+		a.maxptime != b.maxptime ||
+		a.parameters.count() != b.parameters.count())
+	{
+		return false;
+	}
+
+	for(int n = 0; n < a.parameters.count(); ++n)
+	{
+		if(a.parameters[n].name != b.parameters[n].name ||
+			a.parameters[n].value != b.parameters[n].value)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool payloadInfoListEqual(const QList<PPayloadInfo> &a, const QList<PPayloadInfo> &b)
+{
+	if(a.count() != b.count())
+		return false;
+
+	for(int n = 0; n < a.count(); ++n)
+	{
+		if(!payloadInfoEqual(a[n], b[n]))
+			return false;
+	}
+
+	return true;
+}
+
 bool RtpWorker::setupSendRecv()
 {
 	// FIXME:
@@ -921,10 +2701,10 @@ bool RtpWorker::setupSendRecv()
 	//   - once sending or receiving is started, codecs can't be changed
 	//     (changes will be rejected).  one exception: remote theora
 	//     config can be updated.
-	//   - once sending or receiving is started, devices can't be changed
-	//     (changes will be ignored)
+	//   - once sending or receiving is started, devices can be swapped
+	//     in place (media types still cannot be added or removed)
 
-	if(!sendbin)
+	if(!sendbin && !send_shared)
 	{
 		if(!localAudioParams.isEmpty() || !localVideoParams.isEmpty())
 		{
@@ -940,6 +2720,23 @@ bool RtpWorker::setupSendRecv()
 			error = RtpSessionContext::ErrorGeneric;
 			return false;
 		}*/
+
+		// device swaps, however, can be done live, without dropping
+		//   the pipeline to NULL
+		if(!fileDemux)
+		{
+			if(pd_audiosrc && ain != used_ain)
+			{
+				if(!replaceAudioInput())
+					return false;
+			}
+
+			if(pd_videosrc && vin != used_vin)
+			{
+				if(!replaceVideoInput())
+					return false;
+			}
+		}
 	}
 
 	if(!recvbin)
@@ -954,17 +2751,160 @@ bool RtpWorker::setupSendRecv()
 	{
 		// TODO: support adding/removing audio/video to existing session
 
-		// see if theora was updated in the remote config
-		updateTheoraConfig();
+		if(pd_audiosink && aout != used_aout)
+		{
+			if(!replaceAudioOutput())
+				return false;
+		}
+
+		// see if theora was updated in the remote config.  diff first,
+		//   so an update that doesn't touch video (most of them don't)
+		//   doesn't disturb the running video branch, and an update that
+		//   only touches video leaves audio alone entirely
+		if(!payloadInfoListEqual(remoteVideoPayloadInfo, actual_remoteVideoPayloadInfo))
+			updateTheoraConfig();
+	}
+
+	// apply actual settings back to these variables, so the user can
+	//   read them
+	localAudioPayloadInfo = actual_localAudioPayloadInfo;
+	localVideoPayloadInfo = actual_localVideoPayloadInfo;
+	remoteAudioPayloadInfo = actual_remoteAudioPayloadInfo;
+	remoteVideoPayloadInfo = actual_remoteVideoPayloadInfo;
+
+	return true;
+}
+
+// swap one live device for another, while the rest of the pipeline keeps
+//   running.  the device context hands us a queue (for inputs) or shared
+//   sink chain (for outputs), and destroying the context flushes and
+//   removes that chain from the running pipeline; the replacement gets
+//   synced to the pipeline state as it is added.  there is a brief media
+//   gap during the swap, but no state loss and no renegotiation.
+bool RtpWorker::replaceAudioInput()
+{
+#ifdef RTPWORKER_DEBUG
+	printf("switching audio input to '%s'\n", qPrintable(ain));
+#endif
+
+	// fast path: warm-swap the device inside the existing context.  the
+	//   new device is opened in parallel while the old one keeps
+	//   capturing, so the gap is just the link switchover.  our queue
+	//   element and its link into sendbin are untouched
+	if(pd_audiosrc && pd_audiosrc->switchDevice(ain))
+	{
+		used_ain = ain;
+		return true;
+	}
+
+	delete pd_audiosrc;
+	pd_audiosrc = PipelineDeviceContext::create(send_pipelineContext, ain, PDevice::AudioIn);
+	if(!pd_audiosrc)
+	{
+#ifdef RTPWORKER_DEBUG
+		printf("Failed to create audio input element '%s'.\n", qPrintable(ain));
+#endif
+		audiosrc = 0;
+		error = RtpSessionContext::ErrorGeneric;
+		return false;
+	}
+
+	pd_audiosrc->setDropCounter(&audioSrcDrops);
+	audiosrc = pd_audiosrc->element();
+	gst_element_link(audiosrc, sendbin);
+	used_ain = ain;
+	return true;
+}
+
+bool RtpWorker::replaceVideoInput()
+{
+#ifdef RTPWORKER_DEBUG
+	printf("switching video input to '%s'\n", qPrintable(vin));
+#endif
+
+	// fast path, as in replaceAudioInput
+	if(pd_videosrc && pd_videosrc->switchDevice(vin))
+	{
+		used_vin = vin;
+		return true;
+	}
+
+	PipelineDeviceOptions opts;
+	opts.videoSize = QSize(320, 240);
+	opts.fps = 30;
+
+	delete pd_videosrc;
+	pd_videosrc = PipelineDeviceContext::create(send_pipelineContext, vin, PDevice::VideoIn, opts);
+	if(!pd_videosrc)
+	{
+#ifdef RTPWORKER_DEBUG
+		printf("Failed to create video input element '%s'.\n", qPrintable(vin));
+#endif
+		videosrc = 0;
+		error = RtpSessionContext::ErrorGeneric;
+		return false;
+	}
+
+	pd_videosrc->setDropCounter(&videoSrcDrops);
+	videosrc = pd_videosrc->element();
+	gst_element_link(videosrc, sendbin);
+	used_vin = vin;
+	return true;
+}
+
+bool RtpWorker::replaceAudioOutput()
+{
+#ifdef RTPWORKER_DEBUG
+	printf("switching audio output to '%s'\n", qPrintable(aout));
+#endif
+
+	// fast path: the shared sink chain (and thus our link from recvbin)
+	//   stays in place, only the device bin behind it is exchanged
+	if(pd_audiosink && pd_audiosink->switchDevice(aout))
+	{
+		used_aout = aout;
+		return true;
+	}
+
+	delete pd_audiosink;
+	pd_audiosink = PipelineDeviceContext::create(recv_pipelineContext, aout, PDevice::AudioOut);
+	if(!pd_audiosink)
+	{
+#ifdef RTPWORKER_DEBUG
+		printf("failed to create audio output element\n");
+#endif
+		error = RtpSessionContext::ErrorGeneric;
+		return false;
 	}
 
-	// apply actual settings back to these variables, so the user can
-	//   read them
-	localAudioPayloadInfo = actual_localAudioPayloadInfo;
-	localVideoPayloadInfo = actual_localVideoPayloadInfo;
-	remoteAudioPayloadInfo = actual_remoteAudioPayloadInfo;
-	remoteVideoPayloadInfo = actual_remoteVideoPayloadInfo;
+	gst_element_link(recvbin, pd_audiosink->element());
+	used_aout = aout;
+	return true;
+}
+
+bool RtpWorker::attachSendConsumer()
+{
+	// the owner already negotiated caps, so just mirror them.  pause
+	//   and transmit work as usual: the fan-out checks each consumer's
+	//   own rtpaudioout/rtpvideoout flags
+	localAudioPayloadInfo = send_owner->actual_localAudioPayloadInfo;
+	localVideoPayloadInfo = send_owner->actual_localVideoPayloadInfo;
+	actual_localAudioPayloadInfo = localAudioPayloadInfo;
+	actual_localVideoPayloadInfo = localVideoPayloadInfo;
+	canTransmitAudio = send_owner->canTransmitAudio;
+	canTransmitVideo = send_owner->canTransmitVideo;
+
+	send_consumers_mutex.lock();
+	send_consumers += this;
+	int count = send_consumers.count();
+	send_consumers_mutex.unlock();
+	send_shared = true;
 
+#ifdef RTPWORKER_DEBUG
+	printf("sharing send encoder with existing session (consumers=%d)\n", count);
+#else
+	Q_UNUSED(count);
+#endif
 	return true;
 }
 
@@ -981,6 +2921,13 @@ bool RtpWorker::startSend()
 		GstElement *fileSource = gst_element_factory_make("filesrc", NULL);
 		g_object_set(G_OBJECT(fileSource), "location", infile.toUtf8().data(), NULL);
 
+		// map the file instead of read()ing it: pages are faulted in
+		//   on demand, nothing is resident up front, and a loop seek
+		//   is just an offset change rather than a re-read.  probe
+		//   for the property in case a platform's filesrc lacks it
+		if(g_object_class_find_property(G_OBJECT_GET_CLASS(fileSource), "use-mmap"))
+			g_object_set(G_OBJECT(fileSource), "use-mmap", TRUE, NULL);
+
 		fileDemux = gst_element_factory_make("oggdemux", NULL);
 		g_signal_connect(G_OBJECT(fileDemux),
 			"no-more-pads",
@@ -1000,7 +2947,16 @@ bool RtpWorker::startSend()
 	else if(!ain.isEmpty() || !vin.isEmpty())
 	{
 		if(send_in_use)
+		{
+			// the send pipeline already encodes for another session.
+			//   if we'd capture from the same devices, don't encode
+			//   again: attach to the owning session and share its
+			//   rtp output, so N peers cost one encoder
+			if(send_owner && !send_owner->fileDemux && ain == send_owner->used_ain && vin == send_owner->used_vin)
+				return attachSendConsumer();
+
 			return false;
+		}
 
 		sendbin = gst_bin_new("sendbin");
 
@@ -1019,7 +2975,9 @@ bool RtpWorker::startSend()
 				return false;
 			}
 
+			pd_audiosrc->setDropCounter(&audioSrcDrops);
 			audiosrc = pd_audiosrc->element();
+			used_ain = ain;
 		}
 
 		if(!vin.isEmpty() && !localVideoParams.isEmpty())
@@ -1044,7 +3002,9 @@ bool RtpWorker::startSend()
 				return false;
 			}
 
+			pd_videosrc->setDropCounter(&videoSrcDrops);
 			videosrc = pd_videosrc->element();
+			used_vin = vin;
 		}
 	}
 
@@ -1053,6 +3013,7 @@ bool RtpWorker::startSend()
 		return true;
 
 	send_in_use = true;
+	send_owner = this;
 
 	if(audiosrc)
 	{
@@ -1085,6 +3046,9 @@ bool RtpWorker::startSend()
 		}
 	}
 
+	// hook the record taps up to a mux, if any were made
+	addRecordChain();
+
 	gst_bin_add(GST_BIN(spipeline), sendbin);
 
 	if(!audiosrc && !videosrc)
@@ -1134,55 +3098,161 @@ bool RtpWorker::startSend()
 		//gst_element_get_state(pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
 		send_pipelineContext->activate();
 
-		// 6 seconds ought to be enough time to init
-		int ret = gst_element_get_state(spipeline, NULL, NULL, 6 * GST_SECOND);
-		//gst_element_get_state(sendbin, NULL, NULL, GST_CLOCK_TIME_NONE);
-		if(ret != GST_STATE_CHANGE_SUCCESS && ret != GST_STATE_CHANGE_NO_PREROLL)
+		// startup continues asynchronously from here, so a slow
+		//   device open delays only its own branch: audio can flow
+		//   while a webcam is still initializing.  we track the
+		//   pipeline via the bus, and we know a branch is really
+		//   producing when its payloader negotiates caps
+		if(!busWatch)
 		{
-#ifdef RTPWORKER_DEBUG
-			printf("error/timeout while setting send pipeline to PLAYING\n");
-#endif
-			cleanup();
-			error = RtpSessionContext::ErrorGeneric;
-			return false;
+			GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(spipeline));
+			busWatch = gst_bus_create_watch(bus);
+			gst_object_unref(bus);
+			g_source_set_callback(busWatch, (GSourceFunc)cb_bus_call, this, NULL);
+			g_source_attach(busWatch, mainContext_);
 		}
 
-		if(!shared_clock && use_shared_clock)
+		if(audiortppay)
+		{
+			GstPad *pad = gst_element_get_static_pad(audiortppay, "src");
+			g_signal_connect(G_OBJECT(pad), "notify::caps", G_CALLBACK(cb_payloader_caps_notify), this);
+			gst_object_unref(pad);
+		}
+		if(videortppay)
 		{
-			printf("send clock is master\n");
+			GstPad *pad = gst_element_get_static_pad(videortppay, "src");
+			g_signal_connect(G_OBJECT(pad), "notify::caps", G_CALLBACK(cb_payloader_caps_notify), this);
+			gst_object_unref(pad);
+		}
 
-			shared_clock = gst_pipeline_get_clock(GST_PIPELINE(spipeline));
-			gst_pipeline_use_clock(GST_PIPELINE(spipeline), shared_clock);
-			send_clock_is_shared = true;
+		sendStartPending = true;
 
-			// if recv active, apply this clock to it
-			if(recv_in_use)
-			{
-				printf("recv pipeline slaving to send clock\n");
-				gst_element_set_state(rpipeline, GST_STATE_READY);
-				gst_element_get_state(rpipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
-				gst_pipeline_use_clock(GST_PIPELINE(rpipeline), shared_clock);
-				gst_element_set_state(rpipeline, GST_STATE_PLAYING);
-			}
+		// 6 seconds ought to be enough time to init
+		startTimeout = g_timeout_source_new(6000);
+		g_source_set_callback(startTimeout, cb_doStartTimeout, this, NULL);
+		g_source_attach(startTimeout, mainContext_);
+
+		// in case negotiation won the race with the signal connects
+		scheduleSendStartCheck();
+	}
+
+	return true;
+}
+
+gboolean RtpWorker::cb_checkSendStarted(gpointer data)
+{
+	return ((RtpWorker *)data)->checkSendStarted();
+}
+
+gboolean RtpWorker::cb_doStartTimeout(gpointer data)
+{
+	return ((RtpWorker *)data)->doStartTimeout();
+}
+
+void RtpWorker::cb_payloader_caps_notify(GObject *obj, GParamSpec *pspec, gpointer data)
+{
+	Q_UNUSED(obj);
+	Q_UNUSED(pspec);
+
+	((RtpWorker *)data)->scheduleSendStartCheck();
+}
+
+// may be called from a streaming thread.  bounce to the worker thread;
+//   redundant checks are cheap and harmless
+void RtpWorker::scheduleSendStartCheck()
+{
+	GSource *ctimer = g_timeout_source_new(0);
+	g_source_set_callback(ctimer, cb_checkSendStarted, this, NULL);
+	g_source_attach(ctimer, mainContext_);
+}
+
+// see if all requested send branches have negotiated yet, and if so,
+//   finish what used to be the tail of the blocking startSend()
+gboolean RtpWorker::checkSendStarted()
+{
+	QMutexLocker locker(&worker_setup_mutex);
+
+	if(!sendStartPending)
+		return FALSE;
+
+	// not all branches ready yet.  the timeout has the final word
+	if(!getCaps())
+		return FALSE;
+
+	sendStartPending = false;
+	if(startTimeout)
+	{
+		g_source_destroy(startTimeout);
+		startTimeout = 0;
+	}
+
+	if(!shared_clock && use_shared_clock)
+	{
+		printf("send clock is master\n");
+
+		shared_clock = gst_pipeline_get_clock(GST_PIPELINE(spipeline));
+		gst_pipeline_use_clock(GST_PIPELINE(spipeline), shared_clock);
+		send_clock_is_shared = true;
+
+		// if recv active, apply this clock to it
+		if(recv_refs > 0)
+		{
+			printf("recv pipeline slaving to send clock\n");
+			gst_element_set_state(rpipeline, GST_STATE_READY);
+			gst_element_get_state(rpipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+			gst_pipeline_use_clock(GST_PIPELINE(rpipeline), shared_clock);
+			gst_element_set_state(rpipeline, GST_STATE_PLAYING);
 		}
+	}
 
 #ifdef RTPWORKER_DEBUG
-		printf("state changed\n");
+	printf("send pipeline started\n");
 
-		dump_pipeline(spipeline);
+	dump_pipeline(spipeline);
 #endif
 
-		if(!getCaps())
-		{
-			error = RtpSessionContext::ErrorCodec;
-			return false;
-		}
+	actual_localAudioPayloadInfo = localAudioPayloadInfo;
+	actual_localVideoPayloadInfo = localVideoPayloadInfo;
+
+	if(startNotifyPending)
+	{
+		startNotifyPending = false;
+		if(cb_started)
+			cb_started(app);
+	}
+	else if(updateNotifyPending)
+	{
+		updateNotifyPending = false;
+		if(cb_updated)
+			cb_updated(app);
+	}
+
+	return FALSE;
+}
+
+gboolean RtpWorker::doStartTimeout()
+{
+	QMutexLocker locker(&worker_setup_mutex);
 
-		actual_localAudioPayloadInfo = localAudioPayloadInfo;
-		actual_localVideoPayloadInfo = localVideoPayloadInfo;
+	startTimeout = 0;
+
+	if(sendStartPending)
+	{
+#ifdef RTPWORKER_DEBUG
+		printf("error/timeout while setting send pipeline to PLAYING\n");
+#endif
+		failSendStart();
 	}
 
-	return true;
+	return FALSE;
+}
+
+void RtpWorker::failSendStart()
+{
+	cleanup(); // also clears the pending flags
+	error = RtpSessionContext::ErrorGeneric;
+	if(cb_error)
+		cb_error(app);
 }
 
 bool RtpWorker::startRecv()
@@ -1190,25 +3260,52 @@ bool RtpWorker::startRecv()
 	QString acodec, vcodec;
 	GstElement *audioout = 0;
 	GstElement *asrc = 0;
+	bool recv_acquired = false;
 
-	// TODO: support more than speex
-	int speex_at = -1;
+	// of the audio codecs we support, prefer opus over speex
+	int audio_at = -1;
 	for(int n = 0; n < remoteAudioPayloadInfo.count(); ++n)
 	{
 		const PPayloadInfo &ri = remoteAudioPayloadInfo[n];
-		if(ri.name.toUpper() == "SPEEX" && ri.clockrate == 16000)
+		if(ri.name.toUpper() == "OPUS" && ri.clockrate == 48000)
 		{
-			speex_at = n;
+			audio_at = n;
 			break;
 		}
 	}
+	if(audio_at == -1)
+	{
+		for(int n = 0; n < remoteAudioPayloadInfo.count(); ++n)
+		{
+			const PPayloadInfo &ri = remoteAudioPayloadInfo[n];
+			if(ri.name.toUpper() == "SPEEX" && ri.clockrate == 16000)
+			{
+				audio_at = n;
+				break;
+			}
+		}
+	}
+	// the l16 passthrough pseudo-codec, when offered
+	if(audio_at == -1)
+	{
+		for(int n = 0; n < remoteAudioPayloadInfo.count(); ++n)
+		{
+			const PPayloadInfo &ri = remoteAudioPayloadInfo[n];
+			if(ri.name.toUpper() == "L16")
+			{
+				audio_at = n;
+				break;
+			}
+		}
+	}
 
-	// TODO: support more than theora
+	// TODO: support more than theora (raw is the passthrough
+	//   pseudo-codec)
 	int theora_at = -1;
 	for(int n = 0; n < remoteVideoPayloadInfo.count(); ++n)
 	{
 		const PPayloadInfo &ri = remoteVideoPayloadInfo[n];
-		if(ri.name.toUpper() == "THEORA" && ri.clockrate == 90000)
+		if((ri.name.toUpper() == "THEORA" || ri.name.toUpper() == "RAW") && ri.clockrate == 90000)
 		{
 			theora_at = n;
 			break;
@@ -1216,20 +3313,20 @@ bool RtpWorker::startRecv()
 	}
 
 	// if remote does not support our codecs, error out
-	// FIXME: again, support more than speex/theora
-	if((!remoteAudioPayloadInfo.isEmpty() && speex_at == -1) ||
+	// FIXME: again, support more than opus/speex/theora
+	if((!remoteAudioPayloadInfo.isEmpty() && audio_at == -1) ||
 		(!remoteVideoPayloadInfo.isEmpty() && theora_at == -1))
 	{
 		return false;
 	}
 
-	if(!remoteAudioPayloadInfo.isEmpty() && speex_at != -1)
+	if(!remoteAudioPayloadInfo.isEmpty() && audio_at != -1)
 	{
 #ifdef RTPWORKER_DEBUG
 		printf("setting up audio recv\n");
 #endif
 
-		int at = speex_at;
+		int at = audio_at;
 
 		GstStructure *cs = payloadInfoToStructure(remoteAudioPayloadInfo[at], "audio");
 		if(!cs)
@@ -1240,14 +3337,15 @@ bool RtpWorker::startRecv()
 			return false;
 		}
 
-		if(recv_in_use)
-			return false;
-
 		if(!recvbin)
 			recvbin = gst_bin_new("recvbin");
 
 		audiortpsrc_mutex.lock();
 		audiortpsrc = gst_element_factory_make("apprtpsrc", NULL);
+		gst_apprtpsrc_set_bufmon_site((GstAppRtpSrc *)audiortpsrc, PSI_BUFMON_PACKET_IN_AUDIO);
+		delete audioIngress;
+		audioIngress = new RtpIngressFilter;
+		audioIngress->allowedTypes += remoteAudioPayloadInfo[at].id;
 		audiortpsrc_mutex.unlock();
 
 		GstCaps *caps = gst_caps_new_empty();
@@ -1256,9 +3354,12 @@ bool RtpWorker::startRecv()
 		gst_caps_unref(caps);
 
 		// FIXME: what if we don't have a name and just id?
-		//   it's okay, for now we only support speex which requires
-		//   the name..
+		//   it's okay, for now we only support opus/speex which
+		//   require the name..
 		acodec = remoteAudioPayloadInfo[at].name.toLower();
+
+		// the jitter estimator needs the rtp clock to convert to time
+		audioRtpStats.clockrate.fetchAndStoreRelaxed(remoteAudioPayloadInfo[at].clockrate);
 	}
 
 	if(!remoteVideoPayloadInfo.isEmpty() && theora_at != -1)
@@ -1278,14 +3379,15 @@ bool RtpWorker::startRecv()
 			goto fail1;
 		}
 
-		if(recv_in_use)
-			return false;
-
 		if(!recvbin)
 			recvbin = gst_bin_new("recvbin");
 
 		videortpsrc_mutex.lock();
 		videortpsrc = gst_element_factory_make("apprtpsrc", NULL);
+		gst_apprtpsrc_set_bufmon_site((GstAppRtpSrc *)videortpsrc, PSI_BUFMON_PACKET_IN_VIDEO);
+		delete videoIngress;
+		videoIngress = new RtpIngressFilter;
+		videoIngress->allowedTypes += remoteVideoPayloadInfo[at].id;
 		videortpsrc_mutex.unlock();
 
 		GstCaps *caps = gst_caps_new_empty();
@@ -1296,18 +3398,34 @@ bool RtpWorker::startRecv()
 		// FIXME: what if we don't have a name and just id?
 		//   it's okay, for now we only really support theora which
 		//   requires the name..
-		vcodec = remoteVideoPayloadInfo[at].name;
-		if(vcodec == "H263-1998") // FIXME: gross
-			vcodec = "h263p";
+		// map the rtp encoding-name to our codec name via the table
+		const CodecDescriptor *cd = codec_lookup_rtp(remoteVideoPayloadInfo[at].name);
+		if(cd)
+			vcodec = QLatin1String(cd->name);
 		else
-			vcodec = vcodec.toLower();
+			vcodec = remoteVideoPayloadInfo[at].name.toLower();
+
+		// we advertise ulpfec, so the peer may interleave fec packets
+		//   with the video; set up recovery for them.  skip the odd
+		//   case of the codec itself sitting on our fec pt
+		if(remoteVideoPayloadInfo[at].id != VIDEO_FEC_PT)
+		{
+			videortpsrc_mutex.lock();
+			delete videoFecDec;
+			videoFecDec = new UlpFecDecoder;
+			videoFecDec->setup(VIDEO_FEC_PT);
+			videoIngress->allowedTypes += VIDEO_FEC_PT;
+			videoIngress->dupExemptType = VIDEO_FEC_PT;
+			videortpsrc_mutex.unlock();
+		}
 	}
 
 	// no desire to receive
 	if(!recvbin)
 		return true;
 
-	recv_in_use = true;
+	++recv_refs;
+	recv_acquired = true;
 
 	if(audiortpsrc)
 	{
@@ -1315,6 +3433,26 @@ bool RtpWorker::startRecv()
 		if(!audiodec)
 			goto fail1;
 
+		audiojbuf = gst_bin_get_by_name(GST_BIN(audiodec), "audiojbuf");
+		if(audiojbuf)
+		{
+			guint lat = 0;
+			g_object_get(G_OBJECT(audiojbuf), "latency", &lat, NULL);
+
+			if(jitterMinLatency != -1 && jitterMaxLatency != -1)
+			{
+				lat = (guint)qBound(jitterMinLatency, (int)lat, jitterMaxLatency);
+				g_object_set(G_OBJECT(audiojbuf), "latency", lat, NULL);
+
+				// adapt the latency to measured jitter once a second
+				jbufTimer = g_timeout_source_new(1000);
+				g_source_set_callback(jbufTimer, cb_doAdaptJbuf, this, NULL);
+				g_source_attach(jbufTimer, mainContext_);
+			}
+
+			audioJbufLatency.fetchAndStoreRelaxed((int)lat);
+		}
+
 		if(!aout.isEmpty())
 		{
 #ifdef RTPWORKER_DEBUG
@@ -1331,34 +3469,52 @@ bool RtpWorker::startRecv()
 			}
 
 			audioout = pd_audiosink->element();
+			used_aout = aout;
 		}
 		else
 			audioout = gst_element_factory_make("fakesink", NULL);
 
+		volumeout = elementcache_make("volume");
+		lastAppliedOutputVolume = (int)outputVolume;
+		g_object_set(G_OBJECT(volumeout), "volume", (double)lastAppliedOutputVolume / 100, NULL);
+
+		// feed the output meter from what goes to the speakers
 		{
-			QMutexLocker locker(&volumeout_mutex);
-			volumeout = gst_element_factory_make("volume", NULL);
-			double vol = (double)outputVolume / 100;
-			g_object_set(G_OBJECT(volumeout), "volume", vol, NULL);
+			GstPad *mpad = gst_element_get_static_pad(volumeout, "src");
+			gst_pad_add_buffer_probe(mpad, G_CALLBACK(cb_audio_out_buffer), this);
+			gst_object_unref(GST_OBJECT(mpad));
 		}
 
-		GstElement *audioconvert = gst_element_factory_make("audioconvert", NULL);
-		GstElement *audioresample = gst_element_factory_make("audioresample", NULL);
+		// the queue puts decode and convert/resample on separate
+		//   streaming threads, so a slow decode doesn't starve the
+		//   output side
+		GstElement *audiodecqueue = elementcache_make("queue");
+		GstElement *audioconvert = elementcache_make("audioconvert");
+		GstElement *audioresample = elementcache_make("audioresample");
+		bins_audioresample_configure(audioresample);
 		if(pd_audiosink)
 			asrc = audioresample;
 
 		gst_bin_add(GST_BIN(recvbin), audiortpsrc);
 		gst_bin_add(GST_BIN(recvbin), audiodec);
+		gst_bin_add(GST_BIN(recvbin), audiodecqueue);
 		gst_bin_add(GST_BIN(recvbin), volumeout);
 		gst_bin_add(GST_BIN(recvbin), audioconvert);
 		gst_bin_add(GST_BIN(recvbin), audioresample);
 		if(!asrc)
 			gst_bin_add(GST_BIN(recvbin), audioout);
 
-		gst_element_link_many(audiortpsrc, audiodec, volumeout, audioconvert, audioresample, NULL);
+		gst_element_link_many(audiortpsrc, audiodec, audiodecqueue, volumeout, audioconvert, audioresample, NULL);
 		if(!asrc)
 			gst_element_link(audioresample, audioout);
 
+		if(audioTrace)
+		{
+			audioTrace->attach(LatencyTracer::Stage_RtpIn, audiortpsrc, "src");
+			audioTrace->attach(LatencyTracer::Stage_DecOut, audiodec, "src");
+			audioTrace->attach(LatencyTracer::Stage_Sink, audioout, "sink");
+		}
+
 		actual_remoteAudioPayloadInfo = remoteAudioPayloadInfo;
 	}
 
@@ -1368,18 +3524,58 @@ bool RtpWorker::startRecv()
 		if(!videodec)
 			goto fail1;
 
-		GstElement *videoconvert = gst_element_factory_make("ffmpegcolorspace", NULL);
 		GstElement *videosink = gst_element_factory_make("appvideosink", NULL);
 		GstAppVideoSink *appVideoSink = (GstAppVideoSink *)videosink;
 		appVideoSink->appdata = this;
 		appVideoSink->show_frame = cb_show_frame_output;
+		appVideoSink->frame_wanted = cb_frame_wanted_output;
+		if(shmVideoExport)
+		{
+			// the ring itself is created on the first frame, once we
+			//   know the size (see show_frame_output).  until then
+			//   the sink keeps using show_frame
+			appVideoSink->show_frame_shm = cb_show_frame_shm_output;
+			shmOutputSink = appVideoSink;
+		}
+
+		// give the decoder its own streaming thread.  with HD remote
+		//   video, decode plus colorspace conversion on one thread can
+		//   miss frame deadlines; the queue lets them run on two cores
+		GstElement *videodecqueue = elementcache_make("queue");
+
+		// gate the display branch on widget presence (or the shm ring).
+		//   the decoder still runs — the stream needs its reference
+		//   frames — but unwatched output skips the queue hop, the
+		//   conversion and the sink entirely
+		{
+			GstPad *gpad = gst_element_get_static_pad(videodecqueue, "sink");
+			gst_pad_add_buffer_probe(gpad, G_CALLBACK(cb_video_output_gate), this);
+			gst_object_unref(GST_OBJECT(gpad));
+		}
 
 		gst_bin_add(GST_BIN(recvbin), videortpsrc);
 		gst_bin_add(GST_BIN(recvbin), videodec);
-		gst_bin_add(GST_BIN(recvbin), videoconvert);
+		gst_bin_add(GST_BIN(recvbin), videodecqueue);
 		gst_bin_add(GST_BIN(recvbin), videosink);
 
-		gst_element_link_many(videortpsrc, videodec, videoconvert, videosink, NULL);
+		gst_element_link_many(videortpsrc, videodec, videodecqueue, NULL);
+
+		// the sink takes I420 natively and converts in-place, so the
+		//   generic converter is only needed for decoders that output
+		//   something else
+		if(!gst_element_link(videodecqueue, videosink))
+		{
+			GstElement *videoconvert = elementcache_make("ffmpegcolorspace");
+			gst_bin_add(GST_BIN(recvbin), videoconvert);
+			gst_element_link_many(videodecqueue, videoconvert, videosink, NULL);
+		}
+
+		if(videoTrace)
+		{
+			videoTrace->attach(LatencyTracer::Stage_RtpIn, videortpsrc, "src");
+			videoTrace->attach(LatencyTracer::Stage_DecOut, videodec, "src");
+			videoTrace->attach(LatencyTracer::Stage_Sink, videosink, "sink");
+		}
 
 		actual_remoteVideoPayloadInfo = remoteVideoPayloadInfo;
 	}
@@ -1397,22 +3593,32 @@ bool RtpWorker::startRecv()
 		gst_element_link(recvbin, audioout);
 	}
 
-	if(shared_clock && send_clock_is_shared)
-	{
-		printf("recv pipeline slaving to send clock\n");
-		gst_pipeline_use_clock(GST_PIPELINE(rpipeline), shared_clock);
-	}
-
 	//gst_element_set_locked_state(recvbin, FALSE);
 	//gst_element_set_state(recvbin, GST_STATE_PLAYING);
 #ifdef RTPWORKER_DEBUG
 	printf("activating\n");
 #endif
 
-	gst_element_set_state(rpipeline, GST_STATE_READY);
-	gst_element_get_state(rpipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+	if(recv_refs == 1)
+	{
+		if(shared_clock && send_clock_is_shared)
+		{
+			printf("recv pipeline slaving to send clock\n");
+			gst_pipeline_use_clock(GST_PIPELINE(rpipeline), shared_clock);
+		}
+
+		gst_element_set_state(rpipeline, GST_STATE_READY);
+		gst_element_get_state(rpipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
 
-	recv_pipelineContext->activate();
+		recv_pipelineContext->activate();
+	}
+	else
+	{
+		// the pipeline is already running for another session, so
+		//   don't disturb it.  just bring our branch up to speed in
+		//   place; its audio joins the mix at the shared sink
+		gst_element_sync_state_with_parent(recvbin);
+	}
 
 	/*if(!shared_clock && use_shared_clock)
 	{
@@ -1451,22 +3657,38 @@ fail1:
 		recvbin = 0;
 	}
 
+	shmOutputSink = 0;
+
 	delete pd_audiosink;
 	pd_audiosink = 0;
 
-	recv_in_use = false;
+	if(recv_acquired)
+		--recv_refs;
 
 	return false;
 }
 
 bool RtpWorker::addAudioChain()
 {
-	// TODO: support other codecs.  for now, we only support speex 16khz
+	// opus if the app asked for it, otherwise speex 16khz.  "l16" is
+	//   the passthrough pseudo-codec (raw pcm, no encode), for
+	//   measuring framework overhead
+	// TODO: honor the rest of localAudioParams
 	QString codec = "speex";
 	int rate = 16000;
 	int size = 16;
 	int channels = 1;
-	//QString codec = localAudioParams[0].codec;
+	if(!localAudioParams.isEmpty() && localAudioParams[0].codec == "opus")
+	{
+		codec = "opus";
+		rate = 48000;
+	}
+	else if(!localAudioParams.isEmpty() && localAudioParams[0].codec == "l16")
+	{
+		codec = "l16";
+		if(localAudioParams[0].sampleRate > 0)
+			rate = localAudioParams[0].sampleRate;
+	}
 	//int rate = localAudioParams[0].sampleRate;
 	//int size = localAudioParams[0].sampleSize;
 	//int channels = localAudioParams[0].channels;
@@ -1476,28 +3698,41 @@ bool RtpWorker::addAudioChain()
 
 	// see if we need to match a pt id
 	int pt = -1;
+	int remotePtime = -1;
+	int remoteMaxptime = -1;
 	for(int n = 0; n < remoteAudioPayloadInfo.count(); ++n)
 	{
 		const PPayloadInfo &ri = remoteAudioPayloadInfo[n];
-		if(ri.name.toUpper() == "SPEEX" && ri.clockrate == 16000)
+		if(ri.name.toUpper() == codec.toUpper() && ri.clockrate == rate)
 		{
 			pt = ri.id;
+			remotePtime = ri.ptime;
+			remoteMaxptime = ri.maxptime;
 			break;
 		}
 	}
 
+	// packetization interval: local preference wins, else whatever the
+	//   peer asked for.  either way the peer's maxptime bounds it
+	int ptime = -1;
+	if(!localAudioParams.isEmpty() && localAudioParams[0].ptime > 0)
+		ptime = localAudioParams[0].ptime;
+	else if(remotePtime > 0)
+		ptime = remotePtime;
+	if(ptime > 0 && remoteMaxptime > 0 && ptime > remoteMaxptime)
+		ptime = remoteMaxptime;
+
 	// NOTE: we don't bother with a maxbitrate constraint on audio yet
 
-	GstElement *audioenc = bins_audioenc_create(codec, pt, rate, size, channels);
+	// tap the encoded stream for recording, except in file playback
+	//   mode (nothing sensible to record there)
+	GstElement *audioenc = bins_audioenc_create(codec, pt, rate, size, channels, fileDemux ? false : true, ptime, payloaderMtu(false), dtxEnabled);
 	if(!audioenc)
 		return false;
 
-	{
-		QMutexLocker locker(&volumein_mutex);
-		volumein = gst_element_factory_make("volume", NULL);
-		double vol = (double)inputVolume / 100;
-		g_object_set(G_OBJECT(volumein), "volume", vol, NULL);
-	}
+	volumein = elementcache_make("volume");
+	lastAppliedInputVolume = (int)inputVolume;
+	g_object_set(G_OBJECT(volumein), "volume", (double)lastAppliedInputVolume / 100, NULL);
 
 	GstElement *audiortpsink = gst_element_factory_make("apprtpsink", NULL);
 	GstAppRtpSink *appRtpSink = (GstAppRtpSink *)audiortpsink;
@@ -1505,10 +3740,11 @@ bool RtpWorker::addAudioChain()
 		g_object_set(G_OBJECT(appRtpSink), "sync", FALSE, NULL);
 	appRtpSink->appdata = this;
 	appRtpSink->packet_ready = cb_packet_ready_rtp_audio;
+	appRtpSink->packets_ready = cb_packets_ready_rtp_audio;
 
 	GstElement *queue = 0;
 	if(fileDemux)
-		queue = gst_element_factory_make("queue", NULL);
+		queue = elementcache_make("queue");
 
 	if(queue)
 		gst_bin_add(GST_BIN(sendbin), queue);
@@ -1519,8 +3755,25 @@ bool RtpWorker::addAudioChain()
 
 	gst_element_link_many(volumein, audioenc, audiortpsink, NULL);
 
+	// feed the input meter from what actually goes to the encoder,
+	//   i.e. after the volume element
+	{
+		GstPad *mpad = gst_element_get_static_pad(volumein, "src");
+		gst_pad_add_buffer_probe(mpad, G_CALLBACK(cb_audio_in_buffer), this);
+		gst_object_unref(GST_OBJECT(mpad));
+	}
+
 	audiortppay = audioenc;
 
+	if(audioTrace)
+	{
+		if(!fileDemux)
+			audioTrace->attach(LatencyTracer::Stage_Src, audiosrc, "src");
+		audioTrace->attach(LatencyTracer::Stage_EncIn, audioenc, "sink");
+		audioTrace->attachByName(LatencyTracer::Stage_EncOut, GST_BIN(audioenc), "audioenc", "src");
+		audioTrace->attach(LatencyTracer::Stage_RtpOut, audiortpsink, "sink");
+	}
+
 	if(fileDemux)
 	{
 		gst_element_link(queue, volumein);
@@ -1545,11 +3798,14 @@ bool RtpWorker::addAudioChain()
 
 bool RtpWorker::addVideoChain()
 {
-	// TODO: support other codecs.  for now, we only support theora
+	// TODO: support other codecs.  for now, we only support theora,
+	//   plus the "rawvideo" passthrough pseudo-codec (no encode) for
+	//   measuring framework overhead
 	QString codec = "theora";
 	QSize size = QSize(320, 240);
 	int fps = 30;
-	//QString codec = localVideoParams[0].codec;
+	if(!localVideoParams.isEmpty() && localVideoParams[0].codec == "rawvideo")
+		codec = "rawvideo";
 	//QSize size = localVideoParams[0].size;
 	//int fps = localVideoParams[0].fps;
 #ifdef RTPWORKER_DEBUG
@@ -1558,10 +3814,11 @@ bool RtpWorker::addVideoChain()
 
 	// see if we need to match a pt id
 	int pt = -1;
+	QString rtpName = (codec == "rawvideo") ? QString("RAW") : QString("THEORA");
 	for(int n = 0; n < remoteVideoPayloadInfo.count(); ++n)
 	{
 		const PPayloadInfo &ri = remoteVideoPayloadInfo[n];
-		if(ri.name.toUpper() == "THEORA" && ri.clockrate == 90000)
+		if(ri.name.toUpper() == rtpName && ri.clockrate == 90000)
 		{
 			pt = ri.id;
 			break;
@@ -1573,27 +3830,91 @@ bool RtpWorker::addVideoChain()
 	if(audiortppay)
 		videokbps -= 45;
 
-	GstElement *videoprep = bins_videoprep_create(size, fps, fileDemux ? false : true);
+	// the app's speed/latency preference rides in on the first params
+	//   entry
+	int encPreset = VideoEncPreset_Quality;
+	if(!localVideoParams.isEmpty())
+		encPreset = localVideoParams[0].encodePreset;
+
+	// opt-in multi-threaded encode.  spreads the encode chain over
+	//   several cores, which helps hold the frame rate at higher
+	//   resolutions
+	int encThreads = 1;
+	{
+		QByteArray val = qgetenv("PSI_VIDEO_ENC_THREADS");
+		if(!val.isEmpty() && val.toInt() > 1)
+			encThreads = val.toInt();
+	}
+
+	GstElement *scalefilter = 0;
+	GstElement *videoprep = bins_videoprep_create(size, fps, fileDemux ? false : true, &scalefilter);
 	if(!videoprep)
 		return false;
 
-	GstElement *videoenc = bins_videoenc_create(codec, pt, videokbps);
+	GstElement *videoenc = bins_videoenc_create(codec, pt, videokbps, encPreset, encThreads, fileDemux ? false : true, payloaderMtu(true));
 	if(!videoenc)
 	{
 		g_object_unref(G_OBJECT(videoprep));
 		return false;
 	}
 
+	// keep a handle on the encoder element, for live bitrate changes
+	videoencoder = gst_bin_get_by_name(GST_BIN(videoenc), "videoenc");
+
+	// and on the encode branch and scale capsfilter, for live
+	//   resolution downshifts (see setVideoSendDownscale)
+	videoencbin = (GstElement *)gst_object_ref(GST_OBJECT(videoenc));
+	if(scalefilter)
+		videoprepScaleFilter = (GstElement *)gst_object_ref(GST_OBJECT(scalefilter));
+	videoSendBaseSize = size;
+	videoSendDownscale = 0;
+
 	GstElement *videotee = gst_element_factory_make("tee", NULL);
 
-	GstElement *playqueue = gst_element_factory_make("queue", NULL);
-	GstElement *videoconvertplay = gst_element_factory_make("ffmpegcolorspace", NULL);
+	GstElement *playqueue = elementcache_make("queue");
+
+	// note: the preview branch keeps its converter even though the sink
+	//   takes I420 natively.  the tee upstream carries whatever format
+	//   the camera produces, and the encoder bin does its own
+	//   conversion, so this is the only element that can absorb e.g. a
+	//   YUY2-only camera.  it negotiates passthrough when the formats
+	//   already match.
+	GstElement *videoconvertplay = elementcache_make("ffmpegcolorspace");
 	GstElement *videoplaysink = gst_element_factory_make("appvideosink", NULL);
 	GstAppVideoSink *appVideoSink = (GstAppVideoSink *)videoplaysink;
 	appVideoSink->appdata = this;
 	appVideoSink->show_frame = cb_show_frame_preview;
+	appVideoSink->frame_wanted = cb_frame_wanted_preview;
+
+	// the self-view doesn't need full camera rate.  drop frames before
+	//   the converter, so the throttled frames skip the colorspace
+	//   conversion too, not just the ui paint
+	GstElement *playrate = 0;
+	GstElement *playratefilter = 0;
+	if(previewFps > 0)
+	{
+		playrate = elementcache_make("videorate");
+		if(playrate)
+		{
+			// never duplicate frames to pad up to the cap
+			if(g_object_class_find_property(G_OBJECT_GET_CLASS(playrate), "drop-only"))
+				g_object_set(G_OBJECT(playrate), "drop-only", TRUE, NULL);
+
+			playratefilter = elementcache_make("capsfilter");
+			GstCaps *caps = gst_caps_new_empty();
+			GstStructure *cs;
+			cs = gst_structure_new("video/x-raw-yuv",
+				"framerate", GST_TYPE_FRACTION, previewFps, 1, NULL);
+			gst_caps_append_structure(caps, cs);
+			cs = gst_structure_new("video/x-raw-rgb",
+				"framerate", GST_TYPE_FRACTION, previewFps, 1, NULL);
+			gst_caps_append_structure(caps, cs);
+			g_object_set(G_OBJECT(playratefilter), "caps", caps, NULL);
+			gst_caps_unref(caps);
+		}
+	}
 
-	GstElement *rtpqueue = gst_element_factory_make("queue", NULL);
+	GstElement *rtpqueue = elementcache_make("queue");
 	GstElement *videortpsink = gst_element_factory_make("apprtpsink", NULL);
 	GstAppRtpSink *appRtpSink = (GstAppRtpSink *)videortpsink;
 	if(!fileDemux)
@@ -1603,7 +3924,7 @@ bool RtpWorker::addVideoChain()
 
 	GstElement *queue = 0;
 	if(fileDemux)
-		queue = gst_element_factory_make("queue", NULL);
+		queue = elementcache_make("queue");
 
 	if(queue)
 		gst_bin_add(GST_BIN(sendbin), queue);
@@ -1611,6 +3932,11 @@ bool RtpWorker::addVideoChain()
 	gst_bin_add(GST_BIN(sendbin), videoprep);
 	gst_bin_add(GST_BIN(sendbin), videotee);
 	gst_bin_add(GST_BIN(sendbin), playqueue);
+	if(playrate)
+	{
+		gst_bin_add(GST_BIN(sendbin), playrate);
+		gst_bin_add(GST_BIN(sendbin), playratefilter);
+	}
 	gst_bin_add(GST_BIN(sendbin), videoconvertplay);
 	gst_bin_add(GST_BIN(sendbin), videoplaysink);
 	gst_bin_add(GST_BIN(sendbin), rtpqueue);
@@ -1618,11 +3944,110 @@ bool RtpWorker::addVideoChain()
 	gst_bin_add(GST_BIN(sendbin), videortpsink);
 
 	gst_element_link(videoprep, videotee);
-	gst_element_link_many(videotee, playqueue, videoconvertplay, videoplaysink, NULL);
+	if(playrate)
+		gst_element_link_many(videotee, playqueue, playrate, playratefilter, videoconvertplay, videoplaysink, NULL);
+	else
+		gst_element_link_many(videotee, playqueue, videoconvertplay, videoplaysink, NULL);
 	gst_element_link_many(videotee, rtpqueue, videoenc, videortpsink, NULL);
 
+	// gate the self-view branch on widget presence.  dropped at the
+	//   queue entrance, a frame costs the tee a ref/unref and nothing
+	//   more (see cb_video_preview_gate)
+	{
+		GstPad *gpad = gst_element_get_static_pad(playqueue, "sink");
+		gst_pad_add_buffer_probe(gpad, G_CALLBACK(cb_video_preview_gate), this);
+		gst_object_unref(GST_OBJECT(gpad));
+	}
+
 	videortppay = videoenc;
 
+	if(videoTrace)
+	{
+		if(!fileDemux)
+			videoTrace->attach(LatencyTracer::Stage_Src, videosrc, "src");
+		videoTrace->attach(LatencyTracer::Stage_EncIn, videoenc, "sink");
+		videoTrace->attachByName(LatencyTracer::Stage_EncOut, GST_BIN(videoenc), "videoenc", "src");
+		videoTrace->attach(LatencyTracer::Stage_RtpOut, videortpsink, "sink");
+	}
+
+	// if the peer accepts ulpfec, protect the stream toward it
+	for(int n = 0; n < remoteVideoPayloadInfo.count(); ++n)
+	{
+		const PPayloadInfo &ri = remoteVideoPayloadInfo[n];
+		if(ri.name.toLower() == "ulpfec" && ri.clockrate == 90000)
+		{
+			int group = VIDEO_FEC_GROUP;
+			QByteArray val = qgetenv("PSI_FEC_GROUP");
+			if(!val.isEmpty())
+				group = val.toInt();
+
+			QMutexLocker locker(&rtpvideoout_mutex);
+			delete videoFecEnc;
+			videoFecEnc = new UlpFecEncoder;
+			videoFecEnc->setup(ri.id, group);
+#ifdef RTPWORKER_DEBUG
+			printf("video fec enabled: pt=%d group=%d\n", ri.id, group);
+#endif
+			break;
+		}
+	}
+
+	// simulcast: when the app lists a second video params entry, hang a
+	//   low-resolution encode branch off the same tee.  it gets its own
+	//   payload type and shows up as an additional local payloadinfo,
+	//   so an sfu can forward it to low-bandwidth receivers
+	if(localVideoParams.count() >= 2)
+	{
+		QSize lowSize = localVideoParams[1].size;
+		if(lowSize.isEmpty())
+			lowSize = QSize(160, 120);
+
+		// a small slice of the budget is plenty at that resolution
+		int lowkbps = (videokbps > 0) ? qMax(32, videokbps / 8) : 64;
+
+		GstElement *lowprep = bins_videoprep_create(lowSize, fps, fileDemux ? false : true);
+		GstElement *lowenc = lowprep ? bins_videoenc_create(codec, VIDEO_SIMULCAST_PT, lowkbps, encPreset, encThreads, false, payloaderMtu(true)) : 0;
+		if(lowenc)
+		{
+			GstElement *lowqueue = elementcache_make("queue");
+			GstElement *lowrtpsink = gst_element_factory_make("apprtpsink", NULL);
+			GstAppRtpSink *appRtpSinkLow = (GstAppRtpSink *)lowrtpsink;
+			if(!fileDemux)
+				g_object_set(G_OBJECT(appRtpSinkLow), "sync", FALSE, NULL);
+			appRtpSinkLow->appdata = this;
+			appRtpSinkLow->packet_ready = cb_packet_ready_rtp_video_low;
+
+			gst_bin_add(GST_BIN(sendbin), lowqueue);
+			gst_bin_add(GST_BIN(sendbin), lowprep);
+			gst_bin_add(GST_BIN(sendbin), lowenc);
+			gst_bin_add(GST_BIN(sendbin), lowrtpsink);
+
+			gst_element_link_many(videotee, lowqueue, lowprep, lowenc, lowrtpsink, NULL);
+
+			if(fileDemux)
+			{
+				gst_element_set_state(lowqueue, GST_STATE_PAUSED);
+				gst_element_set_state(lowprep, GST_STATE_PAUSED);
+				gst_element_set_state(lowenc, GST_STATE_PAUSED);
+				gst_element_set_state(lowrtpsink, GST_STATE_PAUSED);
+			}
+
+			videortppay2 = lowenc;
+#ifdef RTPWORKER_DEBUG
+			printf("simulcast layer enabled: %dx%d @ %dkbps\n", lowSize.width(), lowSize.height(), lowkbps);
+#endif
+		}
+		else
+		{
+			// no second layer is better than no video at all
+			if(lowprep)
+				g_object_unref(G_OBJECT(lowprep));
+#ifdef RTPWORKER_DEBUG
+			printf("unable to set up simulcast layer, continuing without\n");
+#endif
+		}
+	}
+
 	if(fileDemux)
 	{
 		gst_element_link(queue, videoprep);
@@ -1650,6 +4075,82 @@ bool RtpWorker::addVideoChain()
 	return true;
 }
 
+// tie the record taps into an ogg mux and an app sink.  the chain runs
+//   for the whole session: muxing already-encoded streams is just page
+//   packing, and keeping it alive means the stream headers are captured
+//   no matter when recording starts
+void RtpWorker::addRecordChain()
+{
+	GstPad *apad = audiortppay ? gst_element_get_static_pad(audiortppay, "recsrc") : 0;
+	GstPad *vpad = videortppay ? gst_element_get_static_pad(videortppay, "recsrc") : 0;
+	if(!apad && !vpad)
+		return;
+
+	// ogg by default.  matroska can be selected instead
+	//   (PSI_RECORD_CONTAINER=matroska), which review tools tend to
+	//   handle better for long recordings
+	GstElement *recmux = 0;
+	QString container = QString::fromLatin1(qgetenv("PSI_RECORD_CONTAINER"));
+	if(container == "matroska" || container == "mkv")
+	{
+		recmux = gst_element_factory_make("matroskamux", NULL);
+		if(recmux)
+		{
+			// our output is a live byte stream, so the mux can't
+			//   seek back to patch up the headers at the end
+			if(g_object_class_find_property(G_OBJECT_GET_CLASS(recmux), "streamable"))
+				g_object_set(G_OBJECT(recmux), "streamable", TRUE, NULL);
+
+			record_mutex.lock();
+			recordMuxIsMatroska = true;
+			record_mutex.unlock();
+		}
+	}
+	if(!recmux)
+		recmux = gst_element_factory_make("oggmux", NULL);
+	GstElement *recsink = gst_element_factory_make("apprtpsink", NULL);
+	g_object_set(G_OBJECT(recsink), "sync", FALSE, NULL);
+	GstAppRtpSink *appRtpSink = (GstAppRtpSink *)recsink;
+	appRtpSink->appdata = this;
+	appRtpSink->packet_ready = cb_record_mux_packet;
+
+	gst_bin_add(GST_BIN(sendbin), recmux);
+	gst_bin_add(GST_BIN(sendbin), recsink);
+	gst_element_link(recmux, recsink);
+
+	if(apad)
+	{
+		GstElement *recqueue = elementcache_make("queue");
+		gst_bin_add(GST_BIN(sendbin), recqueue);
+
+		GstPad *qpad = gst_element_get_static_pad(recqueue, "sink");
+		gst_pad_link(apad, qpad);
+		gst_object_unref(GST_OBJECT(qpad));
+		gst_object_unref(GST_OBJECT(apad));
+
+		gst_element_link(recqueue, recmux);
+	}
+
+	if(vpad)
+	{
+		GstElement *recqueue = elementcache_make("queue");
+		gst_bin_add(GST_BIN(sendbin), recqueue);
+
+		GstPad *qpad = gst_element_get_static_pad(recqueue, "sink");
+		gst_pad_link(vpad, qpad);
+		gst_object_unref(GST_OBJECT(qpad));
+		gst_object_unref(GST_OBJECT(vpad));
+
+		gst_element_link(recqueue, recmux);
+	}
+
+	recordTapped = true;
+
+#ifdef RTPWORKER_DEBUG
+	printf("record tap enabled (no re-encode)\n");
+#endif
+}
+
 bool RtpWorker::getCaps()
 {
 	if(audiortppay)
@@ -1721,6 +4222,33 @@ bool RtpWorker::getCaps()
 		gst_caps_unref(caps);
 
 		localVideoPayloadInfo = QList<PPayloadInfo>() << pi;
+
+		// the low simulcast layer, if present, is advertised as an
+		//   additional payload.  not having caps yet is not an error:
+		//   the layer only negotiates along with the primary
+		if(videortppay2)
+		{
+			GstPad *pad2 = gst_element_get_static_pad(videortppay2, "src");
+			GstCaps *caps2 = gst_pad_get_negotiated_caps(pad2);
+			gst_object_unref(pad2);
+			if(caps2)
+			{
+				GstStructure *cs2 = gst_caps_get_structure(caps2, 0);
+				PPayloadInfo pi2 = structureToPayloadInfo(cs2);
+				if(pi2.id != -1)
+					localVideoPayloadInfo += pi2;
+				gst_caps_unref(caps2);
+			}
+		}
+
+		// advertise rfc 5109 fec alongside the codec, so the peer can
+		//   protect its stream toward us
+		PPayloadInfo fi;
+		fi.id = VIDEO_FEC_PT;
+		fi.name = "ulpfec";
+		fi.clockrate = 90000;
+		localVideoPayloadInfo += fi;
+
 		canTransmitVideo = true;
 	}
 
@@ -1744,7 +4272,7 @@ bool RtpWorker::updateTheoraConfig()
 		return false;
 
 	// if so, update the videortpsrc caps
-	for(int n = 0; n < remoteAudioPayloadInfo.count(); ++n)
+	for(int n = 0; n < remoteVideoPayloadInfo.count(); ++n)
 	{
 		const PPayloadInfo &ri = remoteVideoPayloadInfo[n];
 		if(ri.name.toUpper() == "THEORA" && ri.clockrate == 90000 && ri.id == actual_remoteVideoPayloadInfo[theora_at].id)
@@ -1767,7 +4295,7 @@ bool RtpWorker::updateTheoraConfig()
 			g_object_set(G_OBJECT(videortpsrc), "caps", caps, NULL);
 			gst_caps_unref(caps);
 
-			actual_remoteAudioPayloadInfo[theora_at] = ri;
+			actual_remoteVideoPayloadInfo[theora_at] = ri;
 			return true;
 		}
 	}
@@ -25,9 +25,12 @@
 #include <QByteArray>
 #include <QImage>
 #include <QMutex>
+#include <QAtomicInt>
+#include <QExplicitlySharedDataPointer>
 #include <gst/gst.h>
 #include "psimediaprovider.h"
 #include "gstcustomelements/gstcustomelements.h"
+#include "srtp.h"
 
 namespace PsiMedia {
 
@@ -35,16 +38,152 @@ class PipelineDeviceContext;
 
 class Stats;
 
+class LatencyTracer;
+
+class UlpFecEncoder;
+class UlpFecDecoder;
+
+class RtpIngressFilter;
+
+class ShmFrameRing;
+
+// ref-counted holder for the GstBuffer backing a zero-copy frame.  the
+//   QImage in Frame points directly at the buffer data, so the buffer must
+//   outlive every copy of the frame.  gst_buffer_unref is thread-safe, so
+//   the last copy may be dropped from any thread.
+class FrameBuffer : public QSharedData
+{
+public:
+	GstBuffer *buf;
+
+	FrameBuffer(GstBuffer *_buf) :
+		buf(_buf)
+	{
+		gst_buffer_ref(buf);
+	}
+
+	~FrameBuffer()
+	{
+		gst_buffer_unref(buf);
+	}
+
+private:
+	FrameBuffer(const FrameBuffer &);
+	FrameBuffer &operator=(const FrameBuffer &);
+};
+
+// per-stream counters for the hot paths.  updated with atomic ops only,
+//   so the streaming threads never take a lock, and any thread may read
+class StreamStats
+{
+public:
+	QAtomicInt packetsOut;
+	QAtomicInt bytesOut;
+	QAtomicInt packetsIn;
+	QAtomicInt bytesIn;
+	QAtomicInt packetsLost;
+	QAtomicInt nextRtpSeq; // (last seq seen + 1), or 0 if none yet
+
+	QAtomicInt clockrate; // rtp clock, for jitter conversion.  0 if unknown
+	QAtomicInt transit; // last packet transit time, in clock units
+	QAtomicInt jitterX16; // rfc 3550 interarrival jitter, clock units * 16
+
+	void countOut(int bytes)
+	{
+		packetsOut.ref();
+		bytesOut.fetchAndAddRelaxed(bytes);
+	}
+
+	void countIn(const PRtpPacket &packet)
+	{
+		packetsIn.ref();
+		bytesIn.fetchAndAddRelaxed(packet.rawValue.size());
+
+		// watch rtp sequence gaps to maintain the lost counter
+		if(packet.rawValue.size() < 4)
+			return;
+		const unsigned char *p = (const unsigned char *)packet.rawValue.data();
+		int seq = (p[2] << 8) | p[3];
+		int prev = nextRtpSeq.fetchAndStoreRelaxed(seq + 1);
+		if(prev != 0)
+		{
+			int gap = (seq - (prev - 1)) & 0xffff;
+			if(gap > 1 && gap < 0x8000)
+				packetsLost.fetchAndAddRelaxed(gap - 1);
+		}
+
+		// rfc 3550 interarrival jitter estimate.  relaxed atomics:
+		//   concurrent writers can only make the estimate momentarily
+		//   imprecise, never corrupt it
+		int rate = (int)clockrate;
+		if(rate > 0 && packet.rawValue.size() >= 8)
+		{
+			quint32 rtpTime = ((quint32)p[4] << 24) | ((quint32)p[5] << 16) | ((quint32)p[6] << 8) | (quint32)p[7];
+
+			GTimeVal now;
+			g_get_current_time(&now);
+			qint64 arrival = ((qint64)now.tv_sec * 1000000 + now.tv_usec) * rate / 1000000;
+
+			int t = (int)((quint32)arrival - rtpTime);
+			int prevT = transit.fetchAndStoreRelaxed(t);
+			if(prevT != 0)
+			{
+				int d = t - prevT;
+				if(d < 0)
+					d = -d;
+				int j = (int)jitterX16;
+				jitterX16.fetchAndAddRelaxed(d - ((j + 8) >> 4));
+			}
+		}
+	}
+
+	int jitterMs() const
+	{
+		int rate = (int)clockrate;
+		if(rate < 1)
+			return 0;
+		return (int)((qint64)((int)jitterX16 / 16) * 1000 / rate);
+	}
+};
+
 // Note: do not destruct this class during one of its callbacks
 class RtpWorker
 {
 public:
-	// this class exists in case we want to add metadata to the image,
-	//   such as a timestamp
+	// the image references the pixels of the underlying GstBuffer rather
+	//   than copying them.  copies of a frame share the buffer, which is
+	//   released when the last copy goes away.
 	class Frame
 	{
 	public:
 		QImage image;
+		QExplicitlySharedDataPointer<FrameBuffer> buffer;
+	};
+
+	// a frame that lives in the shared-memory ring rather than in a
+	//   buffer we own.  fd/ringSize identify the segment (they only
+	//   change when the ring is (re)created, e.g. on a resolution
+	//   bump); offset locates the pixels within it.  rgb32, tightly
+	//   packed
+	class ShmFrame
+	{
+	public:
+		int fd;
+		int ringSize;
+		int offset;
+		int width;
+		int height;
+		int stride;
+
+		ShmFrame() :
+			fd(-1),
+			ringSize(0),
+			offset(0),
+			width(0),
+			height(0),
+			stride(0)
+		{
+		}
 	};
 
 	void *app; // for callbacks
@@ -63,13 +202,88 @@ public:
 	QList<PPayloadInfo> remoteVideoPayloadInfo;
 	int maxbitrate;
 
+	// effective path mtu in bytes (largest ip packet the route
+	//   delivers unfragmented), -1 = payloader defaults.  the chain
+	//   builders derive a per-payloader budget from it, leaving room
+	//   for ip/udp, the srtp tag and the fec headers, so no emitted
+	//   packet relies on ip fragmentation
+	int pathMtu;
+
+	// voice activity detection / discontinuous transmission on the
+	//   audio send path.  the encoder replaces silence with minimal
+	//   comfort-noise frames and the worker withholds most of those
+	//   from the wire, keeping the sequence space consecutive so the
+	//   receiver sees a timestamp jump rather than loss
+	bool dtxEnabled;
+
+	// audio jitter buffer latency bounds, in milliseconds.  both -1
+	//   means fixed latency (the default).  when set, the target adapts
+	//   to the measured interarrival jitter within these bounds.
+	int jitterMinLatency;
+	int jitterMaxLatency;
+
+	// fps cap for the preview branch, <1 = full camera rate.  distinct
+	//   from the encode fps: only the self-view is throttled
+	int previewFps;
+
+	// deliver received video via the shared-memory ring (unix only).
+	//   frames arrive through cb_shmOutputFrame instead of
+	//   cb_outputFrame once the ring exists; until then (and on
+	//   platforms without shm) the normal image path is used
+	bool shmVideoExport;
+
+	// how often to fire the audio intensity callbacks, in milliseconds.
+	//   <1 (the default) means never: the meters are still maintained
+	//   in audioInputIntensity/audioOutputIntensity for polling
+	int intensityInterval;
+
 	// read-only
 	bool canTransmitAudio;
 	bool canTransmitVideo;
-	int outputVolume;
-	int inputVolume;
 	int error;
 
+	// desired volume levels, 0-100.  the setters store here wait-free
+	//   and the streaming thread applies changes to the live volume
+	//   element per buffer, so slider drags never contend with media
+	QAtomicInt outputVolume;
+	QAtomicInt inputVolume;
+
+	// video send pacing: how many packets a frame may emit back-to-back
+	//   before the remainder is smoothed out over roughly a frame
+	//   interval.  <1 (the default) sends everything immediately
+	QAtomicInt videoPaceBurst;
+
+	// whether anything downstream is consuming preview/output frames
+	//   (a widget is attached).  while 0, raw frames are dropped at the
+	//   branch entrance, before the queue and colorspace conversion, so
+	//   an unwatched branch costs nothing per frame.  updated live from
+	//   the device config
+	QAtomicInt wantPreviewFrames;
+	QAtomicInt wantOutputFrames;
+
+	// optional srtp, applied in place on the packet buffers right at
+	//   the packet callbacks (outgoing) and at rtp ingress (incoming).
+	//   internally locked, so keys may be set live from any thread.
+	//   inactive until a key is set
+	SrtpSession srtpOut;
+	SrtpSession srtpIn;
+
+	// live counters, safe to snapshot from any thread
+	StreamStats audioRtpStats;
+	StreamStats videoRtpStats;
+	QAtomicInt previewFrames;
+	QAtomicInt outputFrames;
+	QAtomicInt previewFramesRetired; // frames the ui took or overwrote,
+	QAtomicInt outputFramesRetired; //   see framesRetired()
+	QAtomicInt audioJbufLatency; // current jitter buffer target, in ms
+	QAtomicInt audioSrcDrops; // buffers discarded by the device branch queues
+	QAtomicInt videoSrcDrops;
+	QAtomicInt audioInputIntensity; // meter levels, 0-100.  output is
+	QAtomicInt audioOutputIntensity; //   -1 until audio is received
+
+	PRtpSessionStats statsSnapshot() const;
+	PResourceUsage resourceSnapshot() const;
+
 	RtpWorker(GMainContext *mainContext);
 	~RtpWorker();
 
@@ -79,7 +293,11 @@ public:
 	void transmitVideo();
 	void pauseAudio();
 	void pauseVideo();
-	void stop(); // can be called at any time after calling start
+	// can be called at any time after calling start.  the stopped
+	//   callback fires as soon as the session is detached (packets stop
+	//   flowing both ways); pipeline dismantling and device release
+	//   continue in the background afterwards
+	void stop();
 
 	// the rtp input functions are safe to call from any thread
 	void rtpAudioIn(const PRtpPacket &packet);
@@ -88,6 +306,37 @@ public:
 	void setOutputVolume(int level);
 	void setInputVolume(int level);
 
+	// from the delivery side, whenever delivered frames were painted
+	//   or overwritten unseen.  the gap between delivered and retired
+	//   drives the video sink's qos gate: when the ui stops keeping
+	//   up, the sink drops frames instead of letting displayed latency
+	//   grow.  safe from any thread
+	void framesRetired(bool preview, bool output);
+
+	// hand a consumed record chunk back for reuse.  chunks are
+	//   produced on a streaming thread and freed wherever the consumer
+	//   drops them; recycling lets the next mux page take over the
+	//   allocation instead of paying a cross-thread malloc/free per
+	//   chunk.  safe from any thread; empty buffers are ignored
+	static void recycleRecordBuffer(const QByteArray &buf);
+
+	// adjusts the live encoder immediately, without a codec update
+	//   transaction.  called in the worker thread
+	void setMaximumSendingBitrate(int kbps);
+
+	// forces the video encoder to emit a keyframe as soon as possible.
+	//   called in the worker thread
+	void requestVideoKeyframe();
+
+	// live downshift of the encoded video size: each halving divides
+	//   the configured width and height by two, 0 restores the
+	//   configured size.  the scale capsfilter is updated behind a pad
+	//   block and the encode branch is restarted in place, so audio and
+	//   the session setup are untouched; the restarted encoder opens
+	//   with fresh stream headers and a keyframe, which the payloader
+	//   announces in-band.  called in the worker thread
+	void setVideoSendDownscale(int halvings);
+
 	void recordStart();
 	void recordStop();
 
@@ -101,14 +350,26 @@ public:
 	void (*cb_audioOutputIntensity)(int value, void *app);
 	void (*cb_audioInputIntensity)(int value, void *app);
 
+	// pipeline stall watchdog: a stage that was flowing has made no
+	//   progress for a whole detection window (see PSI_WATCHDOG_MS).
+	//   stage is a short name like "video-capture".  fired once per
+	//   stall; the stage re-arms when data moves again
+	void (*cb_stalled)(const QString &stage, void *app);
+
 	// callbacks - from alternate thread, be safe!
 	//   also, it is not safe to assign callbacks except before starting
 
 	void (*cb_previewFrame)(const Frame &frame, void *app);
 	void (*cb_outputFrame)(const Frame &frame, void *app);
+	void (*cb_shmOutputFrame)(const ShmFrame &frame, void *app);
 	void (*cb_rtpAudioOut)(const PRtpPacket &packet, void *app);
 	void (*cb_rtpVideoOut)(const PRtpPacket &packet, void *app);
 
+	// talkspurt boundaries detected by the dtx gate.  fired on silence
+	//   onset (false) and speech resumption (true); never fired while
+	//   dtx is disabled
+	void (*cb_audioTalkingChanged)(bool talking, void *app);
+
 	 // empty record packet = EOF/error
 	void (*cb_recordData)(const QByteArray &packet, void *app);
 
@@ -116,28 +377,142 @@ private:
 	GMainContext *mainContext_;
 	GSource *timer;
 
+	// async send startup.  startSend() returns before the pipeline
+	//   reaches PLAYING; completion is driven by bus messages and by
+	//   caps negotiation on the payloaders, with a timeout backstop.
+	//   the started/updated callback owed to the app is remembered
+	//   here and fired on completion
+	bool sendStartPending;
+	bool startNotifyPending;
+	bool updateNotifyPending;
+	GSource *startTimeout;
+	GSource *busWatch;
+
 	PipelineDeviceContext *pd_audiosrc, *pd_videosrc, *pd_audiosink;
 	GstElement *sendbin, *recvbin;
 
 	GstElement *fileDemux;
+	GstElement *audiojbuf;
+	GSource *jbufTimer;
+	GSource *intensityTimer;
+	GSource *watchdogTimer;
+	GstElement *videoencoder; // inside sendbin, for live bitrate pokes
+
+	// live resolution downshift.  videoencbin is the whole encode
+	//   branch (convert/encode/payload), restarted in place when the
+	//   size changes; videoprepScaleFilter is the size capsfilter ahead
+	//   of the send tee.  videoAdaptCaps stages the new caps for the
+	//   blocked callback, guarded by videoadapt_mutex (the callback
+	//   runs on a streaming thread)
+	GstElement *videoencbin;
+	GstElement *videoprepScaleFilter;
+	QSize videoSendBaseSize;
+	int videoSendDownscale;
+	GstCaps *videoAdaptCaps;
+	QMutex videoadapt_mutex;
+
+	// rfc 5109 protection for the video rtp path.  the encoder exists
+	//   only when the peer negotiated fec (guarded by rtpvideoout_mutex),
+	//   the decoder whenever we receive video (guarded by
+	//   videortpsrc_mutex)
+	UlpFecEncoder *videoFecEnc;
+	UlpFecDecoder *videoFecDec;
+
+	// shared-memory frame export.  the ring is created lazily on the
+	//   first output frame (that's when we learn the size) and attached
+	//   to the output sink.  both are touched only from the streaming
+	//   thread while the pipeline runs, and from the worker thread after
+	//   recvbin teardown
+	ShmFrameRing *shmRing;
+	GstAppVideoSink *shmOutputSink;
+
+	// sanity/duplicate filters at the rtp ingress, created when
+	//   receiving is set up.  guarded by the matching rtpsrc mutex
+	RtpIngressFilter *audioIngress;
+	RtpIngressFilter *videoIngress;
+
+	// pacing state for outgoing video, guarded by pace_mutex.  the
+	//   timer lives on the worker's glib context and drains the queue
+	//   a few packets per tick
+	QList<PRtpPacket> paceQueue;
+	GSource *paceTimer;
+	int frameBurstUsed;
+	QMutex pace_mutex;
 	GstElement *audiosrc;
 	GstElement *videosrc;
 	GstElement *audiortpsrc;
 	GstElement *videortpsrc;
 	GstElement *audiortppay;
 	GstElement *videortppay;
+	GstElement *videortppay2; // low-resolution simulcast layer, if any
 	GstElement *volumein;
 	GstElement *volumeout;
+
+	// levels last written to the volume elements, touched only by the
+	//   probes on their src pads (i.e. the streaming threads)
+	int lastAppliedInputVolume;
+	int lastAppliedOutputVolume;
 	bool rtpaudioout;
 	bool rtpvideoout;
+	bool send_shared; // true if riding another session's encoder
 	QMutex audiortpsrc_mutex;
 	QMutex videortpsrc_mutex;
-	QMutex volumein_mutex;
-	QMutex volumeout_mutex;
 	QMutex rtpaudioout_mutex;
 	QMutex rtpvideoout_mutex;
 
-	//GSource *recordTimer;
+	// recording.  the record chain taps the encoded streams off the
+	//   send encoders (no second encode) and muxes them to ogg (or
+	//   matroska, see PSI_RECORD_CONTAINER).  it runs for the whole
+	//   session so the header pages are always captured; data is only
+	//   delivered to the app while recording is on.  guarded by
+	//   record_mutex (the mux sink delivers on a streaming thread)
+	bool recording;
+	bool recordTapped;
+	bool recordMuxIsMatroska;
+	bool recordHeadersDone;
+	bool recordHeadersSent;
+	QByteArray recordHeaders;
+	QMutex record_mutex;
+
+	// pipeline stall watchdog.  each monitored stage owns a heartbeat
+	//   bumped as buffers pass its probe or packet callback; a
+	//   low-frequency timer on the worker context samples them and
+	//   flags a stage that was flowing but made no progress for a
+	//   whole window.  the ingress stages are tracked only as feeders:
+	//   network silence is normal, not a pipeline fault
+	enum WatchStage
+	{
+		Watch_AudioCapture,
+		Watch_AudioEncode,
+		Watch_AudioPlayback,
+		Watch_VideoCapture,
+		Watch_VideoEncode,
+		Watch_VideoDecode,
+		Watch_AudioIngress,
+		Watch_VideoIngress,
+		WatchStageCount
+	};
+
+	class WatchState
+	{
+	public:
+		QAtomicInt heartbeat; // bumped by the stage as data passes
+		int lastSeen; // heartbeat at the previous sample
+		bool alive; // stage has shown progress this setup
+		bool reported; // stalled and not yet recovered
+	};
+
+	WatchState watch[WatchStageCount];
+	QAtomicInt stallCounts[WatchStageCount]; // cumulative, for stats
+
+	// dtx gate state, touched only from the audio packet callbacks
+	//   (i.e. one streaming thread).  the sequence offset survives dtx
+	//   being turned off, since the wire sequence must stay consecutive
+	//   for the rest of the stream
+	bool audioTalking;
+	int audioSilenceRun;
+	int audioSilenceKeep;
+	quint16 audioDtxSeqOffset;
 
 	QList<PPayloadInfo> actual_localAudioPayloadInfo;
 	QList<PPayloadInfo> actual_localVideoPayloadInfo;
@@ -147,39 +522,116 @@ private:
 	Stats *audioStats;
 	Stats *videoStats;
 
+	// per-thread cpu accounting.  gstreamer offers no way to enumerate a
+	//   pipeline's streaming threads, but every media path runs through
+	//   one of our probes or app sinks, so each passing buffer samples
+	//   its own thread's cpu clock and the deltas are folded into this
+	//   slot table.  guarded by cpu_mutex; the critical section is a
+	//   pointer compare and two stores, cheap enough for the hot paths
+	class ThreadCpuSlot
+	{
+	public:
+		GThread *thread;
+		qint64 baseNs; // thread cpu clock at first sighting
+		qint64 lastNs; // most recent sample
+	};
+
+	enum { MaxCpuSlots = 16 };
+	ThreadCpuSlot cpuSlots[MaxCpuSlots];
+	int cpuSlotCount;
+	mutable QMutex cpu_mutex;
+
+	void accountThreadCpu();
+
+	// per-stage latency probes, only created when PSI_TRACE_LATENCY=1.
+	//   dumped through the stats poll
+	LatencyTracer *audioTrace;
+	LatencyTracer *videoTrace;
+
 	void cleanup();
 
 	static gboolean cb_doStart(gpointer data);
 	static gboolean cb_doUpdate(gpointer data);
 	static gboolean cb_doStop(gpointer data);
+	static gboolean cb_doDeferredCleanup(gpointer data);
 	static void cb_fileDemux_no_more_pads(GstElement *element, gpointer data);
 	static void cb_fileDemux_pad_added(GstElement *element, GstPad *pad, gpointer data);
 	static void cb_fileDemux_pad_removed(GstElement *element, GstPad *pad, gpointer data);
 	static gboolean cb_bus_call(GstBus *bus, GstMessage *msg, gpointer data);
-	static void cb_show_frame_preview(int width, int height, const unsigned char *rgb32, gpointer data);
-	static void cb_show_frame_output(int width, int height, const unsigned char *rgb32, gpointer data);
+	static void cb_show_frame_preview(int width, int height, GstBuffer *buf, gpointer data);
+	static void cb_show_frame_output(int width, int height, GstBuffer *buf, gpointer data);
+	static void cb_show_frame_shm_output(int width, int height, int slot, gpointer data);
+	static gboolean cb_frame_wanted_preview(gpointer data);
+	static gboolean cb_frame_wanted_output(gpointer data);
+	static gboolean cb_video_preview_gate(GstPad *pad, GstBuffer *buf, gpointer data);
+	static gboolean cb_video_output_gate(GstPad *pad, GstBuffer *buf, gpointer data);
 	static void cb_packet_ready_rtp_audio(const unsigned char *buf, int size, gpointer data);
+	static void cb_packets_ready_rtp_audio(const GstAppRtpPacket *packets, int count, gpointer data);
 	static void cb_packet_ready_rtp_video(const unsigned char *buf, int size, gpointer data);
+	static void cb_packet_ready_rtp_video_low(const unsigned char *buf, int size, gpointer data);
+	static void cb_record_mux_packet(const unsigned char *buf, int size, gpointer data);
 	static gboolean cb_fileReady(gpointer data);
+	static gboolean cb_doAdaptJbuf(gpointer data);
+	static gboolean cb_doIntensity(gpointer data);
+	static gboolean cb_doWatchdog(gpointer data);
+	static gboolean cb_audio_in_buffer(GstPad *pad, GstBuffer *buf, gpointer data);
+	static gboolean cb_audio_out_buffer(GstPad *pad, GstBuffer *buf, gpointer data);
+	static gboolean cb_doPaceVideo(gpointer data);
+	static gboolean cb_checkSendStarted(gpointer data);
+	static gboolean cb_doStartTimeout(gpointer data);
+	static void cb_payloader_caps_notify(GObject *obj, GParamSpec *pspec, gpointer data);
+	static void cb_videoprep_blocked(GstPad *pad, gboolean blocked, gpointer data);
 
 	gboolean doStart();
 	gboolean doUpdate();
 	gboolean doStop();
+	gboolean doDeferredCleanup();
 	void fileDemux_no_more_pads(GstElement *element);
 	void fileDemux_pad_added(GstElement *element, GstPad *pad);
 	void fileDemux_pad_removed(GstElement *element, GstPad *pad);
 	gboolean bus_call(GstBus *bus, GstMessage *msg);
-	void show_frame_preview(int width, int height, const unsigned char *rgb32);
-	void show_frame_output(int width, int height, const unsigned char *rgb32);
+	void show_frame_preview(int width, int height, GstBuffer *buf);
+	void show_frame_output(int width, int height, GstBuffer *buf);
+	void show_frame_shm_output(int width, int height, int slot);
 	void packet_ready_rtp_audio(const unsigned char *buf, int size);
+	void packets_ready_rtp_audio(const GstAppRtpPacket *packets, int count);
 	void packet_ready_rtp_video(const unsigned char *buf, int size);
+	void packet_ready_rtp_video_low(const unsigned char *buf, int size);
+	void record_mux_packet(const unsigned char *buf, int size);
 	gboolean fileReady();
+	gboolean doAdaptJbuf();
+	gboolean doIntensity();
+	void updateIntensityTimer();
+	gboolean doWatchdog();
+	void restartWatchdog();
+	gboolean doPaceVideo();
+	void paceOrSendVideo(const PRtpPacket &packet);
+	void sendVideoPacketNow(const PRtpPacket &packet);
+	int payloaderMtu(bool video) const;
+	bool dtxProcessAudioPacket(QByteArray *buf);
+	gboolean checkSendStarted();
+	gboolean doStartTimeout();
+	void scheduleSendStartCheck();
+	void failSendStart();
+	void videoprep_blocked(GstPad *pad, gboolean blocked);
+
+	// devices actually in use, so update() can detect changes
+	QString used_aout;
+	QString used_ain;
+	QString used_vin;
 
 	bool setupSendRecv();
+	bool attachSendConsumer();
+	void consumer_packet_audio(const PRtpPacket &packet);
+	void consumer_packet_video(const PRtpPacket &packet);
+	bool replaceAudioInput();
+	bool replaceVideoInput();
+	bool replaceAudioOutput();
 	bool startSend();
 	bool startRecv();
 	bool addAudioChain();
 	bool addVideoChain();
+	void addRecordChain();
 	bool getCaps();
 	bool updateTheoraConfig();
 };
@@ -23,53 +23,11 @@
 #include <QPointer>
 #include "gstthread.h"
 #include "rtpworker.h"
-
-// note: queuing frames doesn't really make much sense, since if the UI
-//   receives 5 frames at once, they'll just get painted on each other in
-//   succession and you'd only really see the last one.  however, we'll queue
-//   frames in case we ever want to do timestamped frames.
-#define QUEUE_FRAME_MAX 10
+#include "payloadinfo.h"
+#include "gstcustomelements/bufmon.h"
 
 namespace PsiMedia {
 
-static int queuedFrameInfo(const QList<RwControlMessage*> &list, RwControlFrame::Type type, int *firstPos)
-{
-	int count = 0;
-	bool first = true;
-	for(int n = 0; n < list.count(); ++n)
-	{
-		const RwControlMessage *msg = list[n];
-		if(msg->type == RwControlMessage::Frame && ((RwControlFrameMessage *)msg)->frame.type == type)
-		{
-			if(first)
-				*firstPos = n;
-			++count;
-			first = false;
-		}
-	}
-	return count;
-}
-
-static RwControlFrameMessage *getLatestFrameAndRemoveOthers(QList<RwControlMessage*> *list, RwControlFrame::Type type)
-{
-	RwControlFrameMessage *fmsg = 0;
-	for(int n = 0; n < list->count(); ++n)
-	{
-		RwControlMessage *msg = list->at(n);
-		if(msg->type == RwControlMessage::Frame && ((RwControlFrameMessage *)msg)->frame.type == type)
-		{
-			// if we already had a frame, discard it and take the next
-			if(fmsg)
-				delete fmsg;
-
-			fmsg = (RwControlFrameMessage *)msg;
-			list->removeAt(n);
-			--n; // adjust position
-		}
-	}
-	return fmsg;
-}
-
 static RwControlAudioIntensityMessage *getLatestAudioIntensityAndRemoveOthers(QList<RwControlMessage*> *list, RwControlAudioIntensity::Type type)
 {
 	RwControlAudioIntensityMessage *amsg = 0;
@@ -131,6 +89,16 @@ static void applyDevicesToWorker(RtpWorker *worker, const RwControlConfigDevices
 	worker->infile = devices.fileNameIn;
 	worker->indata = devices.fileDataIn;
 	worker->loopFile = devices.loopFile;
+	worker->jitterMinLatency = devices.jitterMinLatency;
+	worker->jitterMaxLatency = devices.jitterMaxLatency;
+	worker->videoPaceBurst.fetchAndStoreOrdered(devices.videoPaceBurst);
+	worker->previewFps = devices.previewFps;
+	worker->wantPreviewFrames.fetchAndStoreOrdered(devices.useVideoPreview ? 1 : 0);
+	worker->wantOutputFrames.fetchAndStoreOrdered(devices.useVideoOut ? 1 : 0);
+	worker->shmVideoExport = devices.shmVideoExport;
+	worker->intensityInterval = devices.audioIntensityInterval;
+	worker->srtpOut.setKey(devices.srtpOutKey);
+	worker->srtpIn.setKey(devices.srtpInKey);
 	worker->setOutputVolume(devices.audioOutVolume);
 	worker->setInputVolume(devices.audioInVolume);
 }
@@ -147,6 +115,66 @@ static void applyCodecsToWorker(RtpWorker *worker, const RwControlConfigCodecs &
 		worker->remoteVideoPayloadInfo = codecs.remoteVideoPayloadInfo;
 
 	worker->maxbitrate = codecs.maximumSendingBitrate;
+	worker->pathMtu = codecs.pathMtu;
+	worker->dtxEnabled = codecs.dtxEnabled;
+}
+
+static bool audioParamsListEqual(const QList<PAudioParams> &a, const QList<PAudioParams> &b)
+{
+	if(a.count() != b.count())
+		return false;
+	for(int n = 0; n < a.count(); ++n)
+	{
+		if(a[n].codec != b[n].codec ||
+			a[n].sampleRate != b[n].sampleRate ||
+			a[n].sampleSize != b[n].sampleSize ||
+			a[n].channels != b[n].channels ||
+			a[n].ptime != b[n].ptime)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool videoParamsListEqual(const QList<PVideoParams> &a, const QList<PVideoParams> &b)
+{
+	if(a.count() != b.count())
+		return false;
+	for(int n = 0; n < a.count(); ++n)
+	{
+		if(a[n].codec != b[n].codec ||
+			a[n].size != b[n].size ||
+			a[n].fps != b[n].fps ||
+			a[n].encodePreset != b[n].encodePreset)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// returns true if applying this codec config to the worker would change
+//   nothing.  our signaling commonly resends the full payload lists
+//   verbatim, so this is worth detecting before paying for a pipeline
+//   update
+static bool codecsUnchanged(const RtpWorker *worker, const RwControlConfigCodecs &codecs)
+{
+	if(codecs.useLocalAudioParams && !audioParamsListEqual(codecs.localAudioParams, worker->localAudioParams))
+		return false;
+	if(codecs.useLocalVideoParams && !videoParamsListEqual(codecs.localVideoParams, worker->localVideoParams))
+		return false;
+	if(codecs.useRemoteAudioPayloadInfo && !payloadInfoListEqual(codecs.remoteAudioPayloadInfo, worker->remoteAudioPayloadInfo))
+		return false;
+	if(codecs.useRemoteVideoPayloadInfo && !payloadInfoListEqual(codecs.remoteVideoPayloadInfo, worker->remoteVideoPayloadInfo))
+		return false;
+	if(codecs.maximumSendingBitrate != worker->maxbitrate)
+		return false;
+	if(codecs.pathMtu != worker->pathMtu)
+		return false;
+	if(codecs.dtxEnabled != worker->dtxEnabled)
+		return false;
+	return true;
 }
 
 //----------------------------------------------------------------------------
@@ -158,29 +186,49 @@ RwControlLocal::RwControlLocal(GstThread *thread, QObject *parent) :
 	cb_rtpAudioOut(0),
 	cb_rtpVideoOut(0),
 	cb_recordData(0),
-	wake_pending(false)
+	wake_pending(false),
+	shmFrameDirty(false)
 {
+	for(int n = 0; n < RwControlFrame::TypeCount; ++n)
+		frameDirty[n] = false;
+
 	thread_ = thread;
 	remote_ = 0;
 
-	// create RwControlRemote, block until ready
-	QMutexLocker locker(&m);
-	timer = g_timeout_source_new(0);
-	g_source_set_callback(timer, cb_doCreateRemote, this, NULL);
-	g_source_attach(timer, thread_->mainContext());
-	w.wait(&m);
+	// create RwControlRemote in the background.  we don't wait for
+	//   it: messages posted in the meantime are queued and flushed
+	//   once it exists, so session creation never stalls the qt
+	//   eventloop behind a busy gst thread
+	thread_->postTask(cb_doCreateRemote, this);
 }
 
 RwControlLocal::~RwControlLocal()
 {
-	// delete RwControlRemote, block until done
+	// delete RwControlRemote, block until done.  tasks run in post
+	//   order, so this always happens after the deferred creation
 	QMutexLocker locker(&m);
-	timer = g_timeout_source_new(0);
-	g_source_set_callback(timer, cb_doDestroyRemote, this, NULL);
-	g_source_attach(timer, thread_->mainContext());
+	thread_->postTask(cb_doDestroyRemote, this);
 	w.wait(&m);
 
+	qDeleteAll(pending);
 	qDeleteAll(in);
+
+	for(int n = 0; n < RwControlFrame::TypeCount; ++n)
+	{
+		if(frameDirty[n])
+			psi_bufmon_remove(PSI_BUFMON_FRAME);
+	}
+}
+
+// post a message to the remote object, or queue it if the remote object
+//   doesn't exist yet
+void RwControlLocal::postToRemote(RwControlMessage *msg)
+{
+	QMutexLocker locker(&m);
+	if(remote_)
+		remote_->postMessage(msg);
+	else
+		pending += msg;
 }
 
 void RwControlLocal::start(const RwControlConfigDevices &devices, const RwControlConfigCodecs &codecs)
@@ -188,104 +236,195 @@ void RwControlLocal::start(const RwControlConfigDevices &devices, const RwContro
 	RwControlStartMessage *msg = new RwControlStartMessage;
 	msg->devices = devices;
 	msg->codecs = codecs;
-	remote_->postMessage(msg);
+	postToRemote(msg);
 }
 
 void RwControlLocal::stop()
 {
 	RwControlStopMessage *msg = new RwControlStopMessage;
-	remote_->postMessage(msg);
+	postToRemote(msg);
 }
 
 void RwControlLocal::updateDevices(const RwControlConfigDevices &devices)
 {
 	RwControlUpdateDevicesMessage *msg = new RwControlUpdateDevicesMessage;
 	msg->devices = devices;
-	remote_->postMessage(msg);
+	postToRemote(msg);
 }
 
 void RwControlLocal::updateCodecs(const RwControlConfigCodecs &codecs)
 {
 	RwControlUpdateCodecsMessage *msg = new RwControlUpdateCodecsMessage;
 	msg->codecs = codecs;
-	remote_->postMessage(msg);
+	postToRemote(msg);
 }
 
 void RwControlLocal::setTransmit(const RwControlTransmit &transmit)
 {
 	RwControlTransmitMessage *msg = new RwControlTransmitMessage;
 	msg->transmit = transmit;
-	remote_->postMessage(msg);
+	postToRemote(msg);
 }
 
 void RwControlLocal::setRecord(const RwControlRecord &record)
 {
 	RwControlRecordMessage *msg = new RwControlRecordMessage;
 	msg->record = record;
-	remote_->postMessage(msg);
+	postToRemote(msg);
+}
+
+void RwControlLocal::setMaximumSendingBitrate(int kbps)
+{
+	RwControlMaxBitrateMessage *msg = new RwControlMaxBitrateMessage;
+	msg->kbps = kbps;
+	postToRemote(msg);
+}
+
+void RwControlLocal::requestVideoKeyframe()
+{
+	postToRemote(new RwControlKeyframeMessage);
+}
+
+void RwControlLocal::setVideoSendDownscale(int halvings)
+{
+	RwControlVideoDownscaleMessage *msg = new RwControlVideoDownscaleMessage;
+	msg->halvings = halvings;
+	postToRemote(msg);
 }
 
 void RwControlLocal::rtpAudioIn(const PRtpPacket &packet)
 {
-	remote_->rtpAudioIn(packet);
+	QMutexLocker locker(&m);
+	if(remote_)
+		remote_->rtpAudioIn(packet);
 }
 
 void RwControlLocal::rtpVideoIn(const PRtpPacket &packet)
 {
-	remote_->rtpVideoIn(packet);
+	QMutexLocker locker(&m);
+	if(remote_)
+		remote_->rtpVideoIn(packet);
+}
+
+PRtpSessionStats RwControlLocal::statistics() const
+{
+	QMutexLocker locker(&m);
+	if(!remote_)
+		return PRtpSessionStats();
+	return remote_->statistics();
+}
+
+int RwControlLocal::audioInputIntensity() const
+{
+	QMutexLocker locker(&m);
+	if(!remote_)
+		return 0;
+	return remote_->audioInputIntensity();
+}
+
+int RwControlLocal::audioOutputIntensity() const
+{
+	QMutexLocker locker(&m);
+	if(!remote_)
+		return -1;
+	return remote_->audioOutputIntensity();
+}
+
+PResourceUsage RwControlLocal::resourceUsage() const
+{
+	QMutexLocker locker(&m);
+	if(!remote_)
+		return PResourceUsage();
+	return remote_->resourceUsage();
 }
 
 // note: this is executed in the remote thread
-gboolean RwControlLocal::cb_doCreateRemote(gpointer data)
+void RwControlLocal::cb_doCreateRemote(void *data)
 {
-	return ((RwControlLocal *)data)->doCreateRemote();
+	((RwControlLocal *)data)->doCreateRemote();
 }
 
 // note: this is executed in the remote thread
-gboolean RwControlLocal::doCreateRemote()
+void RwControlLocal::doCreateRemote()
 {
 	QMutexLocker locker(&m);
-	timer = 0;
 	remote_ = new RwControlRemote(thread_->mainContext(), this);
-	w.wakeOne();
-	return FALSE;
+
+	// flush anything posted while we didn't exist, in order
+	while(!pending.isEmpty())
+		remote_->postMessage(pending.takeFirst());
 }
 
 // note: this is executed in the remote thread
-gboolean RwControlLocal::cb_doDestroyRemote(gpointer data)
+void RwControlLocal::cb_doDestroyRemote(void *data)
 {
-	return ((RwControlLocal *)data)->doDestroyRemote();
+	((RwControlLocal *)data)->doDestroyRemote();
 }
 
 // note: this is executed in the remote thread
-gboolean RwControlLocal::doDestroyRemote()
+void RwControlLocal::doDestroyRemote()
 {
 	QMutexLocker locker(&m);
-	timer = 0;
 	delete remote_;
 	remote_ = 0;
 	w.wakeOne();
-	return FALSE;
 }
 
 void RwControlLocal::processMessages()
 {
 	in_mutex.lock();
 	wake_pending = false;
-	QList<RwControlMessage*> list = in;
-	in.clear();
+
+	// swap the queue out whole rather than copy-and-clear, so the
+	//   time under the lock doesn't grow with the backlog
+	QList<RwControlMessage*> list;
+	qSwap(list, in);
 	in_mutex.unlock();
 
+	// take the newest frames out of their slots.  frames never ride
+	//   the queue: each slot always holds the latest, and anything in
+	//   between was overwritten without ever being allocated for
+	RtpWorker::Frame frames[RwControlFrame::TypeCount];
+	bool haveFrame[RwControlFrame::TypeCount];
+	frame_mutex.lock();
+	for(int n = 0; n < RwControlFrame::TypeCount; ++n)
+	{
+		haveFrame[n] = frameDirty[n];
+		if(frameDirty[n])
+		{
+			frames[n] = frameSlot[n];
+			frameSlot[n] = RtpWorker::Frame();
+			frameDirty[n] = false;
+			psi_bufmon_remove(PSI_BUFMON_FRAME);
+		}
+	}
+	RtpWorker::ShmFrame shmFrame;
+	bool haveShmFrame = shmFrameDirty;
+	if(shmFrameDirty)
+	{
+		shmFrame = shmFrameSlot;
+		shmFrameDirty = false;
+	}
+	frame_mutex.unlock();
+
+	// report consumption back to the worker's qos gate.  frames taken
+	//   from the slots are committed to the ui here, so count them
+	//   before the emits below (which may destroy us)
+	if(haveFrame[RwControlFrame::Preview] || haveFrame[RwControlFrame::Output] || haveShmFrame)
+	{
+		QMutexLocker locker(&m);
+		if(remote_)
+		{
+			remote_->framesRetired(haveFrame[RwControlFrame::Preview],
+				haveFrame[RwControlFrame::Output] || haveShmFrame);
+		}
+	}
+
 	QPointer<QObject> self = this;
 
-	// we only care about the latest preview frame
-	RwControlFrameMessage *fmsg;
-	fmsg = getLatestFrameAndRemoveOthers(&list, RwControlFrame::Preview);
-	if(fmsg)
+	if(haveFrame[RwControlFrame::Preview])
 	{
-		QImage i = fmsg->frame.image;
-		delete fmsg;
-		emit previewFrame(i);
+		emit previewFrame(frames[RwControlFrame::Preview]);
 		if(!self)
 		{
 			qDeleteAll(list);
@@ -293,13 +432,19 @@ void RwControlLocal::processMessages()
 		}
 	}
 
-	// we only care about the latest output frame
-	fmsg = getLatestFrameAndRemoveOthers(&list, RwControlFrame::Output);
-	if(fmsg)
+	if(haveFrame[RwControlFrame::Output])
 	{
-		QImage i = fmsg->frame.image;
-		delete fmsg;
-		emit outputFrame(i);
+		emit outputFrame(frames[RwControlFrame::Output]);
+		if(!self)
+		{
+			qDeleteAll(list);
+			return;
+		}
+	}
+
+	if(haveShmFrame)
+	{
+		emit shmOutputFrame(shmFrame);
 		if(!self)
 		{
 			qDeleteAll(list);
@@ -342,9 +487,22 @@ void RwControlLocal::processMessages()
 		if(msg->type == RwControlMessage::Status)
 		{
 			RwControlStatusMessage *smsg = (RwControlStatusMessage *)msg;
-			RwControlStatus status = smsg->status;
+			emit statusReady(smsg->status);
 			delete smsg;
-			emit statusReady(status);
+			if(!self)
+			{
+				qDeleteAll(list);
+				return;
+			}
+		}
+		else if(msg->type == RwControlMessage::AudioTalking)
+		{
+			// every transition matters, so these are delivered in
+			//   order rather than coalesced like intensity
+			RwControlAudioTalkingMessage *tmsg = (RwControlAudioTalkingMessage *)msg;
+			bool talking = tmsg->talking;
+			delete tmsg;
+			emit audioTalkingChanged(talking);
 			if(!self)
 			{
 				qDeleteAll(list);
@@ -361,35 +519,111 @@ void RwControlLocal::postMessage(RwControlMessage *msg)
 {
 	QMutexLocker locker(&in_mutex);
 
-	// if this is a frame, and the queue is maxed, then bump off the
-	//   oldest frame to make room
-	if(msg->type == RwControlMessage::Frame)
+	in += msg;
+	if(!wake_pending)
 	{
-		RwControlFrameMessage *fmsg = (RwControlFrameMessage *)msg;
-		int firstPos = -1;
-		if(queuedFrameInfo(in, fmsg->frame.type, &firstPos) >= QUEUE_FRAME_MAX)
-			in.removeAt(firstPos);
+		QMetaObject::invokeMethod(this, "processMessages", Qt::QueuedConnection);
+		wake_pending = true;
 	}
+}
 
-	in += msg;
+// note: this may be called from the remote thread.  nothing is allocated
+//   or queued per frame: the slot is overwritten in place and we share
+//   the message queue's wake coalescing
+bool RwControlLocal::postFrame(RwControlFrame::Type type, const RtpWorker::Frame &frame)
+{
+	frame_mutex.lock();
+	bool overwrote = frameDirty[type];
+	if(!overwrote)
+		psi_bufmon_add(PSI_BUFMON_FRAME);
+	frameSlot[type] = frame;
+	frameDirty[type] = true;
+	frame_mutex.unlock();
+
+	QMutexLocker locker(&in_mutex);
+	if(!wake_pending)
+	{
+		QMetaObject::invokeMethod(this, "processMessages", Qt::QueuedConnection);
+		wake_pending = true;
+	}
+
+	return overwrote;
+}
+
+// same idea for shm frames, except the slot holds only a descriptor
+//   and offset: the pixels never leave the shared segment
+bool RwControlLocal::postShmFrame(const RtpWorker::ShmFrame &frame)
+{
+	frame_mutex.lock();
+	bool overwrote = shmFrameDirty;
+	shmFrameSlot = frame;
+	shmFrameDirty = true;
+	frame_mutex.unlock();
+
+	QMutexLocker locker(&in_mutex);
 	if(!wake_pending)
 	{
 		QMetaObject::invokeMethod(this, "processMessages", Qt::QueuedConnection);
 		wake_pending = true;
 	}
+
+	return overwrote;
 }
 
 //----------------------------------------------------------------------------
 // RwControlRemote
 //----------------------------------------------------------------------------
+
+// a single long-lived source acting as a mailbox for the remote message
+//   queue.  it fires whenever messages are pending, so posting a message
+//   only needs to wake the loop rather than attach a fresh zero-timeout
+//   source every time
+struct RwControlMailboxSource
+{
+	GSource source;
+	RwControlRemote *remote;
+};
+
+static gboolean mailbox_source_prepare(GSource *source, gint *timeout)
+{
+	*timeout = -1;
+	return ((RwControlMailboxSource *)source)->remote->messagesPending() ? TRUE : FALSE;
+}
+
+static gboolean mailbox_source_check(GSource *source)
+{
+	return ((RwControlMailboxSource *)source)->remote->messagesPending() ? TRUE : FALSE;
+}
+
+static gboolean mailbox_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+	Q_UNUSED(source);
+	return callback(user_data);
+}
+
+static GSourceFuncs mailbox_source_funcs =
+{
+	mailbox_source_prepare,
+	mailbox_source_check,
+	mailbox_source_dispatch,
+	NULL,
+	NULL,
+	NULL
+};
+
 RwControlRemote::RwControlRemote(GMainContext *mainContext, RwControlLocal *local) :
-	timer(0),
 	start_requested(false),
 	blocking(false),
 	pending_status(false)
 {
 	mainContext_ = mainContext;
 	local_ = local;
+
+	mailbox = g_source_new(&mailbox_source_funcs, sizeof(RwControlMailboxSource));
+	((RwControlMailboxSource *)mailbox)->remote = this;
+	g_source_set_callback(mailbox, cb_processMessages, this, NULL);
+	g_source_attach(mailbox, mainContext_);
+
 	worker = new RtpWorker(mainContext_);
 	worker->app = this;
 	worker->cb_started = cb_worker_started;
@@ -399,8 +633,11 @@ RwControlRemote::RwControlRemote(GMainContext *mainContext, RwControlLocal *loca
 	worker->cb_error = cb_worker_error;
 	worker->cb_audioOutputIntensity = cb_worker_audioOutputIntensity;
 	worker->cb_audioInputIntensity = cb_worker_audioInputIntensity;
+	worker->cb_audioTalkingChanged = cb_worker_audioTalkingChanged;
+	worker->cb_stalled = cb_worker_stalled;
 	worker->cb_previewFrame = cb_worker_previewFrame;
 	worker->cb_outputFrame = cb_worker_outputFrame;
+	worker->cb_shmOutputFrame = cb_worker_shmOutputFrame;
 	worker->cb_rtpAudioOut = cb_worker_rtpAudioOut;
 	worker->cb_rtpVideoOut = cb_worker_rtpVideoOut;
 	worker->cb_recordData = cb_worker_recordData;
@@ -410,9 +647,18 @@ RwControlRemote::~RwControlRemote()
 {
 	delete worker;
 
+	g_source_destroy(mailbox);
+	g_source_unref(mailbox);
+
 	qDeleteAll(in);
 }
 
+bool RwControlRemote::messagesPending()
+{
+	QMutexLocker locker(&m);
+	return (!blocking && !in.isEmpty());
+}
+
 gboolean RwControlRemote::cb_processMessages(gpointer data)
 {
 	return ((RwControlRemote *)data)->processMessages();
@@ -453,6 +699,16 @@ void RwControlRemote::cb_worker_audioInputIntensity(int value, void *app)
 	((RwControlRemote *)app)->worker_audioInputIntensity(value);
 }
 
+void RwControlRemote::cb_worker_audioTalkingChanged(bool talking, void *app)
+{
+	((RwControlRemote *)app)->worker_audioTalkingChanged(talking);
+}
+
+void RwControlRemote::cb_worker_stalled(const QString &stage, void *app)
+{
+	((RwControlRemote *)app)->worker_stalled(stage);
+}
+
 void RwControlRemote::cb_worker_previewFrame(const RtpWorker::Frame &frame, void *app)
 {
 	((RwControlRemote *)app)->worker_previewFrame(frame);
@@ -463,6 +719,11 @@ void RwControlRemote::cb_worker_outputFrame(const RtpWorker::Frame &frame, void
 	((RwControlRemote *)app)->worker_outputFrame(frame);
 }
 
+void RwControlRemote::cb_worker_shmOutputFrame(const RtpWorker::ShmFrame &frame, void *app)
+{
+	((RwControlRemote *)app)->worker_shmOutputFrame(frame);
+}
+
 void RwControlRemote::cb_worker_rtpAudioOut(const PRtpPacket &packet, void *app)
 {
 	((RwControlRemote *)app)->worker_rtpAudioOut(packet);
@@ -480,14 +741,10 @@ void RwControlRemote::cb_worker_recordData(const QByteArray &packet, void *app)
 
 gboolean RwControlRemote::processMessages()
 {
-	m.lock();
-	timer = 0;
-	m.unlock();
-
 	while(1)
 	{
 		m.lock();
-		if(in.isEmpty())
+		if(blocking || in.isEmpty())
 		{
 			m.unlock();
 			break;
@@ -507,17 +764,13 @@ gboolean RwControlRemote::processMessages()
 		{
 			m.lock();
 			blocking = true;
-			if(timer)
-			{
-				g_source_destroy(timer);
-				timer = 0;
-			}
 			m.unlock();
 			break;
 		}
 	}
 
-	return FALSE;
+	// the mailbox source is persistent
+	return TRUE;
 }
 
 bool RwControlRemote::processMessage(RwControlMessage *msg)
@@ -569,6 +822,14 @@ bool RwControlRemote::processMessage(RwControlMessage *msg)
 	{
 		RwControlUpdateCodecsMessage *umsg = (RwControlUpdateCodecsMessage *)msg;
 
+		// no-op update: reply with current status right away instead
+		//   of rebuilding caps and poking the pipeline
+		if(codecsUnchanged(worker, umsg->codecs))
+		{
+			local_->postMessage(statusFromWorker(worker));
+			return true;
+		}
+
 		applyCodecsToWorker(worker, umsg->codecs);
 
 		pending_status = true;
@@ -589,6 +850,22 @@ bool RwControlRemote::processMessage(RwControlMessage *msg)
 		else
 			worker->pauseVideo();
 	}
+	else if(msg->type == RwControlMessage::MaxBitrate)
+	{
+		RwControlMaxBitrateMessage *bmsg = (RwControlMaxBitrateMessage *)msg;
+
+		worker->setMaximumSendingBitrate(bmsg->kbps);
+	}
+	else if(msg->type == RwControlMessage::KeyframeRequest)
+	{
+		worker->requestVideoKeyframe();
+	}
+	else if(msg->type == RwControlMessage::VideoDownscale)
+	{
+		RwControlVideoDownscaleMessage *dmsg = (RwControlVideoDownscaleMessage *)msg;
+
+		worker->setVideoSendDownscale(dmsg->halvings);
+	}
 	else if(msg->type == RwControlMessage::Record)
 	{
 		RwControlRecordMessage *rmsg = (RwControlRecordMessage *)msg;
@@ -662,22 +939,45 @@ void RwControlRemote::worker_audioInputIntensity(int value)
 	local_->postMessage(msg);
 }
 
-void RwControlRemote::worker_previewFrame(const RtpWorker::Frame &frame)
+// note: called from the streaming thread.  postMessage is safe there,
+//   and transitions are rare (talkspurt boundaries, not per packet)
+void RwControlRemote::worker_audioTalkingChanged(bool talking)
 {
-	RwControlFrameMessage *msg = new RwControlFrameMessage;
-	msg->frame.type = RwControlFrame::Preview;
-	msg->frame.image = frame.image;
+	RwControlAudioTalkingMessage *msg = new RwControlAudioTalkingMessage;
+	msg->talking = talking;
 	local_->postMessage(msg);
 }
 
-void RwControlRemote::worker_outputFrame(const RtpWorker::Frame &frame)
+// spontaneous status carrying the stalled stage name.  the session
+//   stays active; the app decides whether to restart anything
+void RwControlRemote::worker_stalled(const QString &stage)
 {
-	RwControlFrameMessage *msg = new RwControlFrameMessage;
-	msg->frame.type = RwControlFrame::Output;
-	msg->frame.image = frame.image;
+	RwControlStatusMessage *msg = statusFromWorker(worker);
+	msg->status.stallStage = stage;
 	local_->postMessage(msg);
 }
 
+void RwControlRemote::worker_previewFrame(const RtpWorker::Frame &frame)
+{
+	// an overwritten frame will never be painted: retire it here so
+	//   the qos gate's delivered/retired gap reflects only frames that
+	//   are genuinely still in flight
+	if(local_->postFrame(RwControlFrame::Preview, frame))
+		worker->framesRetired(true, false);
+}
+
+void RwControlRemote::worker_outputFrame(const RtpWorker::Frame &frame)
+{
+	if(local_->postFrame(RwControlFrame::Output, frame))
+		worker->framesRetired(false, true);
+}
+
+void RwControlRemote::worker_shmOutputFrame(const RtpWorker::ShmFrame &frame)
+{
+	if(local_->postShmFrame(frame))
+		worker->framesRetired(false, true);
+}
+
 void RwControlRemote::worker_rtpAudioOut(const PRtpPacket &packet)
 {
 	if(local_->cb_rtpAudioOut)
@@ -702,12 +1002,11 @@ void RwControlRemote::resumeMessages()
 	if(blocking)
 	{
 		blocking = false;
-		if(!in.isEmpty() && !timer)
-		{
-			timer = g_timeout_source_new(0);
-			g_source_set_callback(timer, cb_processMessages, this, NULL);
-			g_source_attach(timer, mainContext_);
-		}
+
+		// the mailbox source notices pending messages on the next
+		//   loop iteration
+		if(!in.isEmpty())
+			g_main_context_wakeup(mainContext_);
 	}
 }
 
@@ -726,12 +1025,8 @@ void RwControlRemote::postMessage(RwControlMessage *msg)
 
 	in += msg;
 
-	if(!blocking && !timer)
-	{
-		timer = g_timeout_source_new(0);
-		g_source_set_callback(timer, cb_processMessages, this, NULL);
-		g_source_attach(timer, mainContext_);
-	}
+	// rouse the remote loop.  the mailbox source picks the message up
+	g_main_context_wakeup(mainContext_);
 }
 
 // note: this may be called from the local thread
@@ -746,4 +1041,35 @@ void RwControlRemote::rtpVideoIn(const PRtpPacket &packet)
 	worker->rtpVideoIn(packet);
 }
 
+// note: this may be called from the local thread.  the worker's
+//   counters are atomics, so no locking is needed
+PRtpSessionStats RwControlRemote::statistics() const
+{
+	return worker->statsSnapshot();
+}
+
+int RwControlRemote::audioInputIntensity() const
+{
+	return (int)worker->audioInputIntensity;
+}
+
+int RwControlRemote::audioOutputIntensity() const
+{
+	return (int)worker->audioOutputIntensity;
+}
+
+// plain atomic increments in the worker, so this is callable from the
+//   qt thread without waking anything
+void RwControlRemote::framesRetired(bool preview, bool output)
+{
+	worker->framesRetired(preview, output);
+}
+
+// note: this may be called from the local thread.  the snapshot locks
+//   only the worker's small cpu-slot table
+PResourceUsage RwControlRemote::resourceUsage() const
+{
+	return worker->resourceSnapshot();
+}
+
 }
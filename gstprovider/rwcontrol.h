@@ -40,9 +40,11 @@ namespace PsiMedia {
 // RwControlLocal  - object to live in "local" Qt eventloop
 // RwControlRemote - object to live in "remote" glib eventloop
 //
-// When RwControlLocal is created, you pass it the GstThread.  The constructor
-// atomically creates a corresponding RwControlRemote in the remote thread and
-// associates the two objects.
+// When RwControlLocal is created, you pass it the GstThread.  A
+// corresponding RwControlRemote is created in the remote thread in the
+// background; the constructor does not wait for it.  Messages posted
+// before the remote object exists are queued and delivered in order once
+// it does, so the caller can start using the control immediately.
 //
 // The possible exchanges are made clear here.  Things you can do:
 //
@@ -72,8 +74,11 @@ namespace PsiMedia {
 // - At any time, it is possible to receive a spontaneous status message.
 //   This is to indicate an error or a completed file playback.
 //
-// - Preview and output video frames are signaled normally and are intended
-//   for immediate display.
+// - Preview and output video frames bypass the message queue.  Each type
+//   has a fixed latest-frame slot: the remote thread overwrites the slot
+//   with every new frame and the local side paints whatever is newest
+//   when it wakes, so frames are never queued and a rate mismatch costs
+//   nothing.
 //
 // - RTP packets and recording data bypass the event-based message-passing
 //   mechanisms described above.  Instead, special methods and callbacks are
@@ -88,20 +93,42 @@ public:
 	QString audioOutId;
 	QString audioInId;
 	QString videoInId;
+	// prefer fileNameIn: the worker mmaps the file, so playback
+	//   streams pages on demand with nothing resident up front.
+	//   fileDataIn keeps the whole stimulus in memory (the copies
+	//   along the way are shallow, but the buffer itself is not)
 	QString fileNameIn;
 	QByteArray fileDataIn;
 	bool loopFile;
 	bool useVideoPreview;
 	bool useVideoOut;
+	bool shmVideoExport; // received video via shared memory (unix only)
 	int audioOutVolume;
 	int audioInVolume;
+	int jitterMinLatency; // ms, -1 = fixed latency
+	int jitterMaxLatency; // ms, -1 = fixed latency
+	int videoPaceBurst; // packets, <1 = no pacing
+	int previewFps; // fps cap for the preview branch, <1 = full rate
+	int audioIntensityInterval; // ms between intensity signals, <1 = none
+
+	// srtp master key + salt per direction, empty = no srtp.  applying
+	//   the same key again is a no-op, so these ride the device config
+	//   safely
+	QByteArray srtpOutKey;
+	QByteArray srtpInKey;
 
 	RwControlConfigDevices() :
 		loopFile(false),
 		useVideoPreview(false),
 		useVideoOut(false),
+		shmVideoExport(false),
 		audioOutVolume(-1),
-		audioInVolume(-1)
+		audioInVolume(-1),
+		jitterMinLatency(-1),
+		jitterMaxLatency(-1),
+		videoPaceBurst(-1),
+		previewFps(-1),
+		audioIntensityInterval(-1)
 	{
 	}
 };
@@ -121,12 +148,22 @@ public:
 
 	int maximumSendingBitrate;
 
+	// effective path mtu in bytes, -1 = payloader defaults.  rides
+	//   the codec config because applying it means repacketizing
+	int pathMtu;
+
+	// vad/dtx on the audio send path.  rides the codec config because
+	//   applying it means reconfiguring the encoder
+	bool dtxEnabled;
+
 	RwControlConfigCodecs() :
 		useLocalAudioParams(false),
 		useLocalVideoParams(false),
 		useRemoteAudioPayloadInfo(false),
 		useRemoteVideoPayloadInfo(false),
-		maximumSendingBitrate(-1)
+		maximumSendingBitrate(-1),
+		pathMtu(-1),
+		dtxEnabled(false)
 	{
 	}
 };
@@ -174,6 +211,11 @@ public:
 	bool error;
 	int errorCode;
 
+	// set on a spontaneous status from the pipeline watchdog: the
+	//   named stage stopped making progress (see PSI_WATCHDOG_MS in
+	//   rtpworker.cpp).  the session stays active
+	QString stallStage;
+
 	RwControlStatus() :
 		canTransmitAudio(false),
 		canTransmitVideo(false),
@@ -204,18 +246,16 @@ public:
 	}
 };
 
-// always remote -> local, for internal use
+// frame types for the latest-frame slots, always remote -> local
 class RwControlFrame
 {
 public:
 	enum Type
 	{
 		Preview,
-		Output
+		Output,
+		TypeCount
 	};
-
-	Type type;
-	QImage image;
 };
 
 // internal
@@ -230,9 +270,12 @@ public:
 		UpdateCodecs,
 		Transmit,
 		Record,
+		MaxBitrate,
+		KeyframeRequest,
+		VideoDownscale,
 		Status,
 		AudioIntensity,
-		Frame
+		AudioTalking
 	};
 
 	Type type;
@@ -312,6 +355,43 @@ public:
 	}
 };
 
+// fire-and-forget: pokes the live encoder, no status reply
+class RwControlMaxBitrateMessage : public RwControlMessage
+{
+public:
+	int kbps;
+
+	RwControlMaxBitrateMessage() :
+		RwControlMessage(RwControlMessage::MaxBitrate),
+		kbps(-1)
+	{
+	}
+};
+
+// fire-and-forget: forces the video encoder to emit a keyframe
+class RwControlKeyframeMessage : public RwControlMessage
+{
+public:
+	RwControlKeyframeMessage() :
+		RwControlMessage(RwControlMessage::KeyframeRequest)
+	{
+	}
+};
+
+// fire-and-forget: halves the encoded video size (see
+//   RtpWorker::setVideoSendDownscale)
+class RwControlVideoDownscaleMessage : public RwControlMessage
+{
+public:
+	int halvings;
+
+	RwControlVideoDownscaleMessage() :
+		RwControlMessage(RwControlMessage::VideoDownscale),
+		halvings(0)
+	{
+	}
+};
+
 class RwControlStatusMessage : public RwControlMessage
 {
 public:
@@ -334,13 +414,16 @@ public:
 	}
 };
 
-class RwControlFrameMessage : public RwControlMessage
+// talkspurt boundary from the dtx gate.  unlike intensity, every
+//   transition matters, so these are never coalesced
+class RwControlAudioTalkingMessage : public RwControlMessage
 {
 public:
-	RwControlFrame frame;
+	bool talking;
 
-	RwControlFrameMessage() :
-		RwControlMessage(RwControlMessage::Frame)
+	RwControlAudioTalkingMessage() :
+		RwControlMessage(RwControlMessage::AudioTalking),
+		talking(false)
 	{
 	}
 };
@@ -360,9 +443,33 @@ public:
 	void setTransmit(const RwControlTransmit &transmit);
 	void setRecord(const RwControlRecord &record);
 
-	// can be called from any thread
+	// fire-and-forget bitrate nudge for the live encoder, without a
+	//   codec update transaction.  no status reply
+	void setMaximumSendingBitrate(int kbps);
+
+	// fire-and-forget keyframe request for the video encoder
+	void requestVideoKeyframe();
+
+	// fire-and-forget live downshift of the encoded video size: each
+	//   halving divides the configured dimensions by two, 0 restores
+	//   the configured size.  no status reply
+	void setVideoSendDownscale(int halvings);
+
+	// can be called from any thread.  packets arriving before the
+	//   remote object is up are dropped (live media: there is nothing
+	//   useful to do with them yet anyway)
 	void rtpAudioIn(const PRtpPacket &packet);
 	void rtpVideoIn(const PRtpPacket &packet);
+	PRtpSessionStats statistics() const;
+
+	// poll the meters maintained in-pipeline, without any message
+	//   traffic.  can be called from any thread
+	int audioInputIntensity() const;
+	int audioOutputIntensity() const;
+
+	// snapshot of the host resources the worker is consuming.  can be
+	//   called from any thread
+	PResourceUsage resourceUsage() const;
 
 	// can come from any thread.
 	// note that it is only safe to assign callbacks prior to starting.
@@ -377,33 +484,59 @@ signals:
 	// response to start, stop, updateCodecs, or it could be spontaneous
 	void statusReady(const RwControlStatus &status);
 
-	void previewFrame(const QImage &img);
-	void outputFrame(const QImage &img);
+	void previewFrame(const RtpWorker::Frame &frame);
+	void outputFrame(const RtpWorker::Frame &frame);
+	void shmOutputFrame(const RtpWorker::ShmFrame &frame);
 	void audioOutputIntensityChanged(int intensity);
 	void audioInputIntensityChanged(int intensity);
 
+	// talkspurt boundaries detected by the dtx gate (see
+	//   RtpWorker::dtxEnabled).  only emitted while dtx is enabled
+	void audioTalkingChanged(bool talking);
+
 private slots:
 	void processMessages();
 
 private:
 	GstThread *thread_;
-	GSource *timer;
-	QMutex m;
+	mutable QMutex m;
 	QWaitCondition w;
 	RwControlRemote *remote_;
 	bool wake_pending;
 
+	// messages posted before remote_ exists, flushed on creation
+	QList<RwControlMessage*> pending;
+
 	QMutex in_mutex;
 	QList<RwControlMessage*> in;
 
-	static gboolean cb_doCreateRemote(gpointer data);
-	static gboolean cb_doDestroyRemote(gpointer data);
+	// latest-frame slots, one per frame type.  the remote thread
+	//   overwrites the slot with each new frame and we paint whatever
+	//   is newest at wake time.  the frame data is refcounted, so an
+	//   overwrite just drops a reference
+	QMutex frame_mutex;
+	RtpWorker::Frame frameSlot[RwControlFrame::TypeCount];
+	bool frameDirty[RwControlFrame::TypeCount];
 
-	gboolean doCreateRemote();
-	gboolean doDestroyRemote();
+	// shm frames get the same latest-wins treatment.  the descriptor
+	//   is plain data, so an overwrite costs nothing at all
+	RtpWorker::ShmFrame shmFrameSlot;
+	bool shmFrameDirty;
+
+	static void cb_doCreateRemote(void *data);
+	static void cb_doDestroyRemote(void *data);
+
+	void doCreateRemote();
+	void doDestroyRemote();
+
+	void postToRemote(RwControlMessage *msg);
 
 	friend class RwControlRemote;
 	void postMessage(RwControlMessage *msg);
+	// both return true if the slot was still dirty, i.e. the previous
+	//   frame was overwritten without ever reaching the ui
+	bool postFrame(RwControlFrame::Type type, const RtpWorker::Frame &frame);
+	bool postShmFrame(const RtpWorker::ShmFrame &frame);
 };
 
 class RwControlRemote
@@ -412,8 +545,11 @@ public:
 	RwControlRemote(GMainContext *mainContext, RwControlLocal *local);
 	~RwControlRemote();
 
+	// called by the mailbox source funcs only
+	bool messagesPending();
+
 private:
-	GSource *timer;
+	GSource *mailbox;
 	GMainContext *mainContext_;
 	QMutex m;
 	RwControlLocal *local_;
@@ -432,8 +568,11 @@ private:
 	static void cb_worker_error(void *app);
 	static void cb_worker_audioOutputIntensity(int value, void *app);
 	static void cb_worker_audioInputIntensity(int value, void *app);
+	static void cb_worker_audioTalkingChanged(bool talking, void *app);
+	static void cb_worker_stalled(const QString &stage, void *app);
 	static void cb_worker_previewFrame(const RtpWorker::Frame &frame, void *app);
 	static void cb_worker_outputFrame(const RtpWorker::Frame &frame, void *app);
+	static void cb_worker_shmOutputFrame(const RtpWorker::ShmFrame &frame, void *app);
 	static void cb_worker_rtpAudioOut(const PRtpPacket &packet, void *app);
 	static void cb_worker_rtpVideoOut(const PRtpPacket &packet, void *app);
 	static void cb_worker_recordData(const QByteArray &packet, void *app);
@@ -446,8 +585,11 @@ private:
 	void worker_error();
 	void worker_audioOutputIntensity(int value);
 	void worker_audioInputIntensity(int value);
+	void worker_audioTalkingChanged(bool talking);
+	void worker_stalled(const QString &stage);
 	void worker_previewFrame(const RtpWorker::Frame &frame);
 	void worker_outputFrame(const RtpWorker::Frame &frame);
+	void worker_shmOutputFrame(const RtpWorker::ShmFrame &frame);
 	void worker_rtpAudioOut(const PRtpPacket &packet);
 	void worker_rtpVideoOut(const PRtpPacket &packet);
 	void worker_recordData(const QByteArray &packet);
@@ -461,6 +603,11 @@ private:
 	void postMessage(RwControlMessage *msg);
 	void rtpAudioIn(const PRtpPacket &packet);
 	void rtpVideoIn(const PRtpPacket &packet);
+	PRtpSessionStats statistics() const;
+	int audioInputIntensity() const;
+	int audioOutputIntensity() const;
+	PResourceUsage resourceUsage() const;
+	void framesRetired(bool preview, bool output);
 };
 
 }
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2008-2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "shmframering.h"
+
+#ifdef Q_OS_UNIX
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+namespace PsiMedia {
+
+ShmFrameRing::ShmFrameRing() :
+	fd_(-1),
+	slotSize_(0),
+	slotCount_(0),
+	base_(0)
+{
+}
+
+ShmFrameRing::~ShmFrameRing()
+{
+	reset();
+}
+
+bool ShmFrameRing::create(int slotSize, int slotCount)
+{
+#ifdef Q_OS_UNIX
+	reset();
+
+	if(slotSize < 1 || slotCount < 1)
+		return false;
+
+	// page-align the slots, so a renderer can map a subrange if it
+	//   ever wants to
+	long page = sysconf(_SC_PAGESIZE);
+	if(page > 0)
+		slotSize = (slotSize + (int)page - 1) & ~((int)page - 1);
+
+	// the name exists only long enough to get a descriptor.  unlinking
+	//   right away means a crash leaks nothing, and the renderer gets
+	//   the descriptor over a socket rather than by name
+	char name[64];
+	snprintf(name, sizeof(name), "/psimedia-%d-%p", (int)getpid(), (void *)this);
+
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if(fd == -1)
+		return false;
+	shm_unlink(name);
+
+	int total = slotSize * slotCount;
+	if(ftruncate(fd, total) == -1)
+	{
+		close(fd);
+		return false;
+	}
+
+	void *p = mmap(0, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(p == MAP_FAILED)
+	{
+		close(fd);
+		return false;
+	}
+
+	fd_ = fd;
+	slotSize_ = slotSize;
+	slotCount_ = slotCount;
+	base_ = (unsigned char *)p;
+	return true;
+#else
+	Q_UNUSED(slotSize);
+	Q_UNUSED(slotCount);
+	return false;
+#endif
+}
+
+void ShmFrameRing::reset()
+{
+#ifdef Q_OS_UNIX
+	if(base_)
+		munmap(base_, slotSize_ * slotCount_);
+	if(fd_ != -1)
+		close(fd_);
+#endif
+
+	fd_ = -1;
+	slotSize_ = 0;
+	slotCount_ = 0;
+	base_ = 0;
+}
+
+bool ShmFrameRing::isValid() const
+{
+	return (fd_ != -1);
+}
+
+int ShmFrameRing::fd() const
+{
+	return fd_;
+}
+
+int ShmFrameRing::totalSize() const
+{
+	return slotSize_ * slotCount_;
+}
+
+int ShmFrameRing::slotSize() const
+{
+	return slotSize_;
+}
+
+int ShmFrameRing::slotCount() const
+{
+	return slotCount_;
+}
+
+unsigned char *ShmFrameRing::base() const
+{
+	return base_;
+}
+
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2008-2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef PSI_SHMFRAMERING_H
+#define PSI_SHMFRAMERING_H
+
+#include <QtGlobal>
+
+namespace PsiMedia {
+
+// a single anonymous posix shared memory segment divided into
+//   fixed-size frame slots.  the writer (our video sink) fills slots
+//   round-robin; a renderer in another process receives the descriptor
+//   once over a socket, maps the whole segment once, and then every
+//   frame is just an offset into it.  the name is unlinked immediately
+//   after creation, so nothing leaks if we crash and the segment only
+//   travels by descriptor.
+//
+// slot reuse is purely positional: with several slots, the writer is
+//   always many frames away from the one it most recently announced,
+//   so a renderer that keeps up never sees a torn frame.  unix only;
+//   create() fails cleanly elsewhere.
+class ShmFrameRing
+{
+public:
+	ShmFrameRing();
+	~ShmFrameRing();
+
+	// slotSize is rounded up to a page.  returns false if shared
+	//   memory isn't available
+	bool create(int slotSize, int slotCount);
+	void reset();
+
+	bool isValid() const;
+	int fd() const;
+	int totalSize() const;
+	int slotSize() const;
+	int slotCount() const;
+	unsigned char *base() const;
+
+private:
+	int fd_;
+	int slotSize_;
+	int slotCount_;
+	unsigned char *base_;
+
+	ShmFrameRing(const ShmFrameRing &);
+	ShmFrameRing &operator=(const ShmFrameRing &);
+};
+
+}
+
+#endif
@@ -0,0 +1,537 @@
+/*
+ * Copyright (C) 2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "srtp.h"
+
+#include <string.h>
+
+namespace PsiMedia {
+
+//----------------------------------------------------------------------------
+// aes-128, encrypt direction only (counter mode never decrypts a block)
+//----------------------------------------------------------------------------
+
+static const unsigned char aes_sbox[256] =
+{
+	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+	0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+	0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+	0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+	0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+	0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+	0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+	0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+	0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+	0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+	0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+	0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+	0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+	0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+	0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+	0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static inline unsigned char aes_xtime(unsigned char x)
+{
+	return (unsigned char)((x << 1) ^ ((x & 0x80) ? 0x1b : 0x00));
+}
+
+// expands a 16 byte key into the 176 byte round key schedule
+static void aes_expand_key(const unsigned char *key, unsigned char *schedule)
+{
+	static const unsigned char rcon[10] =
+	{
+		0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36
+	};
+
+	memcpy(schedule, key, 16);
+	for(int n = 4; n < 44; ++n)
+	{
+		unsigned char t[4];
+		memcpy(t, schedule + (n - 1) * 4, 4);
+		if(n % 4 == 0)
+		{
+			unsigned char tmp = t[0];
+			t[0] = (unsigned char)(aes_sbox[t[1]] ^ rcon[n / 4 - 1]);
+			t[1] = aes_sbox[t[2]];
+			t[2] = aes_sbox[t[3]];
+			t[3] = aes_sbox[tmp];
+		}
+		for(int i = 0; i < 4; ++i)
+			schedule[n * 4 + i] = (unsigned char)(schedule[(n - 4) * 4 + i] ^ t[i]);
+	}
+}
+
+static void aes_encrypt_block(const unsigned char *schedule, const unsigned char *in, unsigned char *out)
+{
+	unsigned char s[16];
+	for(int i = 0; i < 16; ++i)
+		s[i] = (unsigned char)(in[i] ^ schedule[i]);
+
+	for(int round = 1; round <= 10; ++round)
+	{
+		// subbytes
+		for(int i = 0; i < 16; ++i)
+			s[i] = aes_sbox[s[i]];
+
+		// shiftrows
+		unsigned char t;
+		t = s[1]; s[1] = s[5]; s[5] = s[9]; s[9] = s[13]; s[13] = t;
+		t = s[2]; s[2] = s[10]; s[10] = t;
+		t = s[6]; s[6] = s[14]; s[14] = t;
+		t = s[3]; s[3] = s[15]; s[15] = s[11]; s[11] = s[7]; s[7] = t;
+
+		// mixcolumns, skipped on the final round
+		if(round < 10)
+		{
+			for(int c = 0; c < 16; c += 4)
+			{
+				unsigned char a0 = s[c];
+				unsigned char a1 = s[c + 1];
+				unsigned char a2 = s[c + 2];
+				unsigned char a3 = s[c + 3];
+				unsigned char x = (unsigned char)(a0 ^ a1 ^ a2 ^ a3);
+				s[c] = (unsigned char)(a0 ^ x ^ aes_xtime((unsigned char)(a0 ^ a1)));
+				s[c + 1] = (unsigned char)(a1 ^ x ^ aes_xtime((unsigned char)(a1 ^ a2)));
+				s[c + 2] = (unsigned char)(a2 ^ x ^ aes_xtime((unsigned char)(a2 ^ a3)));
+				s[c + 3] = (unsigned char)(a3 ^ x ^ aes_xtime((unsigned char)(a3 ^ a0)));
+			}
+		}
+
+		// addroundkey
+		for(int i = 0; i < 16; ++i)
+			s[i] = (unsigned char)(s[i] ^ schedule[round * 16 + i]);
+	}
+
+	memcpy(out, s, 16);
+}
+
+// xors an aes counter-mode keystream into buf.  iv carries the first
+//   14 bytes of the counter block, the last 2 are the block counter
+static void aes_cm_crypt(const unsigned char *schedule, const unsigned char *iv, unsigned char *buf, int len)
+{
+	unsigned char block[16];
+	unsigned char stream[16];
+	memcpy(block, iv, 16);
+
+	int pos = 0;
+	quint16 counter = 0;
+	while(pos < len)
+	{
+		block[14] = (unsigned char)(counter >> 8);
+		block[15] = (unsigned char)(counter & 0xff);
+		aes_encrypt_block(schedule, block, stream);
+
+		int chunk = len - pos;
+		if(chunk > 16)
+			chunk = 16;
+		for(int i = 0; i < chunk; ++i)
+			buf[pos + i] = (unsigned char)(buf[pos + i] ^ stream[i]);
+
+		pos += chunk;
+		++counter;
+	}
+}
+
+//----------------------------------------------------------------------------
+// sha-1 and hmac-sha1
+//----------------------------------------------------------------------------
+
+class Sha1
+{
+public:
+	Sha1()
+	{
+		h[0] = 0x67452301;
+		h[1] = 0xefcdab89;
+		h[2] = 0x98badcfe;
+		h[3] = 0x10325476;
+		h[4] = 0xc3d2e1f0;
+		total = 0;
+		pending = 0;
+	}
+
+	void update(const unsigned char *buf, int len)
+	{
+		total += len;
+		while(len > 0)
+		{
+			int chunk = 64 - pending;
+			if(chunk > len)
+				chunk = len;
+			memcpy(block + pending, buf, chunk);
+			pending += chunk;
+			buf += chunk;
+			len -= chunk;
+			if(pending == 64)
+			{
+				process();
+				pending = 0;
+			}
+		}
+	}
+
+	// writes the 20 byte digest.  the object is spent afterwards
+	void final(unsigned char *out)
+	{
+		quint64 bits = total * 8;
+		unsigned char pad = 0x80;
+		update(&pad, 1);
+		unsigned char zero = 0;
+		while(pending != 56)
+			update(&zero, 1);
+		unsigned char lenbuf[8];
+		for(int i = 0; i < 8; ++i)
+			lenbuf[i] = (unsigned char)(bits >> ((7 - i) * 8));
+		update(lenbuf, 8);
+
+		for(int i = 0; i < 5; ++i)
+		{
+			out[i * 4] = (unsigned char)(h[i] >> 24);
+			out[i * 4 + 1] = (unsigned char)(h[i] >> 16);
+			out[i * 4 + 2] = (unsigned char)(h[i] >> 8);
+			out[i * 4 + 3] = (unsigned char)(h[i]);
+		}
+	}
+
+private:
+	quint32 h[5];
+	quint64 total;
+	unsigned char block[64];
+	int pending;
+
+	static inline quint32 rol(quint32 x, int bits)
+	{
+		return (x << bits) | (x >> (32 - bits));
+	}
+
+	void process()
+	{
+		quint32 w[80];
+		for(int i = 0; i < 16; ++i)
+		{
+			w[i] = ((quint32)block[i * 4] << 24) |
+				((quint32)block[i * 4 + 1] << 16) |
+				((quint32)block[i * 4 + 2] << 8) |
+				(quint32)block[i * 4 + 3];
+		}
+		for(int i = 16; i < 80; ++i)
+			w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+		quint32 a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for(int i = 0; i < 80; ++i)
+		{
+			quint32 f, k;
+			if(i < 20)
+			{
+				f = (b & c) | ((~b) & d);
+				k = 0x5a827999;
+			}
+			else if(i < 40)
+			{
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+			}
+			else if(i < 60)
+			{
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8f1bbcdc;
+			}
+			else
+			{
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+			}
+			quint32 t = rol(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rol(b, 30);
+			b = a;
+			a = t;
+		}
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+};
+
+static void hmac_sha1(const unsigned char *key, int keyLen, const unsigned char *buf, int len, const unsigned char *extra, int extraLen, unsigned char *out)
+{
+	unsigned char pad[64];
+	memset(pad, 0, 64);
+	memcpy(pad, key, keyLen);
+
+	for(int i = 0; i < 64; ++i)
+		pad[i] = (unsigned char)(pad[i] ^ 0x36);
+	Sha1 inner;
+	inner.update(pad, 64);
+	inner.update(buf, len);
+	if(extraLen > 0)
+		inner.update(extra, extraLen);
+	unsigned char digest[20];
+	inner.final(digest);
+
+	for(int i = 0; i < 64; ++i)
+		pad[i] = (unsigned char)(pad[i] ^ 0x36 ^ 0x5c);
+	Sha1 outer;
+	outer.update(pad, 64);
+	outer.update(digest, 20);
+	outer.final(out);
+}
+
+//----------------------------------------------------------------------------
+// SrtpSession
+//----------------------------------------------------------------------------
+
+#define SRTP_TAG_SIZE 10
+#define SRTP_REPLAY_WINDOW 64
+
+// payload offset within an rtp packet, or -1 if the header is
+//   malformed.  csrc entries and a header extension count as header
+static int rtp_header_length(const unsigned char *buf, int len)
+{
+	if(len < 12 || (buf[0] & 0xc0) != 0x80)
+		return -1;
+
+	int headerLen = 12 + (buf[0] & 0x0f) * 4;
+	if(buf[0] & 0x10)
+	{
+		if(len < headerLen + 4)
+			return -1;
+		int extWords = ((int)buf[headerLen + 2] << 8) | buf[headerLen + 3];
+		headerLen += 4 + extWords * 4;
+	}
+	if(len < headerLen)
+		return -1;
+	return headerLen;
+}
+
+// rfc 3711 section 4.3 key derivation with the default rate of zero:
+//   one aes-cm keystream per label, keyed by the master key and ived
+//   by the master salt with the label folded in
+static void derive_key(const unsigned char *masterSchedule, const unsigned char *masterSalt, unsigned char label, unsigned char *out, int outLen)
+{
+	unsigned char iv[16];
+	memset(iv, 0, 16);
+	memcpy(iv, masterSalt, 14);
+	iv[7] = (unsigned char)(iv[7] ^ label);
+
+	memset(out, 0, outLen);
+	aes_cm_crypt(masterSchedule, iv, out, outLen);
+}
+
+SrtpSession::SrtpSession() :
+	active(false)
+{
+}
+
+bool SrtpSession::setKey(const QByteArray &keyAndSalt)
+{
+	QMutexLocker locker(&m);
+
+	if(keyAndSalt == key)
+		return true;
+
+	if(keyAndSalt.isEmpty())
+	{
+		active = false;
+		key.clear();
+		streams.clear();
+		return true;
+	}
+
+	if(keyAndSalt.size() != KeySize)
+		return false;
+
+	const unsigned char *masterKey = (const unsigned char *)keyAndSalt.data();
+	const unsigned char *masterSalt = masterKey + 16;
+
+	unsigned char masterSchedule[176];
+	aes_expand_key(masterKey, masterSchedule);
+
+	unsigned char cipherKey[16];
+	derive_key(masterSchedule, masterSalt, 0x00, cipherKey, 16);
+	derive_key(masterSchedule, masterSalt, 0x01, authKey, 20);
+	derive_key(masterSchedule, masterSalt, 0x02, sessionSalt, 14);
+
+	aes_expand_key(cipherKey, cipherKeySchedule);
+
+	// a rekey restarts every crypto stream
+	streams.clear();
+	key = keyAndSalt;
+	active = true;
+	return true;
+}
+
+bool SrtpSession::isActive() const
+{
+	QMutexLocker locker(&m);
+	return active;
+}
+
+// iv construction from rfc 3711 section 4.1.1: the session salt with
+//   the ssrc and the 48 bit packet index folded in at their offsets
+void SrtpSession::cryptPayload(QByteArray *packet, int headerLen, quint32 ssrc, quint64 index)
+{
+	unsigned char iv[16];
+	memset(iv, 0, 16);
+	memcpy(iv, sessionSalt, 14);
+	for(int i = 0; i < 4; ++i)
+		iv[4 + i] = (unsigned char)(iv[4 + i] ^ (unsigned char)(ssrc >> ((3 - i) * 8)));
+	for(int i = 0; i < 6; ++i)
+		iv[8 + i] = (unsigned char)(iv[8 + i] ^ (unsigned char)(index >> ((5 - i) * 8)));
+
+	unsigned char *buf = (unsigned char *)packet->data();
+	aes_cm_crypt(cipherKeySchedule, iv, buf + headerLen, packet->size() - headerLen);
+}
+
+// the tag covers the whole packet plus the rollover counter, so a
+//   replayed packet from an earlier 16 bit cycle can't authenticate
+void SrtpSession::computeTag(const unsigned char *buf, int len, quint32 roc, unsigned char *tag)
+{
+	unsigned char rocbuf[4];
+	rocbuf[0] = (unsigned char)(roc >> 24);
+	rocbuf[1] = (unsigned char)(roc >> 16);
+	rocbuf[2] = (unsigned char)(roc >> 8);
+	rocbuf[3] = (unsigned char)(roc);
+
+	unsigned char digest[20];
+	hmac_sha1(authKey, 20, buf, len, rocbuf, 4, digest);
+	memcpy(tag, digest, SRTP_TAG_SIZE);
+}
+
+bool SrtpSession::protect(QByteArray *packet)
+{
+	QMutexLocker locker(&m);
+
+	if(!active)
+		return false;
+
+	const unsigned char *buf = (const unsigned char *)packet->data();
+	int headerLen = rtp_header_length(buf, packet->size());
+	if(headerLen < 0)
+		return false;
+
+	quint16 seq = (quint16)(((quint16)buf[2] << 8) | buf[3]);
+	quint32 ssrc = ((quint32)buf[8] << 24) | ((quint32)buf[9] << 16) |
+		((quint32)buf[10] << 8) | (quint32)buf[11];
+
+	Stream &stream = streams[ssrc];
+
+	// the sender owns the sequence space, so a rollover is simply the
+	//   counter coming back around
+	if(stream.seen && seq < stream.maxSeq && (int)(stream.maxSeq - seq) > 32768)
+		++stream.roc;
+	stream.maxSeq = seq;
+	stream.seen = true;
+
+	quint64 index = ((quint64)stream.roc << 16) | seq;
+	cryptPayload(packet, headerLen, ssrc, index);
+
+	int len = packet->size();
+	packet->resize(len + SRTP_TAG_SIZE);
+	computeTag((const unsigned char *)packet->data(), len, stream.roc, (unsigned char *)packet->data() + len);
+	return true;
+}
+
+bool SrtpSession::unprotect(QByteArray *packet)
+{
+	QMutexLocker locker(&m);
+
+	if(!active)
+		return false;
+
+	if(packet->size() < 12 + SRTP_TAG_SIZE)
+		return false;
+	int authLen = packet->size() - SRTP_TAG_SIZE;
+
+	const unsigned char *buf = (const unsigned char *)packet->data();
+	int headerLen = rtp_header_length(buf, authLen);
+	if(headerLen < 0)
+		return false;
+
+	quint16 seq = (quint16)(((quint16)buf[2] << 8) | buf[3]);
+	quint32 ssrc = ((quint32)buf[8] << 24) | ((quint32)buf[9] << 16) |
+		((quint32)buf[10] << 8) | (quint32)buf[11];
+
+	Stream &stream = streams[ssrc];
+
+	// guess which rollover cycle the sequence number belongs to
+	//   (rfc 3711 appendix a)
+	quint32 guessRoc = stream.roc;
+	if(stream.seen)
+	{
+		if(stream.maxSeq < 32768)
+		{
+			if((int)seq - (int)stream.maxSeq > 32768 && stream.roc > 0)
+				guessRoc = stream.roc - 1;
+		}
+		else
+		{
+			if((int)stream.maxSeq - 32768 > (int)seq)
+				guessRoc = stream.roc + 1;
+		}
+	}
+	quint64 index = ((quint64)guessRoc << 16) | seq;
+
+	// constant-time tag check, so the comparison can't leak how many
+	//   leading bytes of a forged tag were right
+	unsigned char tag[SRTP_TAG_SIZE];
+	computeTag(buf, authLen, guessRoc, tag);
+	unsigned char diff = 0;
+	for(int n = 0; n < SRTP_TAG_SIZE; ++n)
+		diff |= tag[n] ^ buf[authLen + n];
+	if(diff != 0)
+		return false;
+
+	// replay protection: a sliding window over the last 64 indexes
+	//   below the highest one authenticated so far
+	quint64 highest = ((quint64)stream.roc << 16) | stream.maxSeq;
+	if(stream.seen && index <= highest)
+	{
+		quint64 age = highest - index;
+		if(age >= SRTP_REPLAY_WINDOW)
+			return false;
+		if(stream.replayWindow & (Q_UINT64_C(1) << age))
+			return false;
+		stream.replayWindow |= (Q_UINT64_C(1) << age);
+	}
+	else
+	{
+		quint64 advance = stream.seen ? index - highest : 0;
+		if(advance >= SRTP_REPLAY_WINDOW)
+			stream.replayWindow = 0;
+		else
+			stream.replayWindow <<= advance;
+		stream.replayWindow |= 1;
+
+		stream.roc = guessRoc;
+		stream.maxSeq = seq;
+		stream.seen = true;
+	}
+
+	packet->resize(authLen);
+	cryptPayload(packet, headerLen, ssrc, index);
+	return true;
+}
+
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef SRTP_H
+#define SRTP_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+
+namespace PsiMedia {
+
+// rfc 3711 secure rtp, AES_CM_128_HMAC_SHA1_80 only, applied directly
+//   to the rtp packets as they pass through the worker.  the cipher is
+//   a stream cipher, so protection happens in place on the packet
+//   buffer with just the 10 byte auth tag appended, and unprotection
+//   strips the tag again — no staging buffers, no extra copies.
+//
+//   one session covers every ssrc on a port (media, fec, simulcast
+//   layers): per-ssrc rollover counters and replay state are tracked
+//   internally.  all methods are thread-safe, so keys can be set from
+//   the application thread while packets flow on streaming threads.
+
+class SrtpSession
+{
+public:
+	// master key (16 bytes) followed by master salt (14 bytes)
+	static const int KeySize = 16 + 14;
+
+	SrtpSession();
+
+	// keyAndSalt must be KeySize bytes; an empty array disables the
+	//   session.  anything else is rejected.  setting the key already
+	//   in use is a no-op, so callers may apply their configuration
+	//   unconditionally without restarting the crypto streams
+	bool setKey(const QByteArray &keyAndSalt);
+
+	bool isActive() const;
+
+	// encrypts the payload in place and appends the auth tag.  returns
+	//   false (leaving the packet untouched) if the session is inactive
+	//   or the packet is malformed
+	bool protect(QByteArray *packet);
+
+	// verifies the auth tag, decrypts in place and strips the tag.
+	//   returns false if the session is inactive, the tag doesn't
+	//   match, the packet replays or is malformed — the caller must
+	//   drop the packet
+	bool unprotect(QByteArray *packet);
+
+private:
+	class Stream
+	{
+	public:
+		quint32 roc;
+		quint16 maxSeq;
+		bool seen;
+		quint64 replayWindow;
+
+		inline Stream() :
+			roc(0),
+			maxSeq(0),
+			seen(false),
+			replayWindow(0)
+		{
+		}
+	};
+
+	mutable QMutex m;
+	bool active;
+	QByteArray key;
+
+	// session keys derived from the master key per rfc 3711 section 4.3
+	unsigned char cipherKeySchedule[176];
+	unsigned char sessionSalt[14];
+	unsigned char authKey[20];
+
+	QHash<quint32, Stream> streams;
+
+	void cryptPayload(QByteArray *packet, int headerLen, quint32 ssrc, quint64 index);
+	void computeTag(const unsigned char *buf, int len, quint32 roc, unsigned char *tag);
+};
+
+}
+
+#endif
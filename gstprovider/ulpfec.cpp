@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "ulpfec.h"
+
+#include <string.h>
+
+// how many recent media packets the decoder keeps for recovery.  fec
+//   arrives right behind the group it protects, so this only needs to
+//   cover a little reordering
+#define FEC_MEDIA_WINDOW 128
+
+// fec packets waiting for their group are dropped beyond this
+#define FEC_PENDING_MAX 16
+
+#define RTP_HEADER_LEN 12
+
+namespace PsiMedia {
+
+static quint16 read16(const unsigned char *p)
+{
+	return ((quint16)p[0] << 8) | (quint16)p[1];
+}
+
+static quint32 read32(const unsigned char *p)
+{
+	return ((quint32)p[0] << 24) | ((quint32)p[1] << 16) | ((quint32)p[2] << 8) | (quint32)p[3];
+}
+
+static void write16(unsigned char *p, quint16 i)
+{
+	p[0] = (unsigned char)(i >> 8);
+	p[1] = (unsigned char)(i & 0xff);
+}
+
+static void write32(unsigned char *p, quint32 i)
+{
+	p[0] = (unsigned char)(i >> 24);
+	p[1] = (unsigned char)((i >> 16) & 0xff);
+	p[2] = (unsigned char)((i >> 8) & 0xff);
+	p[3] = (unsigned char)(i & 0xff);
+}
+
+//----------------------------------------------------------------------------
+// UlpFecEncoder
+//----------------------------------------------------------------------------
+UlpFecEncoder::UlpFecEncoder() :
+	payloadType(-1),
+	groupSize(4),
+	fecSeq(0)
+{
+	reset();
+}
+
+void UlpFecEncoder::setup(int pt, int _groupSize)
+{
+	payloadType = pt;
+	groupSize = qBound(2, _groupSize, 16);
+	reset();
+}
+
+void UlpFecEncoder::reset()
+{
+	count = 0;
+	seqBase = 0;
+	lastTs = 0;
+	ssrc = 0;
+	xorByte0 = 0;
+	xorByte1 = 0;
+	xorTs = 0;
+	xorLen = 0;
+	xorPayload.clear();
+}
+
+QByteArray UlpFecEncoder::update(const QByteArray &mediaPacket)
+{
+	if(payloadType == -1 || mediaPacket.size() < RTP_HEADER_LEN)
+		return QByteArray();
+
+	const unsigned char *p = (const unsigned char *)mediaPacket.data();
+	quint16 seq = read16(p + 2);
+
+	if(count == 0)
+	{
+		seqBase = seq;
+		ssrc = read32(p + 8);
+	}
+	else if((quint16)(seq - seqBase) >= 16)
+	{
+		// a sequence jump would overflow the 16-bit mask; start over
+		reset();
+		seqBase = seq;
+		ssrc = read32(p + 8);
+	}
+
+	// xor-accumulate the protected header fields and the payload,
+	//   zero-extending shorter payloads per the spec
+	xorByte0 ^= p[0] & 0x3f;
+	xorByte1 ^= p[1];
+	xorTs ^= read32(p + 4);
+	lastTs = read32(p + 4);
+
+	int len = mediaPacket.size() - RTP_HEADER_LEN;
+	xorLen ^= len;
+	if(len > xorPayload.size())
+	{
+		// resize doesn't zero the new space, and xor needs it zeroed
+		int oldSize = xorPayload.size();
+		xorPayload.resize(len);
+		memset(xorPayload.data() + oldSize, 0, len - oldSize);
+	}
+	unsigned char *x = (unsigned char *)xorPayload.data();
+	for(int n = 0; n < len; ++n)
+		x[n] ^= p[RTP_HEADER_LEN + n];
+
+	++count;
+	if(count < groupSize)
+		return QByteArray();
+
+	// group complete, emit the fec packet
+	QByteArray out;
+	out.resize(RTP_HEADER_LEN + 10 + 4 + xorPayload.size());
+	unsigned char *o = (unsigned char *)out.data();
+
+	o[0] = 0x80;
+	o[1] = (unsigned char)payloadType; // no marker
+	write16(o + 2, fecSeq++);
+	write32(o + 4, lastTs);
+	write32(o + 8, ssrc);
+
+	// fec header: E=0, L=0 (short mask)
+	o[12] = (unsigned char)xorByte0;
+	o[13] = (unsigned char)xorByte1;
+	write16(o + 14, seqBase);
+	write32(o + 16, xorTs);
+	write16(o + 20, (quint16)xorLen);
+
+	// level 0: protection length and mask
+	write16(o + 22, (quint16)xorPayload.size());
+	quint16 mask = 0;
+	for(int n = 0; n < count; ++n)
+		mask |= 0x8000 >> n;
+	write16(o + 24, mask);
+
+	memcpy(o + 26, xorPayload.data(), xorPayload.size());
+
+	reset();
+	return out;
+}
+
+//----------------------------------------------------------------------------
+// UlpFecDecoder
+//----------------------------------------------------------------------------
+UlpFecDecoder::UlpFecDecoder() :
+	payloadType(-1)
+{
+}
+
+void UlpFecDecoder::setup(int pt)
+{
+	payloadType = pt;
+	reset();
+}
+
+void UlpFecDecoder::reset()
+{
+	media.clear();
+	mediaOrder.clear();
+	pendingFec.clear();
+}
+
+void UlpFecDecoder::rememberMedia(const QByteArray &packet)
+{
+	const unsigned char *p = (const unsigned char *)packet.data();
+	quint16 seq = read16(p + 2);
+
+	if(media.contains(seq))
+		return;
+
+	media.insert(seq, packet);
+	mediaOrder += seq;
+	while(mediaOrder.count() > FEC_MEDIA_WINDOW)
+		media.remove(mediaOrder.takeFirst());
+}
+
+QList<QByteArray> UlpFecDecoder::update(const QByteArray &packet, bool *isFec)
+{
+	*isFec = false;
+
+	if(payloadType == -1 || packet.size() < RTP_HEADER_LEN)
+		return QList<QByteArray>();
+
+	const unsigned char *p = (const unsigned char *)packet.data();
+	int pt = p[1] & 0x7f;
+
+	if(pt == payloadType)
+	{
+		*isFec = true;
+
+		if(packet.size() < RTP_HEADER_LEN + 10 + 4)
+			return QList<QByteArray>();
+
+		pendingFec += packet;
+		while(pendingFec.count() > FEC_PENDING_MAX)
+			pendingFec.removeFirst();
+	}
+	else
+		rememberMedia(packet);
+
+	return tryRecover();
+}
+
+QList<QByteArray> UlpFecDecoder::tryRecover()
+{
+	QList<QByteArray> out;
+
+	for(int n = 0; n < pendingFec.count(); ++n)
+	{
+		const unsigned char *f = (const unsigned char *)pendingFec[n].data();
+		quint16 seqBase = read16(f + 14);
+		int protLen = read16(f + 22);
+		quint16 mask = read16(f + 24);
+
+		if(pendingFec[n].size() < RTP_HEADER_LEN + 10 + 4 + protLen)
+		{
+			pendingFec.removeAt(n--);
+			continue;
+		}
+
+		// see which of the protected packets we hold
+		QList<quint16> present;
+		int missingCount = 0;
+		quint16 missingSeq = 0;
+		for(int i = 0; i < 16; ++i)
+		{
+			if(!(mask & (0x8000 >> i)))
+				continue;
+			quint16 seq = seqBase + i;
+			if(media.contains(seq))
+				present += seq;
+			else
+			{
+				++missingCount;
+				missingSeq = seq;
+			}
+		}
+
+		if(missingCount > 1)
+			continue; // keep waiting
+
+		if(missingCount == 0)
+		{
+			// nothing to do for this group
+			pendingFec.removeAt(n--);
+			continue;
+		}
+
+		// exactly one missing: rebuild it by xor'ing the fec packet
+		//   with the packets that did arrive
+		int byte0 = f[12] & 0x3f;
+		int byte1 = f[13];
+		quint32 ts = read32(f + 16);
+		int len = read16(f + 20);
+		quint32 ssrc = read32(f + 8);
+
+		QByteArray payload((const char *)f + 26, protLen);
+		unsigned char *x = (unsigned char *)payload.data();
+
+		foreach(quint16 seq, present)
+		{
+			const QByteArray &m = media.value(seq);
+			const unsigned char *mp = (const unsigned char *)m.data();
+			byte0 ^= mp[0] & 0x3f;
+			byte1 ^= mp[1];
+			ts ^= read32(mp + 4);
+			int mlen = m.size() - RTP_HEADER_LEN;
+			len ^= mlen;
+			for(int i = 0; i < mlen && i < protLen; ++i)
+				x[i] ^= mp[RTP_HEADER_LEN + i];
+		}
+
+		if(len < 0 || len > protLen)
+		{
+			// corrupt group, give up on it
+			pendingFec.removeAt(n--);
+			continue;
+		}
+
+		QByteArray rec;
+		rec.resize(RTP_HEADER_LEN + len);
+		unsigned char *r = (unsigned char *)rec.data();
+		r[0] = (unsigned char)(0x80 | byte0);
+		r[1] = (unsigned char)byte1;
+		write16(r + 2, missingSeq);
+		write32(r + 4, ts);
+		write32(r + 8, ssrc);
+		memcpy(r + RTP_HEADER_LEN, payload.data(), len);
+
+		rememberMedia(rec);
+		out += rec;
+		pendingFec.removeAt(n--);
+	}
+
+	return out;
+}
+
+}
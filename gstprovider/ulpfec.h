@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2009  Barracuda Networks, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef ULPFEC_H
+#define ULPFEC_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+
+namespace PsiMedia {
+
+// rfc 5109 single-level forward error correction, applied directly to
+//   the rtp packets as they pass through the worker.  one fec packet
+//   per group of media packets can repair any single loss within the
+//   group, trading roughly 1/groupSize extra bandwidth for it.
+
+class UlpFecEncoder
+{
+public:
+	UlpFecEncoder();
+
+	// pt is the payload type negotiated for fec, groupSize is how many
+	//   media packets each fec packet protects (2-16)
+	void setup(int pt, int groupSize);
+	void reset();
+
+	// feeds one outgoing media packet.  returns the fec packet to send
+	//   right behind it when a group completes, else an empty array
+	QByteArray update(const QByteArray &mediaPacket);
+
+private:
+	int payloadType;
+	int groupSize;
+	quint16 fecSeq;
+
+	// accumulated group state
+	int count;
+	quint16 seqBase;
+	quint32 lastTs;
+	quint32 ssrc;
+	int xorByte0;
+	int xorByte1;
+	quint32 xorTs;
+	int xorLen;
+	QByteArray xorPayload;
+};
+
+class UlpFecDecoder
+{
+public:
+	UlpFecDecoder();
+
+	void setup(int pt);
+	void reset();
+
+	// feed every incoming packet on the video port.  media packets are
+	//   remembered, fec packets may complete a recovery.  returns any
+	//   packets reconstructed as a result.  *isFec is set when the
+	//   caller must swallow the packet instead of decoding it
+	QList<QByteArray> update(const QByteArray &packet, bool *isFec);
+
+private:
+	int payloadType;
+
+	// recent media packets keyed by sequence number, with fifo
+	//   eviction, plus fec packets still waiting for enough of their
+	//   group to arrive
+	QHash<quint16, QByteArray> media;
+	QList<quint16> mediaOrder;
+	QList<QByteArray> pendingFec;
+
+	void rememberMedia(const QByteArray &packet);
+	QList<QByteArray> tryRecover();
+};
+
+}
+
+#endif
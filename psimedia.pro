@@ -4,10 +4,13 @@ sub_gstelements.subdir = gstprovider/gstelements/static
 
 sub_demo.subdir = demo
 
+sub_bench.subdir = bench
+
 sub_gstprovider.subdir = gstprovider
 sub_gstprovider.depends = sub_gstelements
 
 SUBDIRS += sub_gstelements
 SUBDIRS += sub_demo
+SUBDIRS += sub_bench
 
 SUBDIRS += sub_gstprovider
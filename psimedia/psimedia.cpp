@@ -27,6 +27,10 @@
 #include <QPainter>
 #endif
 
+#ifdef QT_OPENGL_LIB
+#include <QGLWidget>
+#endif
+
 #include "psimediaprovider.h"
 
 namespace PsiMedia {
@@ -38,6 +42,7 @@ static AudioParams importAudioParams(const PAudioParams &pp)
 	out.setSampleRate(pp.sampleRate);
 	out.setSampleSize(pp.sampleSize);
 	out.setChannels(pp.channels);
+	out.setPtime(pp.ptime);
 	return out;
 }
 
@@ -48,6 +53,7 @@ static PAudioParams exportAudioParams(const AudioParams &p)
 	out.sampleRate = p.sampleRate();
 	out.sampleSize = p.sampleSize();
 	out.channels = p.channels();
+	out.ptime = p.ptime();
 	return out;
 }
 
@@ -57,6 +63,7 @@ static VideoParams importVideoParams(const PVideoParams &pp)
 	out.setCodec(pp.codec);
 	out.setSize(pp.size);
 	out.setFps(pp.fps);
+	out.setEncodePreset((VideoParams::EncodePreset)pp.encodePreset);
 	return out;
 }
 
@@ -66,6 +73,7 @@ static PVideoParams exportVideoParams(const VideoParams &p)
 	out.codec = p.codec();
 	out.size = p.size();
 	out.fps = p.fps();
+	out.encodePreset = (int)p.encodePreset();
 	return out;
 }
 
@@ -117,6 +125,11 @@ static PPayloadInfo exportPayloadInfo(const PayloadInfo &p)
 static Provider *g_provider = 0;
 static QPluginLoader *g_pluginLoader = 0;
 
+// stage-1 handle from preloadPlugin(), waiting for loadPlugin() to
+//   finish the job
+static QPluginLoader *g_preloadLoader = 0;
+static QString g_preloadFname;
+
 static void cleanupProvider();
 
 static Provider *provider()
@@ -161,11 +174,15 @@ bool isSupported()
 	return (provider() ? true : false);
 }
 
-PluginResult loadPlugin(const QString &fname, const QString &resourcePath)
+PluginResult preloadPlugin(const QString &fname)
 {
-	if(g_provider)
+	if(g_provider || g_preloadLoader)
 		return PluginSuccess;
 
+	// note: load() maps the library and checks the plugin metadata,
+	//   but does not instantiate anything.  symbol binding is lazy by
+	//   default, so this is essentially just the dlopen cost, which is
+	//   why it is safe (and worthwhile) to run off the main thread
 	QPluginLoader *loader = new QPluginLoader(fname);
 	if(!loader->load())
 	{
@@ -173,6 +190,35 @@ PluginResult loadPlugin(const QString &fname, const QString &resourcePath)
 		return ErrorLoad;
 	}
 
+	g_preloadLoader = loader;
+	g_preloadFname = fname;
+	qAddPostRoutine(cleanupProvider);
+	return PluginSuccess;
+}
+
+PluginResult loadPlugin(const QString &fname, const QString &resourcePath)
+{
+	if(g_provider)
+		return PluginSuccess;
+
+	QPluginLoader *loader = 0;
+	if(g_preloadLoader && g_preloadFname == fname)
+	{
+		// stage 1 already happened, don't resolve the library again
+		loader = g_preloadLoader;
+		g_preloadLoader = 0;
+		g_preloadFname.clear();
+	}
+	else
+	{
+		loader = new QPluginLoader(fname);
+		if(!loader->load())
+		{
+			delete loader;
+			return ErrorLoad;
+		}
+	}
+
 	Plugin *instance = qobject_cast<Plugin *>(loader->instance());
 	if(!instance)
 	{
@@ -204,6 +250,15 @@ PluginResult loadPlugin(const QString &fname, const QString &resourcePath)
 
 void cleanupProvider()
 {
+	// drop a preload handle that never got consumed
+	if(g_preloadLoader)
+	{
+		g_preloadLoader->unload();
+		delete g_preloadLoader;
+		g_preloadLoader = 0;
+		g_preloadFname.clear();
+	}
+
 	if(!g_provider)
 		return;
 
@@ -239,6 +294,9 @@ public:
 	Device::Type type;
 	QString id;
 	QString name;
+	QList<QSize> videoSizes;
+	QList<int> videoFramerates;
+	QList<int> audioSampleRates;
 };
 
 class Global
@@ -251,6 +309,9 @@ public:
 		dev.d->type = (Device::Type)pd.type;
 		dev.d->id = pd.id;
 		dev.d->name = pd.name;
+		dev.d->videoSizes = pd.videoSizes;
+		dev.d->videoFramerates = pd.videoFramerates;
+		dev.d->audioSampleRates = pd.audioSampleRates;
 		return dev;
 	}
 };
@@ -316,6 +377,21 @@ QString Device::id() const
 	return d->id;
 }
 
+QList<QSize> Device::videoSizes() const
+{
+	return d->videoSizes;
+}
+
+QList<int> Device::videoFramerates() const
+{
+	return d->videoFramerates;
+}
+
+QList<int> Device::audioSampleRates() const
+{
+	return d->audioSampleRates;
+}
+
 #ifdef QT_GUI_LIB
 //----------------------------------------------------------------------------
 // VideoWidget
@@ -330,10 +406,23 @@ public:
 	VideoWidget *q;
 	QSize videoSize;
 
+#ifdef QT_OPENGL_LIB
+	QGLWidget *surface;
+#endif
+
 	VideoWidgetPrivate(VideoWidget *_q) :
 		QObject(_q),
 		q(_q)
 	{
+#ifdef QT_OPENGL_LIB
+		surface = 0;
+#endif
+	}
+
+	// for the GL surface, which cannot emit our signal itself
+	void doPaint(QPainter *p)
+	{
+		emit paintEvent(p);
 	}
 
 	virtual QObject *qobject()
@@ -343,6 +432,15 @@ public:
 
 	virtual QWidget *qwidget()
 	{
+#ifdef QT_OPENGL_LIB
+		// when the GL surface is active, hand it to the provider
+		//   directly.  the surface sets WA_PaintOnScreen, which makes
+		//   us opaque-covered as far as the backing store is concerned,
+		//   so update() calls aimed at the parent would never turn into
+		//   paint events
+		if(surface)
+			return surface;
+#endif
 		return q;
 	}
 
@@ -357,10 +455,50 @@ signals:
 	void paintEvent(QPainter *p);
 };
 
+#ifdef QT_OPENGL_LIB
+// a QGLWidget child covering the whole VideoWidget.  painting a frame
+//   here goes through the GL paint engine, so drawImage becomes a
+//   texture upload and the scaling happens on the GPU instead of the
+//   UI thread.  the provider still paints through the same paintEvent
+//   signal and is none the wiser
+class VideoWidgetGlSurface : public QGLWidget
+{
+public:
+	VideoWidgetPrivate *owner;
+
+	VideoWidgetGlSurface(VideoWidgetPrivate *_owner, QWidget *parent) :
+		QGLWidget(parent),
+		owner(_owner)
+	{
+		// we cover the whole VideoWidget, so let clicks fall through
+		//   to it as they did before the GL path existed
+		setAttribute(Qt::WA_TransparentForMouseEvents);
+	}
+
+protected:
+	virtual void paintEvent(QPaintEvent *event)
+	{
+		Q_UNUSED(event);
+		QPainter p(this);
+		owner->doPaint(&p);
+	}
+};
+#endif
+
 VideoWidget::VideoWidget(QWidget *parent) :
 	QWidget(parent)
 {
 	d = new VideoWidgetPrivate(this);
+
+#ifdef QT_OPENGL_LIB
+	// prefer GL rendering when the system has it.  PSI_NO_OPENGL=1
+	//   forces the plain QPainter path
+	if(QGLFormat::hasOpenGL() && QString::fromLatin1(qgetenv("PSI_NO_OPENGL")) != "1")
+	{
+		d->surface = new VideoWidgetGlSurface(d, this);
+		d->surface->show();
+	}
+#endif
 }
 
 VideoWidget::~VideoWidget()
@@ -376,6 +514,14 @@ QSize VideoWidget::sizeHint() const
 void VideoWidget::paintEvent(QPaintEvent *event)
 {
 	Q_UNUSED(event);
+
+#ifdef QT_OPENGL_LIB
+	// the GL surface covers us and does the painting, and the
+	//   provider updates it directly (see qwidget()).  nothing to do
+	if(d->surface)
+		return;
+#endif
+
 	QPainter p(this);
 	emit d->paintEvent(&p);
 }
@@ -383,6 +529,12 @@ void VideoWidget::paintEvent(QPaintEvent *event)
 void VideoWidget::resizeEvent(QResizeEvent *event)
 {
 	Q_UNUSED(event);
+
+#ifdef QT_OPENGL_LIB
+	if(d->surface)
+		d->surface->setGeometry(rect());
+#endif
+
 	emit d->resized(size());
 }
 #endif
@@ -397,11 +549,13 @@ public:
 	int sampleRate;
 	int sampleSize;
 	int channels;
+	int ptime;
 
 	Private() :
 		sampleRate(0),
 		sampleSize(0),
-		channels(0)
+		channels(0),
+		ptime(-1)
 	{
 	}
 };
@@ -447,6 +601,11 @@ int AudioParams::channels() const
 	return d->channels;
 }
 
+int AudioParams::ptime() const
+{
+	return d->ptime;
+}
+
 void AudioParams::setCodec(const QString &s)
 {
 	d->codec = s;
@@ -467,12 +626,18 @@ void AudioParams::setChannels(int n)
 	d->channels = n;
 }
 
+void AudioParams::setPtime(int n)
+{
+	d->ptime = n;
+}
+
 bool AudioParams::operator==(const AudioParams &other) const
 {
 	if(d->codec == other.d->codec &&
 		d->sampleRate == other.d->sampleRate &&
 		d->sampleSize == other.d->sampleSize &&
-		d->channels == other.d->channels)
+		d->channels == other.d->channels &&
+		d->ptime == other.d->ptime)
 	{
 		return true;
 	}
@@ -489,9 +654,11 @@ public:
 	QString codec;
 	QSize size;
 	int fps;
+	VideoParams::EncodePreset encodePreset;
 
 	Private() :
-		fps(0)
+		fps(0),
+		encodePreset(VideoParams::PresetQuality)
 	{
 	}
 };
@@ -532,6 +699,11 @@ int VideoParams::fps() const
 	return d->fps;
 }
 
+VideoParams::EncodePreset VideoParams::encodePreset() const
+{
+	return d->encodePreset;
+}
+
 void VideoParams::setCodec(const QString &s)
 {
 	d->codec = s;
@@ -547,11 +719,17 @@ void VideoParams::setFps(int n)
 	d->fps = n;
 }
 
+void VideoParams::setEncodePreset(EncodePreset preset)
+{
+	d->encodePreset = preset;
+}
+
 bool VideoParams::operator==(const VideoParams &other) const
 {
 	if(d->codec == other.d->codec &&
 		d->size == other.d->size &&
-		d->fps == other.d->fps)
+		d->fps == other.d->fps &&
+		d->encodePreset == other.d->encodePreset)
 	{
 		return true;
 	}
@@ -607,6 +785,8 @@ public:
 		c = provider()->createFeatures();
 		c->qobject()->setParent(this);
 		connect(c->qobject(), SIGNAL(finished()), SLOT(c_finished()));
+		connect(c->qobject(), SIGNAL(progress(int)), SLOT(c_progress(int)));
+		connect(c->qobject(), SIGNAL(devicesChanged()), q, SIGNAL(devicesChanged()));
 	}
 
 	~Private()
@@ -638,6 +818,28 @@ private slots:
 		importResults(c->results());
 		emit q->finished();
 	}
+
+	void c_progress(int ptypes)
+	{
+		// the completed categories are final in the provider's partial
+		//   results, so importing the whole snapshot is safe: the rest
+		//   is still empty
+		importResults(c->results());
+
+		int types = 0;
+		if(ptypes & FeaturesContext::AudioOut)
+			types |= Features::AudioOut;
+		if(ptypes & FeaturesContext::AudioIn)
+			types |= Features::AudioIn;
+		if(ptypes & FeaturesContext::VideoIn)
+			types |= Features::VideoIn;
+		if(ptypes & FeaturesContext::AudioModes)
+			types |= Features::AudioModes;
+		if(ptypes & FeaturesContext::VideoModes)
+			types |= Features::VideoModes;
+
+		emit q->lookupProgress(types);
+	}
 };
 
 Features::Features(QObject *parent) :
@@ -664,6 +866,8 @@ void Features::lookup(int types)
 		ptypes |= FeaturesContext::AudioModes;
 	if(types & VideoModes)
 		ptypes |= FeaturesContext::VideoModes;
+	if(types & DeviceCaps)
+		ptypes |= FeaturesContext::DeviceCaps;
 
 	d->clearResults();
 	d->c->lookup(ptypes);
@@ -711,11 +915,55 @@ public:
 	QByteArray rawValue;
 	int portOffset;
 
+	// wire arrival time in monotonic nanoseconds, -1 = unknown
+	qint64 arrivalNsecs;
+
+	// set for borrowed-buffer packets.  the deleter fires when the
+	//   last reference goes away, which may be on any thread
+	bool borrowed;
+	void (*deleter)(void *arg);
+	void *deleterArg;
+
 	Private(const QByteArray &_rawValue, int _portOffset) :
 		rawValue(_rawValue),
-		portOffset(_portOffset)
+		portOffset(_portOffset),
+		arrivalNsecs(-1),
+		borrowed(false),
+		deleter(0),
+		deleterArg(0)
+	{
+	}
+
+	Private(const unsigned char *buf, int size, int _portOffset, void (*_deleter)(void *), void *_deleterArg) :
+		rawValue(QByteArray::fromRawData((const char *)buf, size)),
+		portOffset(_portOffset),
+		arrivalNsecs(-1),
+		borrowed(true),
+		deleter(_deleter),
+		deleterArg(_deleterArg)
+	{
+	}
+
+	// a detached copy owns its own deep copy of the data and never
+	//   the deleter, so borrowed buffers can't be released twice
+	Private(const Private &other) :
+		QSharedData(other),
+		rawValue(other.rawValue.constData(), other.rawValue.size()),
+		portOffset(other.portOffset),
+		arrivalNsecs(other.arrivalNsecs),
+		borrowed(false),
+		deleter(0),
+		deleterArg(0)
 	{
 	}
+
+	~Private()
+	{
+		// drop our view of the data before handing the buffer back
+		rawValue = QByteArray();
+		if(deleter)
+			deleter(deleterArg);
+	}
 };
 
 RtpPacket::RtpPacket() :
@@ -728,6 +976,11 @@ RtpPacket::RtpPacket(const QByteArray &rawValue, int portOffset) :
 {
 }
 
+RtpPacket::RtpPacket(const unsigned char *buf, int size, int portOffset, void (*deleter)(void *arg), void *deleterArg) :
+	d(new Private(buf, size, portOffset, deleter, deleterArg))
+{
+}
+
 RtpPacket::RtpPacket(const RtpPacket &other) :
 	d(other.d)
 {
@@ -748,6 +1001,11 @@ bool RtpPacket::isNull() const
 	return (d ? false : true);
 }
 
+bool RtpPacket::isBorrowed() const
+{
+	return (d ? d->borrowed : false);
+}
+
 QByteArray RtpPacket::rawValue() const
 {
 	return d->rawValue;
@@ -758,6 +1016,17 @@ int RtpPacket::portOffset() const
 	return d->portOffset;
 }
 
+qint64 RtpPacket::arrivalNsecs() const
+{
+	return (d ? d->arrivalNsecs : -1);
+}
+
+void RtpPacket::setArrivalNsecs(qint64 ns)
+{
+	if(d)
+		d->arrivalNsecs = ns;
+}
+
 //----------------------------------------------------------------------------
 // RtpChannel
 //----------------------------------------------------------------------------
@@ -769,6 +1038,7 @@ public:
 	RtpChannel *q;
 	RtpChannelContext *c;
 	bool enabled;
+	bool directEnabled;
 	int readyReadListeners;
 
 	RtpChannelPrivate(RtpChannel *_q) :
@@ -776,6 +1046,7 @@ public:
 		q(_q),
 		c(0),
 		enabled(false),
+		directEnabled(false),
 		readyReadListeners(0)
 	{
 	}
@@ -797,6 +1068,7 @@ public:
 		c->qobject()->setParent(this);
 		connect(c->qobject(), SIGNAL(readyRead()), SLOT(c_readyRead()));
 		connect(c->qobject(), SIGNAL(packetsWritten(int)), SLOT(c_packetsWritten(int)));
+		connect(c->qobject(), SIGNAL(pressureChanged(bool)), SLOT(c_pressureChanged(bool)));
 		connect(c->qobject(), SIGNAL(destroyed()), SLOT(c_destroyed()));
 
 		if(readyReadListeners > 0)
@@ -817,6 +1089,11 @@ private slots:
 		emit q->packetsWritten(count);
 	}
 
+	void c_pressureChanged(bool underPressure)
+	{
+		emit q->pressureChanged(underPressure);
+	}
+
 	void c_destroyed()
 	{
 		enabled = false;
@@ -853,6 +1130,17 @@ RtpPacket RtpChannel::read()
 		return RtpPacket();
 }
 
+QList<RtpPacket> RtpChannel::readAll()
+{
+	QList<RtpPacket> out;
+	if(d->c)
+	{
+		foreach(const PRtpPacket &pp, d->c->readAll())
+			out += RtpPacket(pp.rawValue, pp.portOffset);
+	}
+	return out;
+}
+
 void RtpChannel::write(const RtpPacket &rtp)
 {
 	if(d->c)
@@ -866,10 +1154,36 @@ void RtpChannel::write(const RtpPacket &rtp)
 		PRtpPacket pp;
 		pp.rawValue = rtp.rawValue();
 		pp.portOffset = rtp.portOffset();
+		pp.arrivalNsecs = rtp.arrivalNsecs();
+
+		// a borrowed view is only zero-copy on the direct path, where
+		//   the pipeline consumes the bytes before write() returns.
+		//   the queued path holds the data beyond the caller's buffer
+		//   lifetime, so materialize a copy at the boundary
+		if(rtp.isBorrowed() && !d->directEnabled)
+			pp.rawValue = QByteArray(pp.rawValue.constData(), pp.rawValue.size());
+
 		d->c->write(pp);
 	}
 }
 
+void RtpChannel::setDirectWriteEnabled(bool enable)
+{
+	if(d->c)
+	{
+		// enable the channel up front, so that write() from a foreign
+		//   thread never has to perform the lazy enable itself
+		if(enable && !d->enabled)
+		{
+			d->enabled = true;
+			d->c->setEnabled(true);
+		}
+
+		d->directEnabled = enable;
+		d->c->setDirectWriteEnabled(enable);
+	}
+}
+
 void RtpChannel::connectNotify(const char *signal)
 {
 	int oldtotal = d->readyReadListeners;
@@ -1067,6 +1381,213 @@ bool PayloadInfo::operator==(const PayloadInfo &other) const
 	return (*d == *other.d);
 }
 
+//----------------------------------------------------------------------------
+// RtpSessionStats
+//----------------------------------------------------------------------------
+class RtpSessionStats::Private
+{
+public:
+	PRtpSessionStats p;
+};
+
+RtpSessionStats::RtpSessionStats() :
+	d(new Private)
+{
+}
+
+RtpSessionStats::RtpSessionStats(const RtpSessionStats &other) :
+	d(new Private(*other.d))
+{
+}
+
+RtpSessionStats::~RtpSessionStats()
+{
+	delete d;
+}
+
+RtpSessionStats & RtpSessionStats::operator=(const RtpSessionStats &other)
+{
+	*d = *other.d;
+	return *this;
+}
+
+int RtpSessionStats::audioPacketsSent() const
+{
+	return d->p.audioPacketsSent;
+}
+
+int RtpSessionStats::audioBytesSent() const
+{
+	return d->p.audioBytesSent;
+}
+
+int RtpSessionStats::videoPacketsSent() const
+{
+	return d->p.videoPacketsSent;
+}
+
+int RtpSessionStats::videoBytesSent() const
+{
+	return d->p.videoBytesSent;
+}
+
+int RtpSessionStats::audioPacketsReceived() const
+{
+	return d->p.audioPacketsReceived;
+}
+
+int RtpSessionStats::audioBytesReceived() const
+{
+	return d->p.audioBytesReceived;
+}
+
+int RtpSessionStats::audioPacketsLost() const
+{
+	return d->p.audioPacketsLost;
+}
+
+int RtpSessionStats::videoPacketsReceived() const
+{
+	return d->p.videoPacketsReceived;
+}
+
+int RtpSessionStats::videoBytesReceived() const
+{
+	return d->p.videoBytesReceived;
+}
+
+int RtpSessionStats::videoPacketsLost() const
+{
+	return d->p.videoPacketsLost;
+}
+
+int RtpSessionStats::previewFrames() const
+{
+	return d->p.previewFrames;
+}
+
+int RtpSessionStats::outputFrames() const
+{
+	return d->p.outputFrames;
+}
+
+int RtpSessionStats::audioJitterMs() const
+{
+	return d->p.audioJitterMs;
+}
+
+int RtpSessionStats::audioJitterBufferMs() const
+{
+	return d->p.audioJitterBufferMs;
+}
+
+int RtpSessionStats::audioPacketsDropped() const
+{
+	return d->p.audioPacketsDropped;
+}
+
+int RtpSessionStats::videoPacketsDropped() const
+{
+	return d->p.videoPacketsDropped;
+}
+
+int RtpSessionStats::audioRttMs() const
+{
+	return d->p.audioRttMs;
+}
+
+int RtpSessionStats::videoRttMs() const
+{
+	return d->p.videoRttMs;
+}
+
+int RtpSessionStats::audioPacketsLostRemote() const
+{
+	return d->p.audioPacketsLostRemote;
+}
+
+int RtpSessionStats::videoPacketsLostRemote() const
+{
+	return d->p.videoPacketsLostRemote;
+}
+
+QList<RtpSessionStats::ObjectCounter> RtpSessionStats::objectCounters() const
+{
+	QList<ObjectCounter> out;
+	foreach(const PObjectCounter &pc, d->p.objectCounters)
+	{
+		ObjectCounter c;
+		c.name = pc.name;
+		c.live = pc.live;
+		c.highWatermark = pc.highWatermark;
+		out += c;
+	}
+	return out;
+}
+
+QList<RtpSessionStats::StallCounter> RtpSessionStats::stallCounters() const
+{
+	QList<StallCounter> out;
+	foreach(const PStallCounter &pc, d->p.stallCounters)
+	{
+		StallCounter c;
+		c.stage = pc.stage;
+		c.count = pc.count;
+		out += c;
+	}
+	return out;
+}
+
+//----------------------------------------------------------------------------
+// ResourceUsage
+//----------------------------------------------------------------------------
+class ResourceUsage::Private
+{
+public:
+	PResourceUsage p;
+};
+
+ResourceUsage::ResourceUsage() :
+	d(new Private)
+{
+}
+
+ResourceUsage::ResourceUsage(const ResourceUsage &other) :
+	d(new Private(*other.d))
+{
+}
+
+ResourceUsage::~ResourceUsage()
+{
+	delete d;
+}
+
+ResourceUsage & ResourceUsage::operator=(const ResourceUsage &other)
+{
+	*d = *other.d;
+	return *this;
+}
+
+qint64 ResourceUsage::cpuNsecs() const
+{
+	return d->p.cpuNsecs;
+}
+
+int ResourceUsage::streamingThreads() const
+{
+	return d->p.streamingThreads;
+}
+
+int ResourceUsage::poolPacketsServed() const
+{
+	return d->p.poolPacketsServed;
+}
+
+int ResourceUsage::poolPacketsMissed() const
+{
+	return d->p.poolPacketsMissed;
+}
+
 //----------------------------------------------------------------------------
 // RtpSession
 //----------------------------------------------------------------------------
@@ -1079,6 +1600,8 @@ public:
 	RtpSessionContext *c;
 	RtpChannel audioRtpChannel;
 	RtpChannel videoRtpChannel;
+	RtpChannel audioRtcpChannel;
+	RtpChannel videoRtcpChannel;
 
 	RtpSessionPrivate(RtpSession *_q) :
 		QObject(_q),
@@ -1090,10 +1613,13 @@ public:
 		connect(c->qobject(), SIGNAL(preferencesUpdated()), SLOT(c_preferencesUpdated()));
 		connect(c->qobject(), SIGNAL(audioOutputIntensityChanged(int)), SLOT(c_audioOutputIntensityChanged(int)));
 		connect(c->qobject(), SIGNAL(audioInputIntensityChanged(int)), SLOT(c_audioInputIntensityChanged(int)));
+		connect(c->qobject(), SIGNAL(audioInputTalkingChanged(bool)), SLOT(c_audioInputTalkingChanged(bool)));
+		connect(c->qobject(), SIGNAL(stalled(const QString &)), SLOT(c_stalled(const QString &)));
 		connect(c->qobject(), SIGNAL(stoppedRecording()), SLOT(c_stoppedRecording()));
 		connect(c->qobject(), SIGNAL(stopped()), SLOT(c_stopped()));
 		connect(c->qobject(), SIGNAL(finished()), SLOT(c_finished()));
 		connect(c->qobject(), SIGNAL(error()), SLOT(c_error()));
+		connect(c->qobject(), SIGNAL(videoShmFrameReady(const PsiMedia::PVideoShmFrame &)), SLOT(c_videoShmFrameReady(const PsiMedia::PVideoShmFrame &)));
 	}
 
 	~RtpSessionPrivate()
@@ -1106,6 +1632,8 @@ private slots:
 	{
 		audioRtpChannel.d->setContext(c->audioRtpChannel());
 		videoRtpChannel.d->setContext(c->videoRtpChannel());
+		audioRtcpChannel.d->setContext(c->audioRtcpChannel());
+		videoRtcpChannel.d->setContext(c->videoRtcpChannel());
 		emit q->started();
 	}
 
@@ -1124,6 +1652,16 @@ private slots:
 		emit q->audioInputIntensityChanged(intensity);
 	}
 
+	void c_audioInputTalkingChanged(bool talking)
+	{
+		emit q->audioInputTalkingChanged(talking);
+	}
+
+	void c_stalled(const QString &stage)
+	{
+		emit q->stalled(stage);
+	}
+
 	void c_stoppedRecording()
 	{
 		emit q->stoppedRecording();
@@ -1133,6 +1671,8 @@ private slots:
 	{
 		audioRtpChannel.d->setContext(0);
 		videoRtpChannel.d->setContext(0);
+		audioRtcpChannel.d->setContext(0);
+		videoRtcpChannel.d->setContext(0);
 		emit q->stopped();
 	}
 
@@ -1140,6 +1680,8 @@ private slots:
 	{
 		audioRtpChannel.d->setContext(0);
 		videoRtpChannel.d->setContext(0);
+		audioRtcpChannel.d->setContext(0);
+		videoRtcpChannel.d->setContext(0);
 		emit q->finished();
 	}
 
@@ -1147,8 +1689,22 @@ private slots:
 	{
 		audioRtpChannel.d->setContext(0);
 		videoRtpChannel.d->setContext(0);
+		audioRtcpChannel.d->setContext(0);
+		videoRtcpChannel.d->setContext(0);
 		emit q->error();
 	}
+
+	void c_videoShmFrameReady(const PsiMedia::PVideoShmFrame &pframe)
+	{
+		VideoShmFrame frame;
+		frame.fd = pframe.fd;
+		frame.ringSize = pframe.ringSize;
+		frame.offset = pframe.offset;
+		frame.width = pframe.width;
+		frame.height = pframe.height;
+		frame.stride = pframe.stride;
+		emit q->videoShmFrameReady(frame);
+	}
 };
 
 RtpSession::RtpSession(QObject *parent) :
@@ -1217,6 +1773,11 @@ void RtpSession::setRecordingQIODevice(QIODevice *dev)
 	d->c->setRecorder(dev);
 }
 
+void RtpSession::setRecordingFile(const QString &fileName)
+{
+	d->c->setRecordingFile(fileName);
+}
+
 void RtpSession::stopRecording()
 {
 	d->c->stopRecording();
@@ -1243,6 +1804,36 @@ void RtpSession::setMaximumSendingBitrate(int kbps)
 	d->c->setMaximumSendingBitrate(kbps);
 }
 
+void RtpSession::setPathMtu(int bytes)
+{
+	d->c->setPathMtu(bytes);
+}
+
+void RtpSession::setDtxEnabled(bool enabled)
+{
+	d->c->setDtxEnabled(enabled);
+}
+
+void RtpSession::setAudioJitterLatencyRange(int minMs, int maxMs)
+{
+	d->c->setAudioJitterLatencyRange(minMs, maxMs);
+}
+
+void RtpSession::setVideoBurstBudget(int packets)
+{
+	d->c->setVideoBurstBudget(packets);
+}
+
+void RtpSession::setOutgoingSrtpKey(const QByteArray &keyAndSalt)
+{
+	d->c->setOutgoingSrtpKey(keyAndSalt);
+}
+
+void RtpSession::setIncomingSrtpKey(const QByteArray &keyAndSalt)
+{
+	d->c->setIncomingSrtpKey(keyAndSalt);
+}
+
 void RtpSession::setRemoteAudioPreferences(const QList<PayloadInfo> &info)
 {
 	QList<PPayloadInfo> list;
@@ -1259,6 +1850,16 @@ void RtpSession::setRemoteVideoPreferences(const QList<PayloadInfo> &info)
 	d->c->setRemoteVideoPreferences(list);
 }
 
+void RtpSession::setCombinedRtpInputEnabled(bool enabled)
+{
+	d->c->setCombinedRtpInputEnabled(enabled);
+}
+
+void RtpSession::setVideoShmExportEnabled(bool enabled)
+{
+	d->c->setVideoShmExportEnabled(enabled);
+}
+
 void RtpSession::start()
 {
 	d->c->start();
@@ -1289,6 +1890,11 @@ void RtpSession::pauseVideo()
 	d->c->pauseVideo();
 }
 
+void RtpSession::requestKeyframe()
+{
+	d->c->requestKeyframe();
+}
+
 void RtpSession::stop()
 {
 	d->c->stop();
@@ -1377,6 +1983,35 @@ RtpSession::Error RtpSession::errorCode() const
 	return (RtpSession::Error)d->c->errorCode();
 }
 
+RtpSessionStats RtpSession::statistics() const
+{
+	RtpSessionStats out;
+	out.d->p = d->c->statistics();
+	return out;
+}
+
+ResourceUsage RtpSession::resourceUsage() const
+{
+	ResourceUsage out;
+	out.d->p = d->c->resourceUsage();
+	return out;
+}
+
+int RtpSession::audioInputIntensity() const
+{
+	return d->c->audioInputIntensity();
+}
+
+int RtpSession::audioOutputIntensity() const
+{
+	return d->c->audioOutputIntensity();
+}
+
+void RtpSession::setAudioIntensityInterval(int ms)
+{
+	d->c->setAudioIntensityInterval(ms);
+}
+
 RtpChannel *RtpSession::audioRtpChannel()
 {
 	return &d->audioRtpChannel;
@@ -1387,6 +2022,16 @@ RtpChannel *RtpSession::videoRtpChannel()
 	return &d->videoRtpChannel;
 }
 
+RtpChannel *RtpSession::audioRtcpChannel()
+{
+	return &d->audioRtcpChannel;
+}
+
+RtpChannel *RtpSession::videoRtcpChannel()
+{
+	return &d->videoRtcpChannel;
+}
+
 }
 
 #include "psimedia.moc"
@@ -47,6 +47,17 @@ enum PluginResult
 bool isSupported();
 PluginResult loadPlugin(const QString &fname, const QString &resourcePath);
 void unloadPlugin();
+
+// optional staged loading, for apps with a tight cold-start budget.
+//   preloadPlugin() does only the cheap first stage: it maps the plugin
+//   library (symbol binding stays lazy) and verifies it is a usable
+//   plugin, without creating the provider or touching the media stack.
+//   it is safe to call from a background thread early in startup.  a
+//   later loadPlugin() with the same fname then picks up the preloaded
+//   handle instead of resolving the library again, leaving only the
+//   provider warmup on the critical path.  calling loadPlugin() without
+//   preloading, or with a different fname, works as before
+PluginResult preloadPlugin(const QString &fname);
 QString creditName();
 QString creditText();
 
@@ -70,6 +81,15 @@ public:
 	QString name() const;
 	QString id() const;
 
+	// device capabilities, filled in when the lookup included
+	//   Features::DeviceCaps (empty otherwise): capture sizes and
+	//   framerates for cameras, sample rates for audio devices.  a
+	//   settings dialog can populate its mode lists from these instead
+	//   of trial-opening the device per mode
+	QList<QSize> videoSizes() const;
+	QList<int> videoFramerates() const;
+	QList<int> audioSampleRates() const;
+
 private:
 	class Private;
 	friend class Global;
@@ -117,10 +137,16 @@ public:
 	int sampleSize() const;
 	int channels() const;
 
+	// preferred packetization interval in milliseconds, or -1 for the
+	//   codec default (20ms).  larger intervals cut packet rate and
+	//   header overhead on constrained links, at the cost of latency
+	int ptime() const;
+
 	void setCodec(const QString &s);
 	void setSampleRate(int n);
 	void setSampleSize(int n);
 	void setChannels(int n);
+	void setPtime(int n);
 
 	bool operator==(const AudioParams &other) const;
 
@@ -137,6 +163,16 @@ private:
 class VideoParams
 {
 public:
+	// encoder speed/latency tradeoff.  Quality keeps the codec's
+	//   defaults, Balanced and Realtime progressively trade compression
+	//   efficiency for cpu headroom and lower delay
+	enum EncodePreset
+	{
+		PresetQuality,
+		PresetBalanced,
+		PresetRealtime
+	};
+
 	VideoParams();
 	VideoParams(const VideoParams &other);
 	~VideoParams();
@@ -145,10 +181,12 @@ public:
 	QString codec() const;
 	QSize size() const;
 	int fps() const;
+	EncodePreset encodePreset() const;
 
 	void setCodec(const QString &s);
 	void setSize(const QSize &s);
 	void setFps(int n);
+	void setEncodePreset(EncodePreset preset);
 
 	bool operator==(const VideoParams &other) const;
 
@@ -174,7 +212,14 @@ public:
 		VideoIn    = 0x04,
 		AudioModes = 0x08,
 		VideoModes = 0x10,
-		All        = 0xff
+
+		// add capability probing to the device lookups (see
+		//   Device::videoSizes et al).  each device is opened once
+		//   during the lookup, so this is opt-in and deliberately not
+		//   part of All
+		DeviceCaps = 0x20,
+
+		All        = 0x1f
 	};
 
 	Features(QObject *parent = 0);
@@ -193,6 +238,20 @@ public:
 signals:
 	void finished();
 
+	// a lookup category completed before the whole lookup did; types
+	//   is the bitmask of Type flags whose accessors now return final
+	//   results.  modes come first (they are table lookups), then each
+	//   device class as its probe finishes, so a call window can react
+	//   to audio devices without waiting out webcam enumeration.
+	//   finished() still follows once everything is in
+	void lookupProgress(int types);
+
+	// the devices available on the system have changed (e.g. a usb
+	//   headset was plugged in).  call lookup() again for the new set.
+	//   only emitted on platforms with hotplug monitoring support; a
+	//   portable application should still offer a manual refresh.
+	void devicesChanged();
+
 private:
 	class Private;
 	friend class Private;
@@ -204,15 +263,38 @@ class RtpPacket
 public:
 	RtpPacket();
 	RtpPacket(const QByteArray &rawValue, int portOffset);
+
+	// zero-copy view over an application-owned buffer.  the data is
+	//   not copied; deleter(deleterArg) is called once, from an
+	//   arbitrary thread, when the last copy of the packet goes away,
+	//   so a receive ring can hand slots straight into the pipeline.
+	//   deleter may be 0 if the caller guarantees the buffer outlives
+	//   the write call.  borrowed packets are consumed without a copy
+	//   on the direct write path (see setDirectWriteEnabled); on the
+	//   queued path the payload is copied at the channel boundary
+	RtpPacket(const unsigned char *buf, int size, int portOffset, void (*deleter)(void *arg), void *deleterArg);
+
 	RtpPacket(const RtpPacket &other);
 	~RtpPacket();
 	RtpPacket & operator=(const RtpPacket &other);
 
 	bool isNull() const;
+	bool isBorrowed() const;
 
 	QByteArray rawValue() const;
 	int portOffset() const;
 
+	// when the packet actually arrived on the wire, in nanoseconds on
+	//   the system monotonic clock (clock_gettime(CLOCK_MONOTONIC); the
+	//   performance counter on windows), or -1 when unknown (the
+	//   default).  set it from SO_TIMESTAMPNS/recvmmsg data, converted
+	//   to the monotonic clock, before write(): the pipeline then
+	//   timestamps the packet at its true arrival instead of at the
+	//   moment it reaches the media thread, so socket-thread and
+	//   eventloop delays stop polluting the jitter measurement
+	qint64 arrivalNsecs() const;
+	void setArrivalNsecs(qint64 ns);
+
 private:
 	class Private;
 	QSharedDataPointer<Private> d;
@@ -227,12 +309,32 @@ class RtpChannel : public QObject
 public:
 	int packetsAvailable() const;
 	RtpPacket read();
+
+	// read every queued packet in one call.  a single readyRead can
+	//   announce many packets, so when the receiver just forwards them
+	//   to a socket this is cheaper than calling read() in a loop.
+	QList<RtpPacket> readAll();
+
 	void write(const RtpPacket &rtp);
 
+	// opt in to calling write() from any thread.  when enabled, write()
+	//   pushes the packet into the pipeline from the calling thread
+	//   rather than waiting for the application eventloop, which removes
+	//   a queuing hop from the receive path.  packetsWritten is still
+	//   emitted from the channel's own thread.  enable this before the
+	//   first foreign-thread write() call.
+	void setDirectWriteEnabled(bool enable);
+
 signals:
 	void readyRead();
 	void packetsWritten(int count);
 
+	// inbound backpressure.  emitted with true when the receive queue
+	//   crosses its high watermark (the reader is falling behind, and
+	//   packets may be dropped), and with false once it drains below
+	//   the low watermark again.
+	void pressureChanged(bool underPressure);
+
 protected:
 	virtual void connectNotify(const char *signal);
 	virtual void disconnectNotify(const char *signal);
@@ -303,6 +405,145 @@ private:
 	Private *d;
 };
 
+// snapshot of session counters, obtained via RtpSession::statistics().
+//   all values count from the start of the session.  byte counters wrap
+//   at 2^31
+class RtpSessionStats
+{
+public:
+	// live count of buffers held at one instrumented site, with the
+	//   highest level ever seen.  over a soak run, a counter that only
+	//   climbs names the leaking site
+	class ObjectCounter
+	{
+	public:
+		QString name;
+		int live;
+		int highWatermark;
+
+		inline ObjectCounter() :
+			live(0),
+			highWatermark(0)
+		{
+		}
+	};
+
+	// how many times the pipeline watchdog flagged one stage as
+	//   stalled (flowing, then no progress for a whole detection
+	//   window)
+	class StallCounter
+	{
+	public:
+		QString stage;
+		int count;
+
+		inline StallCounter() :
+			count(0)
+		{
+		}
+	};
+
+	RtpSessionStats();
+	RtpSessionStats(const RtpSessionStats &other);
+	~RtpSessionStats();
+	RtpSessionStats & operator=(const RtpSessionStats &other);
+
+	int audioPacketsSent() const;
+	int audioBytesSent() const;
+	int videoPacketsSent() const;
+	int videoBytesSent() const;
+	int audioPacketsReceived() const;
+	int audioBytesReceived() const;
+	int audioPacketsLost() const;
+	int videoPacketsReceived() const;
+	int videoBytesReceived() const;
+	int videoPacketsLost() const;
+	int previewFrames() const;
+	int outputFrames() const;
+	int audioJitterMs() const; // measured interarrival jitter
+	int audioJitterBufferMs() const; // current jitter buffer latency
+	int audioPacketsDropped() const; // dropped locally, queue overflow
+	int videoPacketsDropped() const; // dropped locally, queue overflow
+
+	// learned from the peer's rtcp reports.  rtt is -1 until the
+	//   first round trip completes
+	int audioRttMs() const;
+	int videoRttMs() const;
+	int audioPacketsLostRemote() const; // sent packets the peer lost
+	int videoPacketsLostRemote() const; // sent packets the peer lost
+
+	// per-site live buffer counts, process-wide.  empty unless
+	//   instrumentation is enabled (PSI_BUFMON=1)
+	QList<ObjectCounter> objectCounters() const;
+
+	// cumulative stalls flagged by the pipeline watchdog, per stage
+	//   name (e.g. "video-capture").  empty while nothing has stalled
+	QList<StallCounter> stallCounters() const;
+
+private:
+	class Private;
+	friend class RtpSession;
+	Private *d;
+};
+
+// host resources attributable to one session, obtained via
+//   RtpSession::resourceUsage().  intended for supervisors that need to
+//   know which call is eating the box and shed load accordingly
+class ResourceUsage
+{
+public:
+	ResourceUsage();
+	ResourceUsage(const ResourceUsage &other);
+	~ResourceUsage();
+	ResourceUsage & operator=(const ResourceUsage &other);
+
+	// cpu time consumed by the session's media pipeline threads, in
+	//   nanoseconds, and how many distinct threads have been observed.
+	//   this covers capture, encode, decode and playback, but not work
+	//   the host does on the session's behalf elsewhere
+	qint64 cpuNsecs() const;
+	int streamingThreads() const;
+
+	// buffer traffic through the rtp packet pool.  the pool is shared
+	//   by all sessions in the process, so these are process-wide
+	int poolPacketsServed() const;
+	int poolPacketsMissed() const; // fell back to the allocator
+
+private:
+	class Private;
+	friend class RtpSession;
+	Private *d;
+};
+
+// a received video frame living in shared memory, delivered via
+//   RtpSession::videoShmFrameReady() when shm export is enabled.  fd
+//   refers to the whole segment of ringSize bytes and only changes when
+//   the segment is recreated (e.g. the resolution grew): send it to the
+//   renderer process once, let it mmap the segment, and every frame
+//   after that is just an offset.  pixels are rgb32.  the slot is
+//   overwritten again several frames later, so a renderer that keeps up
+//   never sees a torn frame
+class VideoShmFrame
+{
+public:
+	int fd;
+	int ringSize;
+	int offset;
+	int width;
+	int height;
+	int stride;
+
+	inline VideoShmFrame() :
+		fd(-1),
+		ringSize(0),
+		offset(0),
+		width(0),
+		height(0),
+		stride(0)
+	{
+	}
+};
+
 class RtpSession : public QObject
 {
 	Q_OBJECT
@@ -322,6 +563,10 @@ public:
 
 	void setAudioOutputDevice(const QString &deviceId);
 #ifdef QT_GUI_LIB
+	// widgets may be attached and detached (pass 0) at any time, during
+	//   a session too.  while no widget is attached the pipeline stops
+	//   converting frames for that view entirely, so detaching on
+	//   minimize is a real cpu saving, not just a skipped paint
 	void setVideoOutputWidget(VideoWidget *widget);
 #endif
 
@@ -336,9 +581,20 @@ public:
 
 	// pass a QIODevice to record to.  if a device is set before starting
 	//   the session, then recording will wait until it starts.
-	// records in ogg theora+vorbis format
+	// records in ogg theora+vorbis format by default; set
+	//   PSI_RECORD_CONTAINER=matroska in the environment for matroska
 	void setRecordingQIODevice(QIODevice *dev);
 
+	// pass a file path to record to.  unlike the QIODevice variant, the
+	//   file is written by a dedicated disk thread inside the provider,
+	//   so recording i/o never runs on the application's thread.  when
+	//   the recording completes, a seek index is finalized next to it
+	//   (fileName + ".idx"): a plain-text list of "<ms> <byte offset>"
+	//   cue points (every PSI_RECORD_CUE_SECS seconds, default 5), so a
+	//   review tool can open long recordings and seek without scanning
+	//   the whole file
+	void setRecordingFile(const QString &fileName);
+
 	// stop recording operation.  wait for stoppedRecording signal before
 	//   QIODevice is released.
 	void stopRecording();
@@ -349,10 +605,66 @@ public:
 
 	void setMaximumSendingBitrate(int kbps);
 
+	// effective path mtu in bytes: the largest ip packet the route
+	//   delivers unfragmented (e.g. 1200 on some vpns).  packetization
+	//   is budgeted to keep every rtp packet — including srtp and fec
+	//   overhead — within it, since a fragmented packet dropped by one
+	//   fragment loses the whole pair.  by default the payloaders'
+	//   built-in limit (~1400) is used.  set before starting, or call
+	//   updatePreferences() to apply to a live session
+	void setPathMtu(int bytes);
+
+	// voice activity detection / discontinuous transmission for the
+	//   audio send path.  during silence the encoder emits minimal
+	//   comfort-noise frames and most are withheld from the wire,
+	//   which roughly halves audio bandwidth and encode cpu on a
+	//   typical one-sided conversation.  talkspurt boundaries are
+	//   reported through audioInputTalkingChanged, e.g. for a "you
+	//   are talking" indicator.  set before starting, or call
+	//   updatePreferences() to apply to a live session
+	void setDtxEnabled(bool enabled);
+
+	// bound the audio jitter buffer latency, in milliseconds.  when a
+	//   range is set, the buffer adapts its target latency to the
+	//   measured network jitter within these bounds.  by default the
+	//   latency is fixed.  set before starting the session.
+	void setAudioJitterLatencyRange(int minMs, int maxMs);
+
+	// smooth video keyframe bursts: at most this many packets leave
+	//   back-to-back per frame, the rest are spread over the frame
+	//   interval.  helps routers that drop-tail bursts.  by default
+	//   packets go out as the encoder produces them
+	void setVideoBurstBudget(int packets);
+
+	// enable srtp (aes-cm-128 with 80 bit hmac-sha1 tags), applied
+	//   in place on the packet buffers inside the session — encrypted
+	//   packets come out of the rtp channels and plaintext never has
+	//   to round-trip through application code.  keyAndSalt is the
+	//   16 byte master key followed by the 14 byte master salt (30
+	//   bytes total, e.g. as negotiated via xmpp jingle or sdes); an
+	//   empty array disables the direction.  may be set before start
+	//   or live (a rekey restarts the crypto streams)
+	void setOutgoingSrtpKey(const QByteArray &keyAndSalt);
+	void setIncomingSrtpKey(const QByteArray &keyAndSalt);
+
 	// set remote preferences, using payloadinfo.
 	void setRemoteAudioPreferences(const QList<PayloadInfo> &info);
 	void setRemoteVideoPreferences(const QList<PayloadInfo> &info);
 
+	// accept audio and video multiplexed together on the audio rtp
+	//   channel.  packets are sorted to the right stream by payload
+	//   type, using the ids from the remote preferences, so the app
+	//   doesn't have to parse headers itself.  the video rtp channel
+	//   then carries no input.  set the remote preferences first
+	void setCombinedRtpInputEnabled(bool enabled);
+
+	// deliver received video through a shared memory ring (see
+	//   VideoShmFrame) instead of the output widget, so a renderer in
+	//   another process can paint without any pixel copies made here.
+	//   unix only; elsewhere the output widget keeps working as usual.
+	//   set before starting the session
+	void setVideoShmExportEnabled(bool enabled);
+
 	// usage strategy:
 	//   - initiator sets local prefs / bitrate
 	//   - initiator starts(), waits for started()
@@ -440,6 +752,12 @@ public:
 	void transmitVideo();
 	void pauseAudio();
 	void pauseVideo();
+
+	// forces the video encoder to emit a keyframe as soon as possible,
+	//   so the peer can recover from picture loss without waiting for
+	//   the next periodic one.  call this when a PLI arrives
+	void requestKeyframe();
+
 	void stop();
 
 	// in a correctly negotiated session, there will be an equal amount of
@@ -480,18 +798,54 @@ public:
 
 	Error errorCode() const;
 
+	// counter snapshot, cheap enough to poll at any rate
+	RtpSessionStats statistics() const;
+
+	// host resource snapshot, cheap enough to poll at any rate
+	ResourceUsage resourceUsage() const;
+
+	// current audio meter levels, maintained inside the pipeline and
+	//   cheap enough to poll at any rate.  input is 0-100; output is
+	//   0-100, or -1 before any audio has been received.  these do not
+	//   require the intensity signals to be enabled
+	int audioInputIntensity() const;
+	int audioOutputIntensity() const;
+
+	// opt in to the audioInputIntensityChanged /
+	//   audioOutputIntensityChanged signals, emitted every ms
+	//   milliseconds.  <1 (the default) disables them.  polling the
+	//   methods above is preferable when driving many meters, as it
+	//   generates no cross-thread traffic
+	void setAudioIntensityInterval(int ms);
+
 	RtpChannel *audioRtpChannel();
 	RtpChannel *videoRtpChannel();
 
+	// rtcp companions to the rtp channels.  reports are generated and
+	//   consumed internally; the app just transports the packets the
+	//   same way it does the rtp flows
+	RtpChannel *audioRtcpChannel();
+	RtpChannel *videoRtcpChannel();
+
 signals:
 	void started();
 	void preferencesUpdated();
 	void audioOutputIntensityChanged(int intensity); // 0-100, -1 for no signal
 	void audioInputIntensityChanged(int intensity); // 0-100
+	void audioInputTalkingChanged(bool talking); // dtx talkspurt boundary
+
+	// a pipeline stage (e.g. "video-capture") was flowing but has made
+	//   no progress for a whole watchdog window — typically a wedged
+	//   driver or an underrunning sink.  the session stays active; the
+	//   app can switch devices, restart the session, or just surface
+	//   the stage to the user instead of going silently quiet.
+	//   cumulative tallies are in statistics().stallCounters()
+	void stalled(const QString &stage);
 	void stoppedRecording();
 	void stopped();
 	void finished(); // for file playback only
 	void error();
+	void videoShmFrameReady(const PsiMedia::VideoShmFrame &frame);
 
 private:
 	Q_DISABLE_COPY(RtpSession);
@@ -75,6 +75,12 @@ public:
 	Type type;
 	QString name;
 	QString id;
+
+	// device capabilities, filled in when the lookup asked for
+	//   FeaturesContext::DeviceCaps.  empty otherwise
+	QList<QSize> videoSizes;
+	QList<int> videoFramerates;
+	QList<int> audioSampleRates;
 };
 
 class PAudioParams
@@ -84,11 +90,13 @@ public:
 	int sampleRate;
 	int sampleSize;
 	int channels;
+	int ptime; // preferred packetization interval in ms, -1 = default
 
 	inline PAudioParams() :
 		sampleRate(0),
 		sampleSize(0),
-		channels(0)
+		channels(0),
+		ptime(-1)
 	{
 	}
 };
@@ -100,8 +108,13 @@ public:
 	QSize size;
 	int fps;
 
+	// encoder speed/latency tradeoff: 0 = quality (default),
+	//   1 = balanced, 2 = realtime
+	int encodePreset;
+
 	inline PVideoParams() :
-		fps(0)
+		fps(0),
+		encodePreset(0)
 	{
 	}
 };
@@ -150,8 +163,161 @@ public:
 	QByteArray rawValue;
 	int portOffset;
 
+	// wire arrival time in monotonic nanoseconds, -1 = unknown.  only
+	//   meaningful on the write (incoming) path: when set, the provider
+	//   backdates the packet's pipeline timestamp to its true arrival,
+	//   so queuing between the socket and the media thread doesn't
+	//   pollute the jitter measurement
+	qint64 arrivalNsecs;
+
 	inline PRtpPacket() :
-		portOffset(0)
+		portOffset(0),
+		arrivalNsecs(-1)
+	{
+	}
+};
+
+// a received video frame living in a shared memory segment, for
+//   out-of-process rendering.  fd refers to the whole segment of
+//   ringSize bytes; the frame's rgb32 pixels start at offset.  fd and
+//   ringSize only change when the segment is recreated (e.g. the
+//   resolution grew), so a renderer maps once and then reads at
+//   offsets.  the provider overwrites the slot again several frames
+//   later; a renderer that keeps up never sees a torn frame
+class PVideoShmFrame
+{
+public:
+	int fd;
+	int ringSize;
+	int offset;
+	int width;
+	int height;
+	int stride;
+
+	inline PVideoShmFrame() :
+		fd(-1),
+		ringSize(0),
+		offset(0),
+		width(0),
+		height(0),
+		stride(0)
+	{
+	}
+};
+
+// live count of buffers held at one instrumented site, with the highest
+//   level ever seen.  a counter that only climbs over a soak run names
+//   the leaking site
+class PObjectCounter
+{
+public:
+	QString name;
+	int live;
+	int highWatermark;
+
+	inline PObjectCounter() :
+		live(0),
+		highWatermark(0)
+	{
+	}
+};
+
+// cumulative stalls flagged by the pipeline watchdog for one stage,
+//   e.g. "video-capture".  a stage stalls when it was flowing but made
+//   no progress for a whole detection window
+class PStallCounter
+{
+public:
+	QString stage;
+	int count;
+
+	inline PStallCounter() :
+		count(0)
+	{
+	}
+};
+
+// counters since the session started.  byte counters wrap at 2^31
+class PRtpSessionStats
+{
+public:
+	int audioPacketsSent;
+	int audioBytesSent;
+	int videoPacketsSent;
+	int videoBytesSent;
+	int audioPacketsReceived;
+	int audioBytesReceived;
+	int audioPacketsLost;
+	int videoPacketsReceived;
+	int videoBytesReceived;
+	int videoPacketsLost;
+	int previewFrames;
+	int outputFrames;
+	int audioJitterMs; // measured interarrival jitter
+	int audioJitterBufferMs; // current jitter buffer target latency
+	int audioPacketsDropped; // dropped locally due to queue overflow
+	int videoPacketsDropped; // dropped locally due to queue overflow
+
+	// learned from the peer's rtcp reports.  rtt is -1 until the first
+	//   round trip completes
+	int audioRttMs;
+	int videoRttMs;
+	int audioPacketsLostRemote; // our sent packets the peer reported lost
+	int videoPacketsLostRemote;
+
+	// live buffer counts per instrumented site, process-wide.  empty
+	//   unless instrumentation is enabled (PSI_BUFMON=1)
+	QList<PObjectCounter> objectCounters;
+
+	// stall tallies from the pipeline watchdog, per stage.  empty
+	//   while nothing has stalled
+	QList<PStallCounter> stallCounters;
+
+	inline PRtpSessionStats() :
+		audioPacketsSent(0),
+		audioBytesSent(0),
+		videoPacketsSent(0),
+		videoBytesSent(0),
+		audioPacketsReceived(0),
+		audioBytesReceived(0),
+		audioPacketsLost(0),
+		videoPacketsReceived(0),
+		videoBytesReceived(0),
+		videoPacketsLost(0),
+		previewFrames(0),
+		outputFrames(0),
+		audioJitterMs(0),
+		audioJitterBufferMs(0),
+		audioPacketsDropped(0),
+		videoPacketsDropped(0),
+		audioRttMs(-1),
+		videoRttMs(-1),
+		audioPacketsLostRemote(0),
+		videoPacketsLostRemote(0)
+	{
+	}
+};
+
+// host resources attributable to one session, so a supervisor can tell
+//   which call is eating the box and shed load accordingly.  cpu time
+//   is gathered by sampling the thread cpu clock on the pipeline's
+//   streaming threads as media flows through them, so it covers capture,
+//   encode, decode and playback but not time the host spends on our
+//   behalf elsewhere.  the pool counters describe the shared rtp packet
+//   pool, which is process-wide: sessions share one pool
+class PResourceUsage
+{
+public:
+	qint64 cpuNsecs; // cpu time consumed by the session's streaming threads
+	int streamingThreads; // distinct streaming threads observed so far
+	int poolPacketsServed; // buffers handed out by the shared packet pool
+	int poolPacketsMissed; // requests that fell back to the allocator
+
+	inline PResourceUsage() :
+		cpuNsecs(0),
+		streamingThreads(0),
+		poolPacketsServed(0),
+		poolPacketsMissed(0)
 	{
 	}
 };
@@ -176,7 +342,11 @@ public:
 		AudioIn    = 0x02,
 		VideoIn    = 0x04,
 		AudioModes = 0x08,
-		VideoModes = 0x10
+		VideoModes = 0x10,
+
+		// add capability probing to the device lookups.  this opens
+		//   each device once, so it is opt-in
+		DeviceCaps = 0x20
 	};
 
 	virtual void lookup(int types) = 0;
@@ -185,6 +355,16 @@ public:
 
 HINT_SIGNALS:
 	HINT_METHOD(finished())
+
+	// a lookup category completed; types is the bitmask of Type flags
+	//   whose results are now readable via results().  emitted per
+	//   category as probing proceeds, with finished() still marking
+	//   overall completion
+	HINT_METHOD(progress(int types))
+
+	// the set of devices may have changed since the last lookup.  only
+	//   emitted on platforms with hotplug monitoring support.
+	HINT_METHOD(devicesChanged())
 };
 
 class RtpChannelContext : public QObjectInterface
@@ -194,11 +374,20 @@ public:
 
 	virtual int packetsAvailable() const = 0;
 	virtual PRtpPacket read() = 0;
+
+	// drains the queue in one call.  a single readyRead may cover many
+	//   packets, so this avoids a virtual call per packet.
+	virtual QList<PRtpPacket> readAll() = 0;
+
 	virtual void write(const PRtpPacket &rtp) = 0;
 
+	// when enabled, write() may be called from any thread
+	virtual void setDirectWriteEnabled(bool b) = 0;
+
 HINT_SIGNALS:
 	HINT_METHOD(readyRead())
 	HINT_METHOD(packetsWritten(int count))
+	HINT_METHOD(pressureChanged(bool underPressure))
 };
 
 #ifdef QT_GUI_LIB
@@ -241,6 +430,7 @@ public:
 #endif
 
 	virtual void setRecorder(QIODevice *recordDevice) = 0;
+	virtual void setRecordingFile(const QString &fileName) = 0;
 	virtual void stopRecording() = 0;
 
 	virtual void setLocalAudioPreferences(const QList<PAudioParams> &params) = 0;
@@ -248,9 +438,52 @@ public:
 
 	virtual void setMaximumSendingBitrate(int kbps) = 0;
 
+	// effective path mtu in bytes, -1 = payloader defaults.  the
+	//   packetizers are budgeted so no emitted packet (including srtp
+	//   and fec overhead) relies on ip fragmentation.  takes effect at
+	//   start or on the next updatePreferences
+	virtual void setPathMtu(int bytes) = 0;
+
+	// voice activity detection / discontinuous transmission for the
+	//   audio send path.  during silence the encoder emits minimal
+	//   comfort-noise frames and most are withheld from the wire,
+	//   roughly halving audio bandwidth and encode cpu on one-sided
+	//   conversation.  talkspurt boundaries are reported through
+	//   audioInputTalkingChanged.  takes effect at start or on the
+	//   next updatePreferences
+	virtual void setDtxEnabled(bool enabled) = 0;
+
+	// both -1 = fixed latency
+	virtual void setAudioJitterLatencyRange(int minMs, int maxMs) = 0;
+
+	// how many video packets a frame may emit back-to-back before the
+	//   rest are smoothed over the frame interval.  <1 = no pacing
+	virtual void setVideoBurstBudget(int packets) = 0;
+
+	// srtp (aes-cm-128 with 80 bit hmac-sha1 tags), applied in place
+	//   on the packet buffers inside the provider.  keyAndSalt is the
+	//   16 byte master key followed by the 14 byte master salt; an
+	//   empty array disables the direction.  may be set before start
+	//   or live (a rekey restarts the crypto streams)
+	virtual void setOutgoingSrtpKey(const QByteArray &keyAndSalt) = 0;
+	virtual void setIncomingSrtpKey(const QByteArray &keyAndSalt) = 0;
+
 	virtual void setRemoteAudioPreferences(const QList<PPayloadInfo> &info) = 0;
 	virtual void setRemoteVideoPreferences(const QList<PPayloadInfo> &info) = 0;
 
+	// when enabled, the audio rtp channel accepts a stream with audio
+	//   and video multiplexed together, and packets are sorted to the
+	//   right path by payload type id (as set via the remote
+	//   preferences).  the video rtp channel then carries no input
+	virtual void setCombinedRtpInputEnabled(bool enabled) = 0;
+
+	// when enabled (before start), received video is written into a
+	//   shared memory ring and announced via videoShmFrameReady, so a
+	//   renderer in another process can paint with no pixel copies
+	//   made here.  unix only; elsewhere (and until the ring exists)
+	//   frames keep flowing to the output widget instead
+	virtual void setVideoShmExportEnabled(bool enabled) = 0;
+
 	virtual void start() = 0;
 	virtual void updatePreferences() = 0;
 
@@ -259,6 +492,11 @@ public:
 
 	virtual void pauseAudio() = 0;
 	virtual void pauseVideo() = 0;
+
+	// forces the video encoder to emit a keyframe as soon as possible.
+	//   typically driven by a PLI from the peer
+	virtual void requestKeyframe() = 0;
+
 	virtual void stop() = 0;
 
 	virtual QList<PPayloadInfo> localAudioPayloadInfo() const = 0;
@@ -272,6 +510,22 @@ public:
 	virtual bool canTransmitAudio() const = 0;
 	virtual bool canTransmitVideo() const = 0;
 
+	// cheap atomic snapshot, safe to poll at any rate
+	virtual PRtpSessionStats statistics() const = 0;
+
+	// current audio meter levels, maintained in-pipeline and safe to
+	//   poll at any rate.  input is 0-100; output is 0-100, or -1
+	//   before any audio has been received.  the *IntensityChanged
+	//   signals only fire when an interval is set here: <1 (the
+	//   default) disables them, so pollers cost nothing
+	virtual int audioInputIntensity() const = 0;
+	virtual int audioOutputIntensity() const = 0;
+	virtual void setAudioIntensityInterval(int ms) = 0;
+
+	// cheap snapshot of the host resources this session is consuming.
+	//   safe to poll at any rate
+	virtual PResourceUsage resourceUsage() const = 0;
+
 	virtual int outputVolume() const = 0; // 0 (mute) to 100
 	virtual void setOutputVolume(int level) = 0;
 
@@ -283,23 +537,32 @@ public:
 	virtual RtpChannelContext *audioRtpChannel() = 0;
 	virtual RtpChannelContext *videoRtpChannel() = 0;
 
+	// rtcp companions to the rtp channels.  the provider generates
+	//   SR/RR packets on these and parses whatever the app writes in;
+	//   the app just moves them over the wire like the rtp flows
+	virtual RtpChannelContext *audioRtcpChannel() = 0;
+	virtual RtpChannelContext *videoRtcpChannel() = 0;
+
 HINT_SIGNALS:
 	HINT_METHOD(started())
 	HINT_METHOD(preferencesUpdated())
 	HINT_METHOD(audioOutputIntensityChanged(int intensity))
 	HINT_METHOD(audioInputIntensityChanged(int intensity))
+	HINT_METHOD(audioInputTalkingChanged(bool talking))
+	HINT_METHOD(stalled(const QString &stage))
 	HINT_METHOD(stoppedRecording())
 	HINT_METHOD(stopped())
 	HINT_METHOD(finished()) // for file playback only
 	HINT_METHOD(error())
+	HINT_METHOD(videoShmFrameReady(const PVideoShmFrame &frame))
 };
 
 }
 
 Q_DECLARE_INTERFACE(PsiMedia::Plugin, "org.psi-im.psimedia.Plugin/1.0")
 Q_DECLARE_INTERFACE(PsiMedia::Provider, "org.psi-im.psimedia.Provider/1.0")
-Q_DECLARE_INTERFACE(PsiMedia::FeaturesContext, "org.psi-im.psimedia.FeaturesContext/1.0")
-Q_DECLARE_INTERFACE(PsiMedia::RtpChannelContext, "org.psi-im.psimedia.RtpChannelContext/1.0")
-Q_DECLARE_INTERFACE(PsiMedia::RtpSessionContext, "org.psi-im.psimedia.RtpSessionContext/1.0")
+Q_DECLARE_INTERFACE(PsiMedia::FeaturesContext, "org.psi-im.psimedia.FeaturesContext/1.3")
+Q_DECLARE_INTERFACE(PsiMedia::RtpChannelContext, "org.psi-im.psimedia.RtpChannelContext/1.3")
+Q_DECLARE_INTERFACE(PsiMedia::RtpSessionContext, "org.psi-im.psimedia.RtpSessionContext/1.16")
 
 #endif